@@ -0,0 +1,45 @@
+import 'dart:io';
+import 'dart:typed_data';
+
+import 'src/linker.dart';
+
+void main(List<String> argv) async {
+  List<String> objects = [];
+  String output;
+  String entry = "main";
+  int threads = Platform.numberOfProcessors;
+
+  for (int i = 0; i < argv.length; i++) {
+    if (argv[i] == "-o" && i + 1 < argv.length) {
+      output = argv[++i];
+    } else if (argv[i] == "-j" && i + 1 < argv.length) {
+      threads = int.tryParse(argv[++i]) ?? 0;
+    } else if (argv[i] == "--entry" && i + 1 < argv.length) {
+      entry = argv[++i];
+    } else {
+      objects.add(argv[i]);
+    }
+  }
+
+  if (objects.isEmpty || output == null || threads < 1) {
+    print("Usage : llink [objects] -o [output] [-j threads] [--entry symbol]");
+    exit(1);
+  }
+
+  print("Linker : Linking ${objects.length} object(s)");
+  Linker linker = new Linker(objects, entry, threads);
+
+  Uint8List program;
+  try {
+    program = await linker.link();
+  } on LinkerError catch (e) {
+    stderr.writeln("Linker Error : ${e.message}.");
+    exit(1);
+  }
+
+  File out = new File(output);
+  out.createSync();
+  out.writeAsBytesSync(program);
+
+  print("Linker : Linking completed successfully.");
+}
@@ -6,8 +6,12 @@ import 'src/lexer.dart';
 import 'src/parser.dart';
 
 void main(List<String> argv) {
+  // -c produces a relocatable object instead of an executable
+  bool relocatable = argv.contains("-c");
+  argv = argv.where((arg) => arg != "-c").toList();
+
   if (argv.length != 3) {
-    print("Usage : lasm [file] -o [output]");
+    print("Usage : lasm [-c] [file] -o [output]");
     exit(1);
   }
 
@@ -28,7 +32,7 @@ void main(List<String> argv) {
 
   if (parser.hadError) exit(1);
 
-  Assembler assembler = new Assembler(parser.assembly);
+  Assembler assembler = new Assembler(parser.assembly, relocatable);
 
   Uint8List program;
   try {
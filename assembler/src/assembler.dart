@@ -2,6 +2,7 @@ import 'dart:typed_data';
 
 import 'assembly.dart';
 import 'instruction.dart';
+import 'lef.dart';
 import 'token.dart';
 
 List<String> registers = [
@@ -52,8 +53,18 @@ class SectionHeader {
   SectionHeader(this.name, this.type, this.offset);
 }
 
+// A reference to a symbol the linker has to patch into the instruction at `offset`
+class Relocation {
+  int offset;
+  int type;
+  Label label;
+
+  Relocation(this.offset, this.type, this.label);
+}
+
 class Assembler {
   Assembly assembly;
+  bool relocatable;
   Uint8List buffer;
   int offset = 0;
   int address = 0;
@@ -62,10 +73,13 @@ class Assembler {
   int sha = 0;
   int strt  = 0;
   List<int> relocations = [];
+  List<Relocation> symbolRelocations = [];
+  Map<String, Label> externs = {};
+  Map<Label, int> symbols = {};
   // CPU dependant
   final int DATA_TOP = 0x080000;
 
-  Assembler(Assembly program) {
+  Assembler(Assembly program, [this.relocatable = false]) {
     this.assembly = program;
     int size = assembly.instructions.length * 4 + assembly.dataSize;
     buffer = new Uint8List(size * 10);
@@ -76,17 +90,25 @@ class Assembler {
     this.createRelocationTable();
     this.resolveLabels();
 
+    // Objects get their entry point from the linker
     this.entry = this.offset;
-    if (!this.assembly.labels.containsKey(this.assembly.entryPoint)) {
-      throw new AssemblerError(null, "Entry point symbol ${this.assembly.entryPoint} not found in program");
-    }
+    if (!this.relocatable) {
+      if (!this.assembly.labels.containsKey(this.assembly.entryPoint)) {
+        throw new AssemblerError(null, "Entry point symbol ${this.assembly.entryPoint} not found in program");
+      }
 
-    this.entry += this.assembly.labels[this.assembly.entryPoint].address;
+      this.entry += this.assembly.labels[this.assembly.entryPoint].address;
+    }
 
     this.emitInstructions();
     this.emitInstructionHeader();
     this.emitDataSection();
     this.emitStringTable();
+    this.emitSymbolTable();
+    this.emitLineTable();
+    if (this.relocatable) {
+      this.emitRelocationTable();
+    }
     this.emitSectionHeaders();
     this.emitFileHeader();
 
@@ -146,7 +168,11 @@ class Assembler {
         case "lw":
         case "sb":
         case "sh":
-        case "sw": {
+        case "sw":
+        case "ll":
+        case "sc":
+        case "amoadd":
+        case "amoswap": {
           address += instr.rs == null ? 8 : 0;
           break;
         }
@@ -155,7 +181,12 @@ class Assembler {
           break;
         }
         case "la":
-        case "li": {
+        case "li":
+        case "vmemcpy":
+        case "vmemmove":
+        case "vmemset":
+        case "vmemcmp":
+        case "vstrlen": {
           address += 4;
           break;
         }
@@ -183,6 +214,81 @@ class Assembler {
     headers.add(string);
   }
 
+  // Symbols are sorted by segment then address so the VM can binary-search them
+  // in place. Layout : count(32), count * [address(32), name(32), segment(8),
+  // binding(8), padding(16)], followed by the null-terminated names.
+  void emitSymbolTable() {
+    SectionHeader symtab = new SectionHeader(".symtab", 0x08, this.offset);
+
+    List<Label> labels = this.assembly.labels.values.toList()
+      ..addAll(this.externs.values);
+    labels.sort((a, b) => a.segment != b.segment
+        ? a.segment.index - b.segment.index
+        : a.address - b.address);
+
+    this.emitWord(labels.length);
+    int name = 0;
+    for (Label label in labels) {
+      bool global = label.segment == Segment.SGT_UNDEF ||
+          this.assembly.globals.contains(label.name);
+
+      this.symbols[label] = this.symbols.length;
+      this.emitWord(label.address);
+      this.emitWord(name);
+      this.emitByte(label.segment.index);
+      this.emitByte(global ? BIND_GLOBAL : BIND_LOCAL);
+      this.emitBytes([0, 0]);
+      name += label.name.codeUnits.length + 1;
+    }
+
+    for (Label label in labels) {
+      this.emitBytes(label.name.codeUnits + [0]);
+    }
+
+    symtab.size = this.offset - symtab.offset;
+    headers.add(symtab);
+  }
+
+  // Maps the first machine instruction of every source instruction back to its
+  // line, skipping entries that would repeat the previous line.
+  // Layout : count(32), count * [offset(32), line(32)].
+  void emitLineTable() {
+    SectionHeader lines = new SectionHeader(".lines", 0x10, this.offset);
+
+    List<int> entries = [];
+    int last = -1;
+    for (var i = 0; i < this.assembly.instructions.length; ++i) {
+      int line = this.assembly.instructions[i].line;
+      if (line == last) continue;
+
+      entries.add(this.relocations[i]);
+      entries.add(line);
+      last = line;
+    }
+
+    this.emitWord(entries.length >> 1);
+    entries.forEach(this.emitWord);
+
+    lines.size = this.offset - lines.offset;
+    headers.add(lines);
+  }
+
+  // Layout : count(32), count * [offset(32), symbol(32), type(8), padding(24)].
+  void emitRelocationTable() {
+    SectionHeader rel = new SectionHeader(".rel", 0x20, this.offset);
+
+    this.emitWord(this.symbolRelocations.length);
+    for (Relocation relocation in this.symbolRelocations) {
+      this.emitWord(relocation.offset);
+      this.emitWord(this.symbols[relocation.label]);
+      this.emitByte(relocation.type);
+      this.emitBytes([0, 0, 0]);
+    }
+
+    rel.size = this.offset - rel.offset;
+    headers.add(rel);
+  }
+
   void emitDataSection() {
     SectionHeader data = new SectionHeader(".data", 0x04, this.offset);
 
@@ -367,13 +473,7 @@ class Assembler {
         }
         case "beqz":
         case "bnez": {
-          int address;
-          Token label = instr.immed;
-          if(!this.assembly.labels.containsKey(label.value)) {
-            throw new AssemblerError(label, "Undefined label '${label.value}'.");
-          }
-
-          address = this.resolveLabelAddr(this.assembly.labels[label.value].address) >> 2;
+          int address = this._getAddress(instr.immed);
 
           this.emitImmediate(instr.name.substring(0, 3), 0x00, instr.rt.value, address);
           break;
@@ -405,13 +505,7 @@ class Assembler {
         }
         case "bgez":
         case "bltz": {
-          int address;
-          Token label = instr.immed;
-          if(!this.assembly.labels.containsKey(label.value)) {
-            throw new AssemblerError(label, "Undefined label '${label.value}'.");
-          }
-
-          address = this.resolveLabelAddr(this.assembly.labels[label.value].address) >> 2;
+          int address = this._getAddress(instr.immed);
 
           this.emitImmediate("rsi", instr.rt.value, OpCodes[instr.name], address);
           break;
@@ -425,14 +519,13 @@ class Assembler {
           break;
         }
         case "la": {
-          Token label = instr.immed;
-          int address;
-          if(!this.assembly.labels.containsKey(label.value)) {
-            throw new AssemblerError(label, "Undefined label '${label.value}'.");
-          }
+          Label label = this._getLabel(instr.immed);
+          // Text labels are loaded as text offsets, the way jr and hart spawns take them and the linker resolves them
+          int address = label.segment == Segment.SGT_TEXT ? label.address : DATA_TOP + label.address;
 
-          address = DATA_TOP + this.assembly.labels[label.value].address;
+          this._relocate(R_HI16, label);
           this.emitImmediate("lui", 0x00, getRegister("\$at"), address >> 16);
+          this._relocate(R_LO16, label);
           this.emitImmediate("ori", getRegister("\$at"), instr.rt.value, address);
           break;
         }
@@ -443,17 +536,18 @@ class Assembler {
         case "lw":
         case "sb":
         case "sh":
-        case "sw": {
+        case "sw":
+        case "ll":
+        case "sc":
+        case "amoadd":
+        case "amoswap": {
           if (instr.rs == null) { // Then a label has been given as operand
-            Token label = instr.immed;
-            int address;
-            if(!this.assembly.labels.containsKey(label.value)) {
-              throw new AssemblerError(label, "Undefined label '${label.value}'.");
-            }
-
-            address = DATA_TOP + this.assembly.labels[label.value].address;
+            Label label = this._getLabel(instr.immed);
+            int address = DATA_TOP + label.address;
 
+            this._relocate(R_HI16, label);
             this.emitImmediate("lui", 0x00, getRegister("\$at"), address >> 16);
+            this._relocate(R_LO16, label);
             this.emitImmediate("ori", getRegister("\$at"), getRegister("\$at"), address);
             this.emitImmediate(instr.name, getRegister("\$at"), instr.rt.value, 0);
           } else {
@@ -475,7 +569,17 @@ class Assembler {
           this.emitSpecial(instr.name, instr.rs.value, 0x00, 0x00, 0x00);
           break;
         }
-        case "syscall": {
+        case "syscall":
+        case "sync": {
+          this.emitSpecial(instr.name, 0x00, 0x00, 0x00, 0x00);
+          break;
+        }
+        case "vmemcpy":
+        case "vmemmove":
+        case "vmemset":
+        case "vmemcmp":
+        case "vstrlen": {
+          this.emitImmediate("addi", 0x00, getRegister("\$v0"), NativeSyscalls[instr.name]);
           this.emitSpecial("syscall", 0x00, 0x00, 0x00, 0x00);
           break;
         }
@@ -509,14 +613,27 @@ class Assembler {
   }
 
   void emitByte(int byte) {
+    this._reserve(1);
     this.buffer[offset++] = byte;
   }
 
   void emitBytes(List<int> bytes) {
+    this._reserve(bytes.length);
     this.buffer.setAll(offset, bytes);
     offset += bytes.length;
   }
 
+  void _reserve(int count) {
+    if (offset + count <= this.buffer.length) return;
+
+    int length = this.buffer.length * 2 + 64;
+    while (length < offset + count) length *= 2;
+
+    Uint8List buffer = new Uint8List(length);
+    buffer.setAll(0, this.buffer);
+    this.buffer = buffer;
+  }
+
   void emitHalf(int half) {
     emitByte(half >> 0x08);
     emitByte(half);
@@ -535,19 +652,45 @@ class Assembler {
 
   int _getAddress(Token label, [bool absolute = false]) {
     if (label.type == TokenType.T_IDENTIFIER) {
-      if(!this.assembly.labels.containsKey(label.value)) {
-        throw new AssemblerError(label, "Undefined label '${label.value}'.");
+      Label target = this._getLabel(label);
+
+      // Absolute addresses move with the module's text once linked, relative ones only across modules
+      if (absolute) {
+        this._relocate(R_J26, target);
+        return target.address >> 2;
       }
 
-      int address = absolute
-          ? this.assembly.labels[label.value].address
-          : this.resolveLabelAddr(this.assembly.labels[label.value].address);
-      return address >> 2;
+      if (target.segment == Segment.SGT_UNDEF) {
+        this._relocate(R_PC16, target);
+        return 0;
+      }
+
+      return this.resolveLabelAddr(target.address) >> 2;
     }
 
     return ((label.value as int) >> 2) & 0x03FFFFFF;
   }
 
+  Label _getLabel(Token token) {
+    Label label = this.assembly.labels[token.value];
+    if (label != null) return label;
+
+    if (!this.relocatable) {
+      throw new AssemblerError(token, "Undefined label '${token.value}'.");
+    }
+
+    // Left for the linker to resolve
+    return this.externs.putIfAbsent(
+        token.value, () => new Label(token.value, Segment.SGT_UNDEF, 0));
+  }
+
+  // Records a relocation against the instruction about to be emitted
+  void _relocate(int type, Label label) {
+    if (this.relocatable) {
+      this.symbolRelocations.add(new Relocation(this.address, type, label));
+    }
+  }
+
   int _getRt(Token token) {
     if (token.type == TokenType.T_SCALAR) {
       int rt = getRegister("\$at");
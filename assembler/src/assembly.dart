@@ -1,6 +1,6 @@
 import 'instruction.dart';
 
-enum Segment { SGT_TEXT, SGT_DATA }
+enum Segment { SGT_TEXT, SGT_DATA, SGT_UNDEF }
 
 class Label {
   String name;
@@ -22,6 +22,7 @@ class Assembly {
   List<Instruction> instructions = [];
   List<Directive> directives = [];
   Map<String, Label> labels = {};
+  Set<String> globals = new Set<String>();
   int dataSize = 0;
   String entryPoint = "main";
 
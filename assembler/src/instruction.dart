@@ -17,10 +17,21 @@ class Instruction {
   Token immed;
   List<Token> operands;
   InstructionType type;
+  int line = 0;
 
   Instruction(this.name, this.opCount, this.type);
 }
 
+// VM-native memory routines, called like their C counterparts with arguments in $a0-$a2 and the result in $v0.
+// The v prefix keeps them from clashing with guest library labels.
+const Map<String, int> NativeSyscalls = {
+  "vmemcpy": 0x17,
+  "vmemmove": 0x18,
+  "vmemset": 0x19,
+  "vmemcmp": 0x1A,
+  "vstrlen": 0x1B,
+};
+
 const Map<String, int> OpCodes = {
   "rsi": 0x01,
   "j": 0x02,
@@ -47,6 +58,10 @@ const Map<String, int> OpCodes = {
   "sb": 0x28,
   "sh": 0x29,
   "sw": 0x2A,
+  "ll": 0x30,
+  "amoadd": 0x31,
+  "amoswap": 0x32,
+  "sc": 0x38,
 
   // ALU functions
   "sll": 0x00,
@@ -58,6 +73,7 @@ const Map<String, int> OpCodes = {
   "jr": 0x08,
   "jarl": 0x09,
   "syscall": 0x0C,
+  "sync": 0x0F,
   "mfhi": 0x10,
   "mthi": 0x11,
   "mflo": 0x12,
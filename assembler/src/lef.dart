@@ -0,0 +1,132 @@
+import 'dart:typed_data';
+
+// Section types
+const int SHT_EXEC = 0x01;
+const int SHT_STRTAB = 0x02;
+const int SHT_ALLOC = 0x04;
+const int SHT_SYMTAB = 0x08;
+const int SHT_LINES = 0x10;
+const int SHT_REL = 0x20;
+
+// Symbol bindings
+const int BIND_LOCAL = 0x00;
+const int BIND_GLOBAL = 0x01;
+
+// Relocation types
+const int R_J26 = 0x01; // Jump target : S >> 2
+const int R_PC16 = 0x02; // Branch offset : (S - P) >> 2
+const int R_HI16 = 0x03; // Upper half of an address : S >> 16
+const int R_LO16 = 0x04; // Lower half of an address : S & 0xFFFF
+
+const int HEADER_SIZE = 15;
+const int SECTION_HEADER_SIZE = 11;
+
+class LefSection {
+  int type;
+  int offset;
+  int size;
+
+  LefSection(this.type, this.offset, this.size);
+}
+
+class LefFile {
+  Uint8List bytes;
+  int entry;
+  List<LefSection> sections = [];
+
+  LefFile(this.bytes) {
+    if (bytes.length < HEADER_SIZE ||
+        bytes[0] != 0x10 ||
+        new String.fromCharCodes(bytes.sublist(1, 4)) != "LEF") {
+      throw new FormatException("Not a LEF file");
+    }
+
+    this.entry = this.readWord(6);
+    int sha = this.readWord(10);
+    int count = bytes[14];
+    if (sha + count * SECTION_HEADER_SIZE > bytes.length) {
+      throw new FormatException("Truncated section header table");
+    }
+
+    for (int i = 0; i < count; i++) {
+      int at = sha + i * SECTION_HEADER_SIZE;
+      LefSection section = new LefSection(bytes[at + 2], this.readWord(at + 3), this.readWord(at + 7));
+      if (section.offset + section.size > bytes.length) {
+        throw new FormatException("Truncated section");
+      }
+
+      sections.add(section);
+    }
+  }
+
+  Uint8List section(int type) {
+    for (LefSection section in sections) {
+      if (section.type == type) {
+        return new Uint8List.fromList(
+            bytes.sublist(section.offset, section.offset + section.size));
+      }
+    }
+
+    return null;
+  }
+
+  int readWord(int at) {
+    return (bytes[at] << 24) | (bytes[at + 1] << 16) | (bytes[at + 2] << 8) | bytes[at + 3];
+  }
+}
+
+int readWord(List<int> bytes, int at) {
+  return (bytes[at] << 24) | (bytes[at + 1] << 16) | (bytes[at + 2] << 8) | bytes[at + 3];
+}
+
+void writeWord(List<int> bytes, int at, int word) {
+  bytes[at] = (word >> 0x18) & 0xFF;
+  bytes[at + 1] = (word >> 0x10) & 0xFF;
+  bytes[at + 2] = (word >> 0x08) & 0xFF;
+  bytes[at + 3] = word & 0xFF;
+}
+
+class LefWriter {
+  List<int> bytes = new List<int>.filled(HEADER_SIZE, 0, growable: true);
+  List<LefSection> headers = [];
+
+  int get offset => bytes.length;
+
+  void emitByte(int byte) {
+    bytes.add(byte & 0xFF);
+  }
+
+  void emitHalf(int half) {
+    emitByte(half >> 0x08);
+    emitByte(half);
+  }
+
+  void emitWord(int word) {
+    emitByte(word >> 0x18);
+    emitByte(word >> 0x10);
+    emitByte(word >> 0x08);
+    emitByte(word);
+  }
+
+  void emitSection(int type, List<int> content) {
+    headers.add(new LefSection(type, this.offset, content.length));
+    bytes.addAll(content);
+  }
+
+  Uint8List finish(int entry) {
+    int sha = this.offset;
+    for (LefSection header in headers) {
+      this.emitHalf(0);
+      this.emitByte(header.type);
+      this.emitWord(header.offset);
+      this.emitWord(header.size);
+    }
+
+    bytes.setAll(0, [0x10] + "LEF".codeUnits + [0x01, 0x00]);
+    writeWord(bytes, 6, entry);
+    writeWord(bytes, 10, sha);
+    bytes[14] = headers.length;
+
+    return new Uint8List.fromList(bytes);
+  }
+}
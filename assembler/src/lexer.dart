@@ -108,12 +108,22 @@ List<String> instructions = [
   "sb",
   "sh",
   "sw",
+  "ll",
+  "sc",
+  "amoadd",
+  "amoswap",
   "move",
   "mfhi",
   "mflo",
   "mthi",
   "mtlo",
   "syscall",
+  "sync",
+  "vmemcpy",
+  "vmemmove",
+  "vmemset",
+  "vmemcmp",
+  "vstrlen",
 ];
 
 List<String> directives = [
@@ -125,7 +135,8 @@ List<String> directives = [
   ".byte",
   ".half",
   ".word",
-  ".entry"
+  ".entry",
+  ".globl"
 ];
 
 class Lexer {
@@ -0,0 +1,386 @@
+import 'dart:async';
+import 'dart:io';
+import 'dart:isolate';
+import 'dart:typed_data';
+
+import 'lef.dart';
+
+// Mirrors the assembler's Segment enum
+const int SEGMENT_TEXT = 0;
+const int SEGMENT_DATA = 1;
+const int SEGMENT_UNDEF = 2;
+
+const int DATA_TOP = 0x080000;
+
+class ObjectSymbol {
+  String name;
+  int address;
+  int segment;
+  bool global;
+
+  ObjectSymbol(this.name, this.address, this.segment, this.global);
+}
+
+class ObjectRelocation {
+  int offset;
+  int symbol;
+  int type;
+
+  ObjectRelocation(this.offset, this.symbol, this.type);
+}
+
+class ObjectFile {
+  String path;
+  Uint8List text;
+  Uint8List data;
+  List<ObjectSymbol> symbols = [];
+  List<ObjectRelocation> relocations = [];
+  List<int> lines = []; // Pairs of offset and line
+
+  ObjectFile(this.path);
+
+  static ObjectFile read(String path) {
+    LefFile file = new LefFile(new File(path).readAsBytesSync());
+    ObjectFile object = new ObjectFile(path);
+
+    Uint8List rel = file.section(SHT_REL);
+    if (rel == null) {
+      throw new FormatException("'$path' is not a relocatable object");
+    }
+
+    object.text = file.section(SHT_EXEC) ?? new Uint8List(0);
+    object.data = file.section(SHT_ALLOC) ?? new Uint8List(0);
+
+    Uint8List symtab = file.section(SHT_SYMTAB) ?? new Uint8List(4);
+    int count = readWord(symtab, 0);
+    int names = 4 + count * 12;
+    for (int i = 0; i < count; i++) {
+      int at = 4 + i * 12;
+      int name = names + readWord(symtab, at + 4);
+      int end = name;
+      while (symtab[end] != 0) end++;
+
+      object.symbols.add(new ObjectSymbol(
+          new String.fromCharCodes(symtab.sublist(name, end)),
+          readWord(symtab, at),
+          symtab[at + 8],
+          symtab[at + 9] == BIND_GLOBAL));
+    }
+
+    count = readWord(rel, 0);
+    for (int i = 0; i < count; i++) {
+      int at = 4 + i * 12;
+      object.relocations.add(new ObjectRelocation(readWord(rel, at), readWord(rel, at + 4), rel[at + 8]));
+    }
+
+    Uint8List lines = file.section(SHT_LINES);
+    if (lines != null) {
+      count = readWord(lines, 0);
+      for (int i = 0; i < count * 2; i++) {
+        object.lines.add(readWord(lines, 4 + i * 4));
+      }
+    }
+
+    return object;
+  }
+
+  // Isolates only exchange primitive values and lists
+  List<Object> toMessage() {
+    List<Object> symbols = [];
+    for (ObjectSymbol symbol in this.symbols) {
+      symbols.addAll([symbol.name, symbol.address, symbol.segment, symbol.global]);
+    }
+
+    List<int> relocations = [];
+    for (ObjectRelocation relocation in this.relocations) {
+      relocations.addAll([relocation.offset, relocation.symbol, relocation.type]);
+    }
+
+    return [path, text, data, symbols, relocations, lines];
+  }
+
+  static ObjectFile fromMessage(List<Object> message) {
+    ObjectFile object = new ObjectFile(message[0]);
+    object.text = message[1];
+    object.data = message[2];
+
+    List symbols = message[3];
+    for (int i = 0; i < symbols.length; i += 4) {
+      object.symbols.add(new ObjectSymbol(symbols[i], symbols[i + 1], symbols[i + 2], symbols[i + 3]));
+    }
+
+    List relocations = message[4];
+    for (int i = 0; i < relocations.length; i += 3) {
+      object.relocations.add(new ObjectRelocation(relocations[i], relocations[i + 1], relocations[i + 2]));
+    }
+
+    object.lines = new List<int>.from(message[5]);
+    return object;
+  }
+}
+
+class LinkerError {
+  String message;
+
+  LinkerError(this.message);
+}
+
+void _readObjectEntry(List<Object> message) {
+  SendPort reply = message[1];
+  try {
+    reply.send(ObjectFile.read(message[0]).toMessage());
+  } on FileSystemException catch (e) {
+    reply.send("Cannot open file '${e.path}'");
+  } on FormatException catch (e) {
+    reply.send("${message[0]} : ${e.message}");
+  } on RangeError catch (_) {
+    reply.send("${message[0]} : Malformed object file");
+  }
+}
+
+// Message : text, then [offset, type, S, P] for every relocation
+void _relocateEntry(List<Object> message) {
+  List job = message[0];
+  Uint8List text = job[0];
+  List patches = job[1];
+
+  for (int i = 0; i < patches.length; i += 4) {
+    applyRelocation(text, patches[i], patches[i + 1], patches[i + 2], patches[i + 3]);
+  }
+
+  (message[1] as SendPort).send(text);
+}
+
+void applyRelocation(Uint8List text, int offset, int type, int s, int p) {
+  int word = readWord(text, offset);
+
+  switch (type) {
+    case R_J26:
+      word = (word & 0xFC000000) | ((s >> 2) & 0x03FFFFFF);
+      break;
+    case R_PC16:
+      word = (word & 0xFFFF0000) | (((s - p) >> 2) & 0xFFFF);
+      break;
+    case R_HI16:
+      word = (word & 0xFFFF0000) | ((s >> 16) & 0xFFFF);
+      break;
+    case R_LO16:
+      word = (word & 0xFFFF0000) | (s & 0xFFFF);
+      break;
+  }
+
+  writeWord(text, offset, word);
+}
+
+// Runs `entry` on every job with at most `threads` isolates alive at once
+Future<List<Object>> runInIsolates(List<Object> jobs, void entry(List<Object> message), int threads) async {
+  List<Object> results = new List(jobs.length);
+  int next = 0;
+
+  Future<void> worker() async {
+    while (next < jobs.length) {
+      int index = next++;
+      ReceivePort port = new ReceivePort();
+      await Isolate.spawn(entry, [jobs[index], port.sendPort]);
+      results[index] = await port.first;
+    }
+  }
+
+  await Future.wait(new List.generate(threads, (_) => worker()));
+  return results;
+}
+
+class Linker {
+  List<String> paths;
+  String entryPoint;
+  int threads;
+
+  List<ObjectFile> objects = [];
+  List<int> textBases = [];
+  List<int> dataBases = [];
+  Map<String, int> globals = {};
+
+  Linker(this.paths, this.entryPoint, this.threads);
+
+  Future<Uint8List> link() async {
+    // Objects are read and decoded in parallel
+    List<Object> messages = await runInIsolates(paths, _readObjectEntry, threads);
+    for (Object message in messages) {
+      if (message is String) throw new LinkerError(message);
+      objects.add(ObjectFile.fromMessage(message));
+    }
+
+    this.layout();
+    this.collectGlobals();
+
+    List<Object> jobs = [];
+    for (int i = 0; i < objects.length; i++) {
+      jobs.add([objects[i].text, this.resolveRelocations(i)]);
+    }
+
+    List<Object> texts = await runInIsolates(jobs, _relocateEntry, threads);
+    for (int i = 0; i < objects.length; i++) {
+      objects[i].text = texts[i];
+    }
+
+    return this.emitExecutable();
+  }
+
+  // Modules are laid out in command line order, data kept word aligned
+  void layout() {
+    int text = 0, data = 0;
+    for (ObjectFile object in objects) {
+      textBases.add(text);
+      dataBases.add(data);
+      text += object.text.length;
+      data += (object.data.length + 3) & ~3;
+    }
+  }
+
+  int symbolValue(int module, ObjectSymbol symbol) {
+    return symbol.segment == SEGMENT_TEXT
+        ? textBases[module] + symbol.address
+        : DATA_TOP + dataBases[module] + symbol.address;
+  }
+
+  void collectGlobals() {
+    Map<String, String> owners = {};
+    for (int i = 0; i < objects.length; i++) {
+      for (ObjectSymbol symbol in objects[i].symbols) {
+        if (!symbol.global || symbol.segment == SEGMENT_UNDEF) continue;
+
+        if (globals.containsKey(symbol.name)) {
+          throw new LinkerError(
+              "Duplicate symbol '${symbol.name}' in ${objects[i].path} and ${owners[symbol.name]}");
+        }
+
+        globals[symbol.name] = this.symbolValue(i, symbol);
+        owners[symbol.name] = objects[i].path;
+      }
+    }
+  }
+
+  List<int> resolveRelocations(int module) {
+    ObjectFile object = objects[module];
+    List<int> patches = [];
+
+    for (ObjectRelocation relocation in object.relocations) {
+      if (relocation.symbol >= object.symbols.length || relocation.offset + 4 > object.text.length) {
+        throw new LinkerError("${object.path} : Malformed relocation");
+      }
+
+      ObjectSymbol symbol = object.symbols[relocation.symbol];
+      int s;
+      if (symbol.segment == SEGMENT_UNDEF) {
+        if (!globals.containsKey(symbol.name)) {
+          throw new LinkerError("Undefined symbol '${symbol.name}' referenced in ${object.path}");
+        }
+        s = globals[symbol.name];
+      } else {
+        s = this.symbolValue(module, symbol);
+      }
+
+      int p = textBases[module] + relocation.offset;
+      if (relocation.type == R_PC16) {
+        int distance = (s - p) >> 2;
+        if (distance < -0x8000 || distance > 0x7FFF) {
+          throw new LinkerError("Branch to '${symbol.name}' from ${object.path} is out of range");
+        }
+      }
+
+      patches.addAll([relocation.offset, relocation.type, s, p]);
+    }
+
+    return patches;
+  }
+
+  int entryAddress() {
+    if (globals.containsKey(entryPoint)) return globals[entryPoint];
+
+    // Single module programs don't need to export their entry point
+    for (int i = 0; i < objects.length; i++) {
+      for (ObjectSymbol symbol in objects[i].symbols) {
+        if (symbol.name == entryPoint && symbol.segment == SEGMENT_TEXT) {
+          return this.symbolValue(i, symbol);
+        }
+      }
+    }
+
+    throw new LinkerError("Entry point symbol $entryPoint not found in program");
+  }
+
+  Uint8List emitExecutable() {
+    LefWriter writer = new LefWriter();
+    int entry = HEADER_SIZE + this.entryAddress();
+
+    List<int> text = [];
+    List<int> data = [];
+    for (ObjectFile object in objects) {
+      text.addAll(object.text);
+      data.addAll(object.data);
+      while (data.length % 4 != 0) data.add(0);
+    }
+
+    writer.emitSection(SHT_EXEC, text);
+    writer.emitSection(SHT_ALLOC, data);
+    writer.emitSection(SHT_STRTAB, [0, 0]);
+    writer.emitSection(SHT_SYMTAB, this.symbolTable());
+    writer.emitSection(SHT_LINES, this.lineTable());
+
+    return writer.finish(entry);
+  }
+
+  // Same layout as the assembler's, with every defined symbol at its final address
+  List<int> symbolTable() {
+    List<ObjectSymbol> symbols = [];
+    for (int i = 0; i < objects.length; i++) {
+      for (ObjectSymbol symbol in objects[i].symbols) {
+        if (symbol.segment == SEGMENT_UNDEF) continue;
+
+        int address = symbol.segment == SEGMENT_TEXT
+            ? textBases[i] + symbol.address
+            : dataBases[i] + symbol.address;
+        symbols.add(new ObjectSymbol(symbol.name, address, symbol.segment, symbol.global));
+      }
+    }
+    symbols.sort((a, b) => a.segment != b.segment ? a.segment - b.segment : a.address - b.address);
+
+    LefWriter table = new LefWriter();
+    table.bytes.clear();
+    table.emitWord(symbols.length);
+    int name = 0;
+    for (ObjectSymbol symbol in symbols) {
+      table.emitWord(symbol.address);
+      table.emitWord(name);
+      table.emitByte(symbol.segment);
+      table.emitByte(symbol.global ? BIND_GLOBAL : BIND_LOCAL);
+      table.emitHalf(0);
+      name += symbol.name.codeUnits.length + 1;
+    }
+    for (ObjectSymbol symbol in symbols) {
+      table.bytes.addAll(symbol.name.codeUnits + [0]);
+    }
+
+    return table.bytes;
+  }
+
+  List<int> lineTable() {
+    LefWriter table = new LefWriter();
+    table.bytes.clear();
+
+    int count = 0;
+    for (ObjectFile object in objects) {
+      count += object.lines.length >> 1;
+    }
+
+    table.emitWord(count);
+    for (int i = 0; i < objects.length; i++) {
+      for (int j = 0; j < objects[i].lines.length; j += 2) {
+        table.emitWord(textBases[i] + objects[i].lines[j]);
+        table.emitWord(objects[i].lines[j + 1]);
+      }
+    }
+
+    return table.bytes;
+  }
+}
@@ -74,6 +74,14 @@ class Parser {
       return;
     }
 
+    if (this.current.value == ".globl") {
+      do {
+        Token label = this.expect(TokenType.T_IDENTIFIER, "Expected label as .globl directive's operand.");
+        this.assembly.globals.add(label.value);
+      } while (matches(TokenType.T_COMMA));
+      return;
+    }
+
     if (segment != Segment.SGT_DATA) {
       reportError(
           "Cannot put directive ${this.current.lexeme} outside of a .data segment.");
@@ -133,7 +141,17 @@ class Parser {
 
   void getInstruction() {
     Token token = expect(TokenType.T_INSTRUCTION, "Expected an instruction.");
+    int count = this.assembly.instructions.length;
 
+    this._getInstruction(token);
+
+    // Remember the source line so the assembler can emit the line table
+    if (this.assembly.instructions.length > count) {
+      this.assembly.instructions.last.line = token.line;
+    }
+  }
+
+  void _getInstruction(Token token) {
     switch (token.value) {
       case "abs":
       case "div":
@@ -311,6 +329,10 @@ class Parser {
       case "sb":
       case "sh":
       case "sw":
+      case "ll":
+      case "sc":
+      case "amoadd":
+      case "amoswap":
         {
           Token tgt = expect(TokenType.T_REGISTER,
               "Expected register as '${token.value}' first operand.");
@@ -378,9 +400,20 @@ class Parser {
           break;
         }
       case "syscall":
+      case "sync":
+        {
+          this.assembly.addInstruction(
+              new Instruction(token.value, 0, InstructionType.J_TYPE));
+          break;
+        }
+      case "vmemcpy":
+      case "vmemmove":
+      case "vmemset":
+      case "vmemcmp":
+      case "vstrlen":
         {
           this.assembly.addInstruction(
-              new Instruction("syscall", 0, InstructionType.J_TYPE));
+              new Instruction(token.value, 0, InstructionType.J_TYPE));
           break;
         }
     }
@@ -0,0 +1,32 @@
+#ifndef LMIPS_BENCH
+#define LMIPS_BENCH
+
+#include <stdio.h>
+#include <time.h>
+#include "memory.h"
+
+static inline double bench_now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+#define BENCH_REPORT(name, value, unit) printf("%-40s %14.3f %s\n", name, value, unit)
+
+// Encoders for the synthetic guest programs
+static inline uint32_t bench_itype(uint8_t op, uint8_t rs, uint8_t rt, uint16_t immediate) {
+    return ((uint32_t)op << 26) | (rs << 21) | (rt << 16) | immediate;
+}
+
+static inline uint32_t bench_rtype(uint8_t rs, uint8_t rt, uint8_t rd, uint8_t func) {
+    return (rs << 21) | (rt << 16) | (rd << 11) | func;
+}
+
+static inline void bench_load_program(Memory* memory, const uint32_t* program, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        mem_write(memory, PROGRAM_ADDRESS + i * 4, program[i]);
+    }
+}
+
+#endif //LMIPS_BENCH
@@ -0,0 +1,65 @@
+#include "bench.h"
+#include "lmips.h"
+#include "lmips_opcodes.h"
+
+#define ITERATIONS 5
+#define BLOCKS 50000
+#define BLOCK_SIZE 24
+
+// Allocates BLOCKS blocks, keeping their addresses in the data segment, then frees them all
+static void writeProgram(Memory* memory) {
+    const uint32_t program[] = {
+        bench_itype(OP_LUI, 0, $s0, DATA_ADDRESS >> 16),
+        bench_itype(OP_LUI, 0, $s1, BLOCKS >> 16),
+        bench_itype(OP_ORI, $s1, $s1, BLOCKS & 0xFFFF),
+        bench_itype(OP_ADDI, $zero, $a0, BLOCK_SIZE), // allocate:
+        bench_itype(OP_ADDI, $zero, $v0, SYS_MALLOC),
+        SPE_SYSCALL,
+        bench_itype(OP_SW, $s0, $v0, 0),
+        bench_itype(OP_ADDI, $s0, $s0, 4),
+        bench_itype(OP_ADDI, $s1, $s1, -1),
+        bench_itype(OP_BNE, $s1, $zero, -6), // bne $s1, $zero, allocate
+        bench_itype(OP_LUI, 0, $s0, DATA_ADDRESS >> 16),
+        bench_itype(OP_LUI, 0, $s1, BLOCKS >> 16),
+        bench_itype(OP_ORI, $s1, $s1, BLOCKS & 0xFFFF),
+        bench_itype(OP_LW, $s0, $a0, 0), // release:
+        bench_itype(OP_ADDI, $zero, $v0, SYS_FREE),
+        SPE_SYSCALL,
+        bench_itype(OP_ADDI, $s0, $s0, 4),
+        bench_itype(OP_ADDI, $s1, $s1, -1),
+        bench_itype(OP_BNE, $s1, $zero, -5), // bne $s1, $zero, release
+        bench_itype(OP_ADDI, $zero, $v0, SYS_EXIT),
+        SPE_SYSCALL,
+    };
+
+    bench_load_program(memory, program, sizeof(program) / sizeof(program[0]));
+}
+
+int main() {
+    double total = 0;
+    HeapStats stats = {};
+
+    for (int i = 0; i < ITERATIONS; ++i) {
+        Memory memory;
+        initMemory(&memory);
+        LMips mips;
+        initSimulator(&mips, &memory);
+        writeProgram(&memory);
+
+        double start = bench_now();
+        if (runSimulator(&mips) != EXEC_SUCCESS) return 1;
+        total += bench_now() - start;
+
+        stats = mips.allocator->stats;
+        freeSimulator(&mips);
+        freeMemory(&memory);
+    }
+
+    printf("Guest allocating then freeing %d blocks of %d bytes\n", BLOCKS, BLOCK_SIZE);
+    BENCH_REPORT("Allocation and free pair", total / ITERATIONS / BLOCKS * 1e9, "ns");
+    BENCH_REPORT("Peak bytes in use", (double)stats.peak, "bytes");
+    BENCH_REPORT("Bytes reserved from the heap", (double)stats.reserved, "bytes");
+    BENCH_REPORT("Fragmentation at peak", 100.0 * (stats.reserved - stats.peak) / stats.reserved, "%");
+
+    return 0;
+}
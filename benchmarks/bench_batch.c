@@ -0,0 +1,87 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "bench.h"
+#include "batch.h"
+#include "threadpool.h"
+
+#define ITERATIONS 0x100000 // Loop iterations per job
+#define JOBS_PER_CPU 8
+
+// Counts down then prints the counter, as a CPU bound job with a little output
+static const uint32_t program[] = {
+    0x3C080000 | (ITERATIONS >> 16), // lui $t0, ITERATIONS >> 16
+    0x2108FFFF, // loop: addi $t0, $t0, -1
+    0x1500FFFF, // bne $t0, $zero, loop
+    0x01002020, // add $a0, $t0, $zero
+    0x20020001, // addi $v0, $zero, 1
+    0x0000000C, // syscall
+    0x2002000A, // addi $v0, $zero, 10
+    0x0000000C, // syscall
+};
+
+static void putWord(uint8_t* bytes, uint32_t word) {
+    bytes[0] = word >> 24;
+    bytes[1] = word >> 16;
+    bytes[2] = word >> 8;
+    bytes[3] = word;
+}
+
+static bool writeExecutable(char* path) {
+    size_t text = sizeof(program);
+    uint8_t file[15 + sizeof(program) + 11] = {0x10, 'L', 'E', 'F', 1, 0};
+    putWord(&file[6], 15);
+    putWord(&file[10], 15 + text);
+    file[14] = 1;
+    for (size_t i = 0; i < text / 4; ++i) {
+        putWord(&file[15 + i * 4], program[i]);
+    }
+    file[15 + text + 2] = 0x01; // SHT_EXEC
+    putWord(&file[15 + text + 3], 15);
+    putWord(&file[15 + text + 7], text);
+
+    int fd = mkstemp(path);
+    if (fd < 0) return false;
+    bool written = write(fd, file, sizeof(file)) == sizeof(file);
+    close(fd);
+    return written;
+}
+
+static double run(const char* binary, int jobs, int threads) {
+    Batch batch;
+    initBatch(&batch);
+    for (int i = 0; i < jobs; ++i) {
+        batch_add(&batch, binary, NULL);
+    }
+
+    double start = bench_now();
+    batch_run(&batch, threads);
+    double elapsed = bench_now() - start;
+
+    freeBatch(&batch);
+    return elapsed;
+}
+
+int main() {
+    char binary[] = "/tmp/lmips_bench_batch_XXXXXX";
+    if (!writeExecutable(binary)) return 1;
+
+    int cpus = pool_default_threads();
+    int jobs = cpus * JOBS_PER_CPU;
+    printf("%d jobs of %d loop iterations, %d CPUs\n", jobs, ITERATIONS, cpus);
+
+    double single = run(binary, jobs, 1);
+    BENCH_REPORT("1 thread", jobs / single, "jobs/s");
+
+    // Powers of two, then every CPU
+    for (int step = 2; step / 2 < cpus; step *= 2) {
+        int threads = step < cpus ? step : cpus;
+        double elapsed = run(binary, jobs, threads);
+        char name[64];
+        snprintf(name, sizeof(name), "%d threads (%.2fx speedup)", threads, single / elapsed);
+        BENCH_REPORT(name, jobs / elapsed, "jobs/s");
+    }
+
+    unlink(binary);
+    return 0;
+}
@@ -0,0 +1,150 @@
+#include <stdbool.h>
+#include <time.h>
+#include "bench.h"
+#include "lmips.h"
+#include "lmips_opcodes.h"
+#include "threadpool.h"
+
+#define ITEMS 100000 // Items handed from the producer to the consumer
+
+// A one-item mailbox at DATA_ADDRESS, the full flag then the item. Hart 0 consumes what hart 1 produces, each
+// waiting for the flag either in SYS_FUTEX_WAIT or by spinning on it.
+typedef struct {
+    uint32_t words[64];
+    size_t count;
+} Program;
+
+static size_t emit(Program* program, uint32_t word) {
+    program->words[program->count] = word;
+    return program->count++;
+}
+
+static void patch(Program* program, size_t at, size_t target) {
+    program->words[at] = (program->words[at] & 0xFFFF0000) | (uint16_t)(target - at);
+}
+
+static void emitCall(Program* program, uint8_t code, uint16_t value) {
+    emit(program, bench_rtype($s1, $zero, $a0, SPE_ADD));
+    emit(program, bench_itype(OP_ADDI, $zero, $a1, value));
+    emit(program, bench_itype(OP_ADDI, $zero, $v0, code));
+    emit(program, bench_rtype(0, 0, 0, SPE_SYSCALL));
+}
+
+// Waits until the flag isn't `empty`, then reads the mailbox once the other hart wrote it
+static size_t emitWait(Program* program, bool futex, uint16_t empty) {
+    size_t loop = emit(program, bench_itype(OP_LW, $s1, $t0, 0));
+    emit(program, bench_itype(OP_ADDI, $zero, $t1, empty));
+    size_t branch = emit(program, bench_itype(OP_BNE, $t0, $t1, 0));
+    if (futex) {
+        emitCall(program, SYS_FUTEX_WAIT, empty);
+    }
+    patch(program, emit(program, bench_itype(OP_BEQ, $zero, $zero, 0)), loop);
+    patch(program, branch, emit(program, bench_rtype(0, 0, 0, SPE_SYNC)));
+    return loop;
+}
+
+// Flips the flag to `value` and wakes the other hart
+static void emitPost(Program* program, bool futex, uint16_t value) {
+    emit(program, bench_itype(OP_ADDI, $zero, $t2, value));
+    emit(program, bench_itype(OP_AMOSWAP, $s1, $t2, 0));
+    if (futex) {
+        emitCall(program, SYS_FUTEX_WAKE, 1);
+    }
+}
+
+static void emitCount(Program* program) {
+    emit(program, bench_itype(OP_LUI, 0, $s1, DATA_ADDRESS >> 16));
+    emit(program, bench_itype(OP_LUI, 0, $s2, ITEMS >> 16));
+    emit(program, bench_itype(OP_ORI, $s2, $s2, ITEMS & 0xFFFF));
+    emit(program, bench_itype(OP_ADDI, $zero, $s3, 0));
+}
+
+static void build(Program* program, bool futex) {
+    program->count = 0;
+
+    // Consumer, sums the items in $s3
+    size_t spawn = emit(program, bench_itype(OP_ADDI, $zero, $a0, 0));
+    emit(program, bench_itype(OP_ADDI, $sp, $a1, -4096));
+    emit(program, bench_itype(OP_ADDI, $zero, $v0, SYS_HART_SPAWN));
+    emit(program, bench_rtype(0, 0, 0, SPE_SYSCALL));
+    emit(program, bench_rtype($v0, $zero, $s0, SPE_ADD));
+    emitCount(program);
+    size_t loop = emitWait(program, futex, 0);
+    emit(program, bench_itype(OP_LW, $s1, $t1, 4));
+    emit(program, bench_rtype($s3, $t1, $s3, SPE_ADDU));
+    emitPost(program, futex, 0);
+    emit(program, bench_itype(OP_ADDI, $s2, $s2, -1));
+    patch(program, emit(program, bench_itype(OP_BNE, $s2, $zero, 0)), loop);
+    emit(program, bench_rtype($s0, $zero, $a0, SPE_ADD));
+    emit(program, bench_itype(OP_ADDI, $zero, $v0, SYS_HART_JOIN));
+    emit(program, bench_rtype(0, 0, 0, SPE_SYSCALL));
+    emit(program, bench_itype(OP_ADDI, $zero, $v0, SYS_EXIT));
+    emit(program, bench_rtype(0, 0, 0, SPE_SYSCALL));
+
+    // Producer, hands over 1 to ITEMS
+    program->words[spawn] |= program->count * 4;
+    emitCount(program);
+    loop = emitWait(program, futex, 1);
+    emit(program, bench_itype(OP_ADDI, $s3, $s3, 1));
+    emit(program, bench_itype(OP_SW, $s1, $s3, 4));
+    emitPost(program, futex, 1);
+    emit(program, bench_itype(OP_ADDI, $s2, $s2, -1));
+    patch(program, emit(program, bench_itype(OP_BNE, $s2, $zero, 0)), loop);
+    emit(program, bench_itype(OP_ADDI, $zero, $v0, SYS_EXIT));
+    emit(program, bench_rtype(0, 0, 0, SPE_SYSCALL));
+}
+
+static double cpuNow() {
+    struct timespec time;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time);
+
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+static void run(const char* name, bool futex) {
+    Program program;
+    build(&program, futex);
+
+    Memory memory;
+    LMips mips;
+    initMemory(&memory);
+    initSimulator(&mips, &memory);
+    bench_load_program(&memory, program.words, program.count);
+
+    double start = bench_now();
+    double cpuStart = cpuNow();
+    runSimulator(&mips);
+    double cpu = cpuNow() - cpuStart;
+    double elapsed = bench_now() - start;
+
+    if (mips.regs[$s3] != (uint32_t)((uint64_t)ITEMS * (ITEMS + 1) / 2)) {
+        printf("%s : wrong sum %u\n", name, mips.regs[$s3]);
+    }
+
+    char label[64];
+    snprintf(label, sizeof(label), "%s handoff", name);
+    BENCH_REPORT(label, elapsed * 1e9 / ITEMS, "ns/item");
+    snprintf(label, sizeof(label), "%s CPU time", name);
+    BENCH_REPORT(label, cpu * 1e9 / ITEMS, "ns/item");
+    // How many host CPUs were kept busy on average
+    snprintf(label, sizeof(label), "%s CPU use", name);
+    BENCH_REPORT(label, cpu / elapsed, "cores");
+
+    freeSimulator(&mips);
+    freeMemory(&memory);
+}
+
+int main() {
+    int cpus = pool_default_threads();
+    printf("%d items through a one-item mailbox, %d CPUs\n", ITEMS, cpus);
+
+    run("futex", true);
+    // A spinning hart only gives up its CPU when the host preempts it, that is every few ms on a single CPU
+    if (cpus > 1) {
+        run("spin", false);
+    } else {
+        printf("spin : skipped, needs 2 CPUs\n");
+    }
+
+    return 0;
+}
@@ -0,0 +1,63 @@
+#include "bench.h"
+#include "fuzzer.h"
+#include "lmips.h"
+#include "lmips_opcodes.h"
+#include "threadpool.h"
+
+#define EXECUTIONS 1000000
+
+// Reads a line and faults when it starts with "FUZ!", one byte compared at a time
+static const uint32_t program[] = {
+    0x3C040008, // lui $a0, 8
+    0x20050040, // addi $a1, $zero, 64
+    0x20020006, // addi $v0, $zero, 6
+    0x0000000C, // syscall
+    0x90880000, // lbu $t0, 0($a0)
+    0x20090046, // addi $t1, $zero, 'F'
+    0x1509000B, // bne $t0, $t1, exit
+    0x90880001, // lbu $t0, 1($a0)
+    0x20090055, // addi $t1, $zero, 'U'
+    0x15090008, // bne $t0, $t1, exit
+    0x90880002, // lbu $t0, 2($a0)
+    0x2009005A, // addi $t1, $zero, 'Z'
+    0x15090005, // bne $t0, $t1, exit
+    0x90880003, // lbu $t0, 3($a0)
+    0x20090021, // addi $t1, $zero, '!'
+    0x15090002, // bne $t0, $t1, exit
+    0xA8000000, // sw $zero, 0($zero)
+    0x2002000A, // exit: addi $v0, $zero, 10
+    0x0000000C, // syscall
+};
+
+int main() {
+    int cpus = pool_default_threads();
+    printf("%d executions of a 4 byte magic parser, %d CPUs\n", EXECUTIONS, cpus);
+
+    for (int threads = 1; threads <= cpus; threads *= 2) {
+        Memory memory;
+        LMips mips;
+        initMemory(&memory);
+        initSimulator(&mips, &memory);
+        bench_load_program(&memory, program, sizeof(program) / 4);
+
+        Fuzzer fuzzer;
+        if (!initFuzzer(&fuzzer, &mips)) return 1;
+
+        double start = bench_now();
+        fuzzer_run(&fuzzer, threads, EXECUTIONS);
+        double elapsed = bench_now() - start;
+
+        FuzzStats stats;
+        fuzzer_stats(&fuzzer, &stats);
+        char name[64];
+        snprintf(name, sizeof(name), "%d threads (%llu crashes, %zu edges)", threads,
+                 (unsigned long long)stats.crashes, stats.edges);
+        BENCH_REPORT(name, stats.executions / elapsed, "exec/s");
+
+        freeFuzzer(&fuzzer);
+        freeSimulator(&mips);
+        freeMemory(&memory);
+    }
+
+    return 0;
+}
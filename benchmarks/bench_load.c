@@ -0,0 +1,82 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "bench.h"
+#include "loader.h"
+
+#define ITERATIONS 50
+#define TEXT_SIZE (256 * 1024)
+#define DATA_SIZE (MEMORY_SIZE - DATA_ADDRESS - 64 * 1024)
+
+static void put_word(uint8_t* bytes, uint32_t word) {
+    bytes[0] = word >> 24;
+    bytes[1] = word >> 16;
+    bytes[2] = word >> 8;
+    bytes[3] = word;
+}
+
+// Writes an executable with the largest text and data sections the memory map allows
+static void writeExecutable(char* path) {
+    size_t sha = 15 + TEXT_SIZE + DATA_SIZE;
+    size_t size = sha + 2 * 11;
+    uint8_t* file = calloc(1, size);
+
+    memcpy(file, "\x10LEF\x01\x00", 6);
+    put_word(&file[6], 15);
+    put_word(&file[10], sha);
+    file[14] = 2;
+
+    for (size_t i = 0; i < TEXT_SIZE; i += 4) {
+        put_word(&file[15 + i], 0x24080001); // addiu $t0, $zero, 1
+    }
+    for (size_t i = 0; i < DATA_SIZE; ++i) {
+        file[15 + TEXT_SIZE + i] = (uint8_t)(i * 31);
+    }
+
+    uint8_t* header = &file[sha];
+    header[2] = SHT_EXEC;
+    put_word(&header[3], 15);
+    put_word(&header[7], TEXT_SIZE);
+    header[11 + 2] = SHT_ALLOC;
+    put_word(&header[11 + 3], 15 + TEXT_SIZE);
+    put_word(&header[11 + 7], DATA_SIZE);
+
+    int fd = mkstemp(path);
+    write(fd, file, size);
+    close(fd);
+    free(file);
+}
+
+int main() {
+    char path[] = "/tmp/lmips_bench_load_XXXXXX";
+    writeExecutable(path);
+
+    double ready = 0, complete = 0;
+    for (int i = 0; i < ITERATIONS; ++i) {
+        Memory memory;
+        initMemory(&memory);
+        Executable executable;
+
+        double start = bench_now();
+        if (loadExecutable(path, &memory, &executable) != LOAD_SUCCESS) {
+            fprintf(stderr, "Unable to load the synthetic executable.\n");
+            return 1;
+        }
+        double started = bench_now();
+        waitExecutable(&executable);
+        double end = bench_now();
+
+        ready += started - start;
+        complete += end - start;
+
+        freeExecutable(&executable);
+        freeMemory(&memory);
+    }
+
+    printf("Synthetic executable : %d KB of text, %d KB of data\n", TEXT_SIZE / 1024, DATA_SIZE / 1024);
+    BENCH_REPORT("Latency until the entry point can run", ready / ITERATIONS * 1e3, "ms");
+    BENCH_REPORT("Latency until every section is loaded", complete / ITERATIONS * 1e3, "ms");
+
+    unlink(path);
+    return 0;
+}
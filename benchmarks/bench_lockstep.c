@@ -0,0 +1,83 @@
+#include "bench.h"
+#include "lmips.h"
+#include "lmips_opcodes.h"
+#include "lockstep.h"
+
+#define ITERATIONS 0x40000 // Loop iterations per lane
+
+// A xorshift generator seeded from $a0, counting in $s0 the values whose low byte is 0. The lanes only split
+// for those, 1 in 256 iterations.
+static const uint32_t program[] = {
+    0x3C090000 | (ITERATIONS >> 16), // lui $t1, ITERATIONS >> 16
+    0x20100000, // addi $s0, $zero, 0
+    0x20110000, // addi $s1, $zero, 0
+    0x00045340, // loop: sll $t2, $a0, 13
+    0x008A2026, // xor $a0, $a0, $t2
+    0x00045442, // srl $t2, $a0, 17
+    0x008A2026, // xor $a0, $a0, $t2
+    0x00045140, // sll $t2, $a0, 5
+    0x008A2026, // xor $a0, $a0, $t2
+    0x308B00FF, // andi $t3, $a0, 0xFF
+    0x15600002, // bne $t3, $zero, skip
+    0x22100001, // addi $s0, $s0, 1
+    0x02248821, // skip: addu $s1, $s1, $a0
+    0x2129FFFF, // addi $t1, $t1, -1
+    0x1520FFF5, // bne $t1, $zero, loop
+    0x2002000A, // addi $v0, $zero, 10
+    0x0000000C, // syscall
+};
+
+static void initLanes(Memory* memories, LMips* lanes) {
+    for (int i = 0; i < LOCKSTEP_LANES; ++i) {
+        initMemory(&memories[i]);
+        initSimulator(&lanes[i], &memories[i]);
+        bench_load_program(&memories[i], program, sizeof(program) / 4);
+        lanes[i].regs[$a0] = 0x9E3779B9 * (i + 1);
+    }
+}
+
+static uint64_t freeLanes(Memory* memories, LMips* lanes) {
+    uint64_t instructions = 0;
+    for (int i = 0; i < LOCKSTEP_LANES; ++i) {
+        instructions += lanes[i].icount;
+        freeSimulator(&lanes[i]);
+        freeMemory(&memories[i]);
+    }
+
+    return instructions;
+}
+
+int main() {
+    Memory memories[LOCKSTEP_LANES];
+    LMips lanes[LOCKSTEP_LANES];
+    printf("%d lanes of %d loop iterations\n", LOCKSTEP_LANES, ITERATIONS);
+
+    // One VM after the other, as a batch worker runs them
+    initLanes(memories, lanes);
+    double start = bench_now();
+    for (int i = 0; i < LOCKSTEP_LANES; ++i) {
+        runSimulator(&lanes[i]);
+    }
+    double scalar = bench_now() - start;
+    uint64_t instructions = freeLanes(memories, lanes);
+    BENCH_REPORT("scalar", instructions / scalar / 1e6, "MIPS");
+
+    initLanes(memories, lanes);
+    LockStep lockstep;
+    initLockStep(&lockstep);
+    for (int i = 0; i < LOCKSTEP_LANES; ++i) {
+        lockstep_add(&lockstep, &lanes[i]);
+    }
+    start = bench_now();
+    lockstep_run(&lockstep);
+    double vector = bench_now() - start;
+    instructions = freeLanes(memories, lanes);
+
+    char name[64];
+    snprintf(name, sizeof(name), "lock-step (%.2fx speedup)", scalar / vector);
+    BENCH_REPORT(name, instructions / vector / 1e6, "MIPS");
+    BENCH_REPORT("lanes per issued instruction", (double)lockstep.stats.executed / lockstep.stats.issued, "lanes");
+    BENCH_REPORT("divergent branches", lockstep.stats.divergences * 100.0 / lockstep.stats.issued, "% issued");
+
+    return 0;
+}
@@ -0,0 +1,124 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include "bench.h"
+#include "lmips.h"
+#include "devices.h"
+
+#define ITERATIONS 5
+#define PRINTS 200000
+
+// Same shape as hello.asm : a number then a separator per iteration
+static void writeProgram(Memory* memory) {
+    static const uint32_t program[] = {
+        0x3C080000 | (PRINTS >> 16),    // lui $t0, PRINTS >> 16
+        0x35080000 | (PRINTS & 0xFFFF), // ori $t0, $t0, PRINTS & 0xFFFF
+        0x01002020, // loop: add $a0, $t0, $zero
+        0x20020001, // addi $v0, $zero, 1
+        0x0000000C, // syscall
+        0x3C040008, // lui $a0, 0x8 (DATA_ADDRESS)
+        0x20020004, // addi $v0, $zero, 4
+        0x0000000C, // syscall
+        0x2108FFFF, // addi $t0, $t0, -1
+        0x1500FFF9, // bne $t0, $zero, loop
+        0x2002000A, // addi $v0, $zero, 10
+        0x0000000C, // syscall
+    };
+
+    for (size_t i = 0; i < sizeof(program) / sizeof(program[0]); ++i) {
+        mem_write(memory, PROGRAM_ADDRESS + i * 4, program[i]);
+    }
+    mem_write(memory, DATA_ADDRESS, 0x0A000000); // "\n"
+}
+
+// Prints "x\n" per iteration, through print_string or through the console device
+static void writeLineProgram(Memory* memory, bool device) {
+    static const uint32_t syscalls[] = {
+        0x3C080000 | (PRINTS >> 16),    // lui $t0, PRINTS >> 16
+        0x35080000 | (PRINTS & 0xFFFF), // ori $t0, $t0, PRINTS & 0xFFFF
+        0x3C040008, // loop: lui $a0, 0x8 (DATA_ADDRESS)
+        0x20020004, // addi $v0, $zero, 4
+        0x0000000C, // syscall
+        0x2108FFFF, // addi $t0, $t0, -1
+        0x1500FFFC, // bne $t0, $zero, loop
+        0x2002000A, // addi $v0, $zero, 10
+        0x0000000C, // syscall
+    };
+    static const uint32_t stores[] = {
+        0x3C080000 | (PRINTS >> 16),    // lui $t0, PRINTS >> 16
+        0x35080000 | (PRINTS & 0xFFFF), // ori $t0, $t0, PRINTS & 0xFFFF
+        0x20091000, // addi $t1, $zero, DEVICE_CONSOLE_BUFFER
+        0x200A780A, // addi $t2, $zero, "x\n"
+        0xA52A0000, // loop: sh $t2, ($t1)
+        0xA9200FFC, // sw $zero, 0xFFC($t1)
+        0x2108FFFF, // addi $t0, $t0, -1
+        0x1500FFFD, // bne $t0, $zero, loop
+        0x2002000A, // addi $v0, $zero, 10
+        0x0000000C, // syscall
+    };
+
+    const uint32_t* program = device ? stores : syscalls;
+    size_t count = device ? sizeof(stores) / sizeof(stores[0]) : sizeof(syscalls) / sizeof(syscalls[0]);
+    for (size_t i = 0; i < count; ++i) {
+        mem_write(memory, PROGRAM_ADDRESS + i * 4, program[i]);
+    }
+    mem_write(memory, DATA_ADDRESS, 0x780A0000); // "x\n"
+}
+
+static double runLines(bool device, int fd) {
+    double total = 0;
+    for (int i = 0; i < ITERATIONS; ++i) {
+        Memory memory;
+        initMemory(&memory);
+        LMips mips;
+        initSimulator(&mips, &memory);
+        initConsole(&mips.console, fd, CONSOLE_FULLY_BUFFERED);
+        writeLineProgram(&memory, device);
+
+        double start = bench_now();
+        runSimulator(&mips);
+        total += bench_now() - start;
+
+        freeSimulator(&mips);
+        freeMemory(&memory);
+    }
+
+    return total / ITERATIONS / PRINTS * 1e9;
+}
+
+static double run(ConsoleMode mode, int fd) {
+    double total = 0;
+    for (int i = 0; i < ITERATIONS; ++i) {
+        Memory memory;
+        initMemory(&memory);
+        LMips mips;
+        initSimulator(&mips, &memory);
+        initConsole(&mips.console, fd, mode);
+        writeProgram(&memory);
+
+        double start = bench_now();
+        runSimulator(&mips);
+        total += bench_now() - start;
+
+        freeSimulator(&mips);
+        freeMemory(&memory);
+    }
+
+    return total / ITERATIONS / (PRINTS * 2) * 1e9;
+}
+
+int main() {
+    int fd = open("/dev/null", O_WRONLY);
+    if (fd < 0) return 1;
+
+    printf("Guest printing %d numbers and new lines to /dev/null\n", PRINTS);
+    BENCH_REPORT("Line buffered output", run(CONSOLE_LINE_BUFFERED, fd), "ns/syscall");
+    BENCH_REPORT("Fully buffered output", run(CONSOLE_FULLY_BUFFERED, fd), "ns/syscall");
+    BENCH_REPORT("Asynchronous output", run(CONSOLE_ASYNC, fd), "ns/syscall");
+
+    printf("Guest printing %d lines, fully buffered\n", PRINTS);
+    BENCH_REPORT("print_string syscall", runLines(false, fd), "ns/line");
+    BENCH_REPORT("Console device stores", runLines(true, fd), "ns/line");
+
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,76 @@
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "bench.h"
+#include "lmips.h"
+
+#define INTEGERS 2000000
+
+// Sums INTEGERS integers read with SYS_READ_INT into $t1
+static void writeProgram(Memory* memory) {
+    static const uint32_t program[] = {
+        0x3C080000 | (INTEGERS >> 16),    // lui $t0, INTEGERS >> 16
+        0x35080000 | (INTEGERS & 0xFFFF), // ori $t0, $t0, INTEGERS & 0xFFFF
+        0x20020005, // loop: addi $v0, $zero, 5
+        0x0000000C, // syscall
+        0x01224821, // addu $t1, $t1, $v0
+        0x2108FFFF, // addi $t0, $t0, -1
+        0x1500FFFC, // bne $t0, $zero, loop
+        0x2002000A, // addi $v0, $zero, 10
+        0x0000000C, // syscall
+    };
+
+    for (size_t i = 0; i < sizeof(program) / sizeof(program[0]); ++i) {
+        mem_write(memory, PROGRAM_ADDRESS + i * 4, program[i]);
+    }
+}
+
+static void writeInput(char* path) {
+    FILE* file = fdopen(mkstemp(path), "w");
+    for (uint32_t i = 0; i < INTEGERS; ++i) {
+        fprintf(file, "%u\n", i * 2654435761u % 1000000000);
+    }
+    fclose(file);
+}
+
+int main() {
+    char path[] = "/tmp/lmips_bench_scan_XXXXXX";
+    writeInput(path);
+
+    Memory memory;
+    initMemory(&memory);
+    LMips mips;
+    initSimulator(&mips, &memory);
+    initScanner(&mips.scanner, open(path, O_RDONLY));
+    writeProgram(&memory);
+
+    double start = bench_now();
+    runSimulator(&mips);
+    double guest = bench_now() - start;
+    uint32_t sum = mips.regs[$t1];
+    close(mips.scanner.stream.fd);
+
+    // What SYS_READ_INT used to cost on the host alone
+    FILE* input = fopen(path, "r");
+    char buffer[12];
+    uint32_t check = 0;
+    start = bench_now();
+    while (fgets(buffer, 11, input) != NULL) {
+        check += strtoul(buffer, NULL, 0);
+    }
+    double stdio = bench_now() - start;
+    fclose(input);
+
+    printf("Reading %d integers from a file\n", INTEGERS);
+    BENCH_REPORT("Guest SYS_READ_INT loop", INTEGERS / guest / 1e6, "M integers/s");
+    BENCH_REPORT("Host fgets and strtoul alone", INTEGERS / stdio / 1e6, "M integers/s");
+    if (sum != check) {
+        fprintf(stderr, "Guest sum %u differs from %u\n", sum, check);
+        return 1;
+    }
+
+    freeSimulator(&mips);
+    freeMemory(&memory);
+    unlink(path);
+    return 0;
+}
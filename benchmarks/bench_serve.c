@@ -0,0 +1,218 @@
+#include <fcntl.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <spawn.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "bench.h"
+#include "loader.h"
+#include "server.h"
+#include "threadpool.h"
+
+#define REQUESTS 4000
+#define MAX_CLIENTS 16
+#define SPAWNS 200 // Requests run by a new lms process each
+
+// Reads a number and prints it back, the shortest job a client can ask for
+static const uint32_t program[] = {
+    0x20020005, // addi $v0, $zero, 5
+    0x0000000C, // syscall
+    0x00402020, // add $a0, $v0, $zero
+    0x20020001, // addi $v0, $zero, 1
+    0x0000000C, // syscall
+    0x2002000A, // addi $v0, $zero, 10
+    0x0000000C, // syscall
+};
+
+typedef struct {
+    const char* socket;
+    const char* binary;
+    double* latencies;
+    int count;
+    int failures;
+} Client;
+
+static void putWord(uint8_t* bytes, uint32_t word) {
+    bytes[0] = word >> 24;
+    bytes[1] = word >> 16;
+    bytes[2] = word >> 8;
+    bytes[3] = word;
+}
+
+static bool writeExecutable(char* path) {
+    size_t text = sizeof(program);
+    uint8_t file[15 + sizeof(program) + 11] = {0x10, 'L', 'E', 'F', 1, 0};
+    putWord(&file[6], 15);
+    putWord(&file[10], 15 + text);
+    file[14] = 1;
+    for (size_t i = 0; i < text / 4; ++i) {
+        putWord(&file[15 + i * 4], program[i]);
+    }
+    file[15 + text + 2] = 0x01; // SHT_EXEC
+    putWord(&file[15 + text + 3], 15);
+    putWord(&file[15 + text + 7], text);
+
+    int fd = mkstemp(path);
+    if (fd < 0) return false;
+    bool written = write(fd, file, sizeof(file)) == sizeof(file);
+    close(fd);
+    return written;
+}
+
+static int compareLatencies(const void* a, const void* b) {
+    double first = *(const double*)a, second = *(const double*)b;
+    return (first > second) - (first < second);
+}
+
+static void report(const char* name, double* latencies, int count, double elapsed) {
+    char label[64];
+    qsort(latencies, count, sizeof(double), compareLatencies);
+    snprintf(label, sizeof(label), "%s p50", name);
+    BENCH_REPORT(label, latencies[count / 2] * 1e6, "us");
+    snprintf(label, sizeof(label), "%s p99", name);
+    BENCH_REPORT(label, latencies[count * 99 / 100] * 1e6, "us");
+    snprintf(label, sizeof(label), "%s throughput", name);
+    BENCH_REPORT(label, count / elapsed, "req/s");
+}
+
+static void* runClient(void* arg) {
+    Client* client = arg;
+    for (int i = 0; i < client->count; ++i) {
+        char input[16];
+        int size = snprintf(input, sizeof(input), "%d\n", i);
+
+        ServerReply reply;
+        double start = bench_now();
+        bool answered = server_call(client->socket, client->binary, input, size, &reply);
+        client->latencies[i] = bench_now() - start;
+
+        client->failures += !answered || reply.status != BATCH_EXITED;
+        free(reply.output);
+    }
+
+    return NULL;
+}
+
+static void* serve(void* arg) {
+    server_run(arg);
+    return NULL;
+}
+
+// Loading the binary for every request, as a new lms process does after it started
+static void runCold(const char* binary, double* latencies) {
+    double begin = bench_now();
+    for (int i = 0; i < REQUESTS; ++i) {
+        double start = bench_now();
+        Memory memory;
+        initMemory(&memory);
+        LMips mips;
+        initSimulator(&mips, &memory);
+
+        Executable executable;
+        if (loadExecutable(binary, &memory, &executable) == LOAD_SUCCESS) {
+            waitExecutable(&executable);
+            mips.ip = executable.entry;
+            char input[16];
+            Stream stream;
+            initBufferStream(&stream, input, snprintf(input, sizeof(input), "%d\n", i));
+            lmips_set_input(&mips, &stream);
+            initBufferStream(&stream, NULL, 0);
+            lmips_set_output(&mips, &stream);
+            executeSimulator(&mips);
+            freeExecutable(&executable);
+        }
+
+        freeSimulator(&mips);
+        freeMemory(&memory);
+        latencies[i] = bench_now() - start;
+    }
+
+    report("load per request", latencies, REQUESTS, bench_now() - begin);
+}
+
+// A new lms process per request, found next to this benchmark
+static void runProcesses(const char* self, const char* binary, double* latencies) {
+    char* directory = strdup(self);
+    char lms[4096];
+    snprintf(lms, sizeof(lms), "%s/lmips", dirname(directory));
+    free(directory);
+    if (access(lms, X_OK) != 0) return;
+
+    char input[] = "/tmp/lmips_bench_serve_XXXXXX";
+    int fd = mkstemp(input);
+    if (fd < 0 || write(fd, "12\n", 3) != 3) return;
+    close(fd);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, input, O_RDONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    char* argv[] = {lms, (char*)binary, NULL};
+
+    extern char** environ;
+    double begin = bench_now();
+    for (int i = 0; i < SPAWNS; ++i) {
+        double start = bench_now();
+        pid_t pid;
+        int status;
+        if (posix_spawn(&pid, lms, &actions, NULL, argv, environ) != 0) break;
+        waitpid(pid, &status, 0);
+        latencies[i] = bench_now() - start;
+    }
+
+    report("process per request", latencies, SPAWNS, bench_now() - begin);
+    posix_spawn_file_actions_destroy(&actions);
+    unlink(input);
+}
+
+int main(int argc, char const *argv[]) {
+    (void)argc;
+    char binary[] = "/tmp/lmips_bench_serve_XXXXXX";
+    char socket[64];
+    if (!writeExecutable(binary)) return 1;
+    snprintf(socket, sizeof(socket), "%s.sock", binary);
+
+    int cpus = pool_default_threads();
+    printf("%d requests, %d CPUs\n", REQUESTS, cpus);
+
+    double* latencies = malloc(REQUESTS * sizeof(double));
+    runProcesses(argv[0], binary, latencies);
+    runCold(binary, latencies);
+
+    Server server;
+    if (!initServer(&server, socket, cpus) || !server_add(&server, binary)) return 1;
+    pthread_t thread;
+    pthread_create(&thread, NULL, serve, &server);
+
+    for (int clients = 1; clients <= MAX_CLIENTS; clients *= 4) {
+        pthread_t threads[MAX_CLIENTS];
+        Client workers[MAX_CLIENTS];
+        double begin = bench_now();
+        for (int i = 0; i < clients; ++i) {
+            workers[i] = (Client){socket, binary, &latencies[i * (REQUESTS / clients)], REQUESTS / clients, 0};
+            pthread_create(&threads[i], NULL, runClient, &workers[i]);
+        }
+
+        int failures = 0;
+        for (int i = 0; i < clients; ++i) {
+            pthread_join(threads[i], NULL);
+            failures += workers[i].failures;
+        }
+
+        char name[64];
+        snprintf(name, sizeof(name), "served, %d clients", clients);
+        report(name, latencies, REQUESTS / clients * clients, bench_now() - begin);
+        if (failures > 0) {
+            printf("%d requests failed\n", failures);
+        }
+    }
+
+    server_stop(&server);
+    pthread_join(thread, NULL);
+    freeServer(&server);
+    free(latencies);
+    unlink(binary);
+    return 0;
+}
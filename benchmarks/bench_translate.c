@@ -0,0 +1,69 @@
+#include "bench.h"
+#include "lmips.h"
+#include "translator.h"
+
+#define ITERATIONS 0x400000
+
+// The lock-step benchmark loop : a xorshift generator with a rarely taken branch
+static const uint32_t program[] = {
+    0x3C090000 | (ITERATIONS >> 16), // lui $t1, ITERATIONS >> 16
+    0x3C049E37, // lui $a0, 0x9E37
+    0x20100000, // addi $s0, $zero, 0
+    0x20110000, // addi $s1, $zero, 0
+    0x00045340, // loop: sll $t2, $a0, 13
+    0x008A2026, // xor $a0, $a0, $t2
+    0x00045442, // srl $t2, $a0, 17
+    0x008A2026, // xor $a0, $a0, $t2
+    0x00045140, // sll $t2, $a0, 5
+    0x008A2026, // xor $a0, $a0, $t2
+    0x308B00FF, // andi $t3, $a0, 0xFF
+    0x15600002, // bne $t3, $zero, skip
+    0x22100001, // addi $s0, $s0, 1
+    0x02248821, // skip: addu $s1, $s1, $a0
+    0x2129FFFF, // addi $t1, $t1, -1
+    0x1520FFF5, // bne $t1, $zero, loop
+    0x2002000A, // addi $v0, $zero, 10
+    0x0000000C, // syscall
+};
+
+static double run(bool translate, uint64_t* instructions, TranslatorStats* stats) {
+    Memory memory;
+    LMips mips;
+    initMemory(&memory);
+    initSimulator(&mips, &memory);
+    bench_load_program(&memory, program, sizeof(program) / 4);
+
+    Translator translator;
+    if (translate && !initTranslator(&translator, &mips, 1)) return 0;
+
+    double start = bench_now();
+    runSimulator(&mips);
+    double elapsed = bench_now() - start;
+    *instructions = mips.icount;
+
+    freeSimulator(&mips);
+    if (translate) {
+        *stats = translator.stats;
+        freeTranslator(&translator);
+    }
+    freeMemory(&memory);
+    return elapsed;
+}
+
+int main() {
+    uint64_t instructions;
+    TranslatorStats stats;
+    printf("%d loop iterations\n", ITERATIONS);
+
+    double interpreted = run(false, &instructions, &stats);
+    BENCH_REPORT("interpreter", instructions / interpreted / 1e6, "MIPS");
+
+    double translated = run(true, &instructions, &stats);
+    char name[64];
+    snprintf(name, sizeof(name), "translated blocks (%.2fx speedup)", interpreted / translated);
+    BENCH_REPORT(name, instructions / translated / 1e6, "MIPS");
+    BENCH_REPORT("blocks translated", (double)stats.translated, "blocks");
+    BENCH_REPORT("blocks rejected", (double)stats.rejected, "blocks");
+
+    return 0;
+}
@@ -1,134 +1,488 @@
+#include <signal.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
-#include "executable.h"
+#include <unistd.h>
+#include "loader.h"
+#include "imagecache.h"
+#include "image.h"
 #include "lmips.h"
+#include "batch.h"
+#include "threadpool.h"
+#include "fuzzer.h"
+#include "server.h"
+#include "translator.h"
 
-#define HEADER_SIZE (120 / 8)
+#define USAGE \
+    "Usage : lms [options] [file]\n" \
+    "        lms --restore <snapshot>\n" \
+    "        lms --batch <jobs> [--threads <count>] [--budget <count>] [-o <results>]\n" \
+    "        lms --fuzz <runs> [--threads <count>] <file>\n" \
+    "        lms --serve <socket> [--threads <count>] [--budget <count>] <file>...\n" \
+    "Options :\n" \
+    "  --cache-dir=<dir>   Reuse loaded images from <dir>\n" \
+    "  --cache-size=<MB>   Limit the image cache size\n" \
+    "  --cache-stats       Print the image cache hit and miss counts\n" \
+    "  --sandbox=<dir>     Let the program open files beneath <dir>\n" \
+    "  --heap-stats        Print the native allocator counters when the program ends\n" \
+    "  --output=<line|full|async>\n" \
+    "                      Flush the program output at every line, only when the buffer is full, or from a\n" \
+    "                      writer thread\n" \
+    "  --output-stats      Print the high-water mark of the asynchronous output when the program ends\n" \
+    "  --translate         Run hot blocks from translations a background thread builds while the program runs\n" \
+    "  --snapshot-at=<label|icount> -o <snapshot>\n" \
+    "                      Save the VM state before executing <label> or after <icount> instructions\n" \
+    "  --batch <jobs>      Run every \"binary [input]\" line of <jobs> in its own VM, results go to <results>\n" \
+    "                      or stdout\n" \
+    "  --threads <count>   Workers running the batch, the fuzzer or the server, one per CPU by default\n" \
+    "  --budget <count>    Instructions a batch job or a server request may run before it is stopped\n" \
+    "  --fuzz <runs>       Run <file> over <runs> mutated inputs from a snapshot before its first read, and\n" \
+    "                      print the inputs making it fault\n" \
+    "  --serve <socket>    Answer \"<file> <input size>\" requests on a Unix socket, each from a fresh copy of\n" \
+    "                      the loaded <file>, until interrupted\n"
 
-uint32_t read_word(FILE* file) {
-    uint32_t word;
-    fread(&word, sizeof(uint32_t), 1, file);
+typedef struct {
+    const char* file;
+    const char** files; // Every file given, only --serve takes more than one
+    int fileCount;
+    const char* cacheDir;
+    uint64_t cacheSize;
+    bool cacheStats;
+    const char* snapshotAt;
+    const char* output;
+    const char* restore;
+    const char* sandbox;
+    const char* batch;
+    uint64_t fuzz;
+    const char* serve;
+    int threads;
+    uint64_t budget;
+    bool heapStats;
+    bool outputStats;
+    bool translate;
+    bool setConsoleMode;
+    ConsoleMode consoleMode;
+} Options;
 
-    return ((word & 0x000000FF) << 24) |
-        ((word & 0x0000FF00) << 8)  |
-        ((word & 0x00FF0000) >> 8) |
-        ((word & 0xFF000000) >> 24);
+static void usage() {
+    printf(USAGE);
+    exit(1);
 }
 
-uint16_t read_half(FILE* file) {
-    uint16_t half;
-    fread(&half, sizeof(uint16_t), 1, file);
+static Options parseOptions(int argc, char const *argv[]) {
+    Options options = {};
+    options.files = malloc(argc * sizeof(const char*));
+    if (options.files == NULL) usage();
 
-    return (half >> 8) | (half << 8);
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        if (strncmp(arg, "--cache-dir=", 12) == 0) {
+            options.cacheDir = arg + 12;
+        } else if (strncmp(arg, "--cache-size=", 13) == 0) {
+            options.cacheSize = strtoull(arg + 13, NULL, 10) << 20;
+        } else if (strcmp(arg, "--cache-stats") == 0) {
+            options.cacheStats = true;
+        } else if (strcmp(arg, "--heap-stats") == 0) {
+            options.heapStats = true;
+        } else if (strncmp(arg, "--sandbox=", 10) == 0) {
+            options.sandbox = arg + 10;
+        } else if (strcmp(arg, "--output=line") == 0) {
+            options.setConsoleMode = true;
+            options.consoleMode = CONSOLE_LINE_BUFFERED;
+        } else if (strcmp(arg, "--output=full") == 0) {
+            options.setConsoleMode = true;
+            options.consoleMode = CONSOLE_FULLY_BUFFERED;
+        } else if (strcmp(arg, "--output=async") == 0) {
+            options.setConsoleMode = true;
+            options.consoleMode = CONSOLE_ASYNC;
+        } else if (strcmp(arg, "--output-stats") == 0) {
+            options.outputStats = true;
+        } else if (strcmp(arg, "--translate") == 0) {
+            options.translate = true;
+        } else if (strncmp(arg, "--snapshot-at=", 14) == 0) {
+            options.snapshotAt = arg + 14;
+        } else if (strcmp(arg, "-o") == 0 && i + 1 < argc) {
+            options.output = argv[++i];
+        } else if (strcmp(arg, "--restore") == 0 && i + 1 < argc) {
+            options.restore = argv[++i];
+        } else if (strcmp(arg, "--batch") == 0 && i + 1 < argc) {
+            options.batch = argv[++i];
+        } else if (strcmp(arg, "--fuzz") == 0 && i + 1 < argc) {
+            options.fuzz = strtoull(argv[++i], NULL, 10);
+            if (options.fuzz == 0) usage();
+        } else if (strcmp(arg, "--serve") == 0 && i + 1 < argc) {
+            options.serve = argv[++i];
+        } else if (strcmp(arg, "--threads") == 0 && i + 1 < argc) {
+            options.threads = atoi(argv[++i]);
+            if (options.threads <= 0) usage();
+        } else if (strcmp(arg, "--budget") == 0 && i + 1 < argc) {
+            options.budget = strtoull(argv[++i], NULL, 10);
+            if (options.budget == 0) usage();
+        } else if (arg[0] == '-') {
+            usage();
+        } else {
+            options.files[options.fileCount++] = arg;
+            options.file = options.files[0];
+        }
+    }
+
+    if (options.serve != NULL) {
+        if (options.file == NULL || options.batch != NULL || options.fuzz > 0 || options.restore != NULL ||
+                options.snapshotAt != NULL) usage();
+        return options;
+    }
+    if (options.fileCount > 1) {
+        usage();
+    }
+
+    if (options.batch != NULL) {
+        if (options.file != NULL || options.restore != NULL || options.snapshotAt != NULL) usage();
+        return options;
+    }
+    if (options.budget > 0) {
+        usage();
+    }
+    if (options.fuzz > 0) {
+        if (options.file == NULL || options.restore != NULL || options.snapshotAt != NULL) usage();
+        return options;
+    }
+    if (options.restore != NULL) {
+        if (options.file != NULL || options.snapshotAt != NULL) usage();
+    } else if (options.cacheStats ? options.cacheDir == NULL : options.file == NULL) {
+        usage();
+    }
+    if ((options.snapshotAt == NULL) != (options.output == NULL)) {
+        usage();
+    }
+
+    return options;
 }
 
-uint8_t read_byte(FILE* file) {
-    uint8_t byte;
-    fread(&byte, sizeof(uint8_t), 1, file);
+static void loadProgram(const char* file, Memory* memory, LMips* mips, Executable* executable) {
+    switch (loadExecutable(file, memory, executable)) {
+        case LOAD_ERR_OPEN:
+            printf("Unable to open file '%s'.\n", file);
+            exit(1);
+        case LOAD_ERR_FORMAT:
+            printf("File '%s' is not a valid executable file.\n", file);
+            exit(1);
+        case LOAD_ERR_OBJECT:
+            printf("File '%s' is a relocatable object, link it first.\n", file);
+            exit(1);
+        case LOAD_SUCCESS:
+            break;
+    }
 
-    return byte;
+    mips->ip = executable->entry;
 }
 
-FileHeader getHeader(FILE* file, const char* fileName) {
-    FileHeader header;
-    char format[4] = {0x10, 'L', 'E', 'F'};
+// Stops the program at a label of the text segment, or after a number of instructions
+static void setSnapshotPoint(const char* point, LMips* mips, DebugInfo* debug) {
+    char* end;
+    uint64_t count = strtoull(point, &end, 0);
+    if (*point != '\0' && *end == '\0') {
+        mips->stopCount = count;
+        return;
+    }
 
-    fread(header.magic, sizeof(char), 4, file);
-    if (memcmp(header.magic, format, 4) != 0) {
-        printf("File '%s' is not a valid executable file.\n", fileName);
-        fclose(file);
+    Symbol symbol;
+    if (!debug_find_symbol_by_name(debug, point, &symbol) || symbol.segment != SEGMENT_TEXT) {
+        printf("Unknown label '%s'.\n", point);
         exit(1);
     }
 
-    header.major = read_byte(file);
-    header.minor = read_byte(file);
-    header.entry = read_word(file);
-    header.shAddress = read_word(file);
-    header.shCount = read_byte(file);
+    mips->breakpoint = symbol.address;
+}
 
-    header.size = HEADER_SIZE;
+static void initVM(const Options* options, Memory* memory, LMips* mips) {
+    initMemory(memory);
+    initSimulator(mips, memory);
 
-    return header;
+    // Defaults to line buffering on terminals only
+    if (options->setConsoleMode) {
+        initConsole(&mips->console, STDOUT_FILENO, options->consoleMode);
+    }
+
+    if (options->sandbox != NULL && !files_set_root(&mips->files, options->sandbox)) {
+        printf("Unable to open sandbox directory '%s'.\n", options->sandbox);
+        exit(1);
+    }
 }
 
-int main(int argc, char const *argv[]) {
-    if (argc < 2 || argc > 2) {
-        printf("Usage : lms [file]\n");
+static void printHeapStats(const LMips* mips) {
+    HeapStats stats = {};
+    if (mips->allocator != NULL) {
+        stats = mips->allocator->stats;
+    }
+
+    // Whatever is reserved but not handed out, be it rounding or free blocks
+    double fragmentation = stats.reserved > 0 ? 100.0 * (stats.reserved - stats.used) / stats.reserved : 0;
+    fprintf(stderr, "Heap : %llu allocations, %llu frees, %llu bytes in use (peak %llu), %llu reserved, "
+            "%.1f%% fragmentation\n",
+            (unsigned long long)stats.allocations, (unsigned long long)stats.frees,
+            (unsigned long long)stats.used, (unsigned long long)stats.peak,
+            (unsigned long long)stats.reserved, fragmentation);
+}
+
+static void printOutputStats(const LMips* mips) {
+    ConsoleStats stats;
+    if (!console_stats(&mips->console, &stats)) {
+        fprintf(stderr, "Output : not asynchronous\n");
+        return;
+    }
+
+    fprintf(stderr, "Output : %llu of %u bytes pending at most, the program waited %llu times\n",
+            (unsigned long long)stats.highWater, stats.capacity, (unsigned long long)stats.stalls);
+}
+
+static int restoreSnapshot(const Options* options) {
+    const char* file = options->restore;
+    Memory memory = {};
+    LMips mips;
+    initVM(options, &memory, &mips);
+
+    // Only the pages present in the snapshot are mapped
+    if (!image_map(file, NULL, &memory, &mips, NULL)) {
+        printf("File '%s' is not a valid snapshot.\n", file);
         exit(1);
     }
 
-    FILE* source;
-    source = fopen(argv[1], "rw+");
-    if (source == NULL) {
-        printf("Unable to open file '%s'.\n", argv[1]);
+    runSimulator(&mips);
+    if (options->heapStats) {
+        printHeapStats(&mips);
+    }
+    if (options->outputStats) {
+        printOutputStats(&mips);
+    }
+
+    freeSimulator(&mips);
+    freeMemory(&memory);
+    return 0;
+}
+
+static int runBatch(const Options* options) {
+    Batch batch;
+    initBatch(&batch);
+    if (!batch_read_jobs(&batch, options->batch)) {
+        printf("Unable to read jobs file '%s'.\n", options->batch);
         exit(1);
     }
 
-    // Get file header
-    FileHeader header = getHeader(source, argv[1]);
+    FILE* results = options->output != NULL ? fopen(options->output, "w") : stdout;
+    if (results == NULL) {
+        printf("Unable to open results file '%s'.\n", options->output);
+        exit(1);
+    }
 
-    // Get section header table
-    SectionHeader sections[header.shCount];
-    fseek(source, header.shAddress, SEEK_SET);
-    for (int i = 0; i < header.shCount; ++i) {
-        SectionHeader section;
-        section.name = read_half(source);
-        section.type = read_byte(source);
-        section.address = read_word(source);
-        section.size = read_word(source);
+    if (options->budget > 0) {
+        batch.budget = options->budget;
+    }
 
-        sections[i] = section;
+    int threads = options->threads > 0 ? options->threads : pool_default_threads();
+    if (!batch_run(&batch, threads)) {
+        printf("Unable to run the batch.\n");
+        exit(1);
     }
 
+    bool written = batch_write_results(&batch, results);
+    if (results != stdout) {
+        written = fclose(results) == 0 && written;
+    }
+    freeBatch(&batch);
+
+    if (!written) {
+        printf("Unable to write results file '%s'.\n", options->output);
+        return 1;
+    }
+    return 0;
+}
+
+// Non printable bytes as \xHH
+static void printInput(const FuzzInput* input) {
+    for (size_t i = 0; i < input->size; ++i) {
+        uint8_t byte = input->bytes[i];
+        if (byte >= ' ' && byte < 0x7F && byte != '\\') {
+            putchar(byte);
+        } else {
+            printf("\\x%02X", byte);
+        }
+    }
+    putchar('\n');
+}
+
+static int runFuzzer(const Options* options) {
     Memory memory = {};
-    initMemory(&memory);
-    uint32_t programOffset = PROGRAM_ADDRESS;
-    uint32_t dataOffset = DATA_ADDRESS;
-
-    // Start sections reading
-    for (int i = 0; i < header.shCount; ++i) {
-        SectionHeader section = sections[i];
-        fseek(source, section.address, SEEK_SET);
-        switch (section.type) {
-            case SHT_EXEC: {
-                for (int j = 0; j < section.size * 0.25; ++j) {
-                    uint32_t instr = read_word(source);
-                    mem_write(&memory, programOffset, instr);
-                    programOffset += 4;
-                }
-                break;
-            }
-            case SHT_ALLOC: {
-                for (int j = 0; j < section.size; ++j) {
-                    uint8_t buffer = read_byte(source);
-                    mem_write_byte(&memory, dataOffset++, buffer);
-                }
-                break;
-            }
-            case SHT_STRTAB: {
-                read_byte(source);
-                for (int j = 0; j < section.size - 2; ++j) {
-                    uint8_t buffer = read_byte(source);
-                    mem_write_byte(&memory, dataOffset++, buffer);
-                }
-                read_byte(source);
-                break;
-            }
-            case SHT_NULL:
-                break;
+    LMips mips;
+    initVM(options, &memory, &mips);
+
+    Executable executable = {};
+    loadProgram(options->file, &memory, &mips, &executable);
+    waitExecutable(&executable);
+
+    Fuzzer fuzzer;
+    if (!initFuzzer(&fuzzer, &mips)) {
+        printf("Program '%s' ended before reading its input, nothing to fuzz.\n", options->file);
+        exit(1);
+    }
+
+    int threads = options->threads > 0 ? options->threads : pool_default_threads();
+    if (!fuzzer_run(&fuzzer, threads, options->fuzz)) {
+        printf("Unable to start the fuzzer.\n");
+        exit(1);
+    }
+
+    FuzzStats stats;
+    fuzzer_stats(&fuzzer, &stats);
+    printf("Fuzzer : %llu executions, %llu crashes, %llu hangs, %zu edges, %zu inputs in the corpus\n",
+           (unsigned long long)stats.executions, (unsigned long long)stats.crashes,
+           (unsigned long long)stats.hangs, stats.edges, stats.corpus);
+    for (size_t i = 0; i < fuzzer.crashCount; ++i) {
+        printInput(&fuzzer.crashes[i]);
+    }
+
+    freeFuzzer(&fuzzer);
+    freeSimulator(&mips);
+    freeExecutable(&executable);
+    freeMemory(&memory);
+    return 0;
+}
+
+static Server* serving;
+
+static void stopServing(int signal) {
+    (void)signal;
+    server_stop(serving);
+}
+
+static int runServer(const Options* options) {
+    int threads = options->threads > 0 ? options->threads : pool_default_threads();
+    Server server;
+    if (!initServer(&server, options->serve, threads)) {
+        printf("Unable to listen on socket '%s'.\n", options->serve);
+        exit(1);
+    }
+
+    if (options->budget > 0) {
+        server.budget = options->budget;
+    }
+
+    for (int i = 0; i < options->fileCount; ++i) {
+        if (!server_add(&server, options->files[i])) {
+            printf("Unable to load file '%s'.\n", options->files[i]);
+            freeServer(&server);
+            exit(1);
         }
     }
 
-    fclose(source);
+    // Interrupting the server lets it answer the requests it accepted and remove its socket
+    struct sigaction action = {};
+    action.sa_handler = stopServing;
+    serving = &server;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    printf("Serving %d file(s) on '%s' with %d workers\n", options->fileCount, options->serve, threads);
+    fflush(stdout);
+    bool stopped = server_run(&server);
+    printf("Served %llu requests\n", (unsigned long long)server.requests);
+
+    freeServer(&server);
+    return stopped ? 0 : 1;
+}
+
+int main(int argc, char const *argv[]) {
+    Options options = parseOptions(argc, argv);
+
+    if (options.serve != NULL) {
+        return runServer(&options);
+    }
+
+    if (options.fuzz > 0) {
+        return runFuzzer(&options);
+    }
+
+    if (options.batch != NULL) {
+        return runBatch(&options);
+    }
+
+    if (options.restore != NULL) {
+        return restoreSnapshot(&options);
+    }
+
+    ImageCache cache;
+    if (options.cacheDir != NULL) {
+        initImageCache(&cache, options.cacheDir, options.cacheSize);
+    }
+
+    if (options.cacheStats) {
+        ImageCacheStats stats;
+        cache_stats(&cache, &stats);
+        printf("Image cache : %llu hits, %llu misses\n",
+               (unsigned long long)stats.hits, (unsigned long long)stats.misses);
+        freeImageCache(&cache);
+        return 0;
+    }
 
+    Memory memory = {};
     LMips mips;
-    initSimulator(&mips, &memory);
-    mips.ip = header.entry - header.size;
+    initVM(&options, &memory, &mips);
 
-    runSimulator(&mips);
+    Executable executable = {};
+    if (options.cacheDir != NULL) {
+        ImageKey key;
+        initDebugInfo(&executable.debug, options.file);
+
+        if (!cache_key(options.file, &key)) {
+            printf("Unable to open file '%s'.\n", options.file);
+            exit(1);
+        }
+
+        if (!cache_lookup(&cache, &key, &memory, &mips, &executable.debug)) {
+            freeExecutable(&executable);
+            loadProgram(options.file, &memory, &mips, &executable);
+            waitExecutable(&executable);
+            cache_store(&cache, &key, &mips, &executable.debug);
+        }
+
+        freeImageCache(&cache);
+    } else {
+        loadProgram(options.file, &memory, &mips, &executable);
+    }
+
+    mips.debug = &executable.debug;
+
+    if (options.snapshotAt != NULL) {
+        setSnapshotPoint(options.snapshotAt, &mips, &executable.debug);
+    }
+
+    Translator translator;
+    if (options.translate && !initTranslator(&translator, &mips, 1)) {
+        printf("Unable to start the translator.\n");
+        exit(1);
+    }
+
+    if (runSimulator(&mips) == EXEC_BREAKPOINT) {
+        waitExecutable(&executable);
+        if (!image_write(options.output, NULL, &mips, NULL)) {
+            printf("Unable to write snapshot '%s'.\n", options.output);
+            exit(1);
+        }
+    } else if (options.snapshotAt != NULL) {
+        printf("Program ended before reaching '%s', no snapshot written.\n", options.snapshotAt);
+    }
+
+    if (options.heapStats) {
+        printHeapStats(&mips);
+    }
+    if (options.outputStats) {
+        printOutputStats(&mips);
+    }
 
     freeSimulator(&mips);
+    if (options.translate) {
+        freeTranslator(&translator);
+    }
+    freeExecutable(&executable);
     freeMemory(&memory);
     return 0;
 }
@@ -0,0 +1,309 @@
+#include <stdlib.h>
+#include <string.h>
+#include "allocator.h"
+
+#define KIND_NONE 0
+#define KIND_SMALL 1 // Followed by one kind per class
+#define KIND_RUN (KIND_SMALL + HEAP_CLASS_COUNT)
+#define KIND_FREE_RUN (KIND_RUN + 1)
+
+#define PAGE_OF(address) ((address) / MEMORY_PAGE_SIZE)
+
+GuestHeap* newGuestHeap() {
+    return calloc(1, sizeof(GuestHeap));
+}
+
+static bool copyList(AddressList* list) {
+    if (list->items == NULL) return true;
+
+    uint32_t* items = malloc(list->capacity * sizeof(uint32_t));
+    if (items != NULL) {
+        memcpy(items, list->items, list->count * sizeof(uint32_t));
+    }
+    list->items = items;
+    return items != NULL;
+}
+
+GuestHeap* copyGuestHeap(const GuestHeap* heap) {
+    GuestHeap* copy = malloc(sizeof(GuestHeap));
+    if (copy == NULL) return NULL;
+
+    *copy = *heap;
+    bool copied = copyList(&copy->freeRuns);
+    for (int i = 0; i < HEAP_CLASS_COUNT; ++i) {
+        copied = copyList(&copy->freeBlocks[i]) && copied;
+    }
+    if (!copied) {
+        freeGuestHeap(copy);
+        return NULL;
+    }
+
+    return copy;
+}
+
+void freeGuestHeap(GuestHeap* heap) {
+    if (heap == NULL) return;
+
+    for (int i = 0; i < HEAP_CLASS_COUNT; ++i) {
+        free(heap->freeBlocks[i].items);
+    }
+    free(heap->freeRuns.items);
+    free(heap);
+}
+
+// The lists in the order heap_save writes their items
+static AddressList* listAt(GuestHeap* heap, int index) {
+    return index < HEAP_CLASS_COUNT ? &heap->freeBlocks[index] : &heap->freeRuns;
+}
+
+// The heap itself with its list pointers cleared, followed by the items of every list
+void* heap_save(const GuestHeap* heap, size_t* size) {
+    size_t items = 0;
+    for (int i = 0; i <= HEAP_CLASS_COUNT; ++i) {
+        items += listAt((GuestHeap*)heap, i)->count;
+    }
+
+    *size = sizeof(GuestHeap) + items * sizeof(uint32_t);
+    uint8_t* bytes = malloc(*size);
+    if (bytes == NULL) return NULL;
+
+    GuestHeap* saved = (GuestHeap*)bytes;
+    *saved = *heap;
+    uint32_t* next = (uint32_t*)(bytes + sizeof(GuestHeap));
+    for (int i = 0; i <= HEAP_CLASS_COUNT; ++i) {
+        AddressList* list = listAt(saved, i);
+        if (list->count > 0) {
+            memcpy(next, list->items, list->count * sizeof(uint32_t));
+        }
+        next += list->count;
+        list->items = NULL;
+        list->capacity = list->count;
+    }
+
+    return bytes;
+}
+
+GuestHeap* heap_load(const void* bytes, size_t size) {
+    if (size < sizeof(GuestHeap)) return NULL;
+
+    GuestHeap* heap = malloc(sizeof(GuestHeap));
+    if (heap == NULL) return NULL;
+
+    memcpy(heap, bytes, sizeof(GuestHeap));
+    const uint8_t* next = (const uint8_t*)bytes + sizeof(GuestHeap);
+    size_t left = size - sizeof(GuestHeap);
+    bool loaded = true;
+
+    // Every list gets its own items or none, so that a partly loaded heap can still be freed
+    for (int i = 0; i <= HEAP_CLASS_COUNT; ++i) {
+        AddressList* list = listAt(heap, i);
+        size_t length = (size_t)list->count * sizeof(uint32_t);
+        list->items = loaded && length <= left && list->count > 0 ? malloc(length) : NULL;
+        if (list->count > 0 && list->items == NULL) {
+            loaded = false;
+            list->count = 0;
+        }
+
+        list->capacity = list->count;
+        if (list->items != NULL) {
+            memcpy(list->items, next, length);
+            next += length;
+            left -= length;
+        }
+
+        // Free blocks are addresses and free runs page numbers, both index the tables
+        uint32_t limit = i < HEAP_CLASS_COUNT ? MEMORY_SIZE : HEAP_PAGE_COUNT;
+        for (uint32_t j = 0; j < list->count && loaded; ++j) {
+            loaded = list->items[j] < limit;
+        }
+    }
+
+    if (!loaded || left != 0) {
+        freeGuestHeap(heap);
+        return NULL;
+    }
+    return heap;
+}
+
+static bool push(AddressList* list, uint32_t address) {
+    if (list->count == list->capacity) {
+        uint32_t capacity = list->capacity < 64 ? 64 : list->capacity * 2;
+        uint32_t* items = realloc(list->items, capacity * sizeof(uint32_t));
+        if (items == NULL) return false;
+
+        list->items = items;
+        list->capacity = capacity;
+    }
+
+    list->items[list->count++] = address;
+    return true;
+}
+
+static void removeAt(AddressList* list, uint32_t index) {
+    list->items[index] = list->items[--list->count];
+}
+
+static uint32_t blockSize(int class) {
+    return HEAP_MIN_BLOCK << class;
+}
+
+static int sizeClass(uint32_t size) {
+    int class = 0;
+    while (class < HEAP_CLASS_COUNT && blockSize(class) < size) class++;
+
+    return class;
+}
+
+static uint32_t carve(GuestHeap* heap, uint32_t* brk, uint32_t limit, uint32_t pages) {
+    uint32_t start = (*brk + MEMORY_PAGE_SIZE - 1) & ~(MEMORY_PAGE_SIZE - 1);
+    if (start > limit || (limit - start) / MEMORY_PAGE_SIZE < pages) return 0;
+
+    *brk = start + pages * MEMORY_PAGE_SIZE;
+    heap->stats.reserved += (uint64_t)pages * MEMORY_PAGE_SIZE;
+    return start;
+}
+
+static void setSlot(GuestHeap* heap, uint32_t address, bool allocated) {
+    uint32_t slot = (address % MEMORY_PAGE_SIZE) / HEAP_MIN_BLOCK;
+    uint8_t* bits = &heap->slots[PAGE_OF(address)][slot / 8];
+
+    *bits = allocated ? *bits | (1 << (slot % 8)) : *bits & ~(1 << (slot % 8));
+}
+
+static bool isSlotAllocated(const GuestHeap* heap, uint32_t address) {
+    uint32_t slot = (address % MEMORY_PAGE_SIZE) / HEAP_MIN_BLOCK;
+    return heap->slots[PAGE_OF(address)][slot / 8] & (1 << (slot % 8));
+}
+
+static uint32_t allocSmall(GuestHeap* heap, uint32_t* brk, uint32_t limit, int class) {
+    AddressList* free = &heap->freeBlocks[class];
+
+    if (free->count == 0) {
+        uint32_t page = carve(heap, brk, limit, 1);
+        if (page == 0) return 0;
+
+        // Pushed backwards so that blocks are handed out in address order
+        heap->kind[PAGE_OF(page)] = KIND_SMALL + class;
+        for (uint32_t offset = MEMORY_PAGE_SIZE; offset > 0; offset -= blockSize(class)) {
+            if (!push(free, page + offset - blockSize(class))) return 0;
+        }
+    }
+
+    uint32_t address = free->items[--free->count];
+    setSlot(heap, address, true);
+    return address;
+}
+
+static void setRun(GuestHeap* heap, uint32_t page, uint32_t pages, uint8_t kind) {
+    heap->kind[page] = kind;
+    heap->runPages[page] = pages;
+}
+
+// First fit among the free runs, split when larger
+static uint32_t allocRun(GuestHeap* heap, uint32_t* brk, uint32_t limit, uint32_t pages) {
+    AddressList* free = &heap->freeRuns;
+    for (uint32_t i = 0; i < free->count; ++i) {
+        uint32_t page = free->items[i];
+        uint32_t available = heap->runPages[page];
+        if (available < pages) continue;
+
+        if (available > pages) {
+            free->items[i] = page + pages;
+            setRun(heap, page + pages, available - pages, KIND_FREE_RUN);
+        } else {
+            removeAt(free, i);
+        }
+
+        setRun(heap, page, pages, KIND_RUN);
+        return page * MEMORY_PAGE_SIZE;
+    }
+
+    uint32_t address = carve(heap, brk, limit, pages);
+    if (address != 0) {
+        setRun(heap, PAGE_OF(address), pages, KIND_RUN);
+    }
+
+    return address;
+}
+
+uint32_t heap_alloc(GuestHeap* heap, uint32_t* brk, uint32_t limit, uint32_t size) {
+    if (size == 0 || size > MEMORY_SIZE) return 0;
+
+    int class = sizeClass(size);
+    uint32_t address = class < HEAP_CLASS_COUNT
+        ? allocSmall(heap, brk, limit, class)
+        : allocRun(heap, brk, limit, (size + MEMORY_PAGE_SIZE - 1) / MEMORY_PAGE_SIZE);
+    if (address == 0) return 0;
+
+    heap->stats.allocations++;
+    heap->stats.requested += size;
+    heap->stats.used += heap_block_size(heap, address);
+    if (heap->stats.used > heap->stats.peak) {
+        heap->stats.peak = heap->stats.used;
+    }
+
+    return address;
+}
+
+uint32_t heap_block_size(const GuestHeap* heap, uint32_t address) {
+    if (address >= MEMORY_SIZE) return 0;
+
+    uint8_t kind = heap->kind[PAGE_OF(address)];
+    if (kind >= KIND_SMALL && kind < KIND_RUN) {
+        uint32_t size = blockSize(kind - KIND_SMALL);
+        return address % size == 0 && isSlotAllocated(heap, address) ? size : 0;
+    }
+
+    if (kind == KIND_RUN && address % MEMORY_PAGE_SIZE == 0) {
+        return heap->runPages[PAGE_OF(address)] * MEMORY_PAGE_SIZE;
+    }
+
+    return 0;
+}
+
+// Merges a freed run with the free runs right before and after it
+static void releaseRun(GuestHeap* heap, uint32_t page) {
+    AddressList* free = &heap->freeRuns;
+    uint32_t pages = heap->runPages[page];
+
+    uint32_t next = page + pages;
+    if (next < HEAP_PAGE_COUNT && heap->kind[next] == KIND_FREE_RUN) {
+        for (uint32_t i = 0; i < free->count; ++i) {
+            if (free->items[i] == next) {
+                removeAt(free, i);
+                break;
+            }
+        }
+        pages += heap->runPages[next];
+        heap->kind[next] = KIND_NONE;
+    }
+
+    for (uint32_t i = 0; i < free->count; ++i) {
+        uint32_t previous = free->items[i];
+        if (previous + heap->runPages[previous] == page) {
+            heap->kind[page] = KIND_NONE;
+            heap->runPages[previous] += pages;
+            return;
+        }
+    }
+
+    setRun(heap, page, pages, KIND_FREE_RUN);
+    push(free, page);
+}
+
+bool heap_free(GuestHeap* heap, uint32_t address) {
+    uint32_t size = heap_block_size(heap, address);
+    if (size == 0) return false;
+
+    uint8_t kind = heap->kind[PAGE_OF(address)];
+    if (kind == KIND_RUN) {
+        releaseRun(heap, PAGE_OF(address));
+    } else {
+        if (!push(&heap->freeBlocks[kind - KIND_SMALL], address)) return false;
+        setSlot(heap, address, false);
+    }
+
+    heap->stats.frees++;
+    heap->stats.used -= size;
+    return true;
+}
@@ -0,0 +1,51 @@
+#ifndef LMIPS_ALLOCATOR
+#define LMIPS_ALLOCATOR
+
+#include "memory.h"
+
+#define HEAP_MIN_BLOCK 16
+#define HEAP_CLASS_COUNT 8 // Blocks of 16 to 2048 bytes, larger ones get whole pages
+#define HEAP_PAGE_COUNT (MEMORY_SIZE / MEMORY_PAGE_SIZE)
+
+typedef struct {
+    uint64_t allocations, frees;
+    uint64_t requested; // Bytes asked for, in total
+    uint64_t used; // Bytes of live allocations once rounded to their block size
+    uint64_t peak; // Highest `used`
+    uint64_t reserved; // Bytes taken from the heap break
+} HeapStats;
+
+typedef struct {
+    uint32_t* items;
+    uint32_t count, capacity;
+} AddressList;
+
+// Native allocator over the guest heap. Its bookkeeping lives on the host so the guest cannot corrupt it:
+// pages taken from the heap break are either split in blocks of a single class or part of a large run.
+typedef struct {
+    uint8_t kind[HEAP_PAGE_COUNT];
+    uint16_t runPages[HEAP_PAGE_COUNT]; // Length of the run starting at a page
+    uint8_t slots[HEAP_PAGE_COUNT][MEMORY_PAGE_SIZE / HEAP_MIN_BLOCK / 8]; // Allocated blocks of small pages
+    AddressList freeBlocks[HEAP_CLASS_COUNT];
+    AddressList freeRuns; // First page of free runs
+    HeapStats stats;
+} GuestHeap;
+
+GuestHeap* newGuestHeap();
+// A separate heap in the same state, NULL when out of memory
+GuestHeap* copyGuestHeap(const GuestHeap* heap);
+void freeGuestHeap(GuestHeap* heap);
+
+// The state as a single buffer to free, for images. NULL when out of memory.
+void* heap_save(const GuestHeap* heap, size_t* size);
+// A heap in the state saved in `bytes`, NULL when they don't hold one or out of memory
+GuestHeap* heap_load(const void* bytes, size_t size);
+
+// Allocations take pages from the break `*brk` up to `limit`. They return 0 when the heap is exhausted.
+uint32_t heap_alloc(GuestHeap* heap, uint32_t* brk, uint32_t limit, uint32_t size);
+// Returns false for addresses that are not live allocations
+bool heap_free(GuestHeap* heap, uint32_t address);
+// Size of the block holding a live allocation, 0 for other addresses
+uint32_t heap_block_size(const GuestHeap* heap, uint32_t address);
+
+#endif //LMIPS_ALLOCATOR
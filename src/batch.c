@@ -0,0 +1,267 @@
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "batch.h"
+#include "image.h"
+#include "loader.h"
+#include "workpool.h"
+
+struct batchimage {
+    char* binary;
+    char* path;
+    bool valid;
+    struct batchimage* next;
+};
+
+void initBatch(Batch* batch) {
+    batch->jobs = NULL;
+    batch->count = 0;
+    batch->capacity = 0;
+    batch->images = NULL;
+    batch->directory = NULL;
+    batch->budget = BATCH_DEFAULT_BUDGET;
+}
+
+void freeBatch(Batch* batch) {
+    for (size_t i = 0; i < batch->count; ++i) {
+        free(batch->jobs[i].binary);
+        free(batch->jobs[i].input);
+        free(batch->jobs[i].output);
+    }
+    free(batch->jobs);
+
+    struct batchimage* image = batch->images;
+    while (image != NULL) {
+        struct batchimage* next = image->next;
+        if (image->valid) unlink(image->path);
+        free(image->binary);
+        free(image->path);
+        free(image);
+        image = next;
+    }
+
+    if (batch->directory != NULL) {
+        rmdir(batch->directory);
+        free(batch->directory);
+    }
+    initBatch(batch);
+}
+
+bool batch_add(Batch* batch, const char* binary, const char* input) {
+    if (batch->count == batch->capacity) {
+        size_t capacity = batch->capacity > 0 ? batch->capacity * 2 : 64;
+        BatchJob* jobs = realloc(batch->jobs, capacity * sizeof(BatchJob));
+        if (jobs == NULL) return false;
+
+        batch->jobs = jobs;
+        batch->capacity = capacity;
+    }
+
+    BatchJob* job = &batch->jobs[batch->count];
+    memset(job, 0, sizeof(BatchJob));
+    job->binary = strdup(binary);
+    job->input = input != NULL ? strdup(input) : NULL;
+    if (job->binary == NULL || (input != NULL && job->input == NULL)) {
+        free(job->binary);
+        free(job->input);
+        return false;
+    }
+
+    batch->count++;
+    return true;
+}
+
+bool batch_read_jobs(Batch* batch, const char* path) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) return false;
+
+    char* line = NULL;
+    size_t size = 0;
+    bool success = true;
+    while (success && getline(&line, &size, file) >= 0) {
+        char* rest;
+        char* binary = strtok_r(line, " \t\r\n", &rest);
+        if (binary == NULL || binary[0] == '#') continue;
+
+        char* input = strtok_r(NULL, " \t\r\n", &rest);
+        success = batch_add(batch, binary, input);
+    }
+
+    free(line);
+    fclose(file);
+    return success;
+}
+
+// Loads the binary once and keeps the result as an image, which every job then maps
+static void buildImage(void* arg) {
+    struct batchimage* image = arg;
+
+    Memory memory;
+    initMemory(&memory);
+    LMips mips;
+    initSimulator(&mips, &memory);
+
+    Executable executable;
+    if (memory.store != NULL && loadExecutable(image->binary, &memory, &executable) == LOAD_SUCCESS) {
+        waitExecutable(&executable);
+        mips.ip = executable.entry;
+        image->valid = image_write(image->path, NULL, &mips, NULL);
+        freeExecutable(&executable);
+    }
+
+    freeSimulator(&mips);
+    freeMemory(&memory);
+}
+
+BatchStatus batch_status(const LMips* mips, ExecutionResult result) {
+    if (result == EXEC_BREAKPOINT && mips->icount >= mips->stopCount) return BATCH_BUDGET;
+
+    switch (result) {
+        case EXEC_SUCCESS: return BATCH_EXITED;
+        case EXEC_ERR_MEMORY_ADDR: return BATCH_FAULT_MEMORY;
+        case EXEC_ERR_INT_OVERFLOW: return BATCH_FAULT_OVERFLOW;
+        default: return BATCH_FAULT;
+    }
+}
+
+static void runJob(void* arg) {
+    BatchJob* job = arg;
+    if (!job->image->valid) {
+        job->status = BATCH_ERR_LOAD;
+        return;
+    }
+
+    int input = job->input != NULL ? open(job->input, O_RDONLY) : -1;
+    if (job->input != NULL && input < 0) {
+        job->status = BATCH_ERR_INPUT;
+        return;
+    }
+
+    Memory memory;
+    initMemory(&memory);
+    LMips mips;
+    initSimulator(&mips, &memory);
+
+    if (memory.store == NULL || !image_map(job->image->path, NULL, &memory, &mips, NULL)) {
+        job->status = BATCH_ERR_LOAD;
+    } else {
+        Stream stream;
+        initFdStream(&stream, input);
+        lmips_set_input(&mips, &stream);
+        initBufferStream(&stream, NULL, 0);
+        mips.console.mode = CONSOLE_FULLY_BUFFERED;
+        lmips_set_output(&mips, &stream);
+        mips.stopCount = job->budget > UINT64_MAX - mips.icount ? UINT64_MAX : mips.icount + job->budget;
+
+        job->status = batch_status(&mips, executeSimulator(&mips));
+        job->icount = mips.icount;
+        job->output = stream_release(&mips.console.stream, &job->outputSize);
+    }
+
+    freeSimulator(&mips);
+    freeMemory(&memory);
+    if (input >= 0) close(input);
+}
+
+static struct batchimage* findImage(Batch* batch, const char* binary) {
+    for (struct batchimage* image = batch->images; image != NULL; image = image->next) {
+        if (strcmp(image->binary, binary) == 0) return image;
+    }
+
+    return NULL;
+}
+
+static bool collectImages(Batch* batch) {
+    int count = 0;
+    for (size_t i = 0; i < batch->count; ++i) {
+        BatchJob* job = &batch->jobs[i];
+        job->image = findImage(batch, job->binary);
+        if (job->image != NULL) continue;
+
+        struct batchimage* image = calloc(1, sizeof(struct batchimage));
+        size_t length = strlen(batch->directory) + 16;
+        char* path = malloc(length);
+        if (image == NULL || path == NULL || (image->binary = strdup(job->binary)) == NULL) {
+            free(image);
+            free(path);
+            return false;
+        }
+
+        snprintf(path, length, "%s/%d.img", batch->directory, count++);
+        image->path = path;
+        image->next = batch->images;
+        batch->images = image;
+        job->image = image;
+    }
+
+    return true;
+}
+
+bool batch_run(Batch* batch, int threads) {
+    const char* temp = getenv("TMPDIR");
+    temp = temp != NULL ? temp : "/tmp";
+    size_t length = strlen(temp) + 24;
+    batch->directory = malloc(length);
+    if (batch->directory == NULL) return false;
+
+    snprintf(batch->directory, length, "%s/lmips_batch_XXXXXX", temp);
+    if (mkdtemp(batch->directory) == NULL) {
+        free(batch->directory);
+        batch->directory = NULL;
+        return false;
+    }
+
+    WorkPool pool;
+    if (!collectImages(batch)) return false;
+    if (!initWorkPool(&pool, threads)) {
+        freeWorkPool(&pool);
+        return false;
+    }
+
+    // Images first, so that no job waits on a binary being loaded by another worker
+    bool submitted = true;
+    for (struct batchimage* image = batch->images; submitted && image != NULL; image = image->next) {
+        submitted = workpool_submit(&pool, buildImage, image);
+    }
+    workpool_wait(&pool);
+
+    for (size_t i = 0; submitted && i < batch->count; ++i) {
+        batch->jobs[i].budget = batch->budget;
+        submitted = workpool_submit(&pool, runJob, &batch->jobs[i]);
+    }
+
+    freeWorkPool(&pool);
+    return submitted;
+}
+
+const char* batch_status_name(BatchStatus status) {
+    switch (status) {
+        case BATCH_PENDING: return "pending";
+        case BATCH_EXITED: return "exited";
+        case BATCH_FAULT_MEMORY: return "memory-fault";
+        case BATCH_FAULT_OVERFLOW: return "overflow";
+        case BATCH_FAULT: return "fault";
+        case BATCH_BUDGET: return "budget";
+        case BATCH_ERR_LOAD: return "load-error";
+        case BATCH_ERR_INPUT: return "input-error";
+    }
+
+    return "unknown";
+}
+
+bool batch_write_results(const Batch* batch, FILE* file) {
+    for (size_t i = 0; i < batch->count; ++i) {
+        const BatchJob* job = &batch->jobs[i];
+        fprintf(file, "%zu %s %llu %zu %s%s%s\n", i, batch_status_name(job->status),
+                (unsigned long long)job->icount, job->outputSize, job->binary,
+                job->input != NULL ? " " : "", job->input != NULL ? job->input : "");
+
+        if (job->outputSize > 0) {
+            fwrite(job->output, 1, job->outputSize, file);
+        }
+        fputc('\n', file);
+    }
+
+    return fflush(file) == 0 && !ferror(file);
+}
@@ -0,0 +1,57 @@
+#ifndef LMIPS_BATCH
+#define LMIPS_BATCH
+
+#include <stdio.h>
+#include "lmips.h"
+
+#define BATCH_DEFAULT_BUDGET 1000000000 // Instructions a job may run before it is stopped
+
+typedef enum {
+    BATCH_PENDING,
+    BATCH_EXITED,
+    BATCH_FAULT_MEMORY,
+    BATCH_FAULT_OVERFLOW,
+    BATCH_FAULT, // Unknown instruction or syscall
+    BATCH_BUDGET, // Stopped after its instruction budget
+    BATCH_ERR_LOAD, // The binary is not a valid executable
+    BATCH_ERR_INPUT // The input file can't be opened
+} BatchStatus;
+
+typedef struct {
+    char* binary;
+    char* input; // NULL when the job reads nothing
+    struct batchimage* image;
+    BatchStatus status;
+    uint64_t budget;
+    uint64_t icount;
+    uint8_t* output;
+    size_t outputSize;
+} BatchJob;
+
+// Jobs of the same binary share a single loaded image, mapped copy on write by each of them
+typedef struct {
+    BatchJob* jobs;
+    size_t count, capacity;
+    struct batchimage* images;
+    char* directory; // Where the images are written during batch_run
+    uint64_t budget; // Given to every job by batch_run
+} Batch;
+
+void initBatch(Batch* batch);
+void freeBatch(Batch* batch);
+
+bool batch_add(Batch* batch, const char* binary, const char* input);
+// One "binary [input]" job per line, blank lines and lines starting with # are skipped
+bool batch_read_jobs(Batch* batch, const char* path);
+
+// Runs every job in its own VM on a work stealing pool of `threads` workers
+bool batch_run(Batch* batch, int threads);
+
+// For every job in order, a "<index> <status> <icount> <output size> <binary> [input]" line
+// followed by the output and a new line
+bool batch_write_results(const Batch* batch, FILE* file);
+const char* batch_status_name(BatchStatus status);
+// How a job ended given the result of its run, BATCH_BUDGET once it reached its stopCount
+BatchStatus batch_status(const LMips* mips, ExecutionResult result);
+
+#endif //LMIPS_BATCH
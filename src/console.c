@@ -0,0 +1,284 @@
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "console.h"
+
+// The writer is only woken up for a batch this large, otherwise it polls the ring
+#define WAKE_THRESHOLD CONSOLE_BUFFER_SIZE
+#define POLL_INTERVAL_NS (10 * 1000 * 1000)
+
+// Single producer (the guest) single consumer (the writer thread) ring. Bytes only go through
+// atomics, the lock is only taken by a side that has to sleep or wake the other one up.
+struct consolewriter {
+    Stream* stream;
+    char* ring;
+    _Atomic uint64_t head; // Bytes ever appended, only moved by the guest
+    _Atomic uint64_t tail; // Bytes ever written out, only moved by the writer
+    _Atomic bool guestWaiting;
+    _Atomic bool writerWaiting;
+    bool stop;
+    pthread_mutex_t lock;
+    pthread_cond_t readable;
+    pthread_cond_t writable;
+    pthread_t thread;
+    uint64_t highWater;
+    uint64_t stalls;
+};
+
+static void wake(struct consolewriter* writer, _Atomic bool* waiting, pthread_cond_t* condition) {
+    if (atomic_load(waiting)) {
+        pthread_mutex_lock(&writer->lock);
+        pthread_cond_signal(condition);
+        pthread_mutex_unlock(&writer->lock);
+    }
+}
+
+static void* writerMain(void* arg) {
+    struct consolewriter* writer = arg;
+
+    for (;;) {
+        uint64_t tail = atomic_load_explicit(&writer->tail, memory_order_relaxed);
+        uint64_t head = atomic_load_explicit(&writer->head, memory_order_acquire);
+
+        if (head == tail) {
+            // The flag is raised before checking the head again so that the guest can't miss it
+            pthread_mutex_lock(&writer->lock);
+            atomic_store(&writer->writerWaiting, true);
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += POLL_INTERVAL_NS;
+            if (deadline.tv_nsec >= 1000000000) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000;
+            }
+
+            while ((head = atomic_load(&writer->head)) == tail && !writer->stop) {
+                if (pthread_cond_timedwait(&writer->readable, &writer->lock, &deadline) != 0) break;
+            }
+            atomic_store(&writer->writerWaiting, false);
+            bool stop = writer->stop;
+            pthread_mutex_unlock(&writer->lock);
+
+            if (head == tail) {
+                if (stop) break;
+                continue;
+            }
+        }
+
+        // Everything pending goes out at once, in two pieces when it wraps around
+        uint32_t start = tail & (CONSOLE_RING_SIZE - 1);
+        uint64_t size = head - tail;
+        uint64_t first = CONSOLE_RING_SIZE - start < size ? CONSOLE_RING_SIZE - start : size;
+        struct iovec pieces[2] = {
+            {.iov_base = &writer->ring[start], .iov_len = first},
+            {.iov_base = writer->ring, .iov_len = size - first},
+        };
+
+        ssize_t written = stream_writev(writer->stream, pieces, size > first ? 2 : 1);
+        if (written < 0 && errno == EINTR) continue;
+        if (written < 0 && errno == EAGAIN && writer->stream->type == STREAM_FD) {
+            // Non-blocking outputs are waited for rather than dropped
+            struct pollfd output = {.fd = writer->stream->fd, .events = POLLOUT};
+            poll(&output, 1, -1);
+            continue;
+        }
+
+        // Guest output is lost on real errors, like with a closed stdout
+        uint64_t done = written > 0 ? (uint64_t)written : size;
+
+        atomic_store(&writer->tail, tail + done);
+        wake(writer, &writer->guestWaiting, &writer->writable);
+    }
+
+    return NULL;
+}
+
+// Blocks the guest until at most `pending` bytes are left in the ring
+static void waitWriter(struct consolewriter* writer, uint64_t pending) {
+    uint64_t head = atomic_load_explicit(&writer->head, memory_order_relaxed);
+    wake(writer, &writer->writerWaiting, &writer->readable);
+
+    pthread_mutex_lock(&writer->lock);
+    atomic_store(&writer->guestWaiting, true);
+    while (head - atomic_load(&writer->tail) > pending) {
+        pthread_cond_wait(&writer->writable, &writer->lock);
+    }
+    atomic_store(&writer->guestWaiting, false);
+    pthread_mutex_unlock(&writer->lock);
+}
+
+static void ringWrite(struct consolewriter* writer, const char* bytes, size_t size) {
+    while (size > 0) {
+        uint64_t head = atomic_load_explicit(&writer->head, memory_order_relaxed);
+        uint64_t used = head - atomic_load_explicit(&writer->tail, memory_order_acquire);
+        if (used == CONSOLE_RING_SIZE) {
+            writer->stalls++;
+            waitWriter(writer, CONSOLE_RING_SIZE - 1);
+            continue;
+        }
+
+        size_t space = CONSOLE_RING_SIZE - used;
+        size_t count = size < space ? size : space;
+        uint32_t start = head & (CONSOLE_RING_SIZE - 1);
+        size_t first = CONSOLE_RING_SIZE - start < count ? CONSOLE_RING_SIZE - start : count;
+
+        memcpy(&writer->ring[start], bytes, first);
+        memcpy(writer->ring, bytes + first, count - first);
+        atomic_store(&writer->head, head + count);
+
+        if (used + count > writer->highWater) {
+            writer->highWater = used + count;
+        }
+
+        bytes += count;
+        size -= count;
+        if (used < WAKE_THRESHOLD && used + count >= WAKE_THRESHOLD) {
+            wake(writer, &writer->writerWaiting, &writer->readable);
+        }
+    }
+}
+
+static struct consolewriter* startWriter(Stream* stream) {
+    struct consolewriter* writer = calloc(1, sizeof(struct consolewriter));
+    if (writer == NULL) return NULL;
+
+    writer->stream = stream;
+    writer->ring = malloc(CONSOLE_RING_SIZE);
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->readable, NULL);
+    pthread_cond_init(&writer->writable, NULL);
+
+    if (writer->ring == NULL || pthread_create(&writer->thread, NULL, writerMain, writer) != 0) {
+        pthread_mutex_destroy(&writer->lock);
+        pthread_cond_destroy(&writer->readable);
+        pthread_cond_destroy(&writer->writable);
+        free(writer->ring);
+        free(writer);
+        return NULL;
+    }
+
+    return writer;
+}
+
+static void stopWriter(struct consolewriter* writer) {
+    // The writer drains the ring before leaving
+    pthread_mutex_lock(&writer->lock);
+    writer->stop = true;
+    pthread_cond_signal(&writer->readable);
+    pthread_mutex_unlock(&writer->lock);
+    pthread_join(writer->thread, NULL);
+
+    pthread_mutex_destroy(&writer->lock);
+    pthread_cond_destroy(&writer->readable);
+    pthread_cond_destroy(&writer->writable);
+    free(writer->ring);
+    free(writer);
+}
+
+void initConsole(Console* console, int fd, ConsoleMode mode) {
+    Stream stream;
+    initFdStream(&stream, fd);
+    initConsoleStream(console, &stream, mode);
+}
+
+void initConsoleStream(Console* console, const Stream* stream, ConsoleMode mode) {
+    console->stream = *stream;
+    console->mode = mode;
+    console->length = 0;
+    console->writer = NULL;
+
+    if (mode == CONSOLE_ASYNC) {
+        console->writer = startWriter(&console->stream);
+        if (console->writer == NULL) {
+            console->mode = CONSOLE_FULLY_BUFFERED;
+        }
+    }
+}
+
+void freeConsole(Console* console) {
+    console_flush(console);
+    if (console->writer != NULL) {
+        stopWriter(console->writer);
+        console->writer = NULL;
+    }
+    freeStream(&console->stream);
+}
+
+void console_flush(Console* console) {
+    // Waits for the writer so that the output is out before reading input or reporting a fault
+    if (console->writer != NULL) {
+        waitWriter(console->writer, 0);
+        return;
+    }
+
+    const char* bytes = console->buffer;
+    uint32_t size = console->length;
+    while (size > 0) {
+        ssize_t written = stream_write(&console->stream, bytes, size);
+        if (written <= 0) break; // Guest output is lost like with a closed stdout
+
+        bytes += written;
+        size -= written;
+    }
+
+    console->length = 0;
+}
+
+void console_write(Console* console, const char* bytes, size_t size) {
+    if (console->writer != NULL) {
+        ringWrite(console->writer, bytes, size);
+        return;
+    }
+
+    bool newLine = console->mode == CONSOLE_LINE_BUFFERED && memchr(bytes, '\n', size) != NULL;
+
+    while (size > 0) {
+        size_t space = CONSOLE_BUFFER_SIZE - console->length;
+        size_t count = size < space ? size : space;
+
+        memcpy(&console->buffer[console->length], bytes, count);
+        console->length += count;
+        bytes += count;
+        size -= count;
+
+        if (console->length == CONSOLE_BUFFER_SIZE) {
+            console_flush(console);
+        }
+    }
+
+    if (newLine) {
+        console_flush(console);
+    }
+}
+
+void console_write_int(Console* console, int32_t value) {
+    char digits[11];
+    int start = sizeof(digits);
+
+    // Negated as unsigned so that INT32_MIN doesn't overflow
+    uint32_t magnitude = value < 0 ? 0u - (uint32_t)value : (uint32_t)value;
+    do {
+        digits[--start] = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude > 0);
+
+    if (value < 0) {
+        digits[--start] = '-';
+    }
+
+    console_write(console, &digits[start], sizeof(digits) - start);
+}
+
+bool console_stats(const Console* console, ConsoleStats* stats) {
+    if (console->writer == NULL) return false;
+
+    stats->highWater = console->writer->highWater;
+    stats->stalls = console->writer->stalls;
+    stats->capacity = CONSOLE_RING_SIZE;
+    return true;
+}
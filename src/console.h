@@ -0,0 +1,43 @@
+#ifndef LMIPS_CONSOLE
+#define LMIPS_CONSOLE
+
+#include <stddef.h>
+#include "common.h"
+#include "stream.h"
+
+#define CONSOLE_BUFFER_SIZE 4096
+#define CONSOLE_RING_SIZE (1u << 20) // Power of two
+
+typedef enum {
+    CONSOLE_LINE_BUFFERED, // Flushed at every new line, for interactive use
+    CONSOLE_FULLY_BUFFERED, // Flushed only when full
+    CONSOLE_ASYNC // Handed to a writer thread, the guest only waits when it is too far behind
+} ConsoleMode;
+
+typedef struct {
+    uint64_t highWater; // Most bytes ever waiting in the ring
+    uint64_t stalls; // Times the guest waited for room in the ring
+    uint32_t capacity;
+} ConsoleStats;
+
+// Guest output, buffered per VM and written with a single write(2) per flush
+typedef struct {
+    Stream stream;
+    ConsoleMode mode;
+    uint32_t length;
+    char buffer[CONSOLE_BUFFER_SIZE];
+    struct consolewriter* writer; // CONSOLE_ASYNC only
+} Console;
+
+// Falls back to CONSOLE_FULLY_BUFFERED when the writer thread can't be started
+void initConsole(Console* console, int fd, ConsoleMode mode);
+// Takes ownership of `stream`. Callbacks are called by the writer thread in CONSOLE_ASYNC mode.
+void initConsoleStream(Console* console, const Stream* stream, ConsoleMode mode);
+void freeConsole(Console* console);
+
+void console_flush(Console* console);
+void console_write(Console* console, const char* bytes, size_t size);
+void console_write_int(Console* console, int32_t value);
+bool console_stats(const Console* console, ConsoleStats* stats);
+
+#endif //LMIPS_CONSOLE
@@ -0,0 +1,151 @@
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "debuginfo.h"
+
+#define SYMBOL_ENTRY_SIZE 12
+#define LINE_ENTRY_SIZE 8
+
+static uint32_t read_be32(const uint8_t* bytes) {
+    return ((uint32_t)bytes[0] << 24) | (bytes[1] << 16) | (bytes[2] << 8) | bytes[3];
+}
+
+void initDebugInfo(DebugInfo* debug, const char* path) {
+    memset(debug, 0, sizeof(DebugInfo));
+    debug->path = path != NULL ? strdup(path) : NULL;
+}
+
+void freeDebugInfo(DebugInfo* debug) {
+    if (debug->map != NULL) {
+        munmap(debug->map, debug->mapSize);
+    }
+
+    free(debug->path);
+    memset(debug, 0, sizeof(DebugInfo));
+}
+
+static bool validSymtab(const uint8_t* symtab, uint32_t size) {
+    if (size < 4) return false;
+
+    uint64_t count = read_be32(symtab);
+    uint64_t names = 4 + count * SYMBOL_ENTRY_SIZE;
+
+    // Names must exist and the last one must be terminated
+    return names <= size && (count == 0 || (names < size && symtab[size - 1] == '\0'));
+}
+
+static bool validLines(const uint8_t* lines, uint32_t size) {
+    return size >= 4 && 4 + (uint64_t)read_be32(lines) * LINE_ENTRY_SIZE <= size;
+}
+
+// Maps the part of the file spanning both sections, once
+static bool mapDebugInfo(DebugInfo* debug) {
+    if (debug->map != NULL) return true;
+    if (debug->failed || debug->path == NULL) return false;
+    debug->failed = true;
+
+    uint32_t start = UINT32_MAX;
+    uint64_t end = 0;
+    if (debug->symtabSize > 0) {
+        start = debug->symtabOffset;
+        end = (uint64_t)debug->symtabOffset + debug->symtabSize;
+    }
+    if (debug->linesSize > 0) {
+        start = debug->linesOffset < start ? debug->linesOffset : start;
+        uint64_t linesEnd = (uint64_t)debug->linesOffset + debug->linesSize;
+        end = linesEnd > end ? linesEnd : end;
+    }
+    if (end == 0) return false;
+
+    int fd = open(debug->path, O_RDONLY);
+    if (fd < 0) return false;
+
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t base = start - (start % page);
+    size_t size = end - base;
+    void* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, base);
+    close(fd);
+
+    if (map == MAP_FAILED) return false;
+
+    debug->map = map;
+    debug->mapSize = size;
+    if (debug->symtabSize > 0 && validSymtab(debug->map + (debug->symtabOffset - base), debug->symtabSize)) {
+        debug->symtab = debug->map + (debug->symtabOffset - base);
+    }
+    if (debug->linesSize > 0 && validLines(debug->map + (debug->linesOffset - base), debug->linesSize)) {
+        debug->lines = debug->map + (debug->linesOffset - base);
+    }
+
+    debug->failed = false;
+    return true;
+}
+
+static void getSymbol(DebugInfo* debug, uint32_t index, Symbol* symbol) {
+    uint32_t count = read_be32(debug->symtab);
+    const uint8_t* entry = debug->symtab + 4 + index * SYMBOL_ENTRY_SIZE;
+    const char* names = (const char*)debug->symtab + 4 + count * SYMBOL_ENTRY_SIZE;
+    uint32_t namesSize = debug->symtabSize - (4 + count * SYMBOL_ENTRY_SIZE);
+    uint32_t name = read_be32(entry + 4);
+
+    symbol->address = read_be32(entry);
+    symbol->name = name < namesSize ? names + name : "";
+    symbol->segment = (SymbolSegment)entry[8];
+}
+
+bool debug_find_symbol(DebugInfo* debug, SymbolSegment segment, uint32_t address, Symbol* symbol) {
+    if (!mapDebugInfo(debug) || debug->symtab == NULL) return false;
+
+    // Find the last symbol ordered before or at (segment, address)
+    uint64_t key = ((uint64_t)segment << 32) | address;
+    uint32_t low = 0, high = read_be32(debug->symtab);
+    while (low < high) {
+        uint32_t mid = low + ((high - low) >> 1);
+        const uint8_t* entry = debug->symtab + 4 + mid * SYMBOL_ENTRY_SIZE;
+        uint64_t current = ((uint64_t)entry[8] << 32) | read_be32(entry);
+
+        if (current <= key) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    if (low == 0) return false;
+
+    getSymbol(debug, low - 1, symbol);
+    return symbol->segment == segment;
+}
+
+bool debug_find_symbol_by_name(DebugInfo* debug, const char* name, Symbol* symbol) {
+    if (!mapDebugInfo(debug) || debug->symtab == NULL) return false;
+
+    uint32_t count = read_be32(debug->symtab);
+    for (uint32_t i = 0; i < count; ++i) {
+        getSymbol(debug, i, symbol);
+        if (strcmp(symbol->name, name) == 0) return true;
+    }
+
+    return false;
+}
+
+bool debug_find_line(DebugInfo* debug, uint32_t address, uint32_t* line) {
+    if (!mapDebugInfo(debug) || debug->lines == NULL) return false;
+
+    uint32_t low = 0, high = read_be32(debug->lines);
+    while (low < high) {
+        uint32_t mid = low + ((high - low) >> 1);
+        if (read_be32(debug->lines + 4 + mid * LINE_ENTRY_SIZE) <= address) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    if (low == 0) return false;
+
+    *line = read_be32(debug->lines + 4 + (low - 1) * LINE_ENTRY_SIZE + 4);
+    return true;
+}
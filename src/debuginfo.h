@@ -0,0 +1,43 @@
+#ifndef LMIPS_DEBUGINFO
+#define LMIPS_DEBUGINFO
+
+#include <stddef.h>
+#include "common.h"
+
+// Mirrors the assembler's Segment enum
+typedef enum {
+    SEGMENT_TEXT,
+    SEGMENT_DATA,
+    SEGMENT_UNDEF
+} SymbolSegment;
+
+typedef struct {
+    const char* name;
+    uint32_t address; // Offset from the beginning of its segment
+    SymbolSegment segment;
+} Symbol;
+
+// Symbol and line tables of an executable. Nothing is read at load time, the
+// sections are only mapped from the file the first time they are queried.
+typedef struct {
+    char* path;
+    uint32_t symtabOffset;
+    uint32_t symtabSize;
+    uint32_t linesOffset;
+    uint32_t linesSize;
+
+    uint8_t* map;
+    size_t mapSize;
+    const uint8_t* symtab;
+    const uint8_t* lines;
+    bool failed;
+} DebugInfo;
+
+void initDebugInfo(DebugInfo* debug, const char* path);
+void freeDebugInfo(DebugInfo* debug);
+
+bool debug_find_symbol(DebugInfo* debug, SymbolSegment segment, uint32_t address, Symbol* symbol);
+bool debug_find_symbol_by_name(DebugInfo* debug, const char* name, Symbol* symbol);
+bool debug_find_line(DebugInfo* debug, uint32_t address, uint32_t* line);
+
+#endif //LMIPS_DEBUGINFO
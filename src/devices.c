@@ -0,0 +1,47 @@
+#include "devices.h"
+#include "harts.h"
+
+static void transmit(LMips* mips) {
+    console_write(&mips->console, (const char*)&mips->memory->store[DEVICE_CONSOLE_BUFFER], mips->transmitted);
+    mips->transmitted = 0;
+}
+
+// `mips` is hart 0, which owns the console
+static bool store(LMips* mips, uint32_t address, uint32_t size, uint32_t value) {
+    // Any store to the doorbell rings it, the value is not used
+    if (address == DEVICE_CONSOLE_DOORBELL) {
+        transmit(mips);
+        return true;
+    }
+
+    if (address < DEVICE_CONSOLE_BUFFER || address >= DEVICE_CONSOLE_DOORBELL ||
+        DEVICE_CONSOLE_DOORBELL - address < size) {
+        return false;
+    }
+
+    // The buffer lives in the unused page below the program, big-endian like the rest of the memory
+    switch (size) {
+        case 1: mem_write_byte(mips->memory, address, value); break;
+        case 2: mem_write_half(mips->memory, address, value); break;
+        default: mem_write(mips->memory, address, value); break;
+    }
+
+    uint32_t end = address + size - DEVICE_CONSOLE_BUFFER;
+    if (end > mips->transmitted) {
+        mips->transmitted = end;
+    }
+    if (mips->transmitted == DEVICE_CONSOLE_BUFFER_SIZE) {
+        transmit(mips);
+    }
+
+    return true;
+}
+
+bool device_store(LMips* mips, uint32_t address, uint32_t size, uint32_t value) {
+    // Every hart rings the same device
+    hart_lock(mips);
+    bool stored = store(mips->process, address, size, value);
+    hart_unlock(mips);
+
+    return stored;
+}
@@ -0,0 +1,16 @@
+#ifndef LMIPS_DEVICES
+#define LMIPS_DEVICES
+
+#include "lmips.h"
+
+// Console device : bytes stored in the transmit buffer are printed when the doorbell is written,
+// or as soon as the buffer is full
+#define DEVICE_CONSOLE_BUFFER MMIO_ADDRESS
+#define DEVICE_CONSOLE_DOORBELL (MMIO_ADDRESS + MMIO_SIZE - 4)
+#define DEVICE_CONSOLE_BUFFER_SIZE (DEVICE_CONSOLE_DOORBELL - DEVICE_CONSOLE_BUFFER)
+
+// Stores `size` bytes of `value` to a device register, false when nothing is mapped at `address`.
+// Only reached by stores outside of the guest memory, regular stores never pay for it.
+bool device_store(LMips* mips, uint32_t address, uint32_t size, uint32_t value);
+
+#endif //LMIPS_DEVICES
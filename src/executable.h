@@ -17,7 +17,10 @@ typedef enum {
     SHT_NULL,
     SHT_EXEC,
     SHT_STRTAB,
-    SHT_ALLOC = 0x04
+    SHT_ALLOC = 0x04,
+    SHT_SYMTAB = 0x08,
+    SHT_LINES = 0x10,
+    SHT_REL = 0x20
 } SectionType;
 
 typedef struct {
@@ -0,0 +1,145 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "files.h"
+
+#ifdef SYS_openat2
+#include <linux/openat2.h>
+#endif
+
+#define FIRST_GUEST_FD 3
+
+void initFileTable(FileTable* files) {
+    files->root = -1;
+    for (int i = 0; i < GUEST_FILE_COUNT; ++i) {
+        files->fds[i] = -1;
+    }
+}
+
+void freeFileTable(FileTable* files) {
+    for (int i = FIRST_GUEST_FD; i < GUEST_FILE_COUNT; ++i) {
+        if (files->fds[i] >= 0) close(files->fds[i]);
+    }
+    if (files->root >= 0) close(files->root);
+
+    initFileTable(files);
+}
+
+bool files_set_root(FileTable* files, const char* directory) {
+    int root = open(directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (root < 0) return false;
+
+    if (files->root >= 0) close(files->root);
+    files->root = root;
+    return true;
+}
+
+bool files_reopen(FileTable* copy, const FileTable* files) {
+    initFileTable(copy);
+    bool reopened = files->root < 0 || (copy->root = fcntl(files->root, F_DUPFD_CLOEXEC, 0)) >= 0;
+
+    for (int i = FIRST_GUEST_FD; reopened && i < GUEST_FILE_COUNT; ++i) {
+        if (files->fds[i] < 0) continue;
+
+        // Going through /proc opens a new description of the same file, a dup would share its offset
+        char path[32];
+        snprintf(path, sizeof(path), "/proc/self/fd/%d", files->fds[i]);
+        int flags = fcntl(files->fds[i], F_GETFL);
+        off_t offset = lseek(files->fds[i], 0, SEEK_CUR);
+        copy->fds[i] = flags >= 0 ? open(path, (flags & (O_ACCMODE | O_APPEND)) | O_CLOEXEC) : -1;
+        reopened = copy->fds[i] >= 0 && (offset < 0 || lseek(copy->fds[i], offset, SEEK_SET) == offset);
+    }
+
+    if (!reopened) {
+        freeFileTable(copy);
+    }
+    return reopened;
+}
+
+// Without openat2, the path is walked one component at a time without following any symbolic link, so neither
+// `..`, an absolute path nor a link anywhere in the path can leave the root
+static int openWalking(int root, const char* path, int flags) {
+    if (path[0] == '/' || path[0] == '\0') {
+        errno = EPERM;
+        return -1;
+    }
+
+    int directory = root;
+    int fd = -1;
+    for (const char* component = path; component != NULL;) {
+        const char* end = strchr(component, '/');
+        size_t length = end != NULL ? (size_t)(end - component) : strlen(component);
+        char name[NAME_MAX + 1];
+        if (length > NAME_MAX || (length == 2 && component[0] == '.' && component[1] == '.')) {
+            errno = length > NAME_MAX ? ENAMETOOLONG : EPERM;
+            fd = -1;
+            break;
+        }
+        memcpy(name, component, length);
+        name[length] = '\0';
+
+        // Repeated and trailing slashes
+        component = end != NULL ? end + 1 : NULL;
+        if (length == 0 && component != NULL) continue;
+
+        bool last = component == NULL || *component == '\0';
+        fd = last ? openat(directory, length > 0 ? name : ".", flags | O_NOFOLLOW, 0644)
+                  : openat(directory, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (directory != root) close(directory);
+        if (fd < 0 || last) break;
+        directory = fd;
+    }
+
+    return fd;
+}
+
+static int openBeneath(int root, const char* path, int flags) {
+#ifdef SYS_openat2
+    struct open_how how = {};
+    how.flags = flags;
+    how.mode = (flags & O_CREAT) ? 0644 : 0; // openat2 refuses a mode it would not use
+    how.resolve = RESOLVE_BENEATH | RESOLVE_NO_MAGICLINKS;
+
+    int fd = syscall(SYS_openat2, root, path, &how, sizeof(how));
+    if (fd >= 0 || (errno != ENOSYS && errno != EPERM)) return fd;
+#endif
+
+    return openWalking(root, path, flags);
+}
+
+int32_t files_open(FileTable* files, const char* path, uint32_t flags) {
+    if (files->root < 0) return -1;
+
+    int hostFlags;
+    switch (flags) {
+        case 0: hostFlags = O_RDONLY; break;
+        case 1: hostFlags = O_WRONLY | O_CREAT | O_TRUNC; break;
+        case 9: hostFlags = O_WRONLY | O_CREAT | O_APPEND; break;
+        default: return -1;
+    }
+
+    for (int i = FIRST_GUEST_FD; i < GUEST_FILE_COUNT; ++i) {
+        if (files->fds[i] < 0) {
+            files->fds[i] = openBeneath(files->root, path, hostFlags | O_CLOEXEC);
+            return files->fds[i] >= 0 ? i : -1;
+        }
+    }
+
+    return -1;
+}
+
+int files_host_fd(const FileTable* files, uint32_t fd) {
+    return fd >= FIRST_GUEST_FD && fd < GUEST_FILE_COUNT ? files->fds[fd] : -1;
+}
+
+bool files_close(FileTable* files, uint32_t fd) {
+    int host = files_host_fd(files, fd);
+    if (host < 0) return false;
+
+    files->fds[fd] = -1;
+    return close(host) == 0;
+}
@@ -0,0 +1,26 @@
+#ifndef LMIPS_FILES
+#define LMIPS_FILES
+
+#include "common.h"
+
+#define GUEST_FILE_COUNT 32
+
+// Guest file descriptors opened by SYS_OPEN. 0 to 2 are the console and never reach this table.
+typedef struct {
+    int root; // Directory every guest path is resolved beneath, -1 when file syscalls are disabled
+    int fds[GUEST_FILE_COUNT];
+} FileTable;
+
+void initFileTable(FileTable* files);
+void freeFileTable(FileTable* files);
+
+bool files_set_root(FileTable* files, const char* directory);
+// `copy` gets the root of `files` and its files opened again, at the same offsets but each with an offset of its own
+bool files_reopen(FileTable* copy, const FileTable* files);
+
+// Returns the guest fd, or -1. Flags are the MARS ones : 0 read, 1 write, 9 append.
+int32_t files_open(FileTable* files, const char* path, uint32_t flags);
+int files_host_fd(const FileTable* files, uint32_t fd);
+bool files_close(FileTable* files, uint32_t fd);
+
+#endif //LMIPS_FILES
@@ -0,0 +1,430 @@
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "fuzzer.h"
+#include "lmips_opcodes.h"
+#include "syscalls.h"
+
+#define CHUNK 64 // Executions claimed at a time by a worker
+#define INITIAL_CAPACITY 64
+#define TRACE_BLOCK 64
+
+typedef struct {
+    Fuzzer* fuzzer;
+    pthread_t thread;
+    Memory memory;
+    LMips mips;
+    uint8_t trace[COVERAGE_SIZE];
+    uint64_t random;
+    uint8_t* input;
+    size_t size, position;
+    FileTable files; // The target's files, each run gets duplicates of them
+    off_t offsets[GUEST_FILE_COUNT];
+} Worker;
+
+// The first read stops the program before it runs, EXEC_BREAKPOINT tells it apart from the other syscalls
+static ExecutionResult stopAtRead(LMips* mips) {
+    mips->ip -= 4;
+    mips->icount--;
+    return EXEC_BREAKPOINT;
+}
+
+static bool isRead(const LMips* mips) {
+    uint32_t code = mips->regs[$v0];
+    return code == SYS_READ_INT || code == SYS_READ_STRING || (code == SYS_READ && mips->regs[$a0] == 0);
+}
+
+static ExecutionResult stopAtInputRead(LMips* mips) {
+    return mips->regs[$a0] == 0 ? stopAtRead(mips) : sys_read(mips);
+}
+
+bool initFuzzer(Fuzzer* fuzzer, LMips* mips) {
+    memset(fuzzer, 0, sizeof(Fuzzer));
+    fuzzer->target = mips;
+    fuzzer->budget = FUZZ_DEFAULT_BUDGET;
+    fuzzer->maxSize = FUZZ_DEFAULT_MAX_SIZE;
+    fuzzer->seed = 1;
+    pthread_mutex_init(&fuzzer->lock, NULL);
+
+    SyscallHandler syscalls[SYSCALL_COUNT];
+    memcpy(syscalls, mips->syscalls, sizeof(syscalls));
+    mips->syscalls[SYS_READ_INT] = stopAtRead;
+    mips->syscalls[SYS_READ_STRING] = stopAtRead;
+    mips->syscalls[SYS_READ] = stopAtInputRead;
+    ExecutionResult result = executeSimulator(mips);
+    memcpy(mips->syscalls, syscalls, sizeof(syscalls));
+
+    if (result != EXEC_BREAKPOINT || !isRead(mips) || mips->harts != NULL) return false;
+
+    // The workers copy the whole memory, the loader must be done with it
+    if (mips->memory->pending != NULL) {
+        mem_fault(mips->memory, DATA_ADDRESS);
+    }
+
+    fuzzer->edges = calloc(COVERAGE_SIZE, 1);
+    return fuzzer->edges != NULL;
+}
+
+static void freeInput(FuzzInput* input) {
+    free(input->bytes);
+    input->bytes = NULL;
+}
+
+void freeFuzzer(Fuzzer* fuzzer) {
+    for (size_t i = 0; i < fuzzer->corpusCount; ++i) {
+        freeInput(&fuzzer->corpus[i]);
+    }
+    for (size_t i = 0; i < fuzzer->crashCount; ++i) {
+        freeInput(&fuzzer->crashes[i]);
+    }
+    free(fuzzer->corpus);
+    free((void*)fuzzer->edges);
+    fuzzer->corpus = NULL;
+    fuzzer->edges = NULL;
+    fuzzer->corpusCount = fuzzer->corpusCapacity = fuzzer->crashCount = 0;
+    pthread_mutex_destroy(&fuzzer->lock);
+}
+
+static bool copyInput(FuzzInput* input, const void* bytes, size_t size, ExecutionResult result) {
+    input->bytes = malloc(size > 0 ? size : 1);
+    input->size = size;
+    input->result = result;
+    if (input->bytes == NULL) return false;
+
+    memcpy(input->bytes, bytes, size);
+    return true;
+}
+
+// Called with the lock held
+static bool addToCorpus(Fuzzer* fuzzer, const void* bytes, size_t size) {
+    if (fuzzer->corpusCount == fuzzer->corpusCapacity) {
+        size_t capacity = fuzzer->corpusCapacity > 0 ? fuzzer->corpusCapacity * 2 : INITIAL_CAPACITY;
+        FuzzInput* corpus = realloc(fuzzer->corpus, capacity * sizeof(FuzzInput));
+        if (corpus == NULL) return false;
+
+        fuzzer->corpus = corpus;
+        fuzzer->corpusCapacity = capacity;
+    }
+
+    if (!copyInput(&fuzzer->corpus[fuzzer->corpusCount], bytes, size, EXEC_SUCCESS)) return false;
+    fuzzer->stats.corpus = ++fuzzer->corpusCount;
+    return true;
+}
+
+bool fuzzer_add_seed(Fuzzer* fuzzer, const void* bytes, size_t size) {
+    pthread_mutex_lock(&fuzzer->lock);
+    bool added = addToCorpus(fuzzer, bytes, size < fuzzer->maxSize ? size : fuzzer->maxSize);
+    pthread_mutex_unlock(&fuzzer->lock);
+
+    return added;
+}
+
+static ssize_t readInput(void* context, void* bytes, size_t size) {
+    Worker* worker = context;
+    size_t count = worker->size - worker->position < size ? worker->size - worker->position : size;
+    memcpy(bytes, &worker->input[worker->position], count);
+    worker->position += count;
+
+    return count;
+}
+
+static ssize_t discard(void* context, const void* bytes, size_t size) {
+    (void)context;
+    (void)bytes;
+    return size;
+}
+
+// Harts would outlive the run, the workers fail their spawns
+static ExecutionResult refuseHart(LMips* mips) {
+    mips->regs[$v0] = (uint32_t)-1;
+    return EXEC_SUCCESS;
+}
+
+static bool sameHeap(const GuestHeap* heap, const GuestHeap* other) {
+    if (heap == NULL || other == NULL) return heap == other;
+    return memcmp(&heap->stats, &other->stats, sizeof(HeapStats)) == 0;
+}
+
+// Files the run opened are closed, the target's ones are back at their snapshot offsets
+static void restoreFiles(Worker* worker) {
+    FileTable* files = &worker->mips.files;
+    for (int i = 0; i < GUEST_FILE_COUNT; ++i) {
+        if (files->fds[i] >= 0) {
+            close(files->fds[i]);
+            files->fds[i] = -1;
+        }
+
+        int fd = worker->files.fds[i];
+        if (fd >= 0 && (worker->offsets[i] < 0 || lseek(fd, worker->offsets[i], SEEK_SET) >= 0)) {
+            files->fds[i] = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+        }
+    }
+}
+
+// Puts the worker back in the snapshot state, copying only the pages the guest wrote to
+static void restore(Worker* worker) {
+    const LMips* target = worker->fuzzer->target;
+    const uint8_t* image = target->memory->store;
+    Memory* memory = &worker->memory;
+    uint8_t* dirty = memory->dirty;
+    for (uint32_t page = 0; page < MEMORY_PAGE_COUNT; ++page) {
+        if (!dirty[page]) continue;
+
+        uint32_t offset = page * MEMORY_PAGE_SIZE;
+        memcpy(&memory->store[offset], &image[offset], MEMORY_PAGE_SIZE);
+        dirty[page] = 0;
+    }
+    memory->readOnlyStart = target->memory->readOnlyStart;
+    memory->readOnlyEnd = target->memory->readOnlyEnd;
+
+    LMips* mips = &worker->mips;
+    memcpy(mips->regs, target->regs, sizeof(mips->regs));
+    mips->ip = target->ip;
+    mips->hi = target->hi;
+    mips->lo = target->lo;
+    mips->heap = target->heap;
+    mips->icount = target->icount;
+    mips->stop = false;
+    mips->reservation = target->reservation;
+    mips->reserved = target->reserved;
+    mips->transmitted = target->transmitted;
+
+    // Allocations and frees are counted, a heap with the same counts is in the same state
+    if (!sameHeap(mips->allocator, target->allocator)) {
+        freeGuestHeap(mips->allocator);
+        mips->allocator = target->allocator != NULL ? copyGuestHeap(target->allocator) : NULL;
+    }
+
+    restoreFiles(worker);
+}
+
+static bool initWorker(Worker* worker, Fuzzer* fuzzer, int index) {
+    const LMips* target = fuzzer->target;
+    worker->fuzzer = fuzzer;
+    worker->random = (fuzzer->seed + index) * 0x9E3779B97F4A7C15ull | 1;
+    worker->input = malloc(fuzzer->maxSize > 0 ? fuzzer->maxSize : 1);
+
+    initMemory(&worker->memory);
+    if (worker->input == NULL || worker->memory.store == NULL || !mem_track(&worker->memory) ||
+            !files_reopen(&worker->files, &target->files)) {
+        freeMemory(&worker->memory);
+        free(worker->input);
+        return false;
+    }
+    for (int i = 0; i < GUEST_FILE_COUNT; ++i) {
+        worker->offsets[i] = worker->files.fds[i] >= 0 ? lseek(worker->files.fds[i], 0, SEEK_CUR) : -1;
+    }
+
+    memcpy(worker->memory.store, target->memory->store, (size_t)MEMORY_PAGE_COUNT * MEMORY_PAGE_SIZE);
+    worker->memory.base = target->memory->base;
+
+    LMips* mips = &worker->mips;
+    initSimulator(mips, &worker->memory);
+    memcpy(mips->syscalls, target->syscalls, sizeof(mips->syscalls));
+    mips->syscalls[SYS_HART_SPAWN] = refuseHart;
+    mips->coverage = worker->trace;
+    mips->files.root = worker->files.root >= 0 ? fcntl(worker->files.root, F_DUPFD_CLOEXEC, 0) : -1;
+
+    Stream input, output, errors;
+    initCallbackStream(&input, readInput, NULL, worker);
+    initCallbackStream(&output, NULL, discard, NULL);
+    initCallbackStream(&errors, NULL, discard, NULL);
+    lmips_set_input(mips, &input);
+    lmips_set_output(mips, &output);
+    lmips_set_errors(mips, &errors);
+
+    restore(worker);
+    return true;
+}
+
+static void freeWorker(Worker* worker) {
+    freeSimulator(&worker->mips);
+    freeFileTable(&worker->files);
+    freeMemory(&worker->memory);
+    free(worker->input);
+}
+
+// xorshift64*
+static uint32_t nextRandom(Worker* worker) {
+    worker->random ^= worker->random >> 12;
+    worker->random ^= worker->random << 25;
+    worker->random ^= worker->random >> 27;
+    return (worker->random * 0x2545F4914F6CDD1Dull) >> 32;
+}
+
+static void pick(Worker* worker) {
+    Fuzzer* fuzzer = worker->fuzzer;
+
+    // Corpus inputs are never changed nor freed while running, only the array may move
+    pthread_mutex_lock(&fuzzer->lock);
+    FuzzInput input = fuzzer->corpus[nextRandom(worker) % fuzzer->corpusCount];
+    pthread_mutex_unlock(&fuzzer->lock);
+
+    memcpy(worker->input, input.bytes, input.size);
+    worker->size = input.size;
+}
+
+// A few stacked random changes
+static void mutate(Worker* worker) {
+    static const uint8_t interesting[] = {0, 1, '\n', ' ', '0', '9', 'A', 'z', 0x7F, 0x80, 0xFF};
+    size_t maxSize = worker->fuzzer->maxSize;
+    uint8_t* bytes = worker->input;
+
+    int count = 1 + nextRandom(worker) % 4;
+    for (int i = 0; i < count; ++i) {
+        uint32_t random = nextRandom(worker);
+        size_t at = worker->size > 0 ? (random >> 8) % worker->size : 0;
+        switch (worker->size > 0 ? random % 5 : 3) {
+            case 0:
+                bytes[at] ^= 1 << (random >> 29);
+                break;
+            case 1:
+                bytes[at] = nextRandom(worker);
+                break;
+            case 2:
+                bytes[at] = interesting[nextRandom(worker) % sizeof(interesting)];
+                break;
+            case 3:
+                if (worker->size < maxSize) {
+                    at = (random >> 8) % (worker->size + 1);
+                    memmove(&bytes[at + 1], &bytes[at], worker->size - at);
+                    bytes[at] = nextRandom(worker);
+                    worker->size++;
+                }
+                break;
+            default:
+                memmove(&bytes[at], &bytes[at + 1], worker->size - at - 1);
+                worker->size--;
+                break;
+        }
+    }
+}
+
+// Hit counts are bucketed the way AFL does : 1, 2, 3, 4-7, 8-15, 16-31, 32-127, 128+
+static uint8_t bucket(uint8_t count) {
+    if (count < 4) return count == 3 ? 4 : count;
+    if (count < 8) return 8;
+    if (count < 16) return 16;
+    if (count < 32) return 32;
+    return count < 128 ? 64 : 128;
+}
+
+// Merges the trace of the last run in the shared edges and clears it. Returns whether it hit anything new.
+static bool merge(Fuzzer* fuzzer, uint8_t* trace, size_t* newEdges) {
+    bool interesting = false;
+    // Traces are sparse, whole blocks are skipped with a vector OR
+    for (size_t i = 0; i < COVERAGE_SIZE; i += TRACE_BLOCK) {
+        uint64_t any = 0;
+        for (size_t offset = 0; offset < TRACE_BLOCK; offset += sizeof(uint64_t)) {
+            uint64_t word;
+            memcpy(&word, &trace[i + offset], sizeof(word));
+            any |= word;
+        }
+        if (any == 0) continue;
+
+        for (size_t edge = i; edge < i + TRACE_BLOCK; ++edge) {
+            if (trace[edge] == 0) continue;
+
+            uint8_t hit = bucket(trace[edge]);
+            trace[edge] = 0;
+            if (atomic_load_explicit(&fuzzer->edges[edge], memory_order_relaxed) & hit) continue;
+
+            uint8_t seen = atomic_fetch_or(&fuzzer->edges[edge], hit);
+            interesting |= (seen & hit) == 0;
+            *newEdges += seen == 0;
+        }
+    }
+
+    return interesting;
+}
+
+static void fuzzOne(Worker* worker) {
+    Fuzzer* fuzzer = worker->fuzzer;
+    LMips* mips = &worker->mips;
+    pick(worker);
+    mutate(worker);
+
+    worker->position = 0;
+    scanner_reset(&mips->scanner);
+    mips->stopCount = mips->icount + fuzzer->budget;
+    ExecutionResult result = executeSimulator(mips);
+
+    size_t newEdges = 0;
+    bool interesting = merge(fuzzer, worker->trace, &newEdges);
+    if (interesting || result != EXEC_SUCCESS) {
+        pthread_mutex_lock(&fuzzer->lock);
+        fuzzer->stats.edges += newEdges;
+        if (result == EXEC_BREAKPOINT) {
+            fuzzer->stats.hangs++;
+        } else if (result != EXEC_SUCCESS) {
+            fuzzer->stats.crashes++;
+            if (fuzzer->crashCount < FUZZ_MAX_CRASHES &&
+                copyInput(&fuzzer->crashes[fuzzer->crashCount], worker->input, worker->size, result)) {
+                fuzzer->crashCount++;
+            }
+        } else {
+            addToCorpus(fuzzer, worker->input, worker->size);
+        }
+        pthread_mutex_unlock(&fuzzer->lock);
+    }
+
+    restore(worker);
+}
+
+static void* workerMain(void* arg) {
+    Worker* worker = arg;
+    Fuzzer* fuzzer = worker->fuzzer;
+
+    while (atomic_fetch_add(&fuzzer->claimed, CHUNK) < fuzzer->executions) {
+        for (int i = 0; i < CHUNK; ++i) {
+            fuzzOne(worker);
+        }
+
+        pthread_mutex_lock(&fuzzer->lock);
+        fuzzer->stats.executions += CHUNK;
+        pthread_mutex_unlock(&fuzzer->lock);
+    }
+
+    return NULL;
+}
+
+bool fuzzer_run(Fuzzer* fuzzer, int threads, uint64_t executions) {
+    if (fuzzer->corpusCount == 0 && !fuzzer_add_seed(fuzzer, "", 0)) return false;
+
+    Worker* workers = calloc(threads, sizeof(Worker));
+    if (workers == NULL) return false;
+
+    fuzzer->executions = executions;
+    atomic_store(&fuzzer->claimed, 0);
+
+    int started = 0;
+    bool success = true;
+    for (; started < threads; ++started) {
+        Worker* worker = &workers[started];
+        if (!initWorker(worker, fuzzer, started)) {
+            success = false;
+            break;
+        }
+        if (pthread_create(&worker->thread, NULL, workerMain, worker) != 0) {
+            freeWorker(worker);
+            success = false;
+            break;
+        }
+    }
+
+    for (int i = 0; i < started; ++i) {
+        pthread_join(workers[i].thread, NULL);
+        freeWorker(&workers[i]);
+    }
+    free(workers);
+
+    fuzzer->seed += threads;
+    return success && started > 0;
+}
+
+void fuzzer_stats(Fuzzer* fuzzer, FuzzStats* stats) {
+    pthread_mutex_lock(&fuzzer->lock);
+    *stats = fuzzer->stats;
+    pthread_mutex_unlock(&fuzzer->lock);
+}
@@ -0,0 +1,55 @@
+#ifndef LMIPS_FUZZER
+#define LMIPS_FUZZER
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include "lmips.h"
+
+#define FUZZ_DEFAULT_BUDGET 1000000 // Instructions an input may run before it counts as a hang
+#define FUZZ_DEFAULT_MAX_SIZE 256
+#define FUZZ_MAX_CRASHES 64 // Crashing inputs kept, the others are only counted
+
+typedef struct {
+    uint8_t* bytes;
+    size_t size;
+    ExecutionResult result;
+} FuzzInput;
+
+typedef struct {
+    uint64_t executions;
+    uint64_t crashes; // Inputs ending in a fault
+    uint64_t hangs; // Inputs running past the budget
+    size_t corpus; // Inputs kept for reaching new edges or new hit counts
+    size_t edges; // Branch edges taken at least once
+} FuzzStats;
+
+// Feeds mutated inputs to a program, each run from a snapshot taken right before its first read syscall. The
+// workers share a bitmap of the branch edges seen, inputs taking new ones join the corpus to be mutated further.
+typedef struct {
+    LMips* target; // Stopped at the snapshot, the workers copy its state and memory
+    uint64_t budget;
+    size_t maxSize;
+    uint32_t seed;
+    _Atomic uint8_t* edges; // COVERAGE_SIZE classes of hit counts seen, a bit each
+    _Atomic uint64_t claimed; // Executions handed to the workers
+    uint64_t executions;
+    pthread_mutex_t lock; // Guards everything below
+    FuzzInput* corpus;
+    size_t corpusCount, corpusCapacity;
+    FuzzInput crashes[FUZZ_MAX_CRASHES];
+    size_t crashCount;
+    FuzzStats stats;
+} Fuzzer;
+
+// Runs `mips`, loaded with the program, up to its first read of the guest input and leaves it there as the
+// snapshot. The caller keeps the VM and frees it after freeFuzzer. Returns false when the program ends first,
+// or uses harts.
+bool initFuzzer(Fuzzer* fuzzer, LMips* mips);
+void freeFuzzer(Fuzzer* fuzzer);
+
+bool fuzzer_add_seed(Fuzzer* fuzzer, const void* bytes, size_t size);
+// Runs about `executions` inputs over `threads` workers, an empty seed is added if there are none
+bool fuzzer_run(Fuzzer* fuzzer, int threads, uint64_t executions);
+void fuzzer_stats(Fuzzer* fuzzer, FuzzStats* stats);
+
+#endif //LMIPS_FUZZER
@@ -0,0 +1,294 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "harts.h"
+#include "syscalls.h"
+
+// Only hart 0 gets parked by the scheduler, the others poll a non-blocking input
+#define BLOCKED_POLL_NS 1000000
+
+struct futexwaiter {
+    uint32_t address;
+    bool woken;
+    pthread_cond_t wake;
+    struct futexwaiter* next;
+};
+
+struct hart {
+    LMips mips;
+    pthread_t thread;
+    ExecutionResult result;
+    bool done;
+};
+
+static void wakeAll(HartGroup* group) {
+    pthread_cond_broadcast(&group->exited);
+    for (struct futexwaiter* waiter = group->waiters; waiter != NULL; waiter = waiter->next) {
+        pthread_cond_signal(&waiter->wake);
+    }
+}
+
+// Called with the lock held by a hart that stops running, to wait or because it ended
+static void leaveRunning(HartGroup* group) {
+    if (--group->running == 0) {
+        group->stalls++;
+        wakeAll(group);
+    }
+}
+
+static void* hartMain(void* arg) {
+    struct hart* hart = arg;
+    LMips* mips = &hart->mips;
+    HartGroup* group = mips->harts;
+
+    // Runs in slices, the instructions of each one count against the budget of a waiting hart 0
+    ExecutionResult result;
+    bool sliced;
+    for (;;) {
+        uint64_t icount = mips->icount;
+        mips->stopCount = icount + HART_SLICE;
+        result = executeSimulator(mips);
+        sliced = result == EXEC_BREAKPOINT && mips->icount >= mips->stopCount;
+
+        pthread_mutex_lock(&group->lock);
+        group->spent += mips->icount - icount;
+        if (group->spent >= group->deadline) wakeAll(group);
+        if (mips->stop || (!sliced && result != EXEC_BLOCKED)) break;
+        pthread_mutex_unlock(&group->lock);
+
+        if (result == EXEC_BLOCKED) {
+            nanosleep(&(struct timespec){.tv_nsec = BLOCKED_POLL_NS}, NULL);
+        }
+    }
+
+    hart->result = sliced || result == EXEC_BLOCKED ? EXEC_SUCCESS : result;
+    hart->done = true;
+    pthread_cond_broadcast(&group->exited);
+    leaveRunning(group);
+    pthread_mutex_unlock(&group->lock);
+
+    return NULL;
+}
+
+static HartGroup* createGroup(LMips* process) {
+    HartGroup* group = calloc(1, sizeof(HartGroup));
+    if (group == NULL) return NULL;
+
+    // Harts must not race to finish the loader's background copy
+    if (process->memory != NULL && process->memory->pending != NULL) {
+        mem_fault(process->memory, DATA_ADDRESS);
+    }
+
+    pthread_mutex_init(&group->lock, NULL);
+    pthread_cond_init(&group->exited, NULL);
+    group->count = 1;
+    group->running = 1;
+    group->deadline = UINT64_MAX;
+    process->harts = group;
+    return group;
+}
+
+ExecutionResult hart_syscall(LMips* mips, SyscallHandler handler) {
+    pthread_mutex_lock(&mips->harts->lock);
+    // Hart 0 may have exited while this one was waiting
+    ExecutionResult result = mips->stop ? EXEC_SUCCESS : handler(mips);
+    pthread_mutex_unlock(&mips->harts->lock);
+
+    return result;
+}
+
+void stopHarts(HartGroup* group) {
+    for (uint32_t i = 1; i < group->count; ++i) {
+        if (group->harts[i] != NULL) {
+            group->harts[i]->mips.stop = true;
+        }
+    }
+    wakeAll(group);
+}
+
+void freeHarts(LMips* mips) {
+    HartGroup* group = mips->harts;
+    pthread_mutex_lock(&group->lock);
+    stopHarts(group);
+    pthread_mutex_unlock(&group->lock);
+
+    for (uint32_t i = 1; i < group->count; ++i) {
+        struct hart* hart = group->harts[i];
+        if (hart == NULL) continue;
+
+        pthread_join(hart->thread, NULL);
+        freeSimulator(&hart->mips);
+        free(hart);
+    }
+
+    pthread_mutex_destroy(&group->lock);
+    pthread_cond_destroy(&group->exited);
+    free(group);
+    mips->harts = NULL;
+}
+
+// Starts a hart at $a0 with $a1 as its $sp and $a2 as its $a0, its ID is returned in $v0 (-1 on failure)
+ExecutionResult sys_hart_spawn(LMips* mips) {
+    LMips* process = mips->process;
+    uint32_t entry = mips->regs[$a0];
+    mips->regs[$v0] = (uint32_t)-1;
+    if (entry % 4 != 0 || entry >= DATA_ADDRESS - PROGRAM_ADDRESS) return EXEC_SUCCESS;
+
+    // The first spawn comes from hart 0 alone, without the lock later syscalls take
+    bool created = process->harts == NULL;
+    if (created && createGroup(process) == NULL) return EXEC_SUCCESS;
+    HartGroup* group = process->harts;
+    if (created) pthread_mutex_lock(&group->lock);
+
+    struct hart* hart = group->count < MAX_HARTS ? calloc(1, sizeof(struct hart)) : NULL;
+    if (hart != NULL) {
+        LMips* child = &hart->mips;
+        initTestSimulator(child, mips->program);
+        memcpy(child->syscalls, process->syscalls, sizeof(child->syscalls));
+        child->memory = mips->memory;
+        child->debug = process->debug;
+        child->translator = process->translator;
+        child->regs[$gp] = mips->regs[$gp];
+        child->regs[$sp] = mips->regs[$a1];
+        child->regs[$a0] = mips->regs[$a2];
+        child->ip = entry;
+        child->hartId = group->count;
+        child->process = process;
+        child->harts = group;
+
+        if (pthread_create(&hart->thread, NULL, hartMain, hart) == 0) {
+            group->harts[group->count] = hart;
+            group->running++;
+            mips->regs[$v0] = group->count++;
+        } else {
+            freeSimulator(child);
+            free(hart);
+        }
+    }
+
+    if (created) pthread_mutex_unlock(&group->lock);
+    return EXEC_SUCCESS;
+}
+
+// Waits on a condition of the lock until done is set, unless every other hart is waiting or has ended. Only hart 0
+// has a budget, which the instructions of the other harts spend while it waits : once it runs out, the wait is left
+// to run again on resume and EXEC_BREAKPOINT ends the run as if it had reached its stopCount.
+static ExecutionResult await(LMips* mips, pthread_cond_t* condition, const bool* done) {
+    HartGroup* group = mips->harts;
+    bool bounded = mips->hartId == 0 && mips->stopCount != UINT64_MAX;
+    if (bounded) {
+        uint64_t budget = mips->stopCount - mips->icount;
+        group->deadline = budget > UINT64_MAX - group->spent ? UINT64_MAX : group->spent + budget;
+    }
+
+    uint32_t stalls = group->stalls;
+    leaveRunning(group);
+    while (!*done && !mips->stop && group->stalls == stalls && (!bounded || group->spent < group->deadline)) {
+        pthread_cond_wait(condition, &group->lock);
+    }
+    group->running++;
+    if (bounded) group->deadline = UINT64_MAX;
+
+    if (*done || mips->stop || group->stalls != stalls) return EXEC_SUCCESS;
+    // $v0 still holds the syscall
+    mips->ip -= 4;
+    mips->icount--;
+    mips->stopCount = mips->icount;
+    return EXEC_BREAKPOINT;
+}
+
+// Waits for hart $a0 to end, $v0 gets how it ended (0 after SYS_EXIT) or -1 when it can't be joined
+ExecutionResult sys_hart_join(LMips* mips) {
+    HartGroup* group = mips->harts;
+    uint32_t id = mips->regs[$a0];
+    struct hart* hart = group != NULL && id > 0 && id < group->count && id != mips->hartId ? group->harts[id] : NULL;
+    ExecutionResult result = EXEC_SUCCESS;
+    // Syscalls run with the lock held, which the wait releases
+    if (hart != NULL && !hart->done) {
+        result = await(mips, &group->exited, &hart->done);
+    }
+    if (hart == NULL || !hart->done) {
+        if (result == EXEC_SUCCESS) mips->regs[$v0] = (uint32_t)-1;
+        return result;
+    }
+
+    group->harts[id] = NULL;
+    pthread_join(hart->thread, NULL);
+    mips->regs[$v0] = hart->result;
+    freeSimulator(&hart->mips);
+    free(hart);
+
+    return EXEC_SUCCESS;
+}
+
+ExecutionResult sys_hart_id(LMips* mips) {
+    mips->regs[$v0] = mips->hartId;
+    return EXEC_SUCCESS;
+}
+
+// Waits on the word at $a0 while it holds $a1. $v0 gets 0 once woken, 1 when the word held another value and -1
+// when no other hart could ever wake the caller, as every other one is waiting or has ended.
+ExecutionResult sys_futex_wait(LMips* mips) {
+    uint32_t address = mips->regs[$a0];
+    if (address % 4 != 0 || !mem_valid(mips->memory, address)) return EXEC_ERR_MEMORY_ADDR;
+
+    HartGroup* group = mips->harts;
+    if ((uint32_t)mem_read(mips->memory, address) != mips->regs[$a1]) {
+        mips->regs[$v0] = 1;
+        return EXEC_SUCCESS;
+    }
+    if (group == NULL) {
+        mips->regs[$v0] = -1;
+        return EXEC_SUCCESS;
+    }
+
+    // The word was checked under the lock that wakers take, so a store followed by a wake can't be missed
+    struct futexwaiter waiter = {.address = address};
+    pthread_cond_init(&waiter.wake, NULL);
+    struct futexwaiter** last = &group->waiters;
+    while (*last != NULL) {
+        last = &(*last)->next;
+    }
+    *last = &waiter;
+
+    ExecutionResult result = await(mips, &waiter.wake, &waiter.woken);
+
+    // Wakers unlink the waiters they wake
+    if (!waiter.woken) {
+        for (struct futexwaiter** link = &group->waiters; *link != NULL; link = &(*link)->next) {
+            if (*link == &waiter) {
+                *link = waiter.next;
+                break;
+            }
+        }
+    }
+    pthread_cond_destroy(&waiter.wake);
+
+    if (result == EXEC_SUCCESS) mips->regs[$v0] = waiter.woken || mips->stop ? 0 : (uint32_t)-1;
+    return result;
+}
+
+// Wakes at most $a1 harts waiting on the word at $a0, the oldest first. $v0 gets how many were woken.
+ExecutionResult sys_futex_wake(LMips* mips) {
+    uint32_t address = mips->regs[$a0];
+    if (address % 4 != 0 || !mem_valid(mips->memory, address)) return EXEC_ERR_MEMORY_ADDR;
+
+    uint32_t count = 0;
+    HartGroup* group = mips->harts;
+    struct futexwaiter** link = group != NULL ? &group->waiters : NULL;
+    while (link != NULL && *link != NULL && count < mips->regs[$a1]) {
+        struct futexwaiter* waiter = *link;
+        if (waiter->address != address) {
+            link = &waiter->next;
+            continue;
+        }
+
+        *link = waiter->next;
+        waiter->woken = true;
+        pthread_cond_signal(&waiter->wake);
+        count++;
+    }
+
+    mips->regs[$v0] = count;
+    return EXEC_SUCCESS;
+}
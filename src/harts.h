@@ -0,0 +1,39 @@
+#ifndef LMIPS_HARTS
+#define LMIPS_HARTS
+
+#include <pthread.h>
+#include "lmips.h"
+
+#define MAX_HARTS 64 // Hart 0 included, IDs are not reused
+#define HART_SLICE 65536 // Instructions a hart runs between two updates of the spent count
+
+// Harts of a VM, each an LMips running on its own host thread over the memory of hart 0. The lock serialises
+// the syscalls and device stores of every hart, as they share the console, input, files and heap of hart 0.
+typedef struct hartgroup {
+    pthread_mutex_t lock;
+    pthread_cond_t exited;
+    struct hart* harts[MAX_HARTS]; // By ID, hart 0 is the VM itself and joined harts are gone
+    uint32_t count;
+    struct futexwaiter* waiters; // Harts in SYS_FUTEX_WAIT, oldest first
+    uint32_t running; // Harts not waiting in a join or on a futex, hart 0 included
+    uint32_t stalls; // Times every hart was waiting, which ends all the waits as none of them could end
+    uint64_t spent; // Instructions run by the harts other than 0, counted every HART_SLICE at most
+    uint64_t deadline; // The spent count at which a waiting hart 0 runs out of budget, UINT64_MAX otherwise
+} HartGroup;
+
+static inline void hart_lock(LMips* mips) {
+    if (mips->harts != NULL) pthread_mutex_lock(&mips->harts->lock);
+}
+
+static inline void hart_unlock(LMips* mips) {
+    if (mips->harts != NULL) pthread_mutex_unlock(&mips->harts->lock);
+}
+
+ExecutionResult hart_syscall(LMips* mips, SyscallHandler handler);
+
+// Makes every hart stop before its next instruction, called with the lock held
+void stopHarts(HartGroup* group);
+// Stops the harts of hart 0 and waits for them
+void freeHarts(LMips* mips);
+
+#endif //LMIPS_HARTS
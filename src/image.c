@@ -0,0 +1,235 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "allocator.h"
+#include "image.h"
+
+#define PAGE_COUNT (MEMORY_SIZE / MEMORY_PAGE_SIZE)
+#define INDEX_OFFSET MEMORY_PAGE_SIZE
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    ImageKey key;
+    uint32_t regs[REG_COUNT];
+    uint32_t ip, hi, lo, heap;
+    uint32_t readOnlyStart, readOnlyEnd;
+    uint64_t icount;
+    uint32_t symtabOffset, symtabSize;
+    uint32_t linesOffset, linesSize;
+    uint32_t pageCount;
+    uint32_t heapSize; // Of the native allocator state following the pages, 0 when the guest never used it
+} ImageHeader;
+
+static const char IMAGE_MAGIC[4] = {'L', 'I', 'M', 'G'};
+
+static uint32_t dataOffset(uint32_t pageCount) {
+    uint32_t indexSize = pageCount * sizeof(uint32_t);
+    return INDEX_OFFSET + (indexSize + MEMORY_PAGE_SIZE - 1) / MEMORY_PAGE_SIZE * MEMORY_PAGE_SIZE;
+}
+
+static bool isZeroPage(const uint8_t* page) {
+    const uint64_t* words = (const uint64_t*)page;
+    uint64_t any = 0;
+    for (size_t i = 0; i < MEMORY_PAGE_SIZE / sizeof(uint64_t); ++i) {
+        any |= words[i];
+    }
+
+    return any == 0;
+}
+
+static bool writeAll(int fd, const void* buffer, size_t size, off_t offset) {
+    const uint8_t* bytes = buffer;
+    while (size > 0) {
+        ssize_t written = pwrite(fd, bytes, size, offset);
+        if (written <= 0) return false;
+
+        bytes += written;
+        size -= written;
+        offset += written;
+    }
+
+    return true;
+}
+
+static bool readAll(int fd, void* buffer, size_t size, off_t offset) {
+    uint8_t* bytes = buffer;
+    while (size > 0) {
+        ssize_t count = pread(fd, bytes, size, offset);
+        if (count <= 0) return false;
+
+        bytes += count;
+        size -= count;
+        offset += count;
+    }
+
+    return true;
+}
+
+bool image_write(const char* path, const ImageKey* key, const LMips* mips, const DebugInfo* debug) {
+    uint32_t* index = malloc(PAGE_COUNT * sizeof(uint32_t));
+    if (index == NULL) return false;
+
+    ImageHeader header = {};
+    memcpy(header.magic, IMAGE_MAGIC, 4);
+    header.version = IMAGE_VERSION;
+    if (key != NULL) header.key = *key;
+    memcpy(header.regs, mips->regs, sizeof(header.regs));
+    header.ip = mips->ip;
+    header.hi = mips->hi;
+    header.lo = mips->lo;
+    header.heap = mips->heap;
+    header.readOnlyStart = mips->memory->readOnlyStart;
+    header.readOnlyEnd = mips->memory->readOnlyEnd;
+    header.icount = mips->icount;
+    if (debug != NULL) {
+        header.symtabOffset = debug->symtabOffset;
+        header.symtabSize = debug->symtabSize;
+        header.linesOffset = debug->linesOffset;
+        header.linesSize = debug->linesSize;
+    }
+
+    size_t heapSize = 0;
+    void* heap = mips->allocator != NULL ? heap_save(mips->allocator, &heapSize) : NULL;
+    if (mips->allocator != NULL && heap == NULL) {
+        free(index);
+        return false;
+    }
+    header.heapSize = heapSize;
+
+    const uint8_t* store = mips->memory->store;
+    for (uint32_t page = 0; page < PAGE_COUNT; ++page) {
+        if (!isZeroPage(&store[page * MEMORY_PAGE_SIZE])) {
+            index[header.pageCount++] = page;
+        }
+    }
+
+    // Write next to the destination then rename, so readers never see a partial image
+    size_t length = strlen(path);
+    char* temp = malloc(length + 8);
+    if (temp == NULL) {
+        free(heap);
+        free(index);
+        return false;
+    }
+    memcpy(temp, path, length);
+    memcpy(temp + length, ".XXXXXX", 8);
+
+    int fd = mkstemp(temp);
+    bool success = fd >= 0;
+    if (success) {
+        uint32_t offset = dataOffset(header.pageCount);
+        success = writeAll(fd, &header, sizeof(header), 0) &&
+            writeAll(fd, index, header.pageCount * sizeof(uint32_t), INDEX_OFFSET);
+
+        for (uint32_t i = 0; success && i < header.pageCount; ++i) {
+            success = writeAll(fd, &store[index[i] * MEMORY_PAGE_SIZE], MEMORY_PAGE_SIZE,
+                offset + (off_t)i * MEMORY_PAGE_SIZE);
+        }
+
+        off_t end = offset + (off_t)header.pageCount * MEMORY_PAGE_SIZE;
+        success = success && (heap == NULL || writeAll(fd, heap, heapSize, end)) &&
+            ftruncate(fd, end + heapSize) == 0;
+        success = close(fd) == 0 && success;
+        success = success && rename(temp, path) == 0;
+
+        if (!success) {
+            unlink(temp);
+        }
+    }
+
+    free(temp);
+    free(heap);
+    free(index);
+    return success;
+}
+
+// Maps `count` pages from the image at guest page `page`, or copies them when host pages differ in size
+static bool mapPages(int fd, Memory* memory, uint32_t page, uint32_t count, off_t offset) {
+    uint8_t* target = &memory->store[page * MEMORY_PAGE_SIZE];
+    size_t size = (size_t)count * MEMORY_PAGE_SIZE;
+
+    if (sysconf(_SC_PAGESIZE) == MEMORY_PAGE_SIZE) {
+        return mmap(target, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, offset) != MAP_FAILED;
+    }
+
+    return readAll(fd, target, size, offset);
+}
+
+bool image_map(const char* path, const ImageKey* key, Memory* memory, LMips* mips, DebugInfo* debug) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    ImageHeader header;
+    struct stat info;
+    bool valid = fstat(fd, &info) == 0 &&
+        readAll(fd, &header, sizeof(header), 0) &&
+        memcmp(header.magic, IMAGE_MAGIC, 4) == 0 &&
+        header.version == IMAGE_VERSION &&
+        (key == NULL || memcmp(&header.key, key, sizeof(ImageKey)) == 0) &&
+        header.pageCount <= PAGE_COUNT &&
+        header.readOnlyStart <= header.readOnlyEnd && header.readOnlyEnd <= MEMORY_SIZE &&
+        info.st_size == (off_t)dataOffset(header.pageCount) + (off_t)header.pageCount * MEMORY_PAGE_SIZE + header.heapSize;
+
+    // The allocator state is loaded first, there is nothing to undo when it is not valid
+    GuestHeap* heap = NULL;
+    if (valid && header.heapSize > 0) {
+        void* bytes = malloc(header.heapSize);
+        off_t end = (off_t)dataOffset(header.pageCount) + (off_t)header.pageCount * MEMORY_PAGE_SIZE;
+        heap = bytes != NULL && readAll(fd, bytes, header.heapSize, end) ? heap_load(bytes, header.heapSize) : NULL;
+        valid = heap != NULL;
+        free(bytes);
+    }
+
+    uint32_t* index = valid ? malloc((header.pageCount + 1) * sizeof(uint32_t)) : NULL;
+    valid = index != NULL && readAll(fd, index, header.pageCount * sizeof(uint32_t), INDEX_OFFSET);
+    for (uint32_t i = 0; valid && i < header.pageCount; ++i) {
+        valid = index[i] < PAGE_COUNT && (i == 0 || index[i] > index[i - 1]);
+    }
+
+    // Map runs of consecutive pages with a single call
+    uint32_t offset = dataOffset(header.pageCount);
+    for (uint32_t i = 0; valid && i < header.pageCount;) {
+        uint32_t run = 1;
+        while (i + run < header.pageCount && index[i + run] == index[i] + run) run++;
+
+        valid = mapPages(fd, memory, index[i], run, offset + (off_t)i * MEMORY_PAGE_SIZE);
+        // A failed image_map leaves no part of the image behind
+        if (!valid) {
+            for (uint32_t j = 0; j < i + run; ++j) {
+                mem_unmap(memory, index[j] * MEMORY_PAGE_SIZE, MEMORY_PAGE_SIZE);
+            }
+        }
+        i += run;
+    }
+
+    free(index);
+    close(fd);
+    if (!valid) {
+        freeGuestHeap(heap);
+        return false;
+    }
+
+    memcpy(mips->regs, header.regs, sizeof(header.regs));
+    mips->ip = header.ip;
+    mips->hi = header.hi;
+    mips->lo = header.lo;
+    mips->heap = header.heap;
+    mips->icount = header.icount;
+    memory->readOnlyStart = header.readOnlyStart;
+    memory->readOnlyEnd = header.readOnlyEnd;
+    freeGuestHeap(mips->allocator);
+    mips->allocator = heap;
+    if (debug != NULL) {
+        debug->symtabOffset = header.symtabOffset;
+        debug->symtabSize = header.symtabSize;
+        debug->linesOffset = header.linesOffset;
+        debug->linesSize = header.linesSize;
+    }
+
+    return true;
+}
@@ -0,0 +1,24 @@
+#ifndef LMIPS_IMAGE
+#define LMIPS_IMAGE
+
+#include "lmips.h"
+
+#define IMAGE_VERSION 4
+#define IMAGE_BUILD_ID_SIZE 64
+
+// Identifies what an image has been built from, so stale images can be detected
+typedef struct {
+    uint64_t hash;
+    uint64_t size;
+    char build[IMAGE_BUILD_ID_SIZE];
+} ImageKey;
+
+// An image is a page-aligned file holding the VM registers and read-only window followed by the non-zero memory pages.
+// Mapping one back is private (copy on write) and only costs the pages it contains.
+// Layout : header page, page index (32-bit page numbers), page contents, native allocator state; all in host byte
+// order.
+// Snapshots are images written mid-run without a key.
+bool image_write(const char* path, const ImageKey* key, const LMips* mips, const DebugInfo* debug);
+bool image_map(const char* path, const ImageKey* key, Memory* memory, LMips* mips, DebugInfo* debug);
+
+#endif //LMIPS_IMAGE
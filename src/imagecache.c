@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include "imagecache.h"
+
+#define IMAGE_EXTENSION ".limg"
+#define STATS_FILE "stats"
+
+typedef struct {
+    char* path;
+    uint64_t size;
+    struct timespec used;
+} CacheEntry;
+
+void initImageCache(ImageCache* cache, const char* directory, uint64_t maxSize) {
+    cache->directory = strdup(directory);
+    cache->maxSize = maxSize;
+}
+
+void freeImageCache(ImageCache* cache) {
+    free(cache->directory);
+    cache->directory = NULL;
+}
+
+static uint64_t mix(uint64_t hash, uint64_t word) {
+    hash ^= word * 0x9E3779B97F4A7C15ULL;
+    hash = (hash << 31) | (hash >> 33);
+    return hash * 0xC2B2AE3D27D4EB4FULL;
+}
+
+// The running binary identifies the VM build: any rebuild changes its size or modification time
+static void buildId(char* build) {
+    struct stat info;
+    if (stat("/proc/self/exe", &info) == 0) {
+        snprintf(build, IMAGE_BUILD_ID_SIZE, "%llx-%llx.%lx-%llx",
+                 (unsigned long long)info.st_size, (unsigned long long)info.st_mtim.tv_sec,
+                 info.st_mtim.tv_nsec, (unsigned long long)info.st_ino);
+    } else {
+        snprintf(build, IMAGE_BUILD_ID_SIZE, "%s %s", __DATE__, __TIME__);
+    }
+}
+
+bool cache_key(const char* path, ImageKey* key) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    memset(key, 0, sizeof(ImageKey));
+    uint64_t hash = 0x27D4EB2F165667C5ULL;
+    uint8_t buffer[1 << 16];
+    ssize_t count;
+    while ((count = read(fd, buffer, sizeof(buffer))) > 0) {
+        ssize_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            uint64_t word;
+            memcpy(&word, &buffer[i], 8);
+            hash = mix(hash, word);
+        }
+        for (; i < count; ++i) {
+            hash = mix(hash, buffer[i]);
+        }
+        key->size += count;
+    }
+    close(fd);
+
+    if (count < 0) return false;
+
+    key->hash = mix(hash, key->size);
+    buildId(key->build);
+    return true;
+}
+
+static char* entryPath(ImageCache* cache, const ImageKey* key) {
+    size_t length = strlen(cache->directory) + 32;
+    char* path = malloc(length);
+    if (path != NULL) {
+        snprintf(path, length, "%s/%016llx" IMAGE_EXTENSION, cache->directory, (unsigned long long)key->hash);
+    }
+
+    return path;
+}
+
+// Hit and miss counters are shared by every VM using the directory
+static bool updateStats(ImageCache* cache, bool hit, ImageCacheStats* stats) {
+    size_t length = strlen(cache->directory) + sizeof(STATS_FILE) + 1;
+    char path[length];
+    snprintf(path, length, "%s/" STATS_FILE, cache->directory);
+
+    int fd = open(path, stats == NULL ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+    if (fd < 0) return false;
+    flock(fd, stats == NULL ? LOCK_EX : LOCK_SH);
+
+    ImageCacheStats current = {};
+    pread(fd, &current, sizeof(current), 0);
+
+    bool success = true;
+    if (stats == NULL) {
+        if (hit) {
+            current.hits++;
+        } else {
+            current.misses++;
+        }
+        success = pwrite(fd, &current, sizeof(current), 0) == sizeof(current);
+    } else {
+        *stats = current;
+    }
+
+    flock(fd, LOCK_UN);
+    close(fd);
+    return success;
+}
+
+bool cache_lookup(ImageCache* cache, const ImageKey* key, Memory* memory, LMips* mips, DebugInfo* debug) {
+    mkdir(cache->directory, 0755);
+
+    char* path = entryPath(cache, key);
+    if (path == NULL) return false;
+
+    // Images built from another executable content or VM build never match the key
+    bool hit = image_map(path, key, memory, mips, debug);
+    if (hit) {
+        utimensat(AT_FDCWD, path, NULL, 0); // Keeps the eviction order least recently used
+    }
+
+    updateStats(cache, hit, NULL);
+    free(path);
+    return hit;
+}
+
+static int compareEntries(const void* a, const void* b) {
+    const CacheEntry* first = a;
+    const CacheEntry* second = b;
+
+    if (first->used.tv_sec != second->used.tv_sec) {
+        return first->used.tv_sec < second->used.tv_sec ? -1 : 1;
+    }
+
+    return (first->used.tv_nsec > second->used.tv_nsec) - (first->used.tv_nsec < second->used.tv_nsec);
+}
+
+// Removes the least recently used images until the directory fits in its limit
+static void evict(ImageCache* cache) {
+    DIR* directory = opendir(cache->directory);
+    if (directory == NULL) return;
+
+    CacheEntry* entries = NULL;
+    size_t count = 0, capacity = 0;
+    uint64_t total = 0;
+
+    struct dirent* file;
+    while ((file = readdir(directory)) != NULL) {
+        size_t length = strlen(file->d_name);
+        if (length <= sizeof(IMAGE_EXTENSION) - 1 ||
+            strcmp(file->d_name + length - (sizeof(IMAGE_EXTENSION) - 1), IMAGE_EXTENSION) != 0) {
+            continue;
+        }
+
+        size_t pathLength = strlen(cache->directory) + length + 2;
+        char* path = malloc(pathLength);
+        struct stat info;
+        if (path == NULL) break;
+        snprintf(path, pathLength, "%s/%s", cache->directory, file->d_name);
+        if (stat(path, &info) != 0) {
+            free(path);
+            continue;
+        }
+
+        if (count == capacity) {
+            capacity = capacity < 8 ? 8 : capacity * 2;
+            CacheEntry* grown = realloc(entries, capacity * sizeof(CacheEntry));
+            if (grown == NULL) {
+                free(path);
+                break;
+            }
+            entries = grown;
+        }
+
+        // Images are sparse, count what they really occupy
+        entries[count].path = path;
+        entries[count].size = (uint64_t)info.st_blocks * 512;
+        entries[count].used = info.st_mtim;
+        total += entries[count++].size;
+    }
+    closedir(directory);
+
+    qsort(entries, count, sizeof(CacheEntry), compareEntries);
+    for (size_t i = 0; i < count; ++i) {
+        if (total > cache->maxSize && unlink(entries[i].path) == 0) {
+            total -= entries[i].size;
+        }
+        free(entries[i].path);
+    }
+
+    free(entries);
+}
+
+bool cache_store(ImageCache* cache, const ImageKey* key, const LMips* mips, const DebugInfo* debug) {
+    mkdir(cache->directory, 0755);
+
+    char* path = entryPath(cache, key);
+    if (path == NULL) return false;
+
+    bool success = image_write(path, key, mips, debug);
+    free(path);
+
+    if (success && cache->maxSize > 0) {
+        evict(cache);
+    }
+
+    return success;
+}
+
+bool cache_stats(ImageCache* cache, ImageCacheStats* stats) {
+    memset(stats, 0, sizeof(ImageCacheStats));
+
+    return updateStats(cache, false, stats);
+}
@@ -0,0 +1,25 @@
+#ifndef LMIPS_IMAGECACHE
+#define LMIPS_IMAGECACHE
+
+#include "image.h"
+
+// Directory of ready-to-map images, one per executable content and VM build
+typedef struct {
+    char* directory;
+    uint64_t maxSize; // In bytes, 0 means unlimited
+} ImageCache;
+
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+} ImageCacheStats;
+
+void initImageCache(ImageCache* cache, const char* directory, uint64_t maxSize);
+void freeImageCache(ImageCache* cache);
+
+bool cache_key(const char* path, ImageKey* key);
+bool cache_lookup(ImageCache* cache, const ImageKey* key, Memory* memory, LMips* mips, DebugInfo* debug);
+bool cache_store(ImageCache* cache, const ImageKey* key, const LMips* mips, const DebugInfo* debug);
+bool cache_stats(ImageCache* cache, ImageCacheStats* stats);
+
+#endif //LMIPS_IMAGECACHE
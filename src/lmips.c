@@ -1,18 +1,40 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
 
 #include "lmips.h"
 #include "lmips_opcodes.h"
+#include "syscalls.h"
+#include "devices.h"
+#include "harts.h"
+#include "translator.h"
 
 void resetSimulator(LMips* mips) {
     mips->ip = 0;
     mips->hi = 0;
     mips->lo = 0;
     mips->heap = 0;
+    mips->icount = 0;
+    mips->stopCount = UINT64_MAX;
+    mips->breakpoint = UINT32_MAX;
     mips->stop = false;
+    mips->reservation = UINT32_MAX;
+    mips->transmitted = 0;
+    initScanner(&mips->scanner, STDIN_FILENO);
+    initFdStream(&mips->errors, STDERR_FILENO);
+    initFileTable(&mips->files);
+    mips->allocator = NULL;
+    initConsole(&mips->console, STDOUT_FILENO, isatty(STDOUT_FILENO) ? CONSOLE_LINE_BUFFERED : CONSOLE_FULLY_BUFFERED);
     mips->program = NULL;
     mips->memory = NULL;
+    mips->debug = NULL;
+    mips->hartId = 0;
+    mips->process = mips;
+    mips->harts = NULL;
+    mips->coverage = NULL;
+    mips->translator = NULL;
+    initSyscalls(mips);
 
     // Init all registers to 0
     for (size_t i = 0; i < REG_COUNT; i++) {
@@ -39,10 +61,34 @@ void initSimulator(LMips* mips, Memory* memory) {
 }
 
 void freeSimulator(LMips* mips) {
+    if (mips->harts != NULL && mips->hartId == 0) {
+        freeHarts(mips);
+    }
+    freeConsole(&mips->console);
+    freeScanner(&mips->scanner);
+    freeStream(&mips->errors);
+    freeFileTable(&mips->files);
+    freeGuestHeap(mips->allocator);
     resetSimulator(mips);
 }
 
-ExecutionResult runSimulator(LMips* mips) {
+void lmips_set_input(LMips* mips, const Stream* input) {
+    freeScanner(&mips->scanner);
+    initScannerStream(&mips->scanner, input);
+}
+
+void lmips_set_output(LMips* mips, const Stream* output) {
+    ConsoleMode mode = mips->console.mode;
+    freeConsole(&mips->console);
+    initConsoleStream(&mips->console, output, mode);
+}
+
+void lmips_set_errors(LMips* mips, const Stream* errors) {
+    freeStream(&mips->errors);
+    mips->errors = *errors;
+}
+
+static ExecutionResult execute(LMips* mips) {
     if (mips->program == NULL) {
         fprintf(stderr, "Invalid program provided.\n");
         return EXEC_FAILURE;
@@ -83,13 +129,53 @@ ExecutionResult runSimulator(LMips* mips) {
     } while(false)
 #define BINU_OP(op) (mips->regs[GET_RD(instr)] = mips->regs[GET_RS(instr)] op mips->regs[GET_RT(instr)])
 #define CHECK_MEM_ADDR(offset, align, address) \
-    if ((offset % align != 0) || address >= MEMORY_SIZE || address < DATA_ADDRESS) return EXEC_ERR_MEMORY_ADDR
+    if ((offset % align != 0) || !mem_valid(mips->memory, address)) \
+        return EXEC_ERR_MEMORY_ADDR
+// Stores outside of the guest memory fall back to the devices, then leave the switch
+#define CHECK_STORE_ADDR(offset, align, address, size) \
+    if (offset % align != 0) \
+        return EXEC_ERR_MEMORY_ADDR; \
+    if (!mem_valid(mips->memory, address)) { \
+        if (!device_store(mips, address, size, mips->regs[GET_RT(instr)])) \
+            return EXEC_ERR_MEMORY_ADDR; \
+        break; \
+    } \
+    if (!mem_writable(mips->memory, address, size)) \
+        return EXEC_ERR_MEMORY_ADDR
+// Atomic accesses need an aligned word that the guest can write
+#define CHECK_ATOMIC_ADDR(address) \
+    if (address % 4 != 0 || !mem_valid(mips->memory, address) || !mem_writable(mips->memory, address, 4)) \
+        return EXEC_ERR_MEMORY_ADDR
+// Counts the edge for the fuzzer and an entry into the block it leads to for the translator
+#define TAKE_EDGE() \
+    if (mips->coverage != NULL) { \
+        uint8_t* counter = &mips->coverage[COVERAGE_EDGE(ip, mips->ip)]; \
+        *counter += *counter < UINT8_MAX; \
+    } \
+    if (mips->translator != NULL) { \
+        translator_heat(mips->translator, mips->ip); \
+    }
 #define COMP_OP(op) \
     if ((int32_t)(mips->regs[GET_RS(instr)]) op 0) { \
         int32_t offset = sign_extend(GET_IMMED(instr) << 2, 14); \
         mips->ip += (offset - 4); \
     }
 
+        if (mips->ip == mips->breakpoint || mips->icount == mips->stopCount) {
+            return EXEC_BREAKPOINT;
+        }
+
+        // Translated blocks run whole, unless they hold the breakpoint or go past stopCount. One stopping
+        // early leaves the instruction it stopped at to the interpreter, right below.
+        if (mips->translator != NULL) {
+            const Translation* block = translator_lookup(mips->translator, mips->ip);
+            if (block != NULL && block->count <= mips->stopCount - mips->icount &&
+                    mips->breakpoint - block->start >= block->count * 4 && translation_run(mips, block)) {
+                continue;
+            }
+        }
+        mips->icount++;
+
         uint32_t ip = mips->ip;
         uint32_t instr = GET_INSTR(ip);
         uint8_t op = GET_OP(instr);
@@ -125,57 +211,24 @@ ExecutionResult runSimulator(LMips* mips) {
                     case SPE_JR: {
                         uint32_t rs = mips->regs[GET_RS(instr)];
                         mips->ip = rs;
+                        TAKE_EDGE()
                         break;
                     }
                     case SPE_JALR: {
                         uint8_t rd = GET_RD(instr);
                         mips->regs[rd <= 0 ? $ra : rd] = mips->ip;
                         mips->ip = mips->regs[GET_RS(instr)];
+                        TAKE_EDGE()
+                        break;
+                    }
+                    case SPE_SYNC: {
+                        atomic_thread_fence(memory_order_seq_cst);
                         break;
                     }
                     case SPE_SYSCALL: {
-                        switch (mips->regs[$v0]) {
-                            case SYS_PRINT_INT: {
-                                printf("%d", mips->regs[$a0]);
-                                break;
-                            }
-                            case SYS_PRINT_STRING: {
-                                CHECK_MEM_ADDR(0, 1, mips->regs[$a0]);
-                                const char* string = (const char*)&mips->memory->store[mips->regs[$a0]];
-                                printf("%s", string);
-                                fflush(stdout);
-                                break;
-                            }
-                            case SYS_READ_INT: {
-                                char buffer[12];
-                                fgets(buffer, 11, stdin);
-                                buffer[strlen(buffer)] = '\0';
-                                mips->regs[$v0] = strtoul(buffer, NULL, 0);
-                                break;
-                            }
-                            case SYS_READ_STRING: {
-                                uint32_t address = mips->regs[$a0];
-                                CHECK_MEM_ADDR(0, 1, address);
-                                fgets((char*)&mips->memory->store[address], mips->regs[$a1], stdin);
-                                mips->memory->store[address + strlen((char*)&mips->memory->store[address]) - 1] = '\0';
-                                break;
-                            }
-                            case SYS_SBRK: {
-                                mips->regs[$v0] = mips->heap;
-                                mips->heap += mips->regs[$a0];
-                                CHECK_MEM_ADDR(0, 1, mips->heap);
-                                break;
-                            }
-                            case SYS_EXIT: {
-                                mips->stop = true;
-                                break;
-                            }
-                            default: {
-                                fprintf(stderr, "Unknown syscall instruction %d\n", mips->regs[$v0]);
-                                result = EXEC_FAILURE;
-                                break;
-                            }
-                        }
+                        uint32_t code = mips->regs[$v0];
+                        SyscallHandler handler = mips->syscalls[code < SYSCALL_COUNT ? code : 0];
+                        result = mips->harts != NULL ? hart_syscall(mips, handler) : handler(mips);
                         break;
                     }
                     case SPE_MFHI: {
@@ -279,12 +332,14 @@ ExecutionResult runSimulator(LMips* mips) {
             case OP_J: {
                 int32_t jt = GET_JT(instr);
                 mips->ip = jt << 2;
+                TAKE_EDGE()
                 break;
             }
             case OP_JAL: {
                 int32_t jt = GET_JT(instr);
                 mips->regs[$ra] = mips->ip;
                 mips->ip = jt << 2;
+                TAKE_EDGE()
                 break;
             }
             case OP_BEQ: {
@@ -292,6 +347,7 @@ ExecutionResult runSimulator(LMips* mips) {
                     int32_t offset = sign_extend(GET_IMMED(instr) << 2, 14);
                     mips->ip += (offset - 4);
                 }
+                TAKE_EDGE()
                 break;
             }
             case OP_BNE: {
@@ -299,14 +355,17 @@ ExecutionResult runSimulator(LMips* mips) {
                     int32_t offset = sign_extend(GET_IMMED(instr) << 2, 14);
                     mips->ip += (offset - 4);
                 }
+                TAKE_EDGE()
                 break;
             }
             case OP_BLEZ: {
                 COMP_OP(<=)
+                TAKE_EDGE()
                 break;
             }
             case OP_BGTZ: {
                 COMP_OP(>)
+                TAKE_EDGE()
                 break;
             }
             case OP_ADDI: {
@@ -404,7 +463,7 @@ ExecutionResult runSimulator(LMips* mips) {
             case OP_SB: {
                 int16_t offset = GET_IMMED(instr);
                 uint32_t address = mips->regs[GET_RS(instr)] + offset;
-                CHECK_MEM_ADDR(offset, 1, address);
+                CHECK_STORE_ADDR(offset, 1, address, 1);
 
                 mem_write_byte(mips->memory, address, (uint8_t)mips->regs[GET_RT(instr)]);
 
@@ -413,7 +472,7 @@ ExecutionResult runSimulator(LMips* mips) {
             case OP_SH: {
                 int16_t offset = GET_IMMED(instr);
                 uint32_t address = mips->regs[GET_RS(instr)] + offset;
-                CHECK_MEM_ADDR(offset, 1, address);
+                CHECK_STORE_ADDR(offset, 1, address, 2);
 
                 mem_write_half(mips->memory, address, mips->regs[GET_RT(instr)]);
 
@@ -422,12 +481,54 @@ ExecutionResult runSimulator(LMips* mips) {
             case OP_SW: {
                 int16_t offset = GET_IMMED(instr);
                 uint32_t address = mips->regs[GET_RS(instr)] + offset;
-                CHECK_MEM_ADDR(offset, 1, address);
+                CHECK_STORE_ADDR(offset, 1, address, 4);
 
                 mem_write(mips->memory, address, mips->regs[GET_RT(instr)]);
 
                 break;
             }
+            case OP_LL: {
+                int16_t offset = GET_IMMED(instr);
+                uint32_t address = mips->regs[GET_RS(instr)] + offset;
+                CHECK_ATOMIC_ADDR(address);
+
+                mips->reserved = mem_read(mips->memory, address);
+                mips->reservation = address;
+                mips->regs[GET_RT(instr)] = mips->reserved;
+                break;
+            }
+            case OP_SC: {
+                int16_t offset = GET_IMMED(instr);
+                uint32_t address = mips->regs[GET_RS(instr)] + offset;
+                CHECK_ATOMIC_ADDR(address);
+
+                // Succeeds when the word still holds what ll loaded, stores in between that put the same value
+                // back go unnoticed
+                uint8_t rt = GET_RT(instr);
+                bool stored = mips->reservation == address &&
+                              mem_compare_exchange(mips->memory, address, mips->reserved, mips->regs[rt]);
+                mips->reservation = UINT32_MAX;
+                mips->regs[rt] = stored;
+                break;
+            }
+            case OP_AMOADD: {
+                int16_t offset = GET_IMMED(instr);
+                uint32_t address = mips->regs[GET_RS(instr)] + offset;
+                CHECK_ATOMIC_ADDR(address);
+
+                uint8_t rt = GET_RT(instr);
+                mips->regs[rt] = mem_fetch_add(mips->memory, address, mips->regs[rt]);
+                break;
+            }
+            case OP_AMOSWAP: {
+                int16_t offset = GET_IMMED(instr);
+                uint32_t address = mips->regs[GET_RS(instr)] + offset;
+                CHECK_ATOMIC_ADDR(address);
+
+                uint8_t rt = GET_RT(instr);
+                mips->regs[rt] = mem_exchange(mips->memory, address, mips->regs[rt]);
+                break;
+            }
             default:
                 fprintf(stderr, "Unknown instruction %d\n", op);
                 result = EXEC_FAILURE;
@@ -435,6 +536,34 @@ ExecutionResult runSimulator(LMips* mips) {
         }
     }
 
+    return result;
+}
+
+ExecutionResult executeSimulator(LMips* mips) {
+    ExecutionResult result = execute(mips);
+    hart_lock(mips);
+    console_flush(&mips->process->console);
+    hart_unlock(mips);
+
+    return result;
+}
+
+ExecutionResult execInstruction(LMips* mips) {
+    uint64_t stopCount = mips->stopCount;
+    uint32_t breakpoint = mips->breakpoint;
+    mips->stopCount = mips->icount + 1;
+    mips->breakpoint = UINT32_MAX;
+
+    ExecutionResult result = execute(mips);
+    mips->stopCount = stopCount;
+    mips->breakpoint = breakpoint;
+
+    return result == EXEC_BREAKPOINT ? EXEC_SUCCESS : result;
+}
+
+ExecutionResult runSimulator(LMips* mips) {
+    // Guest output comes before any fault report
+    ExecutionResult result = executeSimulator(mips);
     if (result != EXEC_SUCCESS) {
         handleException(result, mips);
     }
@@ -442,10 +571,31 @@ ExecutionResult runSimulator(LMips* mips) {
     return result;
 }
 
+// Prints where the faulting instruction comes from when the executable has debug sections
+static void printLocation(LMips* mips, uint32_t ip) {
+    if (mips->debug == NULL) return;
+
+    Symbol symbol;
+    uint32_t line;
+    if (debug_find_symbol(mips->debug, SEGMENT_TEXT, ip, &symbol)) {
+        fprintf(stderr, "    in %s+%#x", symbol.name, ip - symbol.address);
+        if (debug_find_line(mips->debug, ip, &line)) {
+            fprintf(stderr, " (line %u)", line);
+        }
+        fprintf(stderr, "\n");
+    } else if (debug_find_line(mips->debug, ip, &line)) {
+        fprintf(stderr, "    at line %u\n", line);
+    }
+}
+
 void handleException(ExecutionResult exc, LMips* mips) {
     if (exc == EXEC_ERR_INT_OVERFLOW) {
         fprintf(stderr, "[%#08x] Integer overflow exception.\n", PROGRAM_ADDRESS + mips->ip);
     } else if (exc == EXEC_ERR_MEMORY_ADDR) {
         fprintf(stderr, "[%#08x] Invalid memory address.\n", PROGRAM_ADDRESS + mips->ip);
+    } else {
+        return;
     }
+
+    printLocation(mips, mips->ip - 4);
 }
@@ -1,35 +1,81 @@
 #ifndef LMIPS_MIPS
 #define LMIPS_MIPS
 
+#include <stdatomic.h>
 #include "common.h"
 #include "memory.h"
+#include "debuginfo.h"
+#include "console.h"
+#include "scanner.h"
+#include "files.h"
+#include "allocator.h"
 #include "lmips_registers.h"
 
-struct lm {
-    uint8_t* program;
-    uint32_t regs[REG_COUNT];
-    uint32_t ip;
-    uint32_t hi, lo;
-    uint32_t heap;
-    Memory* memory;
-    bool stop;
-};
+#define SYSCALL_COUNT 64
+#define COVERAGE_SIZE 0x10000
+// Coverage counter of the control flow edge from the branch or jump at `from` to `to`, both text offsets
+#define COVERAGE_EDGE(from, to) (((((from) >> 2) * 0x9E3779B1u) ^ ((to) >> 2)) & (COVERAGE_SIZE - 1))
 
 typedef enum {
     EXEC_SUCCESS,
     EXEC_FAILURE,
     EXEC_ERR_INT_OVERFLOW,
-    EXEC_ERR_MEMORY_ADDR
+    EXEC_ERR_MEMORY_ADDR,
+    EXEC_BREAKPOINT,
+    EXEC_BLOCKED // A read syscall found a non-blocking input empty, it runs again on resume
 } ExecutionResult ;
 
 typedef struct lm LMips;
 
+// Called for `syscall` with the code in $v0. The guest stops when it returns anything but EXEC_SUCCESS.
+typedef ExecutionResult (*SyscallHandler)(LMips* mips);
+
+struct lm {
+    uint8_t* program;
+    uint32_t regs[REG_COUNT];
+    uint32_t ip;
+    uint32_t hi, lo;
+    uint32_t heap;
+    Memory* memory;
+    DebugInfo* debug; // Optional, only used for fault reports
+    uint64_t icount; // Instructions executed so far
+    uint64_t stopCount; // runSimulator returns EXEC_BREAKPOINT once icount reaches it
+    uint32_t breakpoint; // or before executing the instruction at this address
+    _Atomic bool stop; // Set by other harts when hart 0 exits
+    Console console;
+    uint32_t reservation; // Address loaded by the last ll, UINT32_MAX when there is none
+    uint32_t reserved; // and the value sc expects to find there
+    uint32_t transmitted; // Bytes stored in the console device buffer since its last transmission
+    Scanner scanner;
+    Stream errors; // Guest fd 2
+    FileTable files;
+    GuestHeap* allocator; // Created by the first allocation syscall
+    SyscallHandler syscalls[SYSCALL_COUNT]; // Indexed by code, unused codes fail
+    uint32_t hartId;
+    LMips* process; // Hart 0, whose console, input, files and heap every hart uses. The VM itself for hart 0.
+    struct hartgroup* harts; // Created by the first SYS_HART_SPAWN, see harts.h
+    uint8_t* coverage; // Optional, COVERAGE_SIZE saturating counters of the branch and jump edges taken
+    struct translator* translator; // Optional, shared by the harts, see translator.h
+};
+
 void initTestSimulator(LMips* mips, uint8_t* program);
 void initSimulator(LMips* mips, Memory* memory);
 void freeSimulator(LMips* mips);
 ExecutionResult runSimulator(LMips* mips);
+// Same as runSimulator without reporting faults on stderr
+ExecutionResult executeSimulator(LMips* mips);
+// Runs the instruction at ip alone, without flushing the console nor stopping at the breakpoint
 ExecutionResult execInstruction(LMips* mips);
 
+// Replaces the handler of a syscall code, returns false when the code is out of the table
+bool lmips_register_syscall(LMips* mips, uint32_t code, SyscallHandler handler);
+
+// Replace the host ends of the guest standard streams, fds 0 to 2 by default. The VM owns them from then on,
+// buffer streams can be read back with stream_contents until freeSimulator.
+void lmips_set_input(LMips* mips, const Stream* input);
+void lmips_set_output(LMips* mips, const Stream* output);
+void lmips_set_errors(LMips* mips, const Stream* errors);
+
 void handleException(ExecutionResult, LMips*);
 
 #endif // LMIPS_MIPS
@@ -0,0 +1,167 @@
+#include <stdlib.h>
+#include <string.h>
+#include "lmips_api.h"
+#include "lmips.h"
+#include "loader.h"
+#include "translator.h"
+
+struct lmipsvm {
+    Memory memory;
+    LMips mips;
+    Executable executable;
+    bool loaded;
+};
+
+LMipsVM* lmips_create(void) {
+    LMipsVM* vm = calloc(1, sizeof(LMipsVM));
+    if (vm == NULL) return NULL;
+
+    initMemory(&vm->memory);
+    if (vm->memory.store == NULL) {
+        free(vm);
+        return NULL;
+    }
+
+    // Embedded VMs are not attached to a terminal
+    initSimulator(&vm->mips, &vm->memory);
+    vm->mips.console.mode = CONSOLE_FULLY_BUFFERED;
+    return vm;
+}
+
+void lmips_destroy(LMipsVM* vm) {
+    if (vm == NULL) return;
+
+    freeSimulator(&vm->mips);
+    if (vm->loaded) {
+        freeExecutable(&vm->executable);
+    }
+    freeMemory(&vm->memory);
+    free(vm);
+}
+
+static LMipsLoadStatus loaded(LMipsVM* vm, LoadResult result) {
+    switch (result) {
+        case LOAD_SUCCESS:
+            vm->loaded = true;
+            vm->mips.ip = vm->executable.entry;
+            vm->mips.debug = &vm->executable.debug;
+            return LMIPS_LOADED;
+        case LOAD_ERR_OPEN:
+            return LMIPS_ERR_OPEN;
+        case LOAD_ERR_OBJECT:
+            return LMIPS_ERR_OBJECT;
+        default:
+            return LMIPS_ERR_FORMAT;
+    }
+}
+
+LMipsLoadStatus lmips_load_file(LMipsVM* vm, const char* path) {
+    if (vm->loaded) return LMIPS_ERR_STATE;
+
+    return loaded(vm, loadExecutable(path, &vm->memory, &vm->executable));
+}
+
+LMipsLoadStatus lmips_load_buffer(LMipsVM* vm, const void* bytes, size_t size) {
+    if (vm->loaded) return LMIPS_ERR_STATE;
+
+    return loaded(vm, loadExecutableBuffer(bytes, size, &vm->memory, &vm->executable));
+}
+
+LMipsRunStatus lmips_run(LMipsVM* vm, uint64_t budget) {
+    if (!vm->loaded) return LMIPS_FAULT;
+
+    LMips* mips = &vm->mips;
+    mips->stopCount = budget > UINT64_MAX - mips->icount ? UINT64_MAX : mips->icount + budget;
+
+    switch (executeSimulator(mips)) {
+        case EXEC_SUCCESS:
+            return LMIPS_EXITED;
+        case EXEC_BREAKPOINT:
+            return LMIPS_BUDGET;
+        case EXEC_ERR_MEMORY_ADDR:
+            return LMIPS_FAULT_MEMORY;
+        case EXEC_ERR_INT_OVERFLOW:
+            return LMIPS_FAULT_OVERFLOW;
+        default:
+            return LMIPS_FAULT;
+    }
+}
+
+uint64_t lmips_instruction_count(const LMipsVM* vm) {
+    return vm->mips.icount;
+}
+
+uint32_t lmips_get_register(const LMipsVM* vm, int index) {
+    const LMips* mips = &vm->mips;
+    if (index >= 0 && index < REG_COUNT) return mips->regs[index];
+
+    switch (index) {
+        case LMIPS_REG_PC: return PROGRAM_ADDRESS + mips->ip;
+        case LMIPS_REG_HI: return mips->hi;
+        case LMIPS_REG_LO: return mips->lo;
+        default: return 0;
+    }
+}
+
+void lmips_set_register(LMipsVM* vm, int index, uint32_t value) {
+    LMips* mips = &vm->mips;
+    if (index > 0 && index < REG_COUNT) {
+        mips->regs[index] = value;
+        return;
+    }
+
+    switch (index) {
+        case LMIPS_REG_PC: mips->ip = value - PROGRAM_ADDRESS; break;
+        case LMIPS_REG_HI: mips->hi = value; break;
+        case LMIPS_REG_LO: mips->lo = value; break;
+        default: break;
+    }
+}
+
+static bool inRange(LMipsVM* vm, uint32_t address, size_t size) {
+    if (size > MEMORY_SIZE || address > MEMORY_SIZE - size) return false;
+
+    // The host sees the memory as the guest does, once the loader is done with it
+    if (vm->loaded) {
+        waitExecutable(&vm->executable);
+    }
+    return true;
+}
+
+bool lmips_read_memory(LMipsVM* vm, uint32_t address, void* bytes, size_t size) {
+    if (!inRange(vm, address, size)) return false;
+
+    memcpy(bytes, &vm->memory.store[address], size);
+    return true;
+}
+
+bool lmips_write_memory(LMipsVM* vm, uint32_t address, const void* bytes, size_t size) {
+    if (!inRange(vm, address, size) || !mem_writable(&vm->memory, address, size)) return false;
+
+    memcpy(&vm->memory.store[address], bytes, size);
+    mem_mark(&vm->memory, address, size);
+    // Guest stores can't reach the text, only this can
+    if (vm->mips.translator != NULL && address < DATA_ADDRESS && address + size > PROGRAM_ADDRESS) {
+        uint32_t start = address > PROGRAM_ADDRESS ? address : PROGRAM_ADDRESS;
+        translator_invalidate(vm->mips.translator, start - PROGRAM_ADDRESS, address + size - start);
+    }
+    return true;
+}
+
+bool lmips_feed_input(LMipsVM* vm, const void* bytes, size_t size) {
+    Stream input;
+    if (!initBufferStream(&input, bytes, size)) return false;
+
+    lmips_set_input(&vm->mips, &input);
+    return true;
+}
+
+void lmips_capture_output(LMipsVM* vm) {
+    Stream output;
+    initBufferStream(&output, NULL, 0);
+    lmips_set_output(&vm->mips, &output);
+}
+
+const char* lmips_output(const LMipsVM* vm, size_t* size) {
+    return (const char*)stream_contents(&vm->mips.console.stream, size);
+}
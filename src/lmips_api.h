@@ -0,0 +1,71 @@
+#ifndef LMIPS_API
+#define LMIPS_API
+
+// Embedding API of liblmips. Handles share nothing, any number of VMs can run on different threads
+// as long as each one is only used by one thread at a time.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LMIPS_EXPORT __attribute__((visibility("default")))
+
+// Register indices past the 32 general purpose ones
+#define LMIPS_REG_PC 32
+#define LMIPS_REG_HI 33
+#define LMIPS_REG_LO 34
+
+typedef struct lmipsvm LMipsVM;
+
+typedef enum {
+    LMIPS_LOADED,
+    LMIPS_ERR_OPEN,
+    LMIPS_ERR_FORMAT,
+    LMIPS_ERR_OBJECT, // A relocatable object, not linked yet
+    LMIPS_ERR_STATE // A program is already loaded
+} LMipsLoadStatus;
+
+typedef enum {
+    LMIPS_EXITED,
+    LMIPS_BUDGET, // The instruction budget ran out, lmips_run resumes the program
+    LMIPS_FAULT_MEMORY,
+    LMIPS_FAULT_OVERFLOW,
+    LMIPS_FAULT // Unknown instruction or syscall, or nothing loaded
+} LMipsRunStatus;
+
+// NULL when out of memory
+LMIPS_EXPORT LMipsVM* lmips_create(void);
+LMIPS_EXPORT void lmips_destroy(LMipsVM* vm);
+
+LMIPS_EXPORT LMipsLoadStatus lmips_load_file(LMipsVM* vm, const char* path);
+// `bytes` can be released on return
+LMIPS_EXPORT LMipsLoadStatus lmips_load_buffer(LMipsVM* vm, const void* bytes, size_t size);
+
+// Runs at most `budget` instructions, UINT64_MAX for no limit
+LMIPS_EXPORT LMipsRunStatus lmips_run(LMipsVM* vm, uint64_t budget);
+LMIPS_EXPORT uint64_t lmips_instruction_count(const LMipsVM* vm);
+
+// Registers 0 to 31 then LMIPS_REG_*. Writes to $zero and unknown indices are ignored.
+LMIPS_EXPORT uint32_t lmips_get_register(const LMipsVM* vm, int index);
+LMIPS_EXPORT void lmips_set_register(LMipsVM* vm, int index, uint32_t value);
+
+// Whole guest address space, false when out of range or, for writes, read-only
+LMIPS_EXPORT bool lmips_read_memory(LMipsVM* vm, uint32_t address, void* bytes, size_t size);
+LMIPS_EXPORT bool lmips_write_memory(LMipsVM* vm, uint32_t address, const void* bytes, size_t size);
+
+// Standard input read from a copy of `bytes` instead of the process stdin
+LMIPS_EXPORT bool lmips_feed_input(LMipsVM* vm, const void* bytes, size_t size);
+// Standard output kept in memory instead of going to the process stdout, see lmips_output
+LMIPS_EXPORT void lmips_capture_output(LMipsVM* vm);
+// Output captured so far, valid until the next run. NULL when nothing was captured.
+LMIPS_EXPORT const char* lmips_output(const LMipsVM* vm, size_t* size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //LMIPS_API
@@ -25,7 +25,11 @@ enum OpCodes {
     OP_LHU,
     OP_SB = 0x28,
     OP_SH,
-    OP_SW
+    OP_SW,
+    OP_LL = 0x30,
+    OP_AMOADD, // rt = MEM[rs + i], MEM[rs + i] += rt, as one atomic access
+    OP_AMOSWAP, // rt = MEM[rs + i], MEM[rs + i] = rt, as one atomic access
+    OP_SC = 0x38
 };
 
 enum SpecialCodes {
@@ -38,6 +42,7 @@ enum SpecialCodes {
     SPE_JR,
     SPE_JALR,
     SPE_SYSCALL = 0x0C,
+    SPE_SYNC = 0x0F,
     SPE_MFHI = 0x10,
     SPE_MTHI,
     SPE_MFLO,
@@ -64,7 +69,25 @@ enum SysCallCodes {
     SYS_READ_INT,
     SYS_READ_STRING,
     SYS_SBRK = 0x09,
-    SYS_EXIT
+    SYS_EXIT,
+    SYS_OPEN = 0x0D,
+    SYS_READ,
+    SYS_WRITE,
+    SYS_CLOSE,
+    SYS_MMAP = 0x12,
+    SYS_MALLOC = 0x14,
+    SYS_FREE,
+    SYS_REALLOC,
+    SYS_MEMCPY,
+    SYS_MEMMOVE,
+    SYS_MEMSET,
+    SYS_MEMCMP,
+    SYS_STRLEN,
+    SYS_HART_SPAWN,
+    SYS_HART_JOIN,
+    SYS_HART_ID,
+    SYS_FUTEX_WAIT,
+    SYS_FUTEX_WAKE
 };
 
 enum SriCodes {
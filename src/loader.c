@@ -0,0 +1,344 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "loader.h"
+#include "threadpool.h"
+
+#define HEADER_SIZE (120 / 8)
+#define SECTION_HEADER_SIZE 11
+
+// Data sections above the threshold are copied by the pool while the program starts
+#define PARALLEL_THRESHOLD (256 * 1024)
+#define CHUNK_SIZE (64 * 1024)
+#define MAX_LOADER_THREADS 4
+
+typedef struct {
+    struct loadjob* job;
+    uint8_t* target;
+    const uint8_t* source;
+    uint32_t size;
+} Chunk;
+
+struct loadjob {
+    MemoryBarrier barrier;
+    ThreadPool pool;
+    Memory* memory;
+    uint8_t* file;
+    size_t fileSize;
+    Chunk* chunks;
+};
+
+static uint32_t read_word(const uint8_t* bytes) {
+    return ((uint32_t)bytes[0] << 24) | (bytes[1] << 16) | (bytes[2] << 8) | bytes[3];
+}
+
+static uint16_t read_half(const uint8_t* bytes) {
+    return (bytes[0] << 8) | bytes[1];
+}
+
+static bool getHeader(const uint8_t* file, size_t size, FileHeader* header) {
+    char format[4] = {0x10, 'L', 'E', 'F'};
+
+    if (size < HEADER_SIZE || memcmp(file, format, 4) != 0) {
+        return false;
+    }
+
+    memcpy(header->magic, file, 4);
+    header->major = file[4];
+    header->minor = file[5];
+    header->entry = read_word(&file[6]);
+    header->shAddress = read_word(&file[10]);
+    header->shCount = file[14];
+
+    header->size = HEADER_SIZE;
+
+    return (uint64_t)header->shAddress + header->shCount * SECTION_HEADER_SIZE <= size;
+}
+
+// Gathers the CPUs of the NUMA node the caller (the guest thread) runs on, so that the pages
+// first touched by the loader threads end up on the guest's node
+static bool localCpus(cpu_set_t* cpus) {
+    int cpu = sched_getcpu();
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+
+    DIR* directory = cpu >= 0 ? opendir(path) : NULL;
+    if (directory == NULL) return false;
+
+    int node = -1;
+    struct dirent* entry;
+    while ((entry = readdir(directory)) != NULL) {
+        if (strncmp(entry->d_name, "node", 4) == 0 && isDigit(entry->d_name[4])) {
+            node = atoi(entry->d_name + 4);
+            break;
+        }
+    }
+    closedir(directory);
+    if (node < 0) return false;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+    FILE* list = fopen(path, "r");
+    if (list == NULL) return false;
+
+    cpu_set_t allowed;
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+    CPU_ZERO(cpus);
+
+    // Format is "0-3,8-11"
+    int first, last;
+    while (fscanf(list, "%d", &first) == 1) {
+        last = first;
+        int separator = fgetc(list);
+        if (separator == '-') {
+            fscanf(list, "%d", &last);
+            separator = fgetc(list);
+        }
+        for (int i = first; i <= last && i < CPU_SETSIZE; ++i) {
+            if (CPU_ISSET(i, &allowed)) CPU_SET(i, cpus);
+        }
+        if (separator != ',') break;
+    }
+    fclose(list);
+
+    return CPU_COUNT(cpus) > 0;
+}
+
+static void copyChunk(void* arg) {
+    Chunk* chunk = arg;
+    MemoryBarrier* barrier = &chunk->job->barrier;
+
+    memcpy(chunk->target, chunk->source, chunk->size);
+
+    pthread_mutex_lock(&barrier->lock);
+    if (--barrier->remaining == 0) {
+        pthread_cond_broadcast(&barrier->done);
+    }
+    pthread_mutex_unlock(&barrier->lock);
+}
+
+// Splits [dataStart, dataEnd) in chunks copied in the background. Guest accesses to the data
+// segment go through mem_fault until the copy is over.
+static bool startBackgroundCopy(Executable* executable, Memory* memory, uint8_t* file, size_t fileSize,
+                                const Chunk* copies, int copyCount) {
+    struct loadjob* job = calloc(1, sizeof(struct loadjob));
+    if (job == NULL) return false;
+
+    uint32_t count = 0;
+    for (int i = 0; i < copyCount; ++i) {
+        count += (copies[i].size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    }
+
+    job->chunks = malloc(count * sizeof(Chunk));
+    cpu_set_t cpus;
+    bool local = localCpus(&cpus);
+    int threads = local ? CPU_COUNT(&cpus) : pool_default_threads();
+    threads = threads < MAX_LOADER_THREADS ? threads : MAX_LOADER_THREADS;
+
+    if (job->chunks == NULL || !initThreadPool(&job->pool, threads, local ? &cpus : NULL)) {
+        if (job->pool.threads != NULL) freeThreadPool(&job->pool);
+        free(job->chunks);
+        free(job);
+        return false;
+    }
+
+    job->memory = memory;
+    job->file = file;
+    job->fileSize = fileSize;
+    job->barrier.remaining = count;
+    pthread_mutex_init(&job->barrier.lock, NULL);
+    pthread_cond_init(&job->barrier.done, NULL);
+
+    uint32_t dataEnd = DATA_ADDRESS;
+    uint32_t chunk = 0;
+    for (int i = 0; i < copyCount; ++i) {
+        for (uint32_t offset = 0; offset < copies[i].size; offset += CHUNK_SIZE) {
+            uint32_t remaining = copies[i].size - offset;
+
+            job->chunks[chunk].job = job;
+            job->chunks[chunk].target = copies[i].target + offset;
+            job->chunks[chunk].source = copies[i].source + offset;
+            job->chunks[chunk].size = remaining < CHUNK_SIZE ? remaining : CHUNK_SIZE;
+            chunk++;
+        }
+
+        uint32_t end = (uint32_t)(copies[i].target - memory->store) + copies[i].size;
+        dataEnd = end > dataEnd ? end : dataEnd;
+    }
+
+    memory->pending = &job->barrier;
+    memory->base = dataEnd;
+    executable->job = job;
+
+    for (uint32_t i = 0; i < count; ++i) {
+        if (!pool_submit(&job->pool, copyChunk, &job->chunks[i])) {
+            copyChunk(&job->chunks[i]);
+        }
+    }
+
+    return true;
+}
+
+static void release(uint8_t* mapped, size_t size) {
+    if (mapped != NULL) munmap(mapped, size);
+}
+
+// `mapped` is the mapping of `file` when the loader owns it, only then can the data be copied in the background
+static LoadResult loadImage(const uint8_t* file, size_t size, uint8_t* mapped, const char* path,
+                            Memory* memory, Executable* executable) {
+    // Get file header
+    FileHeader header;
+    if (!getHeader(file, size, &header)) {
+        release(mapped, size);
+        return LOAD_ERR_FORMAT;
+    }
+
+    executable->header = header;
+    executable->entry = header.entry - header.size;
+    executable->job = NULL;
+    initDebugInfo(&executable->debug, path);
+
+    uint32_t programOffset = PROGRAM_ADDRESS;
+    uint32_t dataOffset = DATA_ADDRESS;
+    Chunk copies[header.shCount > 0 ? header.shCount : 1];
+    int copyCount = 0;
+    uint64_t dataSize = 0;
+
+    // Locate every section first, the program is copied right away and the data possibly in the background
+    for (int i = 0; i < header.shCount; ++i) {
+        const uint8_t* entry = &file[header.shAddress + i * SECTION_HEADER_SIZE];
+        SectionHeader section;
+        section.name = read_half(entry);
+        section.type = entry[2];
+        section.address = read_word(&entry[3]);
+        section.size = read_word(&entry[7]);
+
+        if ((uint64_t)section.address + section.size > size) {
+            freeExecutable(executable);
+            release(mapped, size);
+            return LOAD_ERR_FORMAT;
+        }
+
+        const uint8_t* source = &file[section.address];
+        uint32_t length = section.size;
+        switch (section.type) {
+            case SHT_EXEC: {
+                length &= ~3u;
+                if ((uint64_t)programOffset + length > DATA_ADDRESS) {
+                    freeExecutable(executable);
+                    release(mapped, size);
+                    return LOAD_ERR_FORMAT;
+                }
+
+                // Instructions are big-endian in the file as in memory
+                memcpy(&memory->store[programOffset], source, length);
+                programOffset += length;
+                continue;
+            }
+            case SHT_STRTAB: {
+                // Its first and last null bytes are not loaded
+                source += 1;
+                length = length >= 2 ? length - 2 : 0;
+                break;
+            }
+            case SHT_ALLOC:
+                break;
+            // Debug sections are only located here, they get mapped on demand
+            case SHT_SYMTAB: {
+                executable->debug.symtabOffset = section.address;
+                executable->debug.symtabSize = section.size;
+                continue;
+            }
+            case SHT_LINES: {
+                executable->debug.linesOffset = section.address;
+                executable->debug.linesSize = section.size;
+                continue;
+            }
+            case SHT_REL: {
+                freeExecutable(executable);
+                release(mapped, size);
+                return LOAD_ERR_OBJECT;
+            }
+            default:
+                continue;
+        }
+
+        if ((uint64_t)dataOffset + length > MEMORY_SIZE) {
+            freeExecutable(executable);
+            release(mapped, size);
+            return LOAD_ERR_FORMAT;
+        }
+
+        copies[copyCount].target = &memory->store[dataOffset];
+        copies[copyCount].source = source;
+        copies[copyCount].size = length;
+        copyCount++;
+        dataOffset += length;
+        dataSize += length;
+    }
+
+    if (mapped != NULL && dataSize >= PARALLEL_THRESHOLD &&
+        startBackgroundCopy(executable, memory, mapped, size, copies, copyCount)) {
+        return LOAD_SUCCESS;
+    }
+
+    for (int i = 0; i < copyCount; ++i) {
+        memcpy(copies[i].target, copies[i].source, copies[i].size);
+    }
+    release(mapped, size);
+
+    return LOAD_SUCCESS;
+}
+
+LoadResult loadExecutable(const char* path, Memory* memory, Executable* executable) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return LOAD_ERR_OPEN;
+    }
+
+    struct stat info;
+    uint8_t* file = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        file = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+
+    if (file == MAP_FAILED) {
+        return LOAD_ERR_FORMAT;
+    }
+
+    return loadImage(file, info.st_size, file, path, memory, executable);
+}
+
+LoadResult loadExecutableBuffer(const uint8_t* bytes, size_t size, Memory* memory, Executable* executable) {
+    return loadImage(bytes, size, NULL, NULL, memory, executable);
+}
+
+void waitExecutable(Executable* executable) {
+    struct loadjob* job = executable->job;
+    if (job == NULL) return;
+
+    pool_wait(&job->pool);
+    freeThreadPool(&job->pool);
+
+    if (job->memory->pending == &job->barrier) {
+        job->memory->pending = NULL;
+        job->memory->base = DATA_ADDRESS;
+    }
+
+    pthread_mutex_destroy(&job->barrier.lock);
+    pthread_cond_destroy(&job->barrier.done);
+    munmap(job->file, job->fileSize);
+    free(job->chunks);
+    free(job);
+    executable->job = NULL;
+}
+
+void freeExecutable(Executable* executable) {
+    waitExecutable(executable);
+    freeDebugInfo(&executable->debug);
+}
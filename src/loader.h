@@ -0,0 +1,28 @@
+#ifndef LMIPS_LOADER
+#define LMIPS_LOADER
+
+#include "executable.h"
+#include "debuginfo.h"
+#include "memory.h"
+
+typedef enum {
+    LOAD_SUCCESS,
+    LOAD_ERR_OPEN,
+    LOAD_ERR_FORMAT,
+    LOAD_ERR_OBJECT
+} LoadResult;
+
+typedef struct {
+    FileHeader header;
+    uint32_t entry; // Instruction pointer of the entry point
+    DebugInfo debug;
+    struct loadjob* job; // Sections still being copied in the background
+} Executable;
+
+LoadResult loadExecutable(const char* path, Memory* memory, Executable* executable);
+// Copies everything right away, `bytes` can be released on return. There is no debug info.
+LoadResult loadExecutableBuffer(const uint8_t* bytes, size_t size, Memory* memory, Executable* executable);
+void waitExecutable(Executable* executable);
+void freeExecutable(Executable* executable);
+
+#endif //LMIPS_LOADER
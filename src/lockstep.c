@@ -0,0 +1,326 @@
+#include <string.h>
+#include "lockstep.h"
+#include "lmips_opcodes.h"
+#include "harts.h"
+
+#define GET_OP(instr) (instr >> 0x1A)
+#define GET_RS(instr) ((instr >> 0x15) & 0x1F)
+#define GET_RT(instr) ((instr >> 0x10) & 0x1F)
+#define GET_RD(instr) ((instr >> 0x0B) & 0x1F)
+#define GET_SA(instr) ((instr >> 0x06) & 0x1F)
+#define GET_FUNC(instr) (instr & 0x3F)
+#define GET_IMMED(instr) (instr & 0xFFFF)
+#define GET_JT(instr) (instr & 0x3FFFFFF)
+
+// Every loop over the lanes has a constant trip count and no branch, the compiler turns them into a few vector
+// instructions. Lane masks are all ones for the lanes running the instruction, 0 for the others.
+#define EACH_LANE for (int lane = 0; lane < LOCKSTEP_LANES; ++lane)
+#define MASK(condition) (-(uint32_t)(condition))
+// Results in values, from the rs lane in s and the rt lane in t
+#define LANE_OP(expression) \
+    EACH_LANE { \
+        uint32_t s = rs[lane]; \
+        uint32_t t = rt[lane]; \
+        (void)s; \
+        (void)t; \
+        values[lane] = (expression); \
+    }
+
+void initLockStep(LockStep* lockstep) {
+    memset(lockstep, 0, sizeof(LockStep));
+    EACH_LANE {
+        lockstep->ip[lane] = UINT32_MAX;
+    }
+}
+
+bool lockstep_add(LockStep* lockstep, LMips* mips) {
+    if (lockstep->count == LOCKSTEP_LANES) return false;
+
+    int lane = lockstep->count++;
+    lockstep->lanes[lane] = mips;
+    for (int i = 0; i < REG_COUNT; ++i) {
+        lockstep->regs[i][lane] = mips->regs[i];
+    }
+    lockstep->ip[lane] = mips->ip;
+    lockstep->results[lane] = EXEC_SUCCESS;
+    return true;
+}
+
+static inline void commit(uint32_t* reg, const uint32_t* values, const uint32_t* active) {
+    EACH_LANE {
+        reg[lane] = (values[lane] & active[lane]) | (reg[lane] & ~active[lane]);
+    }
+}
+
+// Active lanes continue at next, counting a divergence when they don't all go the same way
+static void jump(LockStep* lockstep, const uint32_t* next, const uint32_t* active, int first) {
+    uint32_t differ = 0;
+    EACH_LANE {
+        differ |= (next[lane] ^ next[first]) & active[lane];
+    }
+    commit(lockstep->ip, next, active);
+
+    lockstep->stats.divergences += differ != 0;
+}
+
+// The interpreter runs the instruction in each lane's own VM, for the instructions and faults the lanes don't
+// handle together. Lanes it ends are done.
+static void scalar(LockStep* lockstep, uint32_t ip, const uint32_t* active) {
+    for (int lane = 0; lane < lockstep->count; ++lane) {
+        if (!active[lane]) continue;
+
+        LMips* mips = lockstep->lanes[lane];
+        for (int i = 0; i < REG_COUNT; ++i) {
+            mips->regs[i] = lockstep->regs[i][lane];
+        }
+        mips->ip = ip;
+
+        ExecutionResult result = execInstruction(mips);
+        for (int i = 0; i < REG_COUNT; ++i) {
+            lockstep->regs[i][lane] = mips->regs[i];
+        }
+        lockstep->ip[lane] = result == EXEC_SUCCESS && !mips->stop ? mips->ip : UINT32_MAX;
+        lockstep->results[lane] = result;
+        lockstep->stats.scalar++;
+    }
+}
+
+// Runs the instruction at ip in every active lane, returns false when it has to go through the interpreter
+static bool vector(LockStep* lockstep, uint32_t ip, uint32_t instr, const uint32_t* active, int first) {
+    const uint32_t* rs = lockstep->regs[GET_RS(instr)];
+    const uint32_t* rt = lockstep->regs[GET_RT(instr)];
+    uint32_t values[LOCKSTEP_LANES];
+    uint32_t next[LOCKSTEP_LANES];
+    uint32_t overflow = 0;
+    uint8_t dest = GET_RT(instr);
+
+    switch (GET_OP(instr)) {
+        case OP_SPECIAL: {
+            dest = GET_RD(instr);
+            uint8_t sa = GET_SA(instr);
+            switch (GET_FUNC(instr)) {
+                case SPE_SLL: LANE_OP(t << sa) break;
+                case SPE_SRL: LANE_OP(t >> sa) break;
+                case SPE_SRA: LANE_OP((int32_t)t >> sa) break;
+                case SPE_SLLV: LANE_OP(t << (s & 0x1F)) break;
+                case SPE_SRLV:
+                case SPE_SRAV: LANE_OP(t >> (s & 0x1F)) break;
+                case SPE_ADD: {
+                    LANE_OP(s + t)
+                    EACH_LANE {
+                        overflow |= (rs[lane] ^ values[lane]) & (rt[lane] ^ values[lane]) & active[lane];
+                    }
+                    break;
+                }
+                case SPE_ADDU: LANE_OP(s + t) break;
+                case SPE_SUB: {
+                    LANE_OP(s - t)
+                    EACH_LANE {
+                        overflow |= (rs[lane] ^ rt[lane]) & (rs[lane] ^ values[lane]) & active[lane];
+                    }
+                    break;
+                }
+                case SPE_SUBU: LANE_OP(s - t) break;
+                case SPE_AND: LANE_OP(s & t) break;
+                case SPE_OR: LANE_OP(s | t) break;
+                case SPE_XOR: LANE_OP(s ^ t) break;
+                case SPE_NOR: LANE_OP(~(s | t)) break;
+                case SPE_SLT:
+                case SPE_SLTU: LANE_OP((int32_t)s < (int32_t)t) break;
+                case SPE_JR: {
+                    jump(lockstep, rs, active, first);
+                    return true;
+                }
+                case SPE_JALR: {
+                    // The link is written before the target is read, as the interpreter does
+                    EACH_LANE {
+                        values[lane] = ip + 4;
+                    }
+                    commit(lockstep->regs[dest == 0 ? $ra : dest], values, active);
+                    memcpy(next, rs, sizeof(next));
+                    jump(lockstep, next, active, first);
+                    return true;
+                }
+                default:
+                    return false;
+            }
+            break;
+        }
+        case OP_J:
+        case OP_JAL: {
+            int32_t jt = GET_JT(instr);
+            EACH_LANE {
+                values[lane] = ip + 4;
+                next[lane] = jt << 2;
+            }
+            if (GET_OP(instr) == OP_JAL) {
+                commit(lockstep->regs[$ra], values, active);
+            }
+            jump(lockstep, next, active, first);
+            return true;
+        }
+        case OP_BEQ:
+        case OP_BNE:
+        case OP_BLEZ:
+        case OP_BGTZ: {
+            int32_t offset = sign_extend(GET_IMMED(instr) << 2, 14);
+            switch (GET_OP(instr)) {
+                case OP_BEQ: LANE_OP(MASK(s == t)) break;
+                case OP_BNE: LANE_OP(MASK(s != t)) break;
+                case OP_BLEZ: LANE_OP(MASK((int32_t)s <= 0)) break;
+                default: LANE_OP(MASK((int32_t)s > 0)) break;
+            }
+            EACH_LANE {
+                next[lane] = ((ip + offset) & values[lane]) | ((ip + 4) & ~values[lane]);
+            }
+            jump(lockstep, next, active, first);
+            return true;
+        }
+        case OP_ADDI: {
+            uint32_t immed = sign_extend(GET_IMMED(instr), 16);
+            EACH_LANE {
+                values[lane] = rs[lane] + immed;
+                overflow |= (rs[lane] ^ values[lane]) & (immed ^ values[lane]) & active[lane];
+            }
+            break;
+        }
+        case OP_ADDIU: {
+            uint32_t immed = sign_extend(GET_IMMED(instr), 16);
+            EACH_LANE {
+                values[lane] = rs[lane] + immed;
+            }
+            break;
+        }
+        case OP_SLTI: {
+            int32_t immed = sign_extend(GET_IMMED(instr), 16);
+            EACH_LANE {
+                values[lane] = (int32_t)rs[lane] < immed;
+            }
+            break;
+        }
+        case OP_SLTIU: {
+            uint32_t immed = sign_extend(GET_IMMED(instr), 16);
+            EACH_LANE {
+                values[lane] = rs[lane] < immed;
+            }
+            break;
+        }
+        case OP_ANDI: {
+            uint32_t immed = zero_extend(GET_IMMED(instr), 16);
+            EACH_LANE {
+                values[lane] = rs[lane] & immed;
+            }
+            break;
+        }
+        case OP_ORI: {
+            uint32_t immed = zero_extend(GET_IMMED(instr), 16);
+            EACH_LANE {
+                values[lane] = rs[lane] | immed;
+            }
+            break;
+        }
+        case OP_XORI: {
+            uint32_t immed = zero_extend(GET_IMMED(instr), 16);
+            EACH_LANE {
+                values[lane] = rs[lane] ^ immed;
+            }
+            break;
+        }
+        case OP_LUI: {
+            uint32_t immed = GET_IMMED(instr) << 16;
+            EACH_LANE {
+                values[lane] = immed;
+            }
+            break;
+        }
+        case OP_LW:
+        case OP_SW: {
+            // Each lane accesses its own memory, faults and devices are left to the interpreter
+            int16_t offset = GET_IMMED(instr);
+            bool store = GET_OP(instr) == OP_SW;
+            if (offset % 4 != 0) return false;
+            for (int lane = 0; lane < lockstep->count; ++lane) {
+                Memory* memory = lockstep->lanes[lane]->memory;
+                uint32_t address = rs[lane] + offset;
+                if (active[lane] && (!mem_valid(memory, address) || (store && !mem_writable(memory, address, 4)))) {
+                    return false;
+                }
+            }
+
+            EACH_LANE {
+                values[lane] = 0;
+                if (!active[lane]) continue;
+                Memory* memory = lockstep->lanes[lane]->memory;
+                if (store) {
+                    mem_write(memory, rs[lane] + offset, rt[lane]);
+                } else {
+                    values[lane] = mem_read(memory, rs[lane] + offset);
+                }
+            }
+            if (store) {
+                EACH_LANE {
+                    next[lane] = ip + 4;
+                }
+                commit(lockstep->ip, next, active);
+                return true;
+            }
+            break;
+        }
+        default:
+            return false;
+    }
+
+    // Overflows trap in the interpreter
+    if (overflow >> 31) return false;
+
+    commit(lockstep->regs[dest], values, active);
+    EACH_LANE {
+        next[lane] = ip + 4;
+    }
+    commit(lockstep->ip, next, active);
+    return true;
+}
+
+void lockstep_run(LockStep* lockstep) {
+    LockStepStats* stats = &lockstep->stats;
+    // Instructions run together, the interpreter counts the others in the lane's VM
+    uint64_t icounts[LOCKSTEP_LANES] = {0};
+
+    for (;;) {
+        // The lanes furthest behind run, the others wait for them to catch up
+        uint32_t ip = UINT32_MAX;
+        EACH_LANE {
+            ip = lockstep->ip[lane] < ip ? lockstep->ip[lane] : ip;
+        }
+        if (ip == UINT32_MAX) break;
+
+        uint32_t active[LOCKSTEP_LANES];
+        uint32_t lanes = 0;
+        EACH_LANE {
+            active[lane] = MASK(lockstep->ip[lane] == ip);
+            lanes |= (active[lane] & 1) << lane;
+        }
+        int first = __builtin_ctz(lanes);
+
+        const uint8_t* program = &lockstep->lanes[first]->program[ip];
+        uint32_t instr = (program[0] << 0x18) | (program[1] << 0x10) | (program[2] << 0x08) | program[3];
+        stats->issued++;
+        stats->executed += __builtin_popcount(lanes);
+
+        if (vector(lockstep, ip, instr, active, first)) {
+            EACH_LANE {
+                icounts[lane] += active[lane] & 1;
+            }
+        } else {
+            scalar(lockstep, ip, active);
+        }
+    }
+
+    for (int lane = 0; lane < lockstep->count; ++lane) {
+        LMips* mips = lockstep->lanes[lane];
+        mips->icount += icounts[lane];
+        hart_lock(mips);
+        console_flush(&mips->process->console);
+        hart_unlock(mips);
+    }
+}
@@ -0,0 +1,37 @@
+#ifndef LMIPS_LOCKSTEP
+#define LMIPS_LOCKSTEP
+
+#include "lmips.h"
+
+#define LOCKSTEP_LANES 8 // 8 words, a 256-bit vector
+
+typedef struct {
+    uint64_t issued; // Instructions fetched and decoded once for every lane running them
+    uint64_t executed; // Instructions run, summed over the lanes
+    uint64_t divergences; // Branches sending the lanes running them different ways
+    uint64_t scalar; // Instructions run one lane at a time by the interpreter
+} LockStepStats;
+
+// Runs the same program in up to LOCKSTEP_LANES VMs at once, as the lanes of vector instructions. The lanes
+// whose ip is the lowest run the next instruction together while the others wait for them, so lanes split at
+// a branch meet again where their paths join. Arithmetic, branches, jumps and word accesses are run for all the
+// lanes at once, anything else goes to the interpreter one lane at a time.
+typedef struct {
+    LMips* lanes[LOCKSTEP_LANES];
+    int count;
+    uint32_t regs[REG_COUNT][LOCKSTEP_LANES] __attribute__((aligned(32))); // By register then lane
+    uint32_t ip[LOCKSTEP_LANES]; // UINT32_MAX once the lane is done
+    ExecutionResult results[LOCKSTEP_LANES];
+    LockStepStats stats;
+} LockStep;
+
+void initLockStep(LockStep* lockstep);
+
+// The lane runs from the VM's current state, every lane must have the same text loaded. Breakpoints and
+// instruction budgets are ignored. Returns false once every lane is taken.
+bool lockstep_add(LockStep* lockstep, LMips* mips);
+
+// Runs every lane to its end, their VMs then hold their final state and results their ExecutionResult
+void lockstep_run(LockStep* lockstep);
+
+#endif //LMIPS_LOCKSTEP
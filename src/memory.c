@@ -1,16 +1,122 @@
+#include <errno.h>
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "memory.h"
 
+// Word and half accesses at the last valid addresses (the stack starts at 0x3FFFFF) spill past MEMORY_SIZE
+#define STORE_SIZE (MEMORY_SIZE + MEMORY_PAGE_SIZE)
+
+// Anonymous pages are zero-filled on first touch and page aligned, so images can be mapped over them
 void initMemory(Memory* memory) {
-    memory->store = realloc(NULL, MEMORY_SIZE * sizeof(uint8_t));
+    void* store = mmap(NULL, STORE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    memory->store = store != MAP_FAILED ? store : NULL;
+    memory->base = DATA_ADDRESS;
+    memory->pending = NULL;
+    memory->readOnlyStart = 0;
+    memory->readOnlyEnd = 0;
+    memory->dirty = NULL;
 }
 
 void freeMemory(Memory* memory) {
-    memory->store = realloc(memory->store, 0);
+    if (memory->store != NULL) {
+        munmap(memory->store, STORE_SIZE);
+    }
+
+    free(memory->dirty);
+    memory->store = NULL;
+    memory->dirty = NULL;
+}
+
+bool mem_track(Memory* memory) {
+    if (memory->dirty == NULL) {
+        memory->dirty = calloc(MEMORY_PAGE_COUNT, 1);
+    }
+
+    return memory->dirty != NULL;
+}
+
+// Slow path of guest address checks, taken for addresses outside [base, MEMORY_SIZE).
+// Data still being loaded is waited for, then the whole data segment becomes reachable again.
+bool mem_fault(Memory* memory, uint32_t address) {
+    MemoryBarrier* barrier = memory->pending;
+    if (address < DATA_ADDRESS || address >= MEMORY_SIZE || barrier == NULL) return false;
+
+    pthread_mutex_lock(&barrier->lock);
+    while (barrier->remaining > 0) {
+        pthread_cond_wait(&barrier->done, &barrier->lock);
+    }
+    pthread_mutex_unlock(&barrier->lock);
+
+    memory->pending = NULL;
+    memory->base = DATA_ADDRESS;
+    return true;
+}
+
+bool mem_map_file(Memory* memory, uint32_t address, uint32_t size, int fd, uint64_t offset) {
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (uint64_t)info.st_size < offset) return false;
+
+    // The mapping replaces whatever is there, the loader must be done with it
+    if (memory->pending != NULL) {
+        mem_fault(memory, DATA_ADDRESS);
+    }
+
+    uint64_t available = info.st_size - offset;
+    size_t length = size < available ? size : available;
+    size_t pages = (length + MEMORY_PAGE_SIZE - 1) & ~(size_t)(MEMORY_PAGE_SIZE - 1);
+    uint8_t* target = &memory->store[address];
+
+    // Snapshots restore the pages the mapping replaced like the ones the guest wrote to
+    mem_mark(memory, address, length);
+
+    // The contents are copied rather than mapped from the file : host pages of a file truncated while mapped fault
+    // with SIGBUS on access, which would take the whole host process down
+    size_t done = 0;
+    while (done < length) {
+        ssize_t count = pread(fd, target + done, length - done, offset + done);
+        if (count < 0 && errno == EINTR) continue;
+        if (count < 0) return false;
+        if (count == 0) break;
+        done += count;
+    }
+
+    // Past the end of the file, even one that shrank meanwhile, the last page reads as zeros like a mapping
+    memset(target + done, 0, pages - done);
+    return true;
+}
+
+void mem_unmap(Memory* memory, uint32_t address, uint32_t size) {
+    uint32_t start = address & ~(MEMORY_PAGE_SIZE - 1);
+    size_t length = ((size_t)address + size - start + MEMORY_PAGE_SIZE - 1) & ~(size_t)(MEMORY_PAGE_SIZE - 1);
+    uint8_t* target = &memory->store[start];
+
+    if (sysconf(_SC_PAGESIZE) != MEMORY_PAGE_SIZE ||
+        mmap(target, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED) {
+        memset(target, 0, length);
+    }
 }
 
+// Guest words are big-endian
+static inline uint32_t guestOrder(uint32_t word) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    return __builtin_bswap32(word);
+#else
+    return word;
+#endif
+}
+
+// Aligned words are a single host access, so that other harts never see half of a store
 int32_t mem_read(Memory* memory, uint32_t address) {
+    if ((address & 3) == 0) {
+        _Atomic uint32_t* word = (_Atomic uint32_t*)&memory->store[address];
+        return guestOrder(atomic_load_explicit(word, memory_order_relaxed));
+    }
+
     return memory->store[address + 3] |
            (memory->store[address + 2] << 0x08) |
            (memory->store[address + 1] << 0x10) |
@@ -26,17 +132,49 @@ uint16_t mem_read_half(Memory* memory, uint32_t address) {
 }
 
 void mem_write(Memory* memory, uint32_t address, uint32_t value) {
+    mem_mark(memory, address, 4);
+    if ((address & 3) == 0) {
+        _Atomic uint32_t* word = (_Atomic uint32_t*)&memory->store[address];
+        atomic_store_explicit(word, guestOrder(value), memory_order_relaxed);
+        return;
+    }
+
     memory->store[address + 3] = value;
     memory->store[address + 2] = (uint8_t)(value >> 0x08);
     memory->store[address + 1] = (uint8_t)(value >> 0x10);
     memory->store[address] = (uint8_t)(value >> 0x18);
 }
 
+uint32_t mem_fetch_add(Memory* memory, uint32_t address, uint32_t value) {
+    mem_mark(memory, address, 4);
+    // The word is big-endian, the host can't add to it in place
+    _Atomic uint32_t* word = (_Atomic uint32_t*)&memory->store[address];
+    uint32_t stored = atomic_load_explicit(word, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak(word, &stored, guestOrder(guestOrder(stored) + value))) {}
+
+    return guestOrder(stored);
+}
+
+uint32_t mem_exchange(Memory* memory, uint32_t address, uint32_t value) {
+    mem_mark(memory, address, 4);
+    _Atomic uint32_t* word = (_Atomic uint32_t*)&memory->store[address];
+    return guestOrder(atomic_exchange(word, guestOrder(value)));
+}
+
+bool mem_compare_exchange(Memory* memory, uint32_t address, uint32_t expected, uint32_t value) {
+    mem_mark(memory, address, 4);
+    _Atomic uint32_t* word = (_Atomic uint32_t*)&memory->store[address];
+    uint32_t stored = guestOrder(expected);
+    return atomic_compare_exchange_strong(word, &stored, guestOrder(value));
+}
+
 void mem_write_byte(Memory* memory, uint32_t address, uint8_t value) {
+    mem_mark(memory, address, 1);
     memory->store[address] = value;
 }
 
 void mem_write_half(Memory* memory, uint32_t address, uint16_t value) {
+    mem_mark(memory, address, 2);
     memory->store[address + 1] = value;
     memory->store[address] = (uint8_t)(value >> 0x08);
 }
\ No newline at end of file
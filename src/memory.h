@@ -4,23 +4,82 @@
 #include "common.h"
 
 #define MEMORY_SIZE ((UINT16_MAX + 1) * 64) // 4MB
+#define MMIO_ADDRESS 0x001000 // Device registers, see devices.h
+#define MMIO_SIZE 0x001000
 #define PROGRAM_ADDRESS 0x002000
 #define DATA_ADDRESS 0x080000
 #define HEAP_ADDRESS 0x101000
 #define STACK_ADDRESS 0x3FFFFF
+#define MEMORY_PAGE_SIZE 0x1000
+#define MAP_ADDRESS 0x300000 // Read-only file mappings grow down from here, leaving 1MB to the stack
+#define MEMORY_PAGE_COUNT (MEMORY_SIZE / MEMORY_PAGE_SIZE + 1) // The last page gets accesses spilling past the end
+
+#include <pthread.h>
+
+// Memory contents still being filled in the background by the loader
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+    uint32_t remaining;
+} MemoryBarrier;
 
 typedef struct {
     uint8_t* store;
+    uint32_t base; // Lowest address reachable without going through mem_fault
+    MemoryBarrier* pending;
+    uint32_t readOnlyStart, readOnlyEnd; // Read-only file mappings, empty when equal
+    uint8_t* dirty; // A byte per page set by guest stores, NULL until mem_track
 } Memory;
 
 void initMemory(Memory* memory);
 void freeMemory(Memory* memory);
 
+// Starts recording the pages written by the guest from then on, in memory->dirty. Returns false when out of memory.
+bool mem_track(Memory* memory);
+
+// Records a write to [address, address + size) when tracking, host code writing the store directly calls it
+static inline void mem_mark(Memory* memory, uint32_t address, uint32_t size) {
+    if (memory->dirty == NULL || size == 0) return;
+
+    for (uint32_t page = address / MEMORY_PAGE_SIZE; page <= (address + size - 1) / MEMORY_PAGE_SIZE; ++page) {
+        memory->dirty[page] = 1;
+    }
+}
+
+bool mem_fault(Memory* memory, uint32_t address);
+
+// Whether the guest can access `address`, waiting for the loader when needed
+static inline bool mem_valid(Memory* memory, uint32_t address) {
+    return (address < MEMORY_SIZE && address >= memory->base) || mem_fault(memory, address);
+}
+
+// Whether the guest can store `size` bytes at a valid `address`
+static inline bool mem_writable(Memory* memory, uint32_t address, uint32_t size) {
+    return address + size <= memory->readOnlyStart || address >= memory->readOnlyEnd;
+}
+
+// Same as mem_valid for [address, address + size), bulk accesses only pay for one check
+static inline bool mem_valid_range(Memory* memory, uint32_t address, uint32_t size) {
+    return size <= MEMORY_SIZE - address && mem_valid(memory, address);
+}
+
 int32_t mem_read(Memory* memory, uint32_t address);
 uint8_t mem_read_byte(Memory* memory, uint32_t address);
 uint16_t mem_read_half(Memory* memory, uint32_t address);
 
+// Copies `size` bytes of `fd` from `offset` to the page-aligned `address`, later changes to the file don't show.
+// Pages wholly past the end of the file are left untouched, the mapped ones are marked dirty.
+bool mem_map_file(Memory* memory, uint32_t address, uint32_t size, int fd, uint64_t offset);
+// Puts writable zero pages back over the pages of [address, address + size), undoing mappings
+void mem_unmap(Memory* memory, uint32_t address, uint32_t size);
+
 void mem_write(Memory* memory, uint32_t address, uint32_t value);
+
+// Atomic read-modify-write of the word at an aligned `address`, all sequentially consistent. The first two return
+// the previous value.
+uint32_t mem_fetch_add(Memory* memory, uint32_t address, uint32_t value);
+uint32_t mem_exchange(Memory* memory, uint32_t address, uint32_t value);
+bool mem_compare_exchange(Memory* memory, uint32_t address, uint32_t expected, uint32_t value);
 void mem_write_byte(Memory* memory, uint32_t address, uint8_t value);
 void mem_write_half(Memory* memory, uint32_t address, uint16_t value);
 
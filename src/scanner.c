@@ -0,0 +1,185 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "scanner.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// The buffer is padded so that 16 bytes loads at its end stay in bounds
+#define SCANNER_PADDING 16
+
+void initScanner(Scanner* scanner, int fd) {
+    Stream stream;
+    initFdStream(&stream, fd);
+    initScannerStream(scanner, &stream);
+}
+
+void initScannerStream(Scanner* scanner, const Stream* stream) {
+    scanner->stream = *stream;
+    scanner->buffer = NULL;
+    scanner->start = 0;
+    scanner->end = 0;
+    scanner->eof = false;
+    scanner->blocked = false;
+}
+
+void freeScanner(Scanner* scanner) {
+    free(scanner->buffer);
+    freeStream(&scanner->stream);
+    initScannerStream(scanner, &scanner->stream);
+}
+
+void scanner_reset(Scanner* scanner) {
+    scanner->start = 0;
+    scanner->end = 0;
+    scanner->eof = false;
+    scanner->blocked = false;
+}
+
+// Offset of the first new line in [bytes, bytes + size), or size. Only used on the scanner buffer,
+// whose padding keeps the last 16 bytes load in bounds.
+static size_t findNewLine(const uint8_t* bytes, size_t size) {
+#ifdef __SSE2__
+    const __m128i newLine = _mm_set1_epi8('\n');
+    for (size_t offset = 0; offset < size; offset += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)&bytes[offset]);
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newLine));
+        if (mask != 0) {
+            size_t found = offset + __builtin_ctz(mask);
+            return found < size ? found : size;
+        }
+    }
+
+    return size;
+#else
+    const uint8_t* found = memchr(bytes, '\n', size);
+    return found != NULL ? (size_t)(found - bytes) : size;
+#endif
+}
+
+// Length of the run of decimal digits at the start of the 16 bytes at `bytes`
+static int leadingDigits(const uint8_t* bytes) {
+#ifdef __SSE2__
+    // Bytes are biased so that '0'..'9' become the 10 smallest signed values
+    __m128i chunk = _mm_add_epi8(_mm_loadu_si128((const __m128i*)bytes), _mm_set1_epi8((char)(0x80 - '0')));
+    int digits = _mm_movemask_epi8(_mm_cmplt_epi8(chunk, _mm_set1_epi8((char)(0x80 + 10))));
+
+    return __builtin_ctz(~digits);
+#else
+    int count = 0;
+    while (count < 16 && isDigit(bytes[count])) count++;
+    return count;
+#endif
+}
+
+// Refills the buffer until it holds `count` bytes, a new line or the end of the input
+static void fill(Scanner* scanner, size_t count) {
+    if (scanner->buffer == NULL) {
+        scanner->buffer = calloc(1, SCANNER_BUFFER_SIZE + SCANNER_PADDING);
+        if (scanner->buffer == NULL) {
+            scanner->eof = true;
+            return;
+        }
+    }
+
+    size_t available = scanner->end - scanner->start;
+    size_t searched = 0;
+    while (available < count && available < SCANNER_BUFFER_SIZE && !scanner->eof) {
+        searched += findNewLine(&scanner->buffer[scanner->start + searched], available - searched);
+        if (searched < available) return;
+
+        if (scanner->end == SCANNER_BUFFER_SIZE) {
+            memmove(scanner->buffer, &scanner->buffer[scanner->start], available);
+            scanner->start = 0;
+            scanner->end = available;
+        }
+
+        ssize_t bytes = stream_read(&scanner->stream, &scanner->buffer[scanner->end], SCANNER_BUFFER_SIZE - scanner->end);
+        if (bytes < 0 && errno == EAGAIN) {
+            scanner->blocked = true;
+            return;
+        } else if (bytes <= 0) {
+            scanner->eof = true;
+        } else {
+            scanner->end += bytes;
+            available += bytes;
+        }
+    }
+}
+
+bool scanner_ready(Scanner* scanner, size_t count) {
+    scanner->blocked = false;
+    fill(scanner, count);
+    return !scanner->blocked;
+}
+
+uint32_t scanner_read_int(Scanner* scanner) {
+    fill(scanner, SCANNER_INT_LINE_SIZE);
+    if (scanner->start == scanner->end) return 0;
+
+    // Like fgets, the line is consumed up to its new line or its 10th byte
+    const uint8_t* line = &scanner->buffer[scanner->start];
+    size_t available = scanner->end - scanner->start;
+    size_t length = available < SCANNER_INT_LINE_SIZE ? available : SCANNER_INT_LINE_SIZE;
+    size_t newLine = findNewLine(line, length);
+    length = newLine < length ? newLine + 1 : length;
+    scanner->start += length;
+
+    // Plain decimal numbers are parsed in place, anything strtoul would read differently
+    // (spaces, signs, hexadecimal and octal prefixes) goes through strtoul
+    int digits = leadingDigits(line);
+    digits = (size_t)digits < length ? digits : (int)length;
+    if (digits > 0 && (line[0] != '0' || digits == 1) && (digits == (int)length || (line[digits] != 'x' && line[digits] != 'X'))) {
+        uint64_t value = 0;
+        for (int i = 0; i < digits; ++i) {
+            value = value * 10 + (line[i] - '0');
+        }
+
+        return (uint32_t)value;
+    }
+
+    char copy[SCANNER_INT_LINE_SIZE + 1];
+    memcpy(copy, line, length);
+    copy[length] = '\0';
+    return strtoul(copy, NULL, 0);
+}
+
+ssize_t scanner_read(Scanner* scanner, void* target, size_t size) {
+    size_t available = scanner->end - scanner->start;
+    if (available == 0) {
+        return stream_read(&scanner->stream, target, size);
+    }
+
+    size_t count = size < available ? size : available;
+    memcpy(target, &scanner->buffer[scanner->start], count);
+    scanner->start += count;
+    return count;
+}
+
+size_t scanner_read_line(Scanner* scanner, char* target, size_t size) {
+    if (size == 0) return 0;
+
+    size_t total = 0;
+    while (total < size - 1) {
+        fill(scanner, size - 1 - total);
+        size_t available = scanner->end - scanner->start;
+        if (available == 0) break;
+
+        const uint8_t* line = &scanner->buffer[scanner->start];
+        size_t length = size - 1 - total < available ? size - 1 - total : available;
+        size_t newLine = findNewLine(line, length);
+        length = newLine < length ? newLine + 1 : length;
+
+        memcpy(&target[total], line, length);
+        scanner->start += length;
+        total += length;
+
+        if (newLine < length) break;
+    }
+
+    target[total] = '\0';
+    return total;
+}
@@ -0,0 +1,43 @@
+#ifndef LMIPS_SCANNER
+#define LMIPS_SCANNER
+
+#include <stddef.h>
+#include <sys/types.h>
+#include "common.h"
+#include "stream.h"
+
+#define SCANNER_BUFFER_SIZE (64 * 1024)
+// Longest line SYS_READ_INT has ever looked at (an 11 bytes fgets buffer)
+#define SCANNER_INT_LINE_SIZE 10
+
+// Guest input, read from its stream in large chunks. The buffer is only allocated by the first read syscall.
+typedef struct {
+    Stream stream;
+    uint8_t* buffer;
+    uint32_t start, end; // Unread bytes
+    bool eof;
+    bool blocked; // The last refill found a non-blocking stream empty
+} Scanner;
+
+void initScanner(Scanner* scanner, int fd);
+// Takes ownership of `stream`
+void initScannerStream(Scanner* scanner, const Stream* stream);
+void freeScanner(Scanner* scanner);
+// Drops the buffered input and the end of input, for streams that start over
+void scanner_reset(Scanner* scanner);
+
+// Whether a line of at most `count` bytes can be read without blocking, only ever false for
+// non-blocking streams
+bool scanner_ready(Scanner* scanner, size_t count);
+
+// Same results as fgets(buffer, 11) followed by strtoul(buffer, NULL, 0), 0 at the end of the input
+uint32_t scanner_read_int(Scanner* scanner);
+
+// Same as fgets : at most size - 1 bytes, up to and including a new line, then a null byte.
+// Returns the number of bytes read.
+size_t scanner_read_line(Scanner* scanner, char* target, size_t size);
+
+// Raw read of at most size bytes, buffered input first. Returns the count, 0 at the end of the input or -1.
+ssize_t scanner_read(Scanner* scanner, void* target, size_t size);
+
+#endif //LMIPS_SCANNER
@@ -0,0 +1,264 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "scheduler.h"
+
+#define INITIAL_CAPACITY 16
+
+static uint64_t nanos(clockid_t clock) {
+    struct timespec time;
+    clock_gettime(clock, &time);
+    return (uint64_t)time.tv_sec * 1000000000ull + time.tv_nsec;
+}
+
+// Called with the lock held
+static void enqueue(Scheduler* scheduler, Guest* guest) {
+    guest->state = GUEST_RUNNABLE;
+    guest->queuedAt = nanos(CLOCK_MONOTONIC);
+    guest->next = NULL;
+    if (scheduler->tail != NULL) {
+        scheduler->tail->next = guest;
+    } else {
+        scheduler->head = guest;
+    }
+    scheduler->tail = guest;
+    pthread_cond_signal(&scheduler->available);
+}
+
+static Guest* dequeue(Scheduler* scheduler) {
+    Guest* guest = scheduler->head;
+    scheduler->head = guest->next;
+    if (scheduler->head == NULL) {
+        scheduler->tail = NULL;
+    }
+
+    uint64_t wait = nanos(CLOCK_MONOTONIC) - guest->queuedAt;
+    guest->stats.waitNanos += wait;
+    guest->stats.maxWaitNanos = wait > guest->stats.maxWaitNanos ? wait : guest->stats.maxWaitNanos;
+    guest->state = GUEST_RUNNING;
+    return guest;
+}
+
+// Only the worker running the guest touches its scanner, the inbox is handed over under the lock
+static void deliverInput(Guest* guest) {
+    Stream* input = &guest->mips->scanner.stream;
+    if (guest->inboxLength > 0 && stream_write(input, guest->inbox, guest->inboxLength) >= 0) {
+        guest->inboxLength = 0;
+    }
+    if (guest->inputClosed) {
+        stream_close(input);
+    }
+}
+
+static void runSlice(Scheduler* scheduler, Guest* guest) {
+    LMips* mips = guest->mips;
+    uint64_t icount = mips->icount;
+    mips->stopCount = scheduler->quantum > UINT64_MAX - icount ? UINT64_MAX : icount + scheduler->quantum;
+
+    uint64_t start = nanos(CLOCK_THREAD_CPUTIME_ID);
+    ExecutionResult result = executeSimulator(mips);
+    uint64_t cpu = nanos(CLOCK_THREAD_CPUTIME_ID) - start;
+
+    pthread_mutex_lock(&scheduler->lock);
+    guest->stats.instructions += mips->icount - icount;
+    guest->stats.cpuNanos += cpu;
+    guest->stats.slices++;
+    scheduler->running--;
+
+    if (result == EXEC_BREAKPOINT && mips->icount >= mips->stopCount) {
+        enqueue(scheduler, guest);
+    } else if (result == EXEC_BLOCKED) {
+        guest->stats.parks++;
+        // Input may have come during the slice
+        if (guest->inboxLength > 0 || guest->inputClosed) {
+            enqueue(scheduler, guest);
+        } else {
+            guest->state = GUEST_PARKED;
+        }
+    } else {
+        guest->state = GUEST_DONE;
+        guest->result = result;
+    }
+
+    if (scheduler->head == NULL && scheduler->running == 0) {
+        pthread_cond_broadcast(&scheduler->idle);
+    }
+    pthread_mutex_unlock(&scheduler->lock);
+}
+
+static void* workerMain(void* arg) {
+    Scheduler* scheduler = arg;
+
+    pthread_mutex_lock(&scheduler->lock);
+    for (;;) {
+        while (scheduler->head == NULL && !scheduler->stop) {
+            pthread_cond_wait(&scheduler->available, &scheduler->lock);
+        }
+        if (scheduler->stop) break;
+
+        Guest* guest = dequeue(scheduler);
+        scheduler->running++;
+        deliverInput(guest);
+        pthread_mutex_unlock(&scheduler->lock);
+
+        runSlice(scheduler, guest);
+        pthread_mutex_lock(&scheduler->lock);
+    }
+    pthread_mutex_unlock(&scheduler->lock);
+
+    return NULL;
+}
+
+bool initScheduler(Scheduler* scheduler, int threadCount, uint64_t quantum) {
+    scheduler->threads = malloc(threadCount * sizeof(pthread_t));
+    scheduler->threadCount = 0;
+    scheduler->quantum = quantum > 0 ? quantum : 1;
+    scheduler->guests = NULL;
+    scheduler->count = 0;
+    scheduler->capacity = 0;
+    scheduler->head = NULL;
+    scheduler->tail = NULL;
+    scheduler->running = 0;
+    scheduler->stop = false;
+    pthread_mutex_init(&scheduler->lock, NULL);
+    pthread_cond_init(&scheduler->available, NULL);
+    pthread_cond_init(&scheduler->idle, NULL);
+
+    if (scheduler->threads == NULL) return false;
+
+    for (int i = 0; i < threadCount; ++i) {
+        if (pthread_create(&scheduler->threads[i], NULL, workerMain, scheduler) != 0) break;
+        scheduler->threadCount++;
+    }
+
+    return scheduler->threadCount > 0;
+}
+
+void freeScheduler(Scheduler* scheduler) {
+    pthread_mutex_lock(&scheduler->lock);
+    scheduler->stop = true;
+    pthread_cond_broadcast(&scheduler->available);
+    pthread_mutex_unlock(&scheduler->lock);
+
+    for (int i = 0; i < scheduler->threadCount; ++i) {
+        pthread_join(scheduler->threads[i], NULL);
+    }
+
+    for (size_t i = 0; i < scheduler->count; ++i) {
+        free(scheduler->guests[i]->inbox);
+        free(scheduler->guests[i]);
+    }
+    free(scheduler->guests);
+    free(scheduler->threads);
+    scheduler->guests = NULL;
+    scheduler->threads = NULL;
+    scheduler->count = scheduler->capacity = 0;
+    scheduler->threadCount = 0;
+    pthread_mutex_destroy(&scheduler->lock);
+    pthread_cond_destroy(&scheduler->available);
+    pthread_cond_destroy(&scheduler->idle);
+}
+
+Guest* scheduler_add(Scheduler* scheduler, LMips* mips) {
+    Guest* guest = calloc(1, sizeof(Guest));
+    if (guest == NULL) return NULL;
+
+    guest->mips = mips;
+    Stream input;
+    initPipeStream(&input);
+    lmips_set_input(mips, &input);
+
+    pthread_mutex_lock(&scheduler->lock);
+    if (scheduler->count == scheduler->capacity) {
+        size_t capacity = scheduler->capacity > 0 ? scheduler->capacity * 2 : INITIAL_CAPACITY;
+        Guest** guests = realloc(scheduler->guests, capacity * sizeof(Guest*));
+        if (guests == NULL) {
+            pthread_mutex_unlock(&scheduler->lock);
+            free(guest);
+            return NULL;
+        }
+
+        scheduler->guests = guests;
+        scheduler->capacity = capacity;
+    }
+
+    scheduler->guests[scheduler->count++] = guest;
+    enqueue(scheduler, guest);
+    pthread_mutex_unlock(&scheduler->lock);
+
+    return guest;
+}
+
+bool scheduler_feed(Scheduler* scheduler, Guest* guest, const void* bytes, size_t size) {
+    pthread_mutex_lock(&scheduler->lock);
+    if (guest->inboxLength + size > guest->inboxCapacity) {
+        size_t capacity = guest->inboxCapacity > 0 ? guest->inboxCapacity : 256;
+        while (capacity < guest->inboxLength + size) {
+            capacity *= 2;
+        }
+
+        uint8_t* inbox = realloc(guest->inbox, capacity);
+        if (inbox == NULL) {
+            pthread_mutex_unlock(&scheduler->lock);
+            return false;
+        }
+
+        guest->inbox = inbox;
+        guest->inboxCapacity = capacity;
+    }
+
+    memcpy(&guest->inbox[guest->inboxLength], bytes, size);
+    guest->inboxLength += size;
+    if (guest->state == GUEST_PARKED) {
+        enqueue(scheduler, guest);
+    }
+    pthread_mutex_unlock(&scheduler->lock);
+
+    return true;
+}
+
+void scheduler_close_input(Scheduler* scheduler, Guest* guest) {
+    pthread_mutex_lock(&scheduler->lock);
+    guest->inputClosed = true;
+    if (guest->state == GUEST_PARKED) {
+        enqueue(scheduler, guest);
+    }
+    pthread_mutex_unlock(&scheduler->lock);
+}
+
+void scheduler_wait(Scheduler* scheduler) {
+    pthread_mutex_lock(&scheduler->lock);
+    while (scheduler->head != NULL || scheduler->running > 0) {
+        pthread_cond_wait(&scheduler->idle, &scheduler->lock);
+    }
+    pthread_mutex_unlock(&scheduler->lock);
+}
+
+GuestState scheduler_guest_stats(Scheduler* scheduler, const Guest* guest, GuestStats* stats) {
+    pthread_mutex_lock(&scheduler->lock);
+    GuestState state = guest->state;
+    *stats = guest->stats;
+    pthread_mutex_unlock(&scheduler->lock);
+
+    return state;
+}
+
+void scheduler_stats(Scheduler* scheduler, SchedulerStats* stats) {
+    memset(stats, 0, sizeof(SchedulerStats));
+
+    // (sum x)^2 / (n * sum x^2)
+    double sum = 0, squares = 0;
+    pthread_mutex_lock(&scheduler->lock);
+    for (size_t i = 0; i < scheduler->count; ++i) {
+        const Guest* guest = scheduler->guests[i];
+        double cpu = guest->stats.cpuNanos;
+        sum += cpu;
+        squares += cpu * cpu;
+        stats->done += guest->state == GUEST_DONE;
+        stats->parked += guest->state == GUEST_PARKED;
+    }
+    stats->guests = scheduler->count;
+    pthread_mutex_unlock(&scheduler->lock);
+
+    stats->fairness = squares > 0 ? sum * sum / (stats->guests * squares) : 1;
+}
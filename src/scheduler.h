@@ -0,0 +1,73 @@
+#ifndef LMIPS_SCHEDULER
+#define LMIPS_SCHEDULER
+
+#include <pthread.h>
+#include "lmips.h"
+
+typedef enum {
+    GUEST_RUNNABLE,
+    GUEST_RUNNING,
+    GUEST_PARKED, // Waiting for input in a read syscall
+    GUEST_DONE
+} GuestState;
+
+typedef struct {
+    uint64_t instructions;
+    uint64_t cpuNanos; // Thread CPU time of its slices
+    uint64_t slices;
+    uint64_t parks;
+    uint64_t waitNanos; // Time spent runnable in the run queue
+    uint64_t maxWaitNanos;
+} GuestStats;
+
+typedef struct guest {
+    LMips* mips;
+    GuestState state;
+    ExecutionResult result; // Once done
+    uint8_t* inbox; // Input fed while the guest may be running, handed to its scanner at the next slice
+    size_t inboxLength, inboxCapacity;
+    bool inputClosed;
+    uint64_t queuedAt;
+    GuestStats stats;
+    struct guest* next;
+} Guest;
+
+typedef struct {
+    size_t guests, done, parked;
+    double fairness; // Jain's index of the guests CPU time, 1 when they all got the same
+} SchedulerStats;
+
+// Runs many guests on a few workers, a slice of at most `quantum` instructions at a time. Guests go round
+// a single FIFO run queue, and those reading an empty input are parked until it is fed.
+typedef struct {
+    pthread_t* threads;
+    int threadCount;
+    uint64_t quantum;
+    Guest** guests;
+    size_t count, capacity;
+    Guest* head;
+    Guest* tail;
+    int running;
+    bool stop;
+    pthread_mutex_t lock;
+    pthread_cond_t available;
+    pthread_cond_t idle;
+} Scheduler;
+
+bool initScheduler(Scheduler* scheduler, int threadCount, uint64_t quantum);
+// Stops the workers after their current slice, the guests are left where they are
+void freeScheduler(Scheduler* scheduler);
+
+// The guest is runnable from its current state, with an empty input of its own. The scheduler takes over its
+// input and its stopCount, the caller still owns the VM and frees it after freeScheduler.
+Guest* scheduler_add(Scheduler* scheduler, LMips* mips);
+bool scheduler_feed(Scheduler* scheduler, Guest* guest, const void* bytes, size_t size);
+// Reads past the fed input then end as they would at the end of a file
+void scheduler_close_input(Scheduler* scheduler, Guest* guest);
+
+// Returns once every guest is either done or parked
+void scheduler_wait(Scheduler* scheduler);
+GuestState scheduler_guest_stats(Scheduler* scheduler, const Guest* guest, GuestStats* stats);
+void scheduler_stats(Scheduler* scheduler, SchedulerStats* stats);
+
+#endif //LMIPS_SCHEDULER
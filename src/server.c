@@ -0,0 +1,381 @@
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include "image.h"
+#include "loader.h"
+#include "server.h"
+
+struct serverimage {
+    char* binary;
+    char* path;
+    struct serverimage* next;
+};
+
+typedef struct {
+    Server* server;
+    int fd;
+} Connection;
+
+static bool socketAddress(const char* path, struct sockaddr_un* address) {
+    if (strlen(path) >= sizeof(address->sun_path)) return false;
+
+    memset(address, 0, sizeof(struct sockaddr_un));
+    address->sun_family = AF_UNIX;
+    strcpy(address->sun_path, path);
+    return true;
+}
+
+static bool sendAll(int fd, const void* bytes, size_t size) {
+    while (size > 0) {
+        ssize_t count = send(fd, bytes, size, MSG_NOSIGNAL);
+        if (count < 0 && errno == EINTR) continue;
+        if (count <= 0) return false;
+
+        bytes = (const uint8_t*)bytes + count;
+        size -= count;
+    }
+
+    return true;
+}
+
+static bool receiveAll(int fd, void* bytes, size_t size) {
+    while (size > 0) {
+        ssize_t count = recv(fd, bytes, size, 0);
+        if (count < 0 && errno == EINTR) continue;
+        if (count <= 0) return false;
+
+        bytes = (uint8_t*)bytes + count;
+        size -= count;
+    }
+
+    return true;
+}
+
+// Reads up to the end of the header line, which is replaced by a null character. The bytes read past it, the start of
+// the body, are left in `header` after that end.
+static char* receiveHeader(int fd, char* header, size_t* length) {
+    *length = 0;
+    while (*length < SERVER_MAX_HEADER) {
+        ssize_t count = recv(fd, header + *length, SERVER_MAX_HEADER - *length, 0);
+        if (count < 0 && errno == EINTR) continue;
+        if (count <= 0) return NULL;
+
+        char* end = memchr(header + *length, '\n', count);
+        *length += count;
+        if (end != NULL) {
+            *end = '\0';
+            return end;
+        }
+    }
+
+    return NULL;
+}
+
+// The body starts with whatever receiveHeader read past the header
+static bool receiveBody(int fd, const char* header, size_t length, const char* end, uint8_t* body, size_t size) {
+    size_t received = length - (end + 1 - header);
+    if (received > size) return false;
+
+    memcpy(body, end + 1, received);
+    return receiveAll(fd, body + received, size - received);
+}
+
+static void freeImages(Server* server) {
+    struct serverimage* image = server->images;
+    while (image != NULL) {
+        struct serverimage* next = image->next;
+        unlink(image->path);
+        free(image->binary);
+        free(image->path);
+        free(image);
+        image = next;
+    }
+    server->images = NULL;
+}
+
+bool initServer(Server* server, const char* path, int threads) {
+    server->path = NULL;
+    server->fd = -1;
+    server->images = NULL;
+    server->directory = NULL;
+    server->budget = SERVER_DEFAULT_BUDGET;
+    server->timeout = SERVER_DEFAULT_TIMEOUT;
+    atomic_init(&server->stop, false);
+    atomic_init(&server->requests, 0);
+
+    if (!initWorkPool(&server->pool, threads)) {
+        freeWorkPool(&server->pool);
+        return false;
+    }
+
+    const char* temp = getenv("TMPDIR");
+    temp = temp != NULL ? temp : "/tmp";
+    size_t length = strlen(temp) + 24;
+    server->directory = malloc(length);
+    if (server->directory != NULL) {
+        snprintf(server->directory, length, "%s/lmips_serve_XXXXXX", temp);
+        if (mkdtemp(server->directory) == NULL) {
+            free(server->directory);
+            server->directory = NULL;
+        }
+    }
+
+    struct sockaddr_un address;
+    bool success = server->directory != NULL && socketAddress(path, &address) &&
+        (server->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) >= 0 &&
+        bind(server->fd, (struct sockaddr*)&address, sizeof(address)) == 0 &&
+        (server->path = strdup(path)) != NULL &&
+        listen(server->fd, SOMAXCONN) == 0;
+
+    if (!success) {
+        freeServer(server);
+    }
+    return success;
+}
+
+void freeServer(Server* server) {
+    if (server->fd >= 0) {
+        close(server->fd);
+    }
+
+    // Connections already accepted are answered first
+    freeWorkPool(&server->pool);
+
+    if (server->path != NULL) {
+        unlink(server->path);
+        free(server->path);
+    }
+
+    freeImages(server);
+    if (server->directory != NULL) {
+        rmdir(server->directory);
+        free(server->directory);
+    }
+
+    server->path = NULL;
+    server->fd = -1;
+    server->directory = NULL;
+}
+
+static struct serverimage* findImage(Server* server, const char* binary) {
+    for (struct serverimage* image = server->images; image != NULL; image = image->next) {
+        if (strcmp(image->binary, binary) == 0) return image;
+    }
+
+    return NULL;
+}
+
+// Same as a batch image : the VM registers at the entry point and the loaded pages
+static bool writeImage(const char* binary, const char* path) {
+    Memory memory;
+    initMemory(&memory);
+    LMips mips;
+    initSimulator(&mips, &memory);
+
+    bool written = false;
+    Executable executable;
+    if (memory.store != NULL && loadExecutable(binary, &memory, &executable) == LOAD_SUCCESS) {
+        waitExecutable(&executable);
+        mips.ip = executable.entry;
+        written = image_write(path, NULL, &mips, NULL);
+        freeExecutable(&executable);
+    }
+
+    freeSimulator(&mips);
+    freeMemory(&memory);
+    return written;
+}
+
+bool server_add(Server* server, const char* binary) {
+    if (findImage(server, binary) != NULL) return true;
+
+    int count = 0;
+    for (struct serverimage* image = server->images; image != NULL; image = image->next) {
+        count++;
+    }
+
+    struct serverimage* image = calloc(1, sizeof(struct serverimage));
+    size_t length = strlen(server->directory) + 16;
+    char* path = malloc(length);
+    if (image == NULL || path == NULL || (image->binary = strdup(binary)) == NULL) {
+        free(image);
+        free(path);
+        return false;
+    }
+
+    snprintf(path, length, "%s/%d.img", server->directory, count);
+    if (!writeImage(binary, path)) {
+        free(image->binary);
+        free(image);
+        free(path);
+        return false;
+    }
+
+    image->path = path;
+    image->next = server->images;
+    server->images = image;
+    return true;
+}
+
+static void runRequest(Server* server, const char* binary, const uint8_t* input, size_t size, ServerReply* reply) {
+    struct serverimage* image = findImage(server, binary);
+    reply->status = BATCH_ERR_LOAD;
+    if (image == NULL) return;
+
+    Memory memory;
+    initMemory(&memory);
+    LMips mips;
+    initSimulator(&mips, &memory);
+
+    // Only the pages the guest writes are copied, the others stay shared with the image in the page cache
+    if (memory.store != NULL && image_map(image->path, NULL, &memory, &mips, NULL)) {
+        Stream stream;
+        if (!initBufferStream(&stream, input, size)) {
+            reply->status = BATCH_ERR_INPUT;
+        } else {
+            lmips_set_input(&mips, &stream);
+            initBufferStream(&stream, NULL, 0);
+            mips.console.mode = CONSOLE_FULLY_BUFFERED;
+            lmips_set_output(&mips, &stream);
+            mips.stopCount = server->budget > UINT64_MAX - mips.icount ? UINT64_MAX : mips.icount + server->budget;
+
+            reply->status = batch_status(&mips, executeSimulator(&mips));
+            reply->icount = mips.icount;
+            reply->output = stream_release(&mips.console.stream, &reply->outputSize);
+        }
+    }
+
+    freeSimulator(&mips);
+    freeMemory(&memory);
+}
+
+static void serveConnection(void* arg) {
+    Connection* connection = arg;
+    Server* server = connection->server;
+    int fd = connection->fd;
+    free(connection);
+
+    char header[SERVER_MAX_HEADER];
+    size_t length;
+    char* end = receiveHeader(fd, header, &length);
+    char* separator = end != NULL ? strrchr(header, ' ') : NULL;
+    char* sizeEnd = NULL;
+    unsigned long long size = separator != NULL ? strtoull(separator + 1, &sizeEnd, 10) : 0;
+
+    // Malformed requests are dropped without an answer
+    uint8_t* input = NULL;
+    if (separator == NULL || separator == header || sizeEnd == separator + 1 || *sizeEnd != '\0' ||
+            size > SERVER_MAX_INPUT || (input = malloc(size + 1)) == NULL ||
+            !receiveBody(fd, header, length, end, input, size)) {
+        free(input);
+        close(fd);
+        return;
+    }
+
+    *separator = '\0';
+    ServerReply reply = {};
+    runRequest(server, header, input, size, &reply);
+    free(input);
+
+    length = snprintf(header, sizeof(header), "%s %llu %zu\n", batch_status_name(reply.status),
+                      (unsigned long long)reply.icount, reply.outputSize);
+    if (sendAll(fd, header, length) && reply.outputSize > 0) {
+        sendAll(fd, reply.output, reply.outputSize);
+    }
+
+    free(reply.output);
+    close(fd);
+    atomic_fetch_add(&server->requests, 1);
+}
+
+bool server_run(Server* server) {
+    while (!atomic_load(&server->stop)) {
+        int fd = accept4(server->fd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            break;
+        }
+
+        Connection* connection = malloc(sizeof(Connection));
+        if (connection == NULL) {
+            close(fd);
+            continue;
+        }
+
+        // A client that stalls mid-request or stops reading its response can't hold a worker forever
+        struct timeval timeout = {.tv_sec = server->timeout};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        connection->server = server;
+        connection->fd = fd;
+        if (!workpool_submit(&server->pool, serveConnection, connection)) {
+            free(connection);
+            close(fd);
+        }
+    }
+
+    workpool_wait(&server->pool);
+    return atomic_load(&server->stop);
+}
+
+// Only async-signal-safe calls : shutting the socket down wakes accept up
+void server_stop(Server* server) {
+    atomic_store(&server->stop, true);
+    shutdown(server->fd, SHUT_RDWR);
+}
+
+static bool parseStatus(const char* name, BatchStatus* status) {
+    for (BatchStatus candidate = BATCH_PENDING; candidate <= BATCH_ERR_INPUT; ++candidate) {
+        if (strcmp(batch_status_name(candidate), name) == 0) {
+            *status = candidate;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool server_call(const char* path, const char* binary, const void* input, size_t size, ServerReply* reply) {
+    memset(reply, 0, sizeof(ServerReply));
+
+    struct sockaddr_un address;
+    char header[SERVER_MAX_HEADER];
+    size_t length = snprintf(header, sizeof(header), "%s %zu\n", binary, size);
+    if (length >= sizeof(header) || !socketAddress(path, &address)) return false;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return false;
+
+    bool success = connect(fd, (struct sockaddr*)&address, sizeof(address)) == 0 &&
+        sendAll(fd, header, length) && sendAll(fd, input, size);
+
+    char* end = success ? receiveHeader(fd, header, &length) : NULL;
+    char status[32];
+    unsigned long long icount;
+    size_t outputSize;
+    success = end != NULL && sscanf(header, "%31s %llu %zu", status, &icount, &outputSize) == 3 &&
+        parseStatus(status, &reply->status);
+
+    if (success && outputSize > 0) {
+        reply->output = malloc(outputSize);
+        success = reply->output != NULL && receiveBody(fd, header, length, end, reply->output, outputSize);
+    }
+
+    if (success) {
+        reply->icount = icount;
+        reply->outputSize = outputSize;
+    } else {
+        free(reply->output);
+        reply->output = NULL;
+    }
+
+    close(fd);
+    return success;
+}
@@ -0,0 +1,49 @@
+#ifndef LMIPS_SERVER
+#define LMIPS_SERVER
+
+#include "batch.h"
+#include "workpool.h"
+
+#define SERVER_MAX_INPUT (16 << 20)
+#define SERVER_MAX_HEADER 4096
+#define SERVER_DEFAULT_BUDGET 100000000 // Instructions a request may run before it is stopped
+#define SERVER_DEFAULT_TIMEOUT 10 // Seconds a worker waits on a client before dropping its connection
+
+// Runs guest jobs for clients of a Unix socket, one request per connection :
+//   request  "<binary> <input size>\n" followed by the input
+//   response "<status> <icount> <output size>\n" followed by the output
+// where status is a batch_status_name, "budget" for requests stopped after `budget` instructions. Every binary is loaded once into an image and each request maps a fresh
+// copy on write clone of it, so a request only costs the pages its guest touches.
+typedef struct {
+    char* path; // Of the socket, removed by freeServer
+    int fd;
+    struct serverimage* images;
+    char* directory; // Where the images are kept
+    WorkPool pool;
+    uint64_t budget;
+    int timeout;
+    _Atomic bool stop;
+    _Atomic uint64_t requests;
+} Server;
+
+typedef struct {
+    BatchStatus status;
+    uint64_t icount;
+    uint8_t* output; // Owned by the caller
+    size_t outputSize;
+} ServerReply;
+
+// Listens on `path`, which must not exist yet, and serves requests on `threads` workers
+bool initServer(Server* server, const char* path, int threads);
+void freeServer(Server* server);
+
+// Loads `binary` into the image its requests start from, they then name it as given here
+bool server_add(Server* server, const char* binary);
+// Accepts connections until server_stop, which may be called from a signal handler
+bool server_run(Server* server);
+void server_stop(Server* server);
+
+// Client side : runs `binary` on the server listening at `path`
+bool server_call(const char* path, const char* binary, const void* input, size_t size, ServerReply* reply);
+
+#endif //LMIPS_SERVER
@@ -0,0 +1,149 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "stream.h"
+
+#define MIN_CAPACITY 4096
+
+void initFdStream(Stream* stream, int fd) {
+    memset(stream, 0, sizeof(Stream));
+    stream->type = STREAM_FD;
+    stream->fd = fd;
+}
+
+bool initBufferStream(Stream* stream, const void* bytes, size_t size) {
+    memset(stream, 0, sizeof(Stream));
+    stream->type = STREAM_BUFFER;
+    stream->fd = -1;
+    if (size == 0) return true;
+
+    stream->bytes = malloc(size);
+    if (stream->bytes == NULL) return false;
+
+    memcpy(stream->bytes, bytes, size);
+    stream->length = size;
+    stream->capacity = size;
+    return true;
+}
+
+void initPipeStream(Stream* stream) {
+    initBufferStream(stream, NULL, 0);
+    stream->open = true;
+}
+
+void initCallbackStream(Stream* stream, StreamReader reader, StreamWriter writer, void* context) {
+    memset(stream, 0, sizeof(Stream));
+    stream->type = STREAM_CALLBACK;
+    stream->fd = -1;
+    stream->reader = reader;
+    stream->writer = writer;
+    stream->context = context;
+}
+
+void freeStream(Stream* stream) {
+    free(stream->bytes);
+    stream->bytes = NULL;
+    stream->length = stream->capacity = stream->position = 0;
+}
+
+void stream_close(Stream* stream) {
+    stream->open = false;
+}
+
+ssize_t stream_read(Stream* stream, void* bytes, size_t size) {
+    switch (stream->type) {
+        case STREAM_FD:
+            return read(stream->fd, bytes, size);
+        case STREAM_BUFFER: {
+            size_t available = stream->length - stream->position;
+            size_t count = size < available ? size : available;
+            if (count == 0 && size > 0 && stream->open) {
+                errno = EAGAIN;
+                return -1;
+            }
+
+            memcpy(bytes, &stream->bytes[stream->position], count);
+            stream->position += count;
+            return count;
+        }
+        case STREAM_CALLBACK:
+            return stream->reader != NULL ? stream->reader(stream->context, bytes, size) : -1;
+    }
+
+    return -1;
+}
+
+static bool reserve(Stream* stream, size_t size) {
+    if (stream->length + size <= stream->capacity) return true;
+
+    // Pipes are read as they are written, whatever has been read already makes room
+    if (stream->open && stream->position > 0) {
+        memmove(stream->bytes, &stream->bytes[stream->position], stream->length - stream->position);
+        stream->length -= stream->position;
+        stream->position = 0;
+        if (stream->length + size <= stream->capacity) return true;
+    }
+
+    size_t capacity = stream->capacity > MIN_CAPACITY ? stream->capacity : MIN_CAPACITY;
+    while (capacity < stream->length + size) {
+        capacity *= 2;
+    }
+
+    uint8_t* bytes = realloc(stream->bytes, capacity);
+    if (bytes == NULL) return false;
+
+    stream->bytes = bytes;
+    stream->capacity = capacity;
+    return true;
+}
+
+ssize_t stream_write(Stream* stream, const void* bytes, size_t size) {
+    switch (stream->type) {
+        case STREAM_FD:
+            return write(stream->fd, bytes, size);
+        case STREAM_BUFFER:
+            if (!reserve(stream, size)) return -1;
+
+            memcpy(&stream->bytes[stream->length], bytes, size);
+            stream->length += size;
+            return size;
+        case STREAM_CALLBACK:
+            return stream->writer != NULL ? stream->writer(stream->context, bytes, size) : -1;
+    }
+
+    return -1;
+}
+
+ssize_t stream_writev(Stream* stream, const struct iovec* pieces, int count) {
+    if (stream->type == STREAM_FD) {
+        return writev(stream->fd, pieces, count);
+    }
+
+    // Stops at the first short write like writev(2)
+    ssize_t total = 0;
+    for (int i = 0; i < count; ++i) {
+        ssize_t written = stream_write(stream, pieces[i].iov_base, pieces[i].iov_len);
+        if (written < 0) return total > 0 ? total : written;
+
+        total += written;
+        if ((size_t)written < pieces[i].iov_len) break;
+    }
+
+    return total;
+}
+
+const uint8_t* stream_contents(const Stream* stream, size_t* size) {
+    *size = stream->type == STREAM_BUFFER ? stream->length : 0;
+    return stream->type == STREAM_BUFFER ? stream->bytes : NULL;
+}
+
+uint8_t* stream_release(Stream* stream, size_t* size) {
+    uint8_t* bytes = (uint8_t*)stream_contents(stream, size);
+    if (bytes != NULL) {
+        stream->bytes = NULL;
+        stream->length = stream->capacity = stream->position = 0;
+    }
+
+    return bytes;
+}
@@ -0,0 +1,49 @@
+#ifndef LMIPS_STREAM
+#define LMIPS_STREAM
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include "common.h"
+
+typedef enum {
+    STREAM_FD, // A host fd, never closed by the stream
+    STREAM_BUFFER, // Reads consume the buffer, writes append to it
+    STREAM_CALLBACK
+} StreamType;
+
+// Same contract as read(2) and write(2). Either can be NULL, its calls then fail.
+typedef ssize_t (*StreamReader)(void* context, void* bytes, size_t size);
+typedef ssize_t (*StreamWriter)(void* context, const void* bytes, size_t size);
+
+// Host end of a guest standard stream. Every VM owns its own, nothing is shared or locked.
+typedef struct {
+    StreamType type;
+    int fd;
+    uint8_t* bytes;
+    size_t length, capacity, position;
+    bool open; // Buffers only : more bytes may come, reads of an empty buffer fail with EAGAIN instead of ending
+    StreamReader reader;
+    StreamWriter writer;
+    void* context;
+} Stream;
+
+void initFdStream(Stream* stream, int fd);
+// Starts with a copy of `size` bytes to be read, empty output buffers pass 0
+bool initBufferStream(Stream* stream, const void* bytes, size_t size);
+// Empty open buffer, fed by stream_write and ended by stream_close
+void initPipeStream(Stream* stream);
+void initCallbackStream(Stream* stream, StreamReader reader, StreamWriter writer, void* context);
+void freeStream(Stream* stream);
+void stream_close(Stream* stream);
+
+ssize_t stream_read(Stream* stream, void* bytes, size_t size);
+ssize_t stream_write(Stream* stream, const void* bytes, size_t size);
+ssize_t stream_writev(Stream* stream, const struct iovec* pieces, int count);
+
+// Everything written to a buffer stream so far, NULL when empty or not a buffer
+const uint8_t* stream_contents(const Stream* stream, size_t* size);
+// Same as stream_contents, but the caller now owns the bytes and the stream is left empty
+uint8_t* stream_release(Stream* stream, size_t* size);
+
+#endif //LMIPS_STREAM
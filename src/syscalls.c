@@ -0,0 +1,341 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "syscalls.h"
+#include "harts.h"
+#include "lmips_opcodes.h"
+
+void initSyscalls(LMips* mips) {
+    for (size_t i = 0; i < SYSCALL_COUNT; i++) {
+        mips->syscalls[i] = sys_unknown;
+    }
+
+    mips->syscalls[SYS_PRINT_INT] = sys_print_int;
+    mips->syscalls[SYS_PRINT_STRING] = sys_print_string;
+    mips->syscalls[SYS_READ_INT] = sys_read_int;
+    mips->syscalls[SYS_READ_STRING] = sys_read_string;
+    mips->syscalls[SYS_SBRK] = sys_sbrk;
+    mips->syscalls[SYS_EXIT] = sys_exit;
+    mips->syscalls[SYS_OPEN] = sys_open;
+    mips->syscalls[SYS_READ] = sys_read;
+    mips->syscalls[SYS_WRITE] = sys_write;
+    mips->syscalls[SYS_CLOSE] = sys_close;
+    mips->syscalls[SYS_MMAP] = sys_mmap;
+    mips->syscalls[SYS_MALLOC] = sys_malloc;
+    mips->syscalls[SYS_FREE] = sys_free;
+    mips->syscalls[SYS_REALLOC] = sys_realloc;
+    mips->syscalls[SYS_MEMCPY] = sys_memmove; // Overlaps are harmless, the host memmove is as fast
+    mips->syscalls[SYS_MEMMOVE] = sys_memmove;
+    mips->syscalls[SYS_MEMSET] = sys_memset;
+    mips->syscalls[SYS_MEMCMP] = sys_memcmp;
+    mips->syscalls[SYS_STRLEN] = sys_strlen;
+    mips->syscalls[SYS_HART_SPAWN] = sys_hart_spawn;
+    mips->syscalls[SYS_HART_JOIN] = sys_hart_join;
+    mips->syscalls[SYS_HART_ID] = sys_hart_id;
+    mips->syscalls[SYS_FUTEX_WAIT] = sys_futex_wait;
+    mips->syscalls[SYS_FUTEX_WAKE] = sys_futex_wake;
+}
+
+bool lmips_register_syscall(LMips* mips, uint32_t code, SyscallHandler handler) {
+    // Code 0 also catches the codes past the table
+    if (code == 0 || code >= SYSCALL_COUNT) return false;
+
+    mips->syscalls[code] = handler != NULL ? handler : sys_unknown;
+    return true;
+}
+
+// The heap can grow up to the read-only mappings
+static uint32_t heapLimit(const Memory* memory) {
+    return memory->readOnlyStart != memory->readOnlyEnd ? memory->readOnlyStart : MAP_ADDRESS;
+}
+
+ExecutionResult sys_unknown(LMips* mips) {
+    fprintf(stderr, "Unknown syscall instruction %d\n", mips->regs[$v0]);
+    return EXEC_FAILURE;
+}
+
+ExecutionResult sys_print_int(LMips* mips) {
+    console_write_int(&mips->process->console, mips->regs[$a0]);
+    return EXEC_SUCCESS;
+}
+
+ExecutionResult sys_print_string(LMips* mips) {
+    uint32_t address = mips->regs[$a0];
+    if (!mem_valid(mips->memory, address)) return EXEC_ERR_MEMORY_ADDR;
+
+    const char* string = (const char*)&mips->memory->store[address];
+    console_write(&mips->process->console, string, strnlen(string, MEMORY_SIZE - address));
+    return EXEC_SUCCESS;
+}
+
+// Leaves the guest on its syscall, as if it had not been executed yet
+static ExecutionResult block(LMips* mips) {
+    mips->ip -= 4;
+    mips->icount--;
+    return EXEC_BLOCKED;
+}
+
+ExecutionResult sys_read_int(LMips* mips) {
+    // Prompts must show before the guest blocks on input
+    console_flush(&mips->process->console);
+    if (!scanner_ready(&mips->process->scanner, SCANNER_INT_LINE_SIZE)) return block(mips);
+
+    mips->regs[$v0] = scanner_read_int(&mips->process->scanner);
+    return EXEC_SUCCESS;
+}
+
+ExecutionResult sys_read_string(LMips* mips) {
+    console_flush(&mips->process->console);
+    uint32_t address = mips->regs[$a0];
+    if (!mem_valid(mips->memory, address)) return EXEC_ERR_MEMORY_ADDR;
+
+    // The line is read straight into guest memory, its last byte (usually the new line) is dropped
+    uint32_t size = mips->regs[$a1] < MEMORY_SIZE - address ? mips->regs[$a1] : MEMORY_SIZE - address;
+    if (!mem_writable(mips->memory, address, size)) return EXEC_ERR_MEMORY_ADDR;
+    if (size > 1 && !scanner_ready(&mips->process->scanner, size - 1)) return block(mips);
+
+    size_t length = scanner_read_line(&mips->process->scanner, (char*)&mips->memory->store[address], size);
+    if (length > 0) {
+        mips->memory->store[address + length - 1] = '\0';
+        mem_mark(mips->memory, address, length);
+    }
+    return EXEC_SUCCESS;
+}
+
+// Moves the break by $a0 bytes, it can't cross the read-only mappings and is left as is on failure
+ExecutionResult sys_sbrk(LMips* mips) {
+    const Memory* memory = mips->memory;
+    uint32_t heap = mips->process->heap, next = heap + mips->regs[$a0];
+    uint32_t low = next < heap ? next : heap, high = next < heap ? heap : next;
+    if (!mem_valid(mips->memory, next) || (memory->readOnlyStart != memory->readOnlyEnd &&
+            low < memory->readOnlyEnd && high > memory->readOnlyStart)) {
+        return EXEC_ERR_MEMORY_ADDR;
+    }
+
+    mips->regs[$v0] = heap;
+    mips->process->heap = next;
+    return EXEC_SUCCESS;
+}
+
+ExecutionResult sys_exit(LMips* mips) {
+    mips->stop = true;
+    // Hart 0 ends the whole program, other harts only themselves
+    if (mips->harts != NULL && mips->hartId == 0) {
+        stopHarts(mips->harts);
+    }
+    return EXEC_SUCCESS;
+}
+
+// File syscalls follow MARS : $v0 gets the result, negative on errors
+
+ExecutionResult sys_open(LMips* mips) {
+    uint32_t address = mips->regs[$a0];
+    if (!mem_valid(mips->memory, address)) return EXEC_ERR_MEMORY_ADDR;
+
+    const char* path = (const char*)&mips->memory->store[address];
+    if (strnlen(path, MEMORY_SIZE - address) == MEMORY_SIZE - address) return EXEC_ERR_MEMORY_ADDR;
+
+    mips->regs[$v0] = files_open(&mips->process->files, path, mips->regs[$a1]);
+    return EXEC_SUCCESS;
+}
+
+// Bytes go straight from the host file to guest memory
+ExecutionResult sys_read(LMips* mips) {
+    uint32_t fd = mips->regs[$a0], address = mips->regs[$a1], size = mips->regs[$a2];
+    if (!mem_valid_range(mips->memory, address, size) || !mem_writable(mips->memory, address, size)) {
+        return EXEC_ERR_MEMORY_ADDR;
+    }
+
+    uint8_t* target = &mips->memory->store[address];
+    ssize_t count = -1;
+    if (fd == STDIN_FILENO) {
+        console_flush(&mips->process->console);
+        if (size > 0 && !scanner_ready(&mips->process->scanner, 1)) return block(mips);
+
+        count = scanner_read(&mips->process->scanner, target, size);
+    } else if (files_host_fd(&mips->process->files, fd) >= 0) {
+        count = read(files_host_fd(&mips->process->files, fd), target, size);
+    }
+    if (count > 0) {
+        mem_mark(mips->memory, address, count);
+    }
+
+    mips->regs[$v0] = (int32_t)count;
+    return EXEC_SUCCESS;
+}
+
+ExecutionResult sys_write(LMips* mips) {
+    uint32_t fd = mips->regs[$a0], address = mips->regs[$a1], size = mips->regs[$a2];
+    if (!mem_valid_range(mips->memory, address, size)) return EXEC_ERR_MEMORY_ADDR;
+
+    const uint8_t* source = &mips->memory->store[address];
+    ssize_t count = -1;
+    if (fd == STDOUT_FILENO) {
+        console_write(&mips->process->console, (const char*)source, size);
+        count = size;
+    } else if (fd == STDERR_FILENO) {
+        console_flush(&mips->process->console);
+        count = stream_write(&mips->process->errors, source, size);
+    } else if (files_host_fd(&mips->process->files, fd) >= 0) {
+        count = write(files_host_fd(&mips->process->files, fd), source, size);
+    }
+
+    mips->regs[$v0] = (int32_t)count;
+    return EXEC_SUCCESS;
+}
+
+ExecutionResult sys_close(LMips* mips) {
+    mips->regs[$v0] = files_close(&mips->process->files, mips->regs[$a0]) ? 0 : -1;
+    return EXEC_SUCCESS;
+}
+
+// Maps $a1 bytes of descriptor $a0 from the page-aligned offset $a3, read-only when $a2 is 0 or copy on write
+// when it is 1. Read-only mappings grow down from MAP_ADDRESS so that stores only check one range, private ones
+// are carved from the heap break. The address is returned in $v0.
+ExecutionResult sys_mmap(LMips* mips) {
+    int fd = files_host_fd(&mips->process->files, mips->regs[$a0]);
+    uint32_t size = mips->regs[$a1], flags = mips->regs[$a2], offset = mips->regs[$a3];
+    bool readOnly = flags == 0;
+
+    mips->regs[$v0] = -1;
+    if (fd < 0 || size == 0 || size > MEMORY_SIZE || flags > 1 || offset % MEMORY_PAGE_SIZE != 0) {
+        return EXEC_SUCCESS;
+    }
+
+    Memory* memory = mips->memory;
+    uint32_t length = (size + MEMORY_PAGE_SIZE - 1) & ~(MEMORY_PAGE_SIZE - 1);
+    uint32_t heap = (mips->process->heap + MEMORY_PAGE_SIZE - 1) & ~(MEMORY_PAGE_SIZE - 1);
+    uint32_t top = heapLimit(memory);
+    if (heap > top || top - heap < length) {
+        return EXEC_SUCCESS;
+    }
+
+    uint32_t address = readOnly ? top - length : heap;
+    if (!mem_map_file(memory, address, size, fd, offset)) {
+        return EXEC_SUCCESS;
+    }
+
+    if (readOnly) {
+        memory->readOnlyStart = address;
+        memory->readOnlyEnd = MAP_ADDRESS;
+    } else {
+        mips->process->heap = address + length;
+    }
+
+    mips->regs[$v0] = address;
+    return EXEC_SUCCESS;
+}
+
+static GuestHeap* allocator(LMips* mips) {
+    if (mips->process->allocator == NULL) {
+        mips->process->allocator = newGuestHeap();
+    }
+
+    return mips->process->allocator;
+}
+
+// Allocates $a0 bytes from the native allocator, the address is returned in $v0 (0 when out of memory)
+ExecutionResult sys_malloc(LMips* mips) {
+    GuestHeap* heap = allocator(mips);
+    uint32_t size = mips->regs[$a0];
+    mips->regs[$v0] = heap != NULL ? heap_alloc(heap, &mips->process->heap, heapLimit(mips->memory), size) : 0;
+    return EXEC_SUCCESS;
+}
+
+// Frees the allocation at $a0, freeing anything else is an invalid memory access
+ExecutionResult sys_free(LMips* mips) {
+    uint32_t address = mips->regs[$a0];
+    if (address == 0) return EXEC_SUCCESS;
+
+    GuestHeap* heap = mips->process->allocator;
+    return heap != NULL && heap_free(heap, address) ? EXEC_SUCCESS : EXEC_ERR_MEMORY_ADDR;
+}
+
+// Resizes the allocation at $a0 to $a1 bytes, the possibly moved address is returned in $v0
+ExecutionResult sys_realloc(LMips* mips) {
+    uint32_t address = mips->regs[$a0], size = mips->regs[$a1];
+    GuestHeap* heap = allocator(mips);
+    if (address == 0) {
+        mips->regs[$v0] = heap != NULL ? heap_alloc(heap, &mips->process->heap, heapLimit(mips->memory), size) : 0;
+        return EXEC_SUCCESS;
+    }
+
+    uint32_t current = heap != NULL ? heap_block_size(heap, address) : 0;
+    if (current == 0) return EXEC_ERR_MEMORY_ADDR;
+
+    if (size == 0) {
+        heap_free(heap, address);
+        mips->regs[$v0] = 0;
+        return EXEC_SUCCESS;
+    }
+
+    // Blocks already large enough are kept as long as they aren't more than twice too large
+    if (size <= current && (size > current / 2 || current == HEAP_MIN_BLOCK)) {
+        mips->regs[$v0] = address;
+        return EXEC_SUCCESS;
+    }
+
+    uint32_t moved = heap_alloc(heap, &mips->process->heap, heapLimit(mips->memory), size);
+    if (moved != 0) {
+        uint8_t* store = mips->memory->store;
+        memcpy(&store[moved], &store[address], size < current ? size : current);
+        mem_mark(mips->memory, moved, size < current ? size : current);
+        heap_free(heap, address);
+    }
+
+    mips->regs[$v0] = moved;
+    return EXEC_SUCCESS;
+}
+
+// Bulk memory routines check each range once and leave the work to the host C library
+
+ExecutionResult sys_memmove(LMips* mips) {
+    uint32_t target = mips->regs[$a0], source = mips->regs[$a1], size = mips->regs[$a2];
+    Memory* memory = mips->memory;
+    if (!mem_valid_range(memory, target, size) || !mem_writable(memory, target, size) ||
+        !mem_valid_range(memory, source, size)) {
+        return EXEC_ERR_MEMORY_ADDR;
+    }
+
+    memmove(&memory->store[target], &memory->store[source], size);
+    mem_mark(memory, target, size);
+    mips->regs[$v0] = target;
+    return EXEC_SUCCESS;
+}
+
+ExecutionResult sys_memset(LMips* mips) {
+    uint32_t target = mips->regs[$a0], size = mips->regs[$a2];
+    Memory* memory = mips->memory;
+    if (!mem_valid_range(memory, target, size) || !mem_writable(memory, target, size)) {
+        return EXEC_ERR_MEMORY_ADDR;
+    }
+
+    memset(&memory->store[target], (uint8_t)mips->regs[$a1], size);
+    mem_mark(memory, target, size);
+    mips->regs[$v0] = target;
+    return EXEC_SUCCESS;
+}
+
+ExecutionResult sys_memcmp(LMips* mips) {
+    uint32_t first = mips->regs[$a0], second = mips->regs[$a1], size = mips->regs[$a2];
+    Memory* memory = mips->memory;
+    if (!mem_valid_range(memory, first, size) || !mem_valid_range(memory, second, size)) {
+        return EXEC_ERR_MEMORY_ADDR;
+    }
+
+    int difference = memcmp(&memory->store[first], &memory->store[second], size);
+    mips->regs[$v0] = (difference > 0) - (difference < 0);
+    return EXEC_SUCCESS;
+}
+
+ExecutionResult sys_strlen(LMips* mips) {
+    uint32_t address = mips->regs[$a0];
+    if (!mem_valid(mips->memory, address)) return EXEC_ERR_MEMORY_ADDR;
+
+    // Strings running into the end of the memory are invalid
+    size_t length = strnlen((const char*)&mips->memory->store[address], MEMORY_SIZE - address);
+    if (length == MEMORY_SIZE - address) return EXEC_ERR_MEMORY_ADDR;
+
+    mips->regs[$v0] = length;
+    return EXEC_SUCCESS;
+}
@@ -0,0 +1,34 @@
+#ifndef LMIPS_SYSCALLS
+#define LMIPS_SYSCALLS
+
+#include "lmips.h"
+
+// Fills the table with the built-in SYS_* handlers
+void initSyscalls(LMips* mips);
+
+ExecutionResult sys_unknown(LMips* mips);
+ExecutionResult sys_print_int(LMips* mips);
+ExecutionResult sys_print_string(LMips* mips);
+ExecutionResult sys_read_int(LMips* mips);
+ExecutionResult sys_read_string(LMips* mips);
+ExecutionResult sys_sbrk(LMips* mips);
+ExecutionResult sys_exit(LMips* mips);
+ExecutionResult sys_open(LMips* mips);
+ExecutionResult sys_read(LMips* mips);
+ExecutionResult sys_write(LMips* mips);
+ExecutionResult sys_close(LMips* mips);
+ExecutionResult sys_mmap(LMips* mips);
+ExecutionResult sys_malloc(LMips* mips);
+ExecutionResult sys_free(LMips* mips);
+ExecutionResult sys_realloc(LMips* mips);
+ExecutionResult sys_memmove(LMips* mips);
+ExecutionResult sys_memset(LMips* mips);
+ExecutionResult sys_memcmp(LMips* mips);
+ExecutionResult sys_strlen(LMips* mips);
+ExecutionResult sys_hart_spawn(LMips* mips);
+ExecutionResult sys_hart_join(LMips* mips);
+ExecutionResult sys_hart_id(LMips* mips);
+ExecutionResult sys_futex_wait(LMips* mips);
+ExecutionResult sys_futex_wake(LMips* mips);
+
+#endif //LMIPS_SYSCALLS
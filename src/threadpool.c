@@ -0,0 +1,113 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include "threadpool.h"
+
+static void* workerMain(void* arg) {
+    ThreadPool* pool = arg;
+
+    pthread_mutex_lock(&pool->lock);
+    while (true) {
+        while (pool->head == NULL && !pool->stop) {
+            pthread_cond_wait(&pool->available, &pool->lock);
+        }
+        if (pool->head == NULL) break;
+
+        Task* task = pool->head;
+        pool->head = task->next;
+        if (pool->head == NULL) pool->tail = NULL;
+        pool->running++;
+        pthread_mutex_unlock(&pool->lock);
+
+        task->function(task->arg);
+        free(task);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->running == 0 && pool->head == NULL) {
+            pthread_cond_broadcast(&pool->idle);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+bool initThreadPool(ThreadPool* pool, int threadCount, const cpu_set_t* cpus) {
+    pool->threads = malloc(threadCount * sizeof(pthread_t));
+    pool->threadCount = 0;
+    pool->head = NULL;
+    pool->tail = NULL;
+    pool->running = 0;
+    pool->stop = false;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->available, NULL);
+    pthread_cond_init(&pool->idle, NULL);
+
+    if (pool->threads == NULL) return false;
+
+    pthread_attr_t attributes;
+    pthread_attr_init(&attributes);
+    if (cpus != NULL) {
+        pthread_attr_setaffinity_np(&attributes, sizeof(cpu_set_t), cpus);
+    }
+
+    for (int i = 0; i < threadCount; ++i) {
+        if (pthread_create(&pool->threads[i], &attributes, workerMain, pool) != 0) break;
+        pool->threadCount++;
+    }
+    pthread_attr_destroy(&attributes);
+
+    return pool->threadCount > 0;
+}
+
+void freeThreadPool(ThreadPool* pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = true;
+    pthread_cond_broadcast(&pool->available);
+    pthread_mutex_unlock(&pool->lock);
+
+    // Workers drain the queue before leaving
+    for (int i = 0; i < pool->threadCount; ++i) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    free(pool->threads);
+    pool->threads = NULL;
+    pool->threadCount = 0;
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->available);
+    pthread_cond_destroy(&pool->idle);
+}
+
+bool pool_submit(ThreadPool* pool, TaskFunction function, void* arg) {
+    Task* task = malloc(sizeof(Task));
+    if (task == NULL) return false;
+
+    task->function = function;
+    task->arg = arg;
+    task->next = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->tail != NULL) {
+        pool->tail->next = task;
+    } else {
+        pool->head = task;
+    }
+    pool->tail = task;
+    pthread_cond_signal(&pool->available);
+    pthread_mutex_unlock(&pool->lock);
+
+    return true;
+}
+
+void pool_wait(ThreadPool* pool) {
+    pthread_mutex_lock(&pool->lock);
+    while (pool->head != NULL || pool->running > 0) {
+        pthread_cond_wait(&pool->idle, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+int pool_default_threads() {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 1 ? (int)count : 1;
+}
@@ -0,0 +1,37 @@
+#ifndef LMIPS_THREADPOOL
+#define LMIPS_THREADPOOL
+
+#include <pthread.h>
+#include <sched.h>
+#include "common.h"
+
+typedef void (*TaskFunction)(void* arg);
+
+typedef struct task {
+    TaskFunction function;
+    void* arg;
+    struct task* next;
+} Task;
+
+typedef struct {
+    pthread_t* threads;
+    int threadCount;
+    Task* head;
+    Task* tail;
+    int running;
+    bool stop;
+    pthread_mutex_t lock;
+    pthread_cond_t available;
+    pthread_cond_t idle;
+} ThreadPool;
+
+// Workers are pinned to `cpus` when given
+bool initThreadPool(ThreadPool* pool, int threadCount, const cpu_set_t* cpus);
+void freeThreadPool(ThreadPool* pool);
+
+bool pool_submit(ThreadPool* pool, TaskFunction function, void* arg);
+void pool_wait(ThreadPool* pool);
+
+int pool_default_threads();
+
+#endif //LMIPS_THREADPOOL
@@ -0,0 +1,452 @@
+#include <stdlib.h>
+#include "lmips_opcodes.h"
+#include "translator.h"
+
+#define TEXT_WORDS (TRANSLATOR_TEXT_SIZE / 4)
+#define TEXT_PAGES (TRANSLATOR_TEXT_SIZE / MEMORY_PAGE_SIZE)
+#define PAGE_WORDS (MEMORY_PAGE_SIZE / 4)
+
+typedef struct {
+    Translator* translator;
+    uint32_t ip;
+} Request;
+
+bool initTranslator(Translator* translator, LMips* mips, int threads) {
+    translator->program = mips->program;
+    translator->blocks = NULL;
+    translator->heat = NULL;
+    translator->versions = NULL;
+    atomic_init(&translator->retired, NULL);
+    atomic_init(&translator->stats.queued, 0);
+    atomic_init(&translator->stats.translated, 0);
+    atomic_init(&translator->stats.rejected, 0);
+    atomic_init(&translator->stats.discarded, 0);
+    atomic_init(&translator->stats.invalidations, 0);
+
+    // Zeroed pages come from the kernel on first touch, untouched text costs nothing
+    bool success = initThreadPool(&translator->pool, threads, NULL) &&
+        (translator->blocks = calloc(TEXT_WORDS, sizeof(_Atomic(Translation*)))) != NULL &&
+        (translator->heat = calloc(TEXT_WORDS, sizeof(_Atomic uint16_t))) != NULL &&
+        (translator->versions = calloc(TEXT_PAGES, sizeof(_Atomic uint32_t))) != NULL &&
+        mips->program != NULL;
+
+    if (!success) {
+        freeTranslator(translator);
+        return false;
+    }
+
+    mips->translator = translator;
+    return true;
+}
+
+void freeTranslator(Translator* translator) {
+    // Blocks still queued are decoded first
+    freeThreadPool(&translator->pool);
+
+    for (uint32_t i = 0; translator->blocks != NULL && i < TEXT_WORDS; ++i) {
+        free(atomic_load(&translator->blocks[i]));
+    }
+
+    Translation* block = atomic_load(&translator->retired);
+    while (block != NULL) {
+        Translation* next = block->retired;
+        free(block);
+        block = next;
+    }
+
+    free(translator->blocks);
+    free(translator->heat);
+    free(translator->versions);
+    translator->blocks = NULL;
+    translator->heat = NULL;
+    translator->versions = NULL;
+    atomic_store(&translator->retired, NULL);
+}
+
+// Lock-free push, a hart may still be running the block
+static void retire(Translator* translator, Translation* block) {
+    Translation* head = atomic_load(&translator->retired);
+    do {
+        block->retired = head;
+    } while (!atomic_compare_exchange_weak(&translator->retired, &head, block));
+}
+
+// Whether the instruction can be translated, `ends` is set for the branches and jumps ending a block
+static bool decode(uint32_t instr, TranslatedOp* op, bool* ends) {
+    uint8_t opcode = instr >> 0x1A;
+    uint16_t immediate = instr & 0xFFFF;
+    op->rs = (instr >> 0x15) & 0x1F;
+    op->rt = (instr >> 0x10) & 0x1F;
+    op->rd = (instr >> 0x0B) & 0x1F;
+    op->kind = TRANSLATED_OP(opcode);
+    op->immediate = 0;
+    *ends = false;
+
+    switch (opcode) {
+        case OP_SPECIAL:
+            op->kind = instr & 0x3F;
+            switch (op->kind) {
+                case SPE_SLL:
+                case SPE_SRL:
+                case SPE_SRA:
+                    op->immediate = (instr >> 0x06) & 0x1F;
+                    return true;
+                case SPE_JALR:
+                    op->rd = op->rd <= 0 ? $ra : op->rd;
+                    // Fallthrough
+                case SPE_JR:
+                    *ends = true;
+                    return true;
+                case SPE_SLLV:
+                case SPE_SRLV:
+                case SPE_SRAV:
+                case SPE_SYNC:
+                case SPE_MFHI:
+                case SPE_MTHI:
+                case SPE_MFLO:
+                case SPE_MTLO:
+                case SPE_MULT:
+                case SPE_MULTU:
+                case SPE_DIV:
+                case SPE_DIVU:
+                case SPE_ADD:
+                case SPE_ADDU:
+                case SPE_SUB:
+                case SPE_SUBU:
+                case SPE_AND:
+                case SPE_OR:
+                case SPE_XOR:
+                case SPE_NOR:
+                case SPE_SLT:
+                case SPE_SLTU:
+                    return true;
+                default:
+                    // Syscalls and unknown instructions
+                    return false;
+            }
+        case OP_J:
+        case OP_JAL:
+            op->immediate = (instr & 0x3FFFFFF) << 2;
+            *ends = true;
+            return true;
+        case OP_BEQ:
+        case OP_BNE:
+        case OP_BLEZ:
+        case OP_BGTZ:
+            op->immediate = sign_extend(immediate << 2, 14);
+            *ends = true;
+            return true;
+        case OP_ADDI:
+        case OP_ADDIU:
+        case OP_SLTI:
+        case OP_SLTIU:
+            op->immediate = sign_extend(immediate, 16);
+            return true;
+        case OP_ANDI:
+        case OP_ORI:
+        case OP_XORI:
+            op->immediate = zero_extend(immediate, 16);
+            return true;
+        case OP_LUI:
+            op->immediate = (uint32_t)immediate << 16;
+            return true;
+        case OP_LB:
+        case OP_LBU:
+        case OP_SB:
+        case OP_SH:
+        case OP_SW:
+            op->immediate = (int16_t)immediate;
+            return true;
+        case OP_LH:
+        case OP_LHU:
+        case OP_LW: {
+            // Misaligned offsets always fault, the interpreter reports them
+            int16_t offset = immediate;
+            op->immediate = offset;
+            return offset % (opcode == OP_LW ? 4 : 2) == 0;
+        }
+        default:
+            // Regimm branches, atomics and unknown instructions
+            return false;
+    }
+}
+
+static void translate(void* arg) {
+    Request* request = arg;
+    Translator* translator = request->translator;
+    uint32_t ip = request->ip;
+    free(request);
+
+    uint32_t page = ip / MEMORY_PAGE_SIZE;
+    uint32_t version = atomic_load_explicit(&translator->versions[page], memory_order_acquire);
+    Translation* block = malloc(sizeof(Translation) + TRANSLATOR_MAX_OPS * sizeof(TranslatedOp));
+    if (block == NULL) return;
+
+    block->start = ip;
+    block->count = 0;
+    block->version = version;
+    block->retired = NULL;
+
+    // Blocks stay within their page, so that a single version covers them
+    bool ends = false;
+    while (!ends && block->count < TRANSLATOR_MAX_OPS && (ip + block->count * 4) / MEMORY_PAGE_SIZE == page) {
+        const uint8_t* bytes = &translator->program[ip + block->count * 4];
+        uint32_t instr = ((uint32_t)bytes[0] << 0x18) | (bytes[1] << 0x10) | (bytes[2] << 0x08) | bytes[3];
+        if (!decode(instr, &block->ops[block->count], &ends)) break;
+        block->count++;
+    }
+
+    // Left at the threshold, the block is not queued again until its text changes
+    if (block->count == 0) {
+        atomic_fetch_add(&translator->stats.rejected, 1);
+        free(block);
+        return;
+    }
+
+    // The text changed while it was decoded, the block heats up again from the new one
+    if (atomic_load(&translator->versions[page]) != version) {
+        atomic_fetch_add(&translator->stats.discarded, 1);
+        free(block);
+        return;
+    }
+
+    // An invalidation from here on either takes the block back out or bumps the version lookups check
+    Translation* previous = atomic_exchange(&translator->blocks[ip / 4], block);
+    if (previous != NULL) {
+        retire(translator, previous);
+    }
+    atomic_fetch_add(&translator->stats.translated, 1);
+}
+
+void translator_heat(Translator* translator, uint32_t ip) {
+    if (ip % 4 != 0 || ip >= TRANSLATOR_TEXT_SIZE) return;
+
+    // Racing harts may lose a count, only the one reaching the threshold queues the block
+    _Atomic uint16_t* heat = &translator->heat[ip / 4];
+    uint16_t count = atomic_load_explicit(heat, memory_order_relaxed);
+    if (count >= TRANSLATOR_THRESHOLD) return;
+    if (count + 1 < TRANSLATOR_THRESHOLD) {
+        atomic_store_explicit(heat, count + 1, memory_order_relaxed);
+        return;
+    }
+    if (!atomic_compare_exchange_strong(heat, &count, TRANSLATOR_THRESHOLD)) return;
+
+    Request* request = malloc(sizeof(Request));
+    if (request == NULL) return;
+
+    request->translator = translator;
+    request->ip = ip;
+    if (!pool_submit(&translator->pool, translate, request)) {
+        free(request);
+        return;
+    }
+    atomic_fetch_add(&translator->stats.queued, 1);
+}
+
+void translator_invalidate(Translator* translator, uint32_t ip, uint32_t size) {
+    if (size == 0 || ip >= TRANSLATOR_TEXT_SIZE) return;
+
+    uint32_t last = size - 1 < TRANSLATOR_TEXT_SIZE - ip ? ip + size - 1 : TRANSLATOR_TEXT_SIZE - 1;
+    for (uint32_t page = ip / MEMORY_PAGE_SIZE; page <= last / MEMORY_PAGE_SIZE; ++page) {
+        atomic_fetch_add(&translator->versions[page], 1);
+
+        for (uint32_t slot = page * PAGE_WORDS; slot < (page + 1) * PAGE_WORDS; ++slot) {
+            if (atomic_load_explicit(&translator->blocks[slot], memory_order_relaxed) != NULL) {
+                Translation* block = atomic_exchange(&translator->blocks[slot], NULL);
+                if (block != NULL) {
+                    retire(translator, block);
+                }
+            }
+            atomic_store_explicit(&translator->heat[slot], 0, memory_order_relaxed);
+        }
+    }
+    atomic_fetch_add(&translator->stats.invalidations, 1);
+}
+
+void translator_wait(Translator* translator) {
+    pool_wait(&translator->pool);
+}
+
+// Every case does what the interpreter does for the same instruction, quirks included
+bool translation_run(LMips* mips, const Translation* block) {
+    uint32_t* regs = mips->regs;
+    Memory* memory = mips->memory;
+    const TranslatedOp* op = block->ops;
+    const TranslatedOp* end = block->ops + block->count;
+    uint32_t from = block->start + (block->count - 1) * 4; // The branch or jump, if the block ends with one
+    uint32_t next = block->start + block->count * 4;
+    bool branches = false;
+
+#define VALID(address) ((address) < MEMORY_SIZE && (address) >= memory->base)
+#define STORABLE(address, size) (VALID(address) && mem_writable(memory, address, size))
+
+    for (; op < end; ++op) {
+        switch (op->kind) {
+            case SPE_SLL: regs[op->rd] = regs[op->rt] << op->immediate; break;
+            case SPE_SRL: regs[op->rd] = regs[op->rt] >> op->immediate; break;
+            case SPE_SRA: regs[op->rd] = (int32_t)regs[op->rt] >> op->immediate; break;
+            case SPE_SLLV: regs[op->rd] = regs[op->rt] << (regs[op->rs] & 0x1F); break;
+            case SPE_SRLV:
+            case SPE_SRAV: regs[op->rd] = regs[op->rt] >> (regs[op->rs] & 0x1F); break;
+            case SPE_SYNC: atomic_thread_fence(memory_order_seq_cst); break;
+            case SPE_MFHI: regs[op->rd] = mips->hi; break;
+            case SPE_MTHI:
+            case SPE_MTLO: mips->hi = regs[op->rs]; break;
+            case SPE_MFLO: regs[op->rd] = mips->lo; break;
+            case SPE_MULT:
+            case SPE_MULTU: {
+                int64_t res = regs[op->rs] * regs[op->rt];
+                mips->hi = res >> 0x20;
+                mips->lo = (int32_t)res;
+                break;
+            }
+            case SPE_DIV:
+            case SPE_DIVU: {
+                int32_t rs = regs[op->rs];
+                int32_t rt = regs[op->rt];
+                if (rt != 0) {
+                    mips->lo = rs / rt;
+                    mips->hi = rs - (mips->lo * rt);
+                }
+                break;
+            }
+            case SPE_ADD: {
+                int64_t res = (int64_t)(int32_t)regs[op->rs] + (int32_t)regs[op->rt];
+                if (res > INT32_MAX || res < INT32_MIN) goto leave;
+                regs[op->rd] = (int32_t)res;
+                break;
+            }
+            case SPE_SUB: {
+                int64_t res = (int64_t)(int32_t)regs[op->rs] - (int32_t)regs[op->rt];
+                if (res > INT32_MAX || res < INT32_MIN) goto leave;
+                regs[op->rd] = (int32_t)res;
+                break;
+            }
+            case SPE_ADDU: regs[op->rd] = regs[op->rs] + regs[op->rt]; break;
+            case SPE_SUBU: regs[op->rd] = regs[op->rs] - regs[op->rt]; break;
+            case SPE_AND: regs[op->rd] = regs[op->rs] & regs[op->rt]; break;
+            case SPE_OR: regs[op->rd] = regs[op->rs] | regs[op->rt]; break;
+            case SPE_XOR: regs[op->rd] = regs[op->rs] ^ regs[op->rt]; break;
+            case SPE_NOR: regs[op->rd] = ~(regs[op->rs] | regs[op->rt]); break;
+            case SPE_SLT:
+            case SPE_SLTU: regs[op->rd] = (int32_t)regs[op->rs] < (int32_t)regs[op->rt]; break;
+            case SPE_JR:
+                next = regs[op->rs];
+                branches = true;
+                break;
+            case SPE_JALR:
+                regs[op->rd] = from + 4;
+                next = regs[op->rs];
+                branches = true;
+                break;
+            case TRANSLATED_OP(OP_J):
+                next = op->immediate;
+                branches = true;
+                break;
+            case TRANSLATED_OP(OP_JAL):
+                regs[$ra] = from + 4;
+                next = op->immediate;
+                branches = true;
+                break;
+            case TRANSLATED_OP(OP_BEQ):
+                next = regs[op->rs] == regs[op->rt] ? from + op->immediate : from + 4;
+                branches = true;
+                break;
+            case TRANSLATED_OP(OP_BNE):
+                next = regs[op->rs] != regs[op->rt] ? from + op->immediate : from + 4;
+                branches = true;
+                break;
+            case TRANSLATED_OP(OP_BLEZ):
+                next = (int32_t)regs[op->rs] <= 0 ? from + op->immediate : from + 4;
+                branches = true;
+                break;
+            case TRANSLATED_OP(OP_BGTZ):
+                next = (int32_t)regs[op->rs] > 0 ? from + op->immediate : from + 4;
+                branches = true;
+                break;
+            case TRANSLATED_OP(OP_ADDI): {
+                int64_t res = (int64_t)(int32_t)regs[op->rs] + (int32_t)op->immediate;
+                if (res > INT32_MAX || res < INT32_MIN) goto leave;
+                regs[op->rt] = (int32_t)res;
+                break;
+            }
+            case TRANSLATED_OP(OP_ADDIU): regs[op->rt] = regs[op->rs] + op->immediate; break;
+            case TRANSLATED_OP(OP_SLTI): regs[op->rt] = (int32_t)regs[op->rs] < (int32_t)op->immediate; break;
+            case TRANSLATED_OP(OP_SLTIU): regs[op->rt] = (int32_t)regs[op->rs] < op->immediate; break;
+            case TRANSLATED_OP(OP_ANDI): regs[op->rt] = regs[op->rs] & op->immediate; break;
+            case TRANSLATED_OP(OP_ORI): regs[op->rt] = regs[op->rs] | op->immediate; break;
+            case TRANSLATED_OP(OP_XORI): regs[op->rt] = regs[op->rs] ^ op->immediate; break;
+            case TRANSLATED_OP(OP_LUI): regs[op->rt] = op->immediate; break;
+            case TRANSLATED_OP(OP_LB): {
+                uint32_t address = regs[op->rs] + op->immediate;
+                if (!VALID(address)) goto leave;
+                int8_t byte = mem_read_byte(memory, address);
+                regs[op->rt] = sign_extend(byte, 16);
+                break;
+            }
+            case TRANSLATED_OP(OP_LH): {
+                uint32_t address = regs[op->rs] + op->immediate;
+                if (!VALID(address)) goto leave;
+                int16_t half = mem_read_half(memory, address);
+                regs[op->rt] = sign_extend(half, 16);
+                break;
+            }
+            case TRANSLATED_OP(OP_LW): {
+                uint32_t address = regs[op->rs] + op->immediate;
+                if (!VALID(address)) goto leave;
+                regs[op->rt] = (int32_t)mem_read(memory, address);
+                break;
+            }
+            case TRANSLATED_OP(OP_LBU): {
+                uint32_t address = regs[op->rs] + op->immediate;
+                if (!VALID(address)) goto leave;
+                regs[op->rt] = mem_read_byte(memory, address);
+                break;
+            }
+            case TRANSLATED_OP(OP_LHU): {
+                uint32_t address = regs[op->rs] + op->immediate;
+                if (!VALID(address)) goto leave;
+                regs[op->rt] = mem_read_half(memory, address);
+                break;
+            }
+            // Device registers and read-only mappings are left to the interpreter
+            case TRANSLATED_OP(OP_SB): {
+                uint32_t address = regs[op->rs] + op->immediate;
+                if (!STORABLE(address, 1)) goto leave;
+                mem_write_byte(memory, address, (uint8_t)regs[op->rt]);
+                break;
+            }
+            case TRANSLATED_OP(OP_SH): {
+                uint32_t address = regs[op->rs] + op->immediate;
+                if (!STORABLE(address, 2)) goto leave;
+                mem_write_half(memory, address, regs[op->rt]);
+                break;
+            }
+            case TRANSLATED_OP(OP_SW): {
+                uint32_t address = regs[op->rs] + op->immediate;
+                if (!STORABLE(address, 4)) goto leave;
+                mem_write(memory, address, regs[op->rt]);
+                break;
+            }
+        }
+    }
+
+#undef VALID
+#undef STORABLE
+
+    mips->ip = next;
+    mips->icount += block->count;
+    if (branches) {
+        if (mips->coverage != NULL) {
+            uint8_t* counter = &mips->coverage[COVERAGE_EDGE(from, next)];
+            *counter += *counter < UINT8_MAX;
+        }
+        translator_heat(mips->translator, next);
+    }
+    return true;
+
+leave:
+    mips->ip = block->start + (op - block->ops) * 4;
+    mips->icount += op - block->ops;
+    return false;
+}
@@ -0,0 +1,76 @@
+#ifndef LMIPS_TRANSLATOR
+#define LMIPS_TRANSLATOR
+
+#include "lmips.h"
+#include "threadpool.h"
+
+#define TRANSLATOR_TEXT_SIZE (DATA_ADDRESS - PROGRAM_ADDRESS)
+#define TRANSLATOR_THRESHOLD 64 // Times a block is entered before it is queued for translation
+#define TRANSLATOR_MAX_OPS 64
+
+// A decoded instruction, the immediate is already extended the way the interpreter does it
+typedef struct {
+    uint8_t kind; // SPE_* function of special instructions, TRANSLATED_OP(op) for the others
+    uint8_t rs, rt, rd;
+    uint32_t immediate;
+} TranslatedOp;
+
+#define TRANSLATED_OP(op) (0x40 | (op))
+
+// A straight run of instructions within a text page, ending with its branch or jump if it has one.
+// Immutable once published.
+typedef struct translation {
+    uint32_t start; // Text offset
+    uint32_t count;
+    uint32_t version; // Of its text page when it was decoded
+    struct translation* retired; // Next in the list of translations no longer reachable
+    TranslatedOp ops[];
+} Translation;
+
+typedef struct {
+    _Atomic uint64_t queued;
+    _Atomic uint64_t translated;
+    _Atomic uint64_t rejected; // Blocks starting with an instruction left to the interpreter
+    _Atomic uint64_t discarded; // Translations finished after their text changed
+    _Atomic uint64_t invalidations;
+} TranslatorStats;
+
+// Hot blocks are decoded by background threads while the guest goes on in the interpreter, which picks the
+// translations up once published. Published slots are only ever swapped atomically, a translation whose text
+// page changed since it was decoded is never run.
+typedef struct translator {
+    const uint8_t* program;
+    _Atomic(Translation*)* blocks; // A slot per text word, indexed by the offset of the block start
+    _Atomic uint16_t* heat; // Entries of each block start, TRANSLATOR_THRESHOLD once queued
+    _Atomic uint32_t* versions; // A counter per text page, bumped by translator_invalidate
+    _Atomic(Translation*) retired; // Freed by freeTranslator, harts may still be running them until then
+    ThreadPool pool;
+    TranslatorStats stats;
+} Translator;
+
+// Attaches the translator to `mips` and the harts it spawns from then on, the VM must be freed first
+bool initTranslator(Translator* translator, LMips* mips, int threads);
+void freeTranslator(Translator* translator);
+
+// Counts an entry into the block starting at `ip`, queueing it when it gets hot
+void translator_heat(Translator* translator, uint32_t ip);
+// lmips_write_memory calls it when it rewrites text, translations of the pages in [ip, ip + size) are dropped
+void translator_invalidate(Translator* translator, uint32_t ip, uint32_t size);
+// Waits for the queued blocks
+void translator_wait(Translator* translator);
+
+// Runs the block, returns false when it stopped early with ip and icount at the instruction the interpreter must
+// run next : a fault, an overflow, a device access or anything else it leaves to the interpreter
+bool translation_run(LMips* mips, const Translation* block);
+
+static inline const Translation* translator_lookup(Translator* translator, uint32_t ip) {
+    if (ip % 4 != 0 || ip >= TRANSLATOR_TEXT_SIZE) return NULL;
+
+    Translation* block = atomic_load_explicit(&translator->blocks[ip / 4], memory_order_acquire);
+    if (block == NULL) return NULL;
+
+    uint32_t version = atomic_load_explicit(&translator->versions[ip / MEMORY_PAGE_SIZE], memory_order_acquire);
+    return block->version == version ? block : NULL;
+}
+
+#endif //LMIPS_TRANSLATOR
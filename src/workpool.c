@@ -0,0 +1,191 @@
+#include <stdatomic.h>
+#include <stdlib.h>
+#include "workpool.h"
+
+#define INITIAL_CAPACITY 64
+
+typedef struct {
+    WorkPool* pool;
+    int index;
+} Worker;
+
+static bool push(WorkQueue* queue, WorkItem item) {
+    pthread_mutex_lock(&queue->lock);
+    if (queue->count == queue->capacity) {
+        uint32_t capacity = queue->capacity > 0 ? queue->capacity * 2 : INITIAL_CAPACITY;
+        WorkItem* items = malloc(capacity * sizeof(WorkItem));
+        if (items == NULL) {
+            pthread_mutex_unlock(&queue->lock);
+            return false;
+        }
+
+        for (uint32_t i = 0; i < queue->count; ++i) {
+            items[i] = queue->items[(queue->start + i) % queue->capacity];
+        }
+        free(queue->items);
+        queue->items = items;
+        queue->start = 0;
+        queue->capacity = capacity;
+    }
+
+    queue->items[(queue->start + queue->count) % queue->capacity] = item;
+    queue->count++;
+    pthread_mutex_unlock(&queue->lock);
+    return true;
+}
+
+static bool take(WorkQueue* queue, bool front, WorkItem* item) {
+    pthread_mutex_lock(&queue->lock);
+    bool found = queue->count > 0;
+    if (found) {
+        if (front) {
+            *item = queue->items[queue->start];
+            queue->start = (queue->start + 1) % queue->capacity;
+        } else {
+            *item = queue->items[(queue->start + queue->count - 1) % queue->capacity];
+        }
+        queue->count--;
+    }
+    pthread_mutex_unlock(&queue->lock);
+
+    return found;
+}
+
+static bool findWork(WorkPool* pool, int index, WorkItem* item) {
+    if (take(&pool->queues[index], false, item)) return true;
+
+    for (int i = 1; i < pool->queueCount; ++i) {
+        if (take(&pool->queues[(index + i) % pool->queueCount], true, item)) {
+            atomic_fetch_add(&pool->steals, 1);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void* workerMain(void* arg) {
+    Worker* worker = arg;
+    WorkPool* pool = worker->pool;
+
+    for (;;) {
+        WorkItem item;
+        if (findWork(pool, worker->index, &item)) {
+            atomic_fetch_sub(&pool->queued, 1);
+            item.function(item.arg);
+
+            pthread_mutex_lock(&pool->lock);
+            if (--pool->pending == 0) {
+                pthread_cond_broadcast(&pool->idle);
+            }
+            pthread_mutex_unlock(&pool->lock);
+            continue;
+        }
+
+        // Submissions bump `queued` before signalling under the lock, no wake up can be missed
+        pthread_mutex_lock(&pool->lock);
+        while (atomic_load(&pool->queued) == 0 && !pool->stop) {
+            pthread_cond_wait(&pool->available, &pool->lock);
+        }
+        bool done = atomic_load(&pool->queued) == 0;
+        pthread_mutex_unlock(&pool->lock);
+
+        if (done) break;
+    }
+
+    free(worker);
+    return NULL;
+}
+
+bool initWorkPool(WorkPool* pool, int threadCount) {
+    pool->threads = malloc(threadCount * sizeof(pthread_t));
+    pool->queues = calloc(threadCount, sizeof(WorkQueue));
+    pool->queueCount = threadCount;
+    pool->threadCount = 0;
+    pool->next = 0;
+    pool->pending = 0;
+    atomic_init(&pool->queued, 0);
+    atomic_init(&pool->steals, 0);
+    pool->stop = false;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->available, NULL);
+    pthread_cond_init(&pool->idle, NULL);
+
+    if (pool->threads == NULL || pool->queues == NULL) {
+        free(pool->threads);
+        free(pool->queues);
+        pool->threads = NULL;
+        pool->queues = NULL;
+        return false;
+    }
+
+    for (int i = 0; i < threadCount; ++i) {
+        pthread_mutex_init(&pool->queues[i].lock, NULL);
+    }
+
+    for (int i = 0; i < threadCount; ++i) {
+        Worker* worker = malloc(sizeof(Worker));
+        if (worker == NULL) break;
+
+        worker->pool = pool;
+        worker->index = i;
+        if (pthread_create(&pool->threads[i], NULL, workerMain, worker) != 0) {
+            free(worker);
+            break;
+        }
+        pool->threadCount++;
+    }
+
+    return pool->threadCount > 0;
+}
+
+void freeWorkPool(WorkPool* pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = true;
+    pthread_cond_broadcast(&pool->available);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->threadCount; ++i) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    for (int i = 0; pool->queues != NULL && i < pool->queueCount; ++i) {
+        pthread_mutex_destroy(&pool->queues[i].lock);
+        free(pool->queues[i].items);
+    }
+    free(pool->threads);
+    free(pool->queues);
+    pool->threads = NULL;
+    pool->queues = NULL;
+    pool->threadCount = 0;
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->available);
+    pthread_cond_destroy(&pool->idle);
+}
+
+bool workpool_submit(WorkPool* pool, TaskFunction function, void* arg) {
+    WorkItem item = {function, arg};
+
+    // Started workers get the tasks in turn
+    pthread_mutex_lock(&pool->lock);
+    int index = pool->next++ % pool->threadCount;
+    atomic_fetch_add(&pool->queued, 1);
+    bool queued = push(&pool->queues[index], item);
+    if (queued) {
+        pool->pending++;
+        pthread_cond_signal(&pool->available);
+    } else {
+        atomic_fetch_sub(&pool->queued, 1);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return queued;
+}
+
+void workpool_wait(WorkPool* pool) {
+    pthread_mutex_lock(&pool->lock);
+    while (pool->pending > 0) {
+        pthread_cond_wait(&pool->idle, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
@@ -0,0 +1,42 @@
+#ifndef LMIPS_WORKPOOL
+#define LMIPS_WORKPOOL
+
+#include "threadpool.h"
+
+typedef struct {
+    TaskFunction function;
+    void* arg;
+} WorkItem;
+
+// Per worker deque : the owner pops from the back, thieves take from the front
+typedef struct {
+    pthread_mutex_t lock;
+    WorkItem* items; // Ring buffer
+    uint32_t start, count, capacity;
+} WorkQueue;
+
+// Pool for coarse tasks of uneven length. Tasks are spread over the worker queues and idle workers
+// steal from the others, so that nobody waits on a shared queue.
+typedef struct {
+    pthread_t* threads;
+    WorkQueue* queues;
+    int queueCount;
+    int threadCount;
+    uint32_t next; // Queue receiving the next task
+    uint64_t pending; // Submitted and not finished
+    _Atomic uint64_t queued; // Waiting in a queue
+    _Atomic uint64_t steals;
+    bool stop;
+    pthread_mutex_t lock;
+    pthread_cond_t available;
+    pthread_cond_t idle;
+} WorkPool;
+
+bool initWorkPool(WorkPool* pool, int threadCount);
+// Runs the remaining tasks first
+void freeWorkPool(WorkPool* pool);
+
+bool workpool_submit(WorkPool* pool, TaskFunction function, void* arg);
+void workpool_wait(WorkPool* pool);
+
+#endif //LMIPS_WORKPOOL
@@ -0,0 +1,62 @@
+#include "CuTest.h"
+#include "allocator.h"
+
+void testAllocateSmallBlocks(CuTest* test) {
+    GuestHeap* heap = newGuestHeap();
+    uint32_t brk = HEAP_ADDRESS + 8;
+
+    uint32_t first = heap_alloc(heap, &brk, MAP_ADDRESS, 24);
+    uint32_t second = heap_alloc(heap, &brk, MAP_ADDRESS, 30);
+    CuAssertIntEquals(test, HEAP_ADDRESS + MEMORY_PAGE_SIZE, first);
+    CuAssertIntEquals(test, first + 32, second);
+    CuAssertIntEquals(test, HEAP_ADDRESS + 2 * MEMORY_PAGE_SIZE, brk);
+    CuAssertIntEquals(test, 32, heap_block_size(heap, first));
+
+    // Other classes get their own page
+    uint32_t other = heap_alloc(heap, &brk, MAP_ADDRESS, 100);
+    CuAssertIntEquals(test, HEAP_ADDRESS + 2 * MEMORY_PAGE_SIZE, other);
+
+    CuAssertTrue(test, heap_free(heap, first));
+    CuAssertTrue(test, !heap_free(heap, first));
+    CuAssertTrue(test, !heap_free(heap, second + 4));
+    CuAssertIntEquals(test, first, heap_alloc(heap, &brk, MAP_ADDRESS, 17));
+
+    CuAssertIntEquals(test, 4, heap->stats.allocations);
+    CuAssertIntEquals(test, 1, heap->stats.frees);
+    CuAssertIntEquals(test, 32 + 32 + 128, heap->stats.used);
+    CuAssertIntEquals(test, 2 * MEMORY_PAGE_SIZE, heap->stats.reserved);
+
+    freeGuestHeap(heap);
+}
+
+void testAllocateRuns(CuTest* test) {
+    GuestHeap* heap = newGuestHeap();
+    uint32_t brk = HEAP_ADDRESS;
+
+    uint32_t a = heap_alloc(heap, &brk, MAP_ADDRESS, 5000);
+    uint32_t b = heap_alloc(heap, &brk, MAP_ADDRESS, 4096);
+    uint32_t c = heap_alloc(heap, &brk, MAP_ADDRESS, 3 * 4096);
+    CuAssertIntEquals(test, HEAP_ADDRESS, a);
+    CuAssertIntEquals(test, a + 2 * MEMORY_PAGE_SIZE, b);
+    CuAssertIntEquals(test, b + MEMORY_PAGE_SIZE, c);
+
+    // Neighbouring free runs merge, so the 3 pages of a and b fit a 3 pages allocation
+    CuAssertTrue(test, heap_free(heap, a));
+    CuAssertTrue(test, heap_free(heap, b));
+    CuAssertIntEquals(test, a, heap_alloc(heap, &brk, MAP_ADDRESS, 3 * 4096));
+    CuAssertIntEquals(test, c + 3 * MEMORY_PAGE_SIZE, brk);
+
+    // Exhausted heaps return 0
+    CuAssertIntEquals(test, 0, heap_alloc(heap, &brk, MAP_ADDRESS, MAP_ADDRESS));
+
+    freeGuestHeap(heap);
+}
+
+CuSuite* getLMipsAllocatorSuite() {
+    CuSuite* suite = CuSuiteNew();
+
+    SUITE_ADD_TEST(suite, testAllocateSmallBlocks);
+    SUITE_ADD_TEST(suite, testAllocateRuns);
+
+    return suite;
+}
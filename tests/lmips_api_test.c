@@ -0,0 +1,139 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include "CuTest.h"
+#include "lmips_api.h"
+
+// Reads a number, prints it and stores it at the start of the data segment
+static const uint32_t program[] = {
+    0x20020005, // addi $v0, $zero, 5
+    0x0000000C, // syscall
+    0x00402020, // add $a0, $v0, $zero
+    0x20020001, // addi $v0, $zero, 1
+    0x0000000C, // syscall
+    0x3C080008, // lui $t0, 0x8 (DATA_ADDRESS)
+    0xA9040000, // sw $a0, ($t0)
+    0x2002000A, // addi $v0, $zero, 10
+    0x0000000C, // syscall
+};
+
+#define TEXT_SIZE sizeof(program)
+#define EXECUTABLE_SIZE (15 + TEXT_SIZE + 11)
+
+static void putWord(uint8_t* bytes, uint32_t word) {
+    bytes[0] = word >> 24;
+    bytes[1] = word >> 16;
+    bytes[2] = word >> 8;
+    bytes[3] = word;
+}
+
+static void buildExecutable(uint8_t* bytes) {
+    memset(bytes, 0, EXECUTABLE_SIZE);
+    memcpy(bytes, "\x10LEF\x01\x00", 6);
+    putWord(&bytes[6], 15);
+    putWord(&bytes[10], 15 + TEXT_SIZE);
+    bytes[14] = 1;
+
+    for (size_t i = 0; i < TEXT_SIZE / 4; ++i) {
+        putWord(&bytes[15 + i * 4], program[i]);
+    }
+
+    uint8_t* section = &bytes[15 + TEXT_SIZE];
+    section[2] = 0x01; // SHT_EXEC
+    putWord(&section[3], 15);
+    putWord(&section[7], TEXT_SIZE);
+}
+
+void testApiRunWithBudget(CuTest* test) {
+    uint8_t executable[EXECUTABLE_SIZE];
+    buildExecutable(executable);
+
+    LMipsVM* vm = lmips_create();
+    CuAssertPtrNotNull(test, vm);
+    CuAssertIntEquals(test, LMIPS_FAULT, lmips_run(vm, UINT64_MAX));
+    CuAssertIntEquals(test, LMIPS_ERR_FORMAT, lmips_load_buffer(vm, executable, 10));
+    CuAssertIntEquals(test, LMIPS_LOADED, lmips_load_buffer(vm, executable, sizeof(executable)));
+    CuAssertIntEquals(test, LMIPS_ERR_STATE, lmips_load_buffer(vm, executable, sizeof(executable)));
+
+    CuAssertTrue(test, lmips_feed_input(vm, "123\n", 4));
+    lmips_capture_output(vm);
+
+    CuAssertIntEquals(test, LMIPS_BUDGET, lmips_run(vm, 3));
+    CuAssertIntEquals(test, 3, lmips_instruction_count(vm));
+    CuAssertIntEquals(test, 0x2000 + 12, lmips_get_register(vm, LMIPS_REG_PC));
+    CuAssertIntEquals(test, 123, lmips_get_register(vm, 4));
+
+    // The program goes on from where the host left it
+    lmips_set_register(vm, 0, 1);
+    lmips_set_register(vm, LMIPS_REG_PC, 0x2000 + 8);
+    CuAssertIntEquals(test, LMIPS_EXITED, lmips_run(vm, UINT64_MAX));
+    CuAssertIntEquals(test, 0, lmips_get_register(vm, 0));
+
+    size_t size;
+    const char* output = lmips_output(vm, &size);
+    CuAssertIntEquals(test, 3, size);
+    CuAssertTrue(test, memcmp(output, "123", 3) == 0);
+
+    uint8_t word[4];
+    CuAssertTrue(test, lmips_read_memory(vm, 0x80000, word, 4));
+    CuAssertIntEquals(test, 123, word[3]);
+    CuAssertTrue(test, lmips_write_memory(vm, 0x80000, "\xFF", 1));
+    CuAssertTrue(test, lmips_read_memory(vm, 0x80000, word, 1));
+    CuAssertIntEquals(test, 0xFF, word[0]);
+    CuAssertTrue(test, !lmips_read_memory(vm, 0x3FFFFE, word, 4));
+
+    lmips_destroy(vm);
+}
+
+typedef struct {
+    const uint8_t* executable;
+    char input[16];
+    char output[16];
+    LMipsRunStatus status;
+} Job;
+
+static void* runJob(void* arg) {
+    Job* job = arg;
+    LMipsVM* vm = lmips_create();
+    lmips_load_buffer(vm, job->executable, EXECUTABLE_SIZE);
+    lmips_feed_input(vm, job->input, strlen(job->input));
+    lmips_capture_output(vm);
+    job->status = lmips_run(vm, UINT64_MAX);
+
+    size_t size;
+    const char* output = lmips_output(vm, &size);
+    memcpy(job->output, output, size < sizeof(job->output) - 1 ? size : sizeof(job->output) - 1);
+    lmips_destroy(vm);
+    return NULL;
+}
+
+void testApiParallelVMs(CuTest* test) {
+    uint8_t executable[EXECUTABLE_SIZE];
+    buildExecutable(executable);
+
+    Job jobs[8] = {};
+    pthread_t threads[8];
+    for (int i = 0; i < 8; ++i) {
+        jobs[i].executable = executable;
+        snprintf(jobs[i].input, sizeof(jobs[i].input), "%d\n", i * 1000 + 7);
+        pthread_create(&threads[i], NULL, runJob, &jobs[i]);
+    }
+
+    for (int i = 0; i < 8; ++i) {
+        pthread_join(threads[i], NULL);
+
+        char expected[16];
+        snprintf(expected, sizeof(expected), "%d", i * 1000 + 7);
+        CuAssertIntEquals(test, LMIPS_EXITED, jobs[i].status);
+        CuAssertStrEquals(test, expected, jobs[i].output);
+    }
+}
+
+CuSuite* getLMipsApiSuite() {
+    CuSuite* suite = CuSuiteNew();
+
+    SUITE_ADD_TEST(suite, testApiRunWithBudget);
+    SUITE_ADD_TEST(suite, testApiParallelVMs);
+
+    return suite;
+}
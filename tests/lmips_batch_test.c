@@ -0,0 +1,144 @@
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "CuTest.h"
+#include "batch.h"
+#include "workpool.h"
+
+// Reads a number and prints it back
+static const uint8_t program[] = {
+    0x20, 0x02, 0x00, 0x05, // addi $v0, $zero, 5
+    0x00, 0x00, 0x00, 0x0C, // syscall
+    0x00, 0x40, 0x20, 0x20, // add $a0, $v0, $zero
+    0x20, 0x02, 0x00, 0x01, // addi $v0, $zero, 1
+    0x00, 0x00, 0x00, 0x0C, // syscall
+    0x20, 0x02, 0x00, 0x0A, // addi $v0, $zero, 10
+    0x00, 0x00, 0x00, 0x0C, // syscall
+};
+
+static void writeFile(char* path, const void* bytes, size_t size) {
+    int fd = mkstemp(path);
+    write(fd, bytes, size);
+    close(fd);
+}
+
+static void writeExecutable(char* path) {
+    uint8_t file[15 + sizeof(program) + 11] = {0x10, 'L', 'E', 'F', 1, 0, 0, 0, 0, 15, 0, 0, 0, 15 + sizeof(program), 1};
+    memcpy(&file[15], program, sizeof(program));
+
+    uint8_t* section = &file[15 + sizeof(program)];
+    section[2] = 0x01; // SHT_EXEC
+    section[6] = 15;
+    section[10] = sizeof(program);
+    writeFile(path, file, sizeof(file));
+}
+
+static void countTask(void* arg) {
+    atomic_fetch_add((_Atomic int*)arg, 1);
+}
+
+void testWorkPoolRunsEveryTask(CuTest* test) {
+    WorkPool pool;
+    CuAssertTrue(test, initWorkPool(&pool, 4));
+
+    _Atomic int count = 0;
+    for (int i = 0; i < 1000; ++i) {
+        CuAssertTrue(test, workpool_submit(&pool, countTask, &count));
+    }
+    workpool_wait(&pool);
+    CuAssertIntEquals(test, 1000, atomic_load(&count));
+
+    // Whatever is left runs before the pool goes away
+    for (int i = 0; i < 100; ++i) {
+        workpool_submit(&pool, countTask, &count);
+    }
+    freeWorkPool(&pool);
+    CuAssertIntEquals(test, 1100, atomic_load(&count));
+}
+
+void testBatchRun(CuTest* test) {
+    char binary[] = "/tmp/lmips_batch_XXXXXX";
+    char first[] = "/tmp/lmips_batch_XXXXXX";
+    char second[] = "/tmp/lmips_batch_XXXXXX";
+    char invalid[] = "/tmp/lmips_batch_XXXXXX";
+    char jobs[] = "/tmp/lmips_batch_XXXXXX";
+    writeExecutable(binary);
+    writeFile(first, "12\n", 3);
+    writeFile(second, "-345\n", 5);
+    writeFile(invalid, "ELF", 3);
+
+    char lines[512];
+    int length = snprintf(lines, sizeof(lines), "# binary input\n%s %s\n\n%s %s\n%s /nonexistent\n%s\n",
+                          binary, first, binary, second, binary, invalid);
+    writeFile(jobs, lines, length);
+
+    Batch batch;
+    initBatch(&batch);
+    CuAssertTrue(test, batch_read_jobs(&batch, jobs));
+    CuAssertIntEquals(test, 4, batch.count);
+    CuAssertTrue(test, batch_run(&batch, 3));
+
+    CuAssertIntEquals(test, BATCH_EXITED, batch.jobs[0].status);
+    CuAssertIntEquals(test, 7, batch.jobs[0].icount);
+    CuAssertIntEquals(test, 2, batch.jobs[0].outputSize);
+    CuAssertTrue(test, memcmp(batch.jobs[0].output, "12", 2) == 0);
+    CuAssertIntEquals(test, BATCH_EXITED, batch.jobs[1].status);
+    CuAssertTrue(test, memcmp(batch.jobs[1].output, "-345", 4) == 0);
+    CuAssertIntEquals(test, BATCH_ERR_INPUT, batch.jobs[2].status);
+    CuAssertIntEquals(test, BATCH_ERR_LOAD, batch.jobs[3].status);
+
+    // Jobs of the same binary share its image
+    CuAssertPtrEquals(test, batch.jobs[0].image, batch.jobs[1].image);
+
+    char results[1024] = {};
+    FILE* file = fmemopen(results, sizeof(results) - 1, "w");
+    CuAssertTrue(test, batch_write_results(&batch, file));
+    fclose(file);
+
+    char expected[1024];
+    snprintf(expected, sizeof(expected), "0 exited 7 2 %s %s\n12\n1 exited 7 4 %s %s\n-345\n"
+             "2 input-error 0 0 %s /nonexistent\n\n3 load-error 0 0 %s\n\n",
+             binary, first, binary, second, binary, invalid);
+    CuAssertStrEquals(test, expected, results);
+
+    freeBatch(&batch);
+    unlink(binary);
+    unlink(first);
+    unlink(second);
+    unlink(invalid);
+    unlink(jobs);
+}
+
+void testBatchBudget(CuTest* test) {
+    char binary[] = "/tmp/lmips_batch_XXXXXX";
+    char input[] = "/tmp/lmips_batch_XXXXXX";
+    writeExecutable(binary);
+    writeFile(input, "12\n", 3);
+
+    // Stopped before it prints
+    Batch batch;
+    initBatch(&batch);
+    CuAssertIntEquals(test, BATCH_DEFAULT_BUDGET, batch.budget);
+    batch.budget = 4;
+    CuAssertTrue(test, batch_add(&batch, binary, input));
+    CuAssertTrue(test, batch_run(&batch, 1));
+    CuAssertIntEquals(test, BATCH_BUDGET, batch.jobs[0].status);
+    CuAssertIntEquals(test, 4, batch.jobs[0].icount);
+    CuAssertIntEquals(test, 0, batch.jobs[0].outputSize);
+
+    freeBatch(&batch);
+    unlink(binary);
+    unlink(input);
+}
+
+CuSuite* getLMipsBatchSuite() {
+    CuSuite* suite = CuSuiteNew();
+
+    SUITE_ADD_TEST(suite, testWorkPoolRunsEveryTask);
+    SUITE_ADD_TEST(suite, testBatchRun);
+    SUITE_ADD_TEST(suite, testBatchBudget);
+
+    return suite;
+}
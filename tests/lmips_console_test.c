@@ -0,0 +1,157 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "CuTest.h"
+#include "console.h"
+
+void testConsoleFormatsIntegers(CuTest* test) {
+    int pipes[2];
+    pipe(pipes);
+
+    Console console;
+    initConsole(&console, pipes[1], CONSOLE_FULLY_BUFFERED);
+    console_write_int(&console, 0);
+    console_write(&console, " ", 1);
+    console_write_int(&console, -42);
+    console_write(&console, " ", 1);
+    console_write_int(&console, INT32_MAX);
+    console_write(&console, " ", 1);
+    console_write_int(&console, INT32_MIN);
+    console_flush(&console);
+
+    char output[64] = {};
+    read(pipes[0], output, sizeof(output) - 1);
+    CuAssertStrEquals(test, "0 -42 2147483647 -2147483648", output);
+
+    close(pipes[0]);
+    close(pipes[1]);
+}
+
+void testConsoleBuffering(CuTest* test) {
+    int pipes[2];
+    pipe(pipes);
+
+    Console console;
+    initConsole(&console, pipes[1], CONSOLE_LINE_BUFFERED);
+    console_write(&console, "prompt", 6);
+    CuAssertIntEquals(test, 6, console.length);
+    console_write(&console, "\n", 1);
+    CuAssertIntEquals(test, 0, console.length);
+
+    console.mode = CONSOLE_FULLY_BUFFERED;
+    console_write(&console, "line\n", 5);
+    CuAssertIntEquals(test, 5, console.length);
+
+    // Writes larger than the buffer go through in several flushes
+    char large[CONSOLE_BUFFER_SIZE + 10];
+    memset(large, 'x', sizeof(large));
+    console_write(&console, large, sizeof(large));
+    CuAssertIntEquals(test, 15, console.length);
+    console_flush(&console);
+
+    char output[CONSOLE_BUFFER_SIZE * 2];
+    size_t total = 0;
+    ssize_t count;
+    close(pipes[1]);
+    while ((count = read(pipes[0], output + total, sizeof(output) - total)) > 0) total += count;
+    CuAssertIntEquals(test, 7 + 5 + sizeof(large), total);
+    CuAssertTrue(test, memcmp(output, "prompt\nline\nx", 13) == 0);
+
+    close(pipes[0]);
+}
+
+void testConsoleAsyncWriter(CuTest* test) {
+    int pipes[2];
+    pipe(pipes);
+
+    Console console;
+    initConsole(&console, pipes[1], CONSOLE_ASYNC);
+    CuAssertIntEquals(test, CONSOLE_ASYNC, console.mode);
+
+    console_write(&console, "first ", 6);
+    console_write_int(&console, -7);
+    console_write(&console, "\n", 1);
+
+    // A flush only returns once the writer thread is done
+    console_flush(&console);
+    char output[64] = {};
+    read(pipes[0], output, sizeof(output) - 1);
+    CuAssertStrEquals(test, "first -7\n", output);
+
+    ConsoleStats stats;
+    CuAssertTrue(test, console_stats(&console, &stats));
+    CuAssertTrue(test, stats.highWater >= 1 && stats.highWater <= 9);
+    CuAssertIntEquals(test, CONSOLE_RING_SIZE, stats.capacity);
+
+    console_write(&console, "last", 4);
+    freeConsole(&console);
+    CuAssertPtrEquals(test, NULL, console.writer);
+
+    memset(output, 0, sizeof(output));
+    read(pipes[0], output, sizeof(output) - 1);
+    CuAssertStrEquals(test, "last", output);
+
+    close(pipes[0]);
+    close(pipes[1]);
+}
+
+typedef struct {
+    int fd;
+    size_t total;
+    bool ordered;
+} Drain;
+
+static void* drainThread(void* arg) {
+    Drain* drain = arg;
+    // Late enough for the writer to fill the pipe
+    nanosleep(&(struct timespec){.tv_nsec = 20 * 1000 * 1000}, NULL);
+
+    char bytes[4096];
+    ssize_t count;
+    drain->ordered = true;
+    while ((count = read(drain->fd, bytes, sizeof(bytes))) > 0) {
+        for (ssize_t i = 0; i < count; ++i) {
+            drain->ordered &= bytes[i] == (char)('a' + (drain->total + i) % 26);
+        }
+        drain->total += count;
+    }
+    return NULL;
+}
+
+void testConsoleAsyncWriterNonBlocking(CuTest* test) {
+    int pipes[2];
+    pipe(pipes);
+    fcntl(pipes[1], F_SETFL, O_NONBLOCK);
+
+    Console console;
+    initConsole(&console, pipes[1], CONSOLE_ASYNC);
+    Drain drain = {.fd = pipes[0]};
+    pthread_t thread;
+    pthread_create(&thread, NULL, drainThread, &drain);
+
+    // Far more than a pipe holds, the writer gets EAGAIN until the reader catches up
+    char line[26];
+    for (int i = 0; i < 26; ++i) line[i] = (char)('a' + i);
+    for (int i = 0; i < 10000; ++i) console_write(&console, line, sizeof(line));
+
+    freeConsole(&console);
+    close(pipes[1]);
+    pthread_join(thread, NULL);
+    CuAssertIntEquals(test, 26 * 10000, drain.total);
+    CuAssertTrue(test, drain.ordered);
+
+    close(pipes[0]);
+}
+
+CuSuite* getLMipsConsoleSuite() {
+    CuSuite* suite = CuSuiteNew();
+
+    SUITE_ADD_TEST(suite, testConsoleFormatsIntegers);
+    SUITE_ADD_TEST(suite, testConsoleBuffering);
+    SUITE_ADD_TEST(suite, testConsoleAsyncWriter);
+    SUITE_ADD_TEST(suite, testConsoleAsyncWriterNonBlocking);
+
+    return suite;
+}
@@ -0,0 +1,224 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "CuTest.h"
+#include "fuzzer.h"
+#include "lmips_test_words.h"
+
+// Faults on lines starting with "OK". Every run counts itself at DATA_ADDRESS + 64 and runs an unknown
+// instruction unless it is the first one.
+static const uint32_t parser[] = {
+    /*  0 */ I(OP_LUI, 0, $a0, DATA_ADDRESS >> 16),
+    /*  1 */ I(OP_ADDI, $zero, $a1, 16),
+    /*  2 */ I(OP_ADDI, $zero, $v0, SYS_READ_STRING),
+    /*  3 */ SYSCALL,
+    /*  4 */ I(OP_LW, $a0, $t2, 64),
+    /*  5 */ I(OP_ADDI, $t2, $t2, 1),
+    /*  6 */ I(OP_SW, $a0, $t2, 64),
+    /*  7 */ I(OP_ADDI, $zero, $t3, 1),
+    /*  8 */ I(OP_BNE, $t2, $t3, 18 - 8),
+    /*  9 */ I(OP_LBU, $a0, $t0, 0),
+    /* 10 */ I(OP_ADDI, $zero, $t1, 'O'),
+    /* 11 */ I(OP_BNE, $t0, $t1, 16 - 11),
+    /* 12 */ I(OP_LBU, $a0, $t0, 1),
+    /* 13 */ I(OP_ADDI, $zero, $t1, 'K'),
+    /* 14 */ I(OP_BNE, $t0, $t1, 16 - 14),
+    /* 15 */ I(OP_SW, $zero, $zero, 0),
+    /* 16 */ I(OP_ADDI, $zero, $v0, SYS_EXIT),
+    /* 17 */ SYSCALL,
+    /* 18 */ 0xFC000000
+};
+
+void testFuzzerFindsCrash(CuTest* test) {
+    Memory memory;
+    LMips mips;
+    loadWords(&memory, &mips, parser, sizeof(parser) / 4);
+
+    Fuzzer fuzzer;
+    CuAssertTrue(test, initFuzzer(&fuzzer, &mips));
+    CuAssertIntEquals(test, 3 * 4, mips.ip);
+    CuAssertIntEquals(test, 3, mips.icount);
+
+    CuAssertTrue(test, fuzzer_add_seed(&fuzzer, "A\n", 2));
+    CuAssertTrue(test, fuzzer_run(&fuzzer, 1, 200000));
+
+    FuzzStats stats;
+    fuzzer_stats(&fuzzer, &stats);
+    CuAssertTrue(test, stats.executions >= 200000);
+    CuAssertTrue(test, stats.crashes > 0);
+    CuAssertIntEquals(test, 0, stats.hangs);
+    CuAssertTrue(test, stats.corpus >= 2);
+    CuAssertTrue(test, stats.edges >= 4);
+
+    // Every run started from the snapshot, none of them saw another run's count
+    for (size_t i = 0; i < fuzzer.crashCount; ++i) {
+        FuzzInput* crash = &fuzzer.crashes[i];
+        CuAssertIntEquals(test, EXEC_ERR_MEMORY_ADDR, crash->result);
+        CuAssertTrue(test, crash->size >= 2 && memcmp(crash->bytes, "OK", 2) == 0);
+    }
+    CuAssertIntEquals(test, 0, mem_read(&memory, DATA_ADDRESS + 64));
+
+    freeFuzzer(&fuzzer);
+    freeSimulator(&mips);
+    freeMemory(&memory);
+}
+
+void testFuzzerNeedsARead(CuTest* test) {
+    static const uint32_t exiter[] = {I(OP_ADDI, $zero, $v0, SYS_EXIT), SYSCALL};
+    Memory memory;
+    LMips mips;
+    loadWords(&memory, &mips, exiter, sizeof(exiter) / 4);
+
+    Fuzzer fuzzer;
+    CuAssertTrue(test, !initFuzzer(&fuzzer, &mips));
+
+    freeFuzzer(&fuzzer);
+    freeSimulator(&mips);
+    freeMemory(&memory);
+}
+
+#define SYS_MAP_TABLE 40
+#define TABLE_ADDRESS (MAP_ADDRESS - MEMORY_PAGE_SIZE)
+
+static int tableFd = -1;
+
+// Maps the table read-only the way SYS_MMAP does, without a guest file
+static ExecutionResult sys_map_table(LMips* mips) {
+    if (!mem_map_file(mips->memory, TABLE_ADDRESS, 4, tableFd, 0)) return EXEC_FAILURE;
+
+    mips->memory->readOnlyStart = TABLE_ADDRESS;
+    mips->memory->readOnlyEnd = MAP_ADDRESS;
+    return EXEC_SUCCESS;
+}
+
+// Every run checks the table page is still the plain one of the snapshot, maps the table over it and makes sure a
+// hart can't be spawned, faulting otherwise
+static const uint32_t mapper[] = {
+    /*  0 */ I(OP_LUI, 0, $a0, DATA_ADDRESS >> 16),
+    /*  1 */ I(OP_ADDI, $zero, $a1, 16),
+    /*  2 */ I(OP_ADDI, $zero, $v0, SYS_READ_STRING),
+    /*  3 */ SYSCALL,
+    /*  4 */ I(OP_LUI, 0, $t1, TABLE_ADDRESS >> 16),
+    /*  5 */ I(OP_ORI, $t1, $t1, TABLE_ADDRESS),
+    /*  6 */ I(OP_LW, $t1, $t0, 0),
+    /*  7 */ I(OP_BNE, $t0, $zero, 23 - 7),
+    /*  8 */ I(OP_SW, $t1, $zero, 0),
+    /*  9 */ I(OP_ADDI, $zero, $v0, SYS_MAP_TABLE),
+    /* 10 */ SYSCALL,
+    /* 11 */ I(OP_LW, $t1, $t0, 0),
+    /* 12 */ I(OP_BEQ, $t0, $zero, 23 - 12),
+    /* 13 */ I(OP_ADDI, $zero, $a0, 21 * 4),
+    /* 14 */ I(OP_ADDI, $sp, $a1, -4096),
+    /* 15 */ I(OP_ADDI, $zero, $v0, SYS_HART_SPAWN),
+    /* 16 */ SYSCALL,
+    /* 17 */ I(OP_ADDI, $zero, $t2, -1),
+    /* 18 */ I(OP_BNE, $v0, $t2, 23 - 18),
+    /* 19 */ I(OP_ADDI, $zero, $v0, SYS_EXIT),
+    /* 20 */ SYSCALL,
+    /* 21 */ I(OP_ADDI, $zero, $v0, SYS_EXIT),
+    /* 22 */ SYSCALL,
+    /* 23 */ I(OP_SW, $zero, $zero, 0)
+};
+
+void testFuzzerRestoresMappings(CuTest* test) {
+    char path[] = "/tmp/lmips_table_XXXXXX";
+    tableFd = mkstemp(path);
+    write(tableFd, "\x12\x34\x56\x78", 4);
+
+    Memory memory;
+    LMips mips;
+    loadWords(&memory, &mips, mapper, sizeof(mapper) / 4);
+    CuAssertTrue(test, lmips_register_syscall(&mips, SYS_MAP_TABLE, sys_map_table));
+
+    Fuzzer fuzzer;
+    CuAssertTrue(test, initFuzzer(&fuzzer, &mips));
+    CuAssertTrue(test, fuzzer_add_seed(&fuzzer, "A\n", 2));
+    CuAssertTrue(test, fuzzer_run(&fuzzer, 1, 1000));
+
+    FuzzStats stats;
+    fuzzer_stats(&fuzzer, &stats);
+    CuAssertTrue(test, stats.executions >= 1000);
+    CuAssertIntEquals(test, 0, stats.crashes);
+    CuAssertIntEquals(test, 0, stats.hangs);
+
+    freeFuzzer(&fuzzer);
+    freeSimulator(&mips);
+    freeMemory(&memory);
+    close(tableFd);
+    unlink(path);
+}
+
+// Opens data.txt before its first read, then every run reads "abcd" from it or faults
+static const uint32_t opener[] = {
+    /*  0 */ I(OP_LUI, 0, $a0, DATA_ADDRESS >> 16),
+    /*  1 */ I(OP_ORI, $a0, $a0, 128),
+    /*  2 */ I(OP_ADDI, $zero, $a1, 0),
+    /*  3 */ I(OP_ADDI, $zero, $v0, SYS_OPEN),
+    /*  4 */ SYSCALL,
+    /*  5 */ R($v0, $zero, $s0, 0, SPE_ADD),
+    /*  6 */ I(OP_LUI, 0, $a0, DATA_ADDRESS >> 16),
+    /*  7 */ I(OP_ADDI, $zero, $a1, 16),
+    /*  8 */ I(OP_ADDI, $zero, $v0, SYS_READ_STRING),
+    /*  9 */ SYSCALL,
+    /* 10 */ R($s0, $zero, $a0, 0, SPE_ADD),
+    /* 11 */ I(OP_LUI, 0, $a1, DATA_ADDRESS >> 16),
+    /* 12 */ I(OP_ORI, $a1, $a1, 64),
+    /* 13 */ I(OP_ADDI, $zero, $a2, 4),
+    /* 14 */ I(OP_ADDI, $zero, $v0, SYS_READ),
+    /* 15 */ SYSCALL,
+    /* 16 */ I(OP_ADDI, $zero, $t0, 4),
+    /* 17 */ I(OP_BNE, $v0, $t0, 24 - 17),
+    /* 18 */ I(OP_LW, $a1, $t1, 0),
+    /* 19 */ I(OP_LUI, 0, $t2, 0x6162),
+    /* 20 */ I(OP_ORI, $t2, $t2, 0x6364),
+    /* 21 */ I(OP_BNE, $t1, $t2, 24 - 21),
+    /* 22 */ I(OP_ADDI, $zero, $v0, SYS_EXIT),
+    /* 23 */ SYSCALL,
+    /* 24 */ I(OP_SW, $zero, $zero, 0)
+};
+
+void testFuzzerRestoresFiles(CuTest* test) {
+    char directory[] = "/tmp/lmips_sandbox_XXXXXX";
+    mkdtemp(directory);
+    char path[64];
+    snprintf(path, sizeof(path), "%s/data.txt", directory);
+    FILE* file = fopen(path, "w");
+    fputs("abcdefgh", file);
+    fclose(file);
+
+    Memory memory;
+    LMips mips;
+    loadWords(&memory, &mips, opener, sizeof(opener) / 4);
+    memcpy(&memory.store[DATA_ADDRESS + 128], "data.txt", 9);
+    files_set_root(&mips.files, directory);
+
+    // Every run reads the file from where the snapshot left it, in its own copy of the target's sandbox
+    Fuzzer fuzzer;
+    CuAssertTrue(test, initFuzzer(&fuzzer, &mips));
+    CuAssertTrue(test, fuzzer_add_seed(&fuzzer, "A\n", 2));
+    CuAssertTrue(test, fuzzer_run(&fuzzer, 2, 1000));
+
+    FuzzStats stats;
+    fuzzer_stats(&fuzzer, &stats);
+    CuAssertTrue(test, stats.executions >= 1000);
+    CuAssertIntEquals(test, 0, stats.crashes);
+    CuAssertIntEquals(test, 0, lseek(files_host_fd(&mips.files, mips.regs[$s0]), 0, SEEK_CUR));
+
+    freeFuzzer(&fuzzer);
+    freeSimulator(&mips);
+    freeMemory(&memory);
+    unlink(path);
+    rmdir(directory);
+}
+
+CuSuite* getLMipsFuzzerSuite() {
+    CuSuite* suite = CuSuiteNew();
+
+    SUITE_ADD_TEST(suite, testFuzzerFindsCrash);
+    SUITE_ADD_TEST(suite, testFuzzerNeedsARead);
+    SUITE_ADD_TEST(suite, testFuzzerRestoresMappings);
+    SUITE_ADD_TEST(suite, testFuzzerRestoresFiles);
+
+    return suite;
+}
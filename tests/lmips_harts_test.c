@@ -0,0 +1,362 @@
+#include "CuTest.h"
+#include "lmips.h"
+#include "syscalls.h"
+#include "lmips_test_words.h"
+
+// Spawns harts 1 to 3, each storing 100 + its ID at DATA_ADDRESS + 4 * ID, then joins them
+static const uint32_t spawner[] = {
+    /*  0 */ I(OP_ADDI, $zero, $v0, SYS_HART_ID),
+    /*  1 */ SYSCALL,
+    /*  2 */ I(OP_LUI, 0, $t1, DATA_ADDRESS >> 16),
+    /*  3 */ I(OP_ADDI, $v0, $t2, 7),
+    /*  4 */ I(OP_SW, $t1, $t2, 0),
+    /*  5 */ I(OP_ADDI, $zero, $s0, 1),
+    /*  6 */ I(OP_ADDI, $zero, $s1, 4),
+    /*  7 */ I(OP_ADDI, $zero, $a0, 25 * 4),
+    /*  8 */ R(0, $s0, $t0, 12, SPE_SLL), // A 4KB stack per hart
+    /*  9 */ R($sp, $t0, $a1, 0, SPE_SUB),
+    /* 10 */ I(OP_ADDI, $zero, $a2, 100),
+    /* 11 */ I(OP_ADDI, $zero, $v0, SYS_HART_SPAWN),
+    /* 12 */ SYSCALL,
+    /* 13 */ I(OP_ADDI, $s0, $s0, 1),
+    /* 14 */ I(OP_BNE, $s0, $s1, 7 - 14),
+    /* 15 */ I(OP_ADDI, $zero, $s0, 1),
+    /* 16 */ I(OP_ADDI, $zero, $s2, 0),
+    /* 17 */ R($s0, $zero, $a0, 0, SPE_ADD),
+    /* 18 */ I(OP_ADDI, $zero, $v0, SYS_HART_JOIN),
+    /* 19 */ SYSCALL,
+    /* 20 */ R($s2, $v0, $s2, 0, SPE_ADD),
+    /* 21 */ I(OP_ADDI, $s0, $s0, 1),
+    /* 22 */ I(OP_BNE, $s0, $s1, 17 - 22),
+    /* 23 */ I(OP_ADDI, $zero, $v0, SYS_EXIT),
+    /* 24 */ SYSCALL,
+    /* 25 */ I(OP_ADDI, $zero, $v0, SYS_HART_ID),
+    /* 26 */ SYSCALL,
+    /* 27 */ R(0, $v0, $t0, 2, SPE_SLL),
+    /* 28 */ I(OP_LUI, 0, $t1, DATA_ADDRESS >> 16),
+    /* 29 */ R($t1, $t0, $t1, 0, SPE_ADD),
+    /* 30 */ R($a0, $v0, $t2, 0, SPE_ADD),
+    /* 31 */ I(OP_SW, $t1, $t2, 0),
+    /* 32 */ I(OP_ADDI, $zero, $v0, SYS_EXIT),
+    /* 33 */ SYSCALL
+};
+
+void testSpawnAndJoinHarts(CuTest* test) {
+    Memory memory;
+    LMips mips;
+    loadWords(&memory, &mips, spawner, sizeof(spawner) / 4);
+
+    CuAssertIntEquals(test, EXEC_SUCCESS, runSimulator(&mips));
+    CuAssertIntEquals(test, 7, mem_read(&memory, DATA_ADDRESS));
+    for (int id = 1; id <= 3; ++id) {
+        CuAssertIntEquals(test, 100 + id, mem_read(&memory, DATA_ADDRESS + id * 4));
+    }
+    // Every hart exited normally, and each was joined once
+    CuAssertIntEquals(test, 0, mips.regs[$s2]);
+
+    freeSimulator(&mips);
+    freeMemory(&memory);
+}
+
+// Same as the README example : the entry is loaded by la, which the assembler expands to lui and ori of the text offset
+static const uint32_t labelled[] = {
+    /*  0 */ I(OP_LUI, 0, $at, (11 * 4) >> 16),
+    /*  1 */ I(OP_ORI, $at, $a0, 11 * 4),
+    /*  2 */ I(OP_ADDI, $sp, $a1, -4096),
+    /*  3 */ I(OP_ADDI, $zero, $a2, 42),
+    /*  4 */ I(OP_ADDI, $zero, $v0, SYS_HART_SPAWN),
+    /*  5 */ SYSCALL,
+    /*  6 */ R($v0, $zero, $a0, 0, SPE_ADD),
+    /*  7 */ I(OP_ADDI, $zero, $v0, SYS_HART_JOIN),
+    /*  8 */ SYSCALL,
+    /*  9 */ I(OP_ADDI, $zero, $v0, SYS_EXIT),
+    /* 10 */ SYSCALL,
+    /* 11 */ I(OP_LUI, 0, $t1, DATA_ADDRESS >> 16),
+    /* 12 */ I(OP_SW, $t1, $a0, 0),
+    /* 13 */ I(OP_ADDI, $zero, $v0, SYS_EXIT),
+    /* 14 */ SYSCALL
+};
+
+void testSpawnAtLoadedLabel(CuTest* test) {
+    Memory memory;
+    LMips mips;
+    loadWords(&memory, &mips, labelled, sizeof(labelled) / 4);
+
+    CuAssertIntEquals(test, EXEC_SUCCESS, runSimulator(&mips));
+    CuAssertIntEquals(test, 1, mips.regs[$a0]);
+    CuAssertIntEquals(test, 42, mem_read(&memory, DATA_ADDRESS));
+
+    freeSimulator(&mips);
+    freeMemory(&memory);
+}
+
+// Hart 1 flips a word between 0 and -1 while hart 0 counts the other values it reads in $s3
+static const uint32_t flipper[] = {
+    /*  0 */ I(OP_ADDI, $zero, $a0, 20 * 4),
+    /*  1 */ I(OP_ADDI, $sp, $a1, -4096),
+    /*  2 */ I(OP_ADDI, $zero, $v0, SYS_HART_SPAWN),
+    /*  3 */ SYSCALL,
+    /*  4 */ R($v0, $zero, $s0, 0, SPE_ADD),
+    /*  5 */ I(OP_LUI, 0, $t1, DATA_ADDRESS >> 16),
+    /*  6 */ I(OP_LUI, 0, $t3, 1),
+    /*  7 */ I(OP_ADDI, $zero, $s3, 0),
+    /*  8 */ I(OP_LW, $t1, $t0, 0),
+    /*  9 */ I(OP_BEQ, $t0, $zero, 13 - 9),
+    /* 10 */ I(OP_ADDI, $t0, $t4, 1),
+    /* 11 */ I(OP_BEQ, $t4, $zero, 13 - 11),
+    /* 12 */ I(OP_ADDI, $s3, $s3, 1),
+    /* 13 */ I(OP_ADDI, $t3, $t3, -1),
+    /* 14 */ I(OP_BNE, $t3, $zero, 8 - 14),
+    /* 15 */ R($s0, $zero, $a0, 0, SPE_ADD),
+    /* 16 */ I(OP_ADDI, $zero, $v0, SYS_HART_JOIN),
+    /* 17 */ SYSCALL,
+    /* 18 */ I(OP_ADDI, $zero, $v0, SYS_EXIT),
+    /* 19 */ SYSCALL,
+    /* 20 */ I(OP_LUI, 0, $t1, DATA_ADDRESS >> 16),
+    /* 21 */ I(OP_LUI, 0, $t3, 1),
+    /* 22 */ I(OP_ADDI, $zero, $t0, -1),
+    /* 23 */ I(OP_SW, $t1, $t0, 0),
+    /* 24 */ I(OP_SW, $t1, $zero, 0),
+    /* 25 */ I(OP_ADDI, $t3, $t3, -1),
+    /* 26 */ I(OP_BNE, $t3, $zero, 23 - 26),
+    /* 27 */ I(OP_ADDI, $zero, $v0, SYS_EXIT),
+    /* 28 */ SYSCALL
+};
+
+void testAlignedWordsAreAtomic(CuTest* test) {
+    Memory memory;
+    LMips mips;
+    loadWords(&memory, &mips, flipper, sizeof(flipper) / 4);
+
+    CuAssertIntEquals(test, EXEC_SUCCESS, runSimulator(&mips));
+    CuAssertIntEquals(test, 1, mips.regs[$s0]);
+    CuAssertIntEquals(test, 0, mips.regs[$s3]);
+    CuAssertIntEquals(test, 0, mem_read(&memory, DATA_ADDRESS));
+
+    freeSimulator(&mips);
+    freeMemory(&memory);
+}
+
+// Hart 1 spins forever, hart 0 exits right away and takes it down
+static const uint32_t spinner[] = {
+    I(OP_ADDI, $zero, $a0, 6 * 4),
+    I(OP_ADDI, $sp, $a1, -4096),
+    I(OP_ADDI, $zero, $v0, SYS_HART_SPAWN),
+    SYSCALL,
+    I(OP_ADDI, $zero, $v0, SYS_EXIT),
+    SYSCALL,
+    I(OP_BEQ, $zero, $zero, 0)
+};
+
+void testExitStopsHarts(CuTest* test) {
+    Memory memory;
+    LMips mips;
+    loadWords(&memory, &mips, spinner, sizeof(spinner) / 4);
+
+    CuAssertIntEquals(test, EXEC_SUCCESS, runSimulator(&mips));
+    CuAssertPtrNotNull(test, mips.harts);
+
+    // Waits for hart 1, which stops at its next instruction
+    freeSimulator(&mips);
+    CuAssertPtrEquals(test, NULL, mips.harts);
+    freeMemory(&memory);
+}
+
+// Harts 1 to 3 count to 10000 twice, with amoadd at DATA_ADDRESS and with ll/sc at DATA_ADDRESS + 4
+static const uint32_t counters[] = {
+    /*  0 */ I(OP_ADDI, $zero, $s0, 1),
+    /*  1 */ I(OP_ADDI, $zero, $s1, 4),
+    /*  2 */ I(OP_ADDI, $zero, $a0, 17 * 4),
+    /*  3 */ R(0, $s0, $t0, 12, SPE_SLL),
+    /*  4 */ R($sp, $t0, $a1, 0, SPE_SUB),
+    /*  5 */ I(OP_ADDI, $zero, $v0, SYS_HART_SPAWN),
+    /*  6 */ SYSCALL,
+    /*  7 */ I(OP_ADDI, $s0, $s0, 1),
+    /*  8 */ I(OP_BNE, $s0, $s1, 2 - 8),
+    /*  9 */ I(OP_ADDI, $zero, $s0, 1),
+    /* 10 */ R($s0, $zero, $a0, 0, SPE_ADD),
+    /* 11 */ I(OP_ADDI, $zero, $v0, SYS_HART_JOIN),
+    /* 12 */ SYSCALL,
+    /* 13 */ I(OP_ADDI, $s0, $s0, 1),
+    /* 14 */ I(OP_BNE, $s0, $s1, 10 - 14),
+    /* 15 */ I(OP_ADDI, $zero, $v0, SYS_EXIT),
+    /* 16 */ SYSCALL,
+    /* 17 */ I(OP_LUI, 0, $t1, DATA_ADDRESS >> 16),
+    /* 18 */ I(OP_ADDI, $zero, $t3, 10000),
+    /* 19 */ I(OP_ADDI, $zero, $t0, 1),
+    /* 20 */ I(OP_AMOADD, $t1, $t0, 0),
+    /* 21 */ I(OP_LL, $t1, $t2, 4),
+    /* 22 */ I(OP_ADDI, $t2, $t2, 1),
+    /* 23 */ I(OP_SC, $t1, $t2, 4),
+    /* 24 */ I(OP_BEQ, $t2, $zero, 21 - 24),
+    /* 25 */ I(OP_ADDI, $t3, $t3, -1),
+    /* 26 */ I(OP_BNE, $t3, $zero, 19 - 26),
+    /* 27 */ I(OP_ADDI, $zero, $v0, SYS_EXIT),
+    /* 28 */ SYSCALL
+};
+
+void testContendedCounters(CuTest* test) {
+    Memory memory;
+    LMips mips;
+    loadWords(&memory, &mips, counters, sizeof(counters) / 4);
+
+    CuAssertIntEquals(test, EXEC_SUCCESS, runSimulator(&mips));
+    CuAssertIntEquals(test, 30000, mem_read(&memory, DATA_ADDRESS));
+    CuAssertIntEquals(test, 30000, mem_read(&memory, DATA_ADDRESS + 4));
+
+    freeSimulator(&mips);
+    freeMemory(&memory);
+}
+
+// Hart 0 waits until hart 1 stores 5 at DATA_ADDRESS and wakes it
+static const uint32_t waiter[] = {
+    /*  0 */ I(OP_ADDI, $zero, $a0, 18 * 4),
+    /*  1 */ I(OP_ADDI, $sp, $a1, -4096),
+    /*  2 */ I(OP_ADDI, $zero, $v0, SYS_HART_SPAWN),
+    /*  3 */ SYSCALL,
+    /*  4 */ R($v0, $zero, $s0, 0, SPE_ADD),
+    /*  5 */ I(OP_LUI, 0, $s1, DATA_ADDRESS >> 16),
+    /*  6 */ I(OP_LW, $s1, $t0, 0),
+    /*  7 */ I(OP_BNE, $t0, $zero, 13 - 7),
+    /*  8 */ R($s1, $zero, $a0, 0, SPE_ADD),
+    /*  9 */ I(OP_ADDI, $zero, $a1, 0),
+    /* 10 */ I(OP_ADDI, $zero, $v0, SYS_FUTEX_WAIT),
+    /* 11 */ SYSCALL,
+    /* 12 */ I(OP_BEQ, $zero, $zero, 6 - 12),
+    /* 13 */ R($s0, $zero, $a0, 0, SPE_ADD),
+    /* 14 */ I(OP_ADDI, $zero, $v0, SYS_HART_JOIN),
+    /* 15 */ SYSCALL,
+    /* 16 */ I(OP_ADDI, $zero, $v0, SYS_EXIT),
+    /* 17 */ SYSCALL,
+    /* 18 */ I(OP_LUI, 0, $s1, DATA_ADDRESS >> 16),
+    /* 19 */ I(OP_ADDI, $zero, $t0, 5),
+    /* 20 */ I(OP_SW, $s1, $t0, 0),
+    /* 21 */ R($s1, $zero, $a0, 0, SPE_ADD),
+    /* 22 */ I(OP_ADDI, $zero, $a1, 1),
+    /* 23 */ I(OP_ADDI, $zero, $v0, SYS_FUTEX_WAKE),
+    /* 24 */ SYSCALL,
+    /* 25 */ I(OP_ADDI, $zero, $v0, SYS_EXIT),
+    /* 26 */ SYSCALL
+};
+
+void testFutexWaitAndWake(CuTest* test) {
+    Memory memory;
+    LMips mips;
+    loadWords(&memory, &mips, waiter, sizeof(waiter) / 4);
+
+    // Without other harts, a wait returns right away
+    mips.regs[$a0] = DATA_ADDRESS;
+    mips.regs[$a1] = 3;
+    CuAssertIntEquals(test, EXEC_SUCCESS, sys_futex_wait(&mips));
+    CuAssertIntEquals(test, 1, mips.regs[$v0]);
+    mips.regs[$a1] = 0;
+    CuAssertIntEquals(test, EXEC_SUCCESS, sys_futex_wait(&mips));
+    CuAssertIntEquals(test, -1, mips.regs[$v0]);
+    CuAssertIntEquals(test, EXEC_SUCCESS, sys_futex_wake(&mips));
+    CuAssertIntEquals(test, 0, mips.regs[$v0]);
+    mips.regs[$a0] = DATA_ADDRESS + 2;
+    CuAssertIntEquals(test, EXEC_ERR_MEMORY_ADDR, sys_futex_wait(&mips));
+
+    CuAssertIntEquals(test, EXEC_SUCCESS, runSimulator(&mips));
+    CuAssertIntEquals(test, 5, mips.regs[$t0]);
+    CuAssertIntEquals(test, 1, mips.regs[$s0]);
+
+    freeSimulator(&mips);
+    freeMemory(&memory);
+}
+
+// Hart 0 joins hart 1, which spins forever
+static const uint32_t joiner[] = {
+    /*  0 */ I(OP_ADDI, $zero, $a0, 9 * 4),
+    /*  1 */ I(OP_ADDI, $sp, $a1, -4096),
+    /*  2 */ I(OP_ADDI, $zero, $v0, SYS_HART_SPAWN),
+    /*  3 */ SYSCALL,
+    /*  4 */ R($v0, $zero, $a0, 0, SPE_ADD),
+    /*  5 */ I(OP_ADDI, $zero, $v0, SYS_HART_JOIN),
+    /*  6 */ SYSCALL,
+    /*  7 */ I(OP_ADDI, $zero, $v0, SYS_EXIT),
+    /*  8 */ SYSCALL,
+    /*  9 */ I(OP_BEQ, $zero, $zero, 0)
+};
+
+void testBudgetEndsJoin(CuTest* test) {
+    Memory memory;
+    LMips mips;
+    loadWords(&memory, &mips, joiner, sizeof(joiner) / 4);
+
+    // The instructions of hart 1 spend the budget of hart 0 while it waits, which leaves the join to run on resume
+    for (int run = 0; run < 2; ++run) {
+        mips.stopCount = mips.icount + 100;
+        CuAssertIntEquals(test, EXEC_BREAKPOINT, executeSimulator(&mips));
+        CuAssertTrue(test, mips.icount >= mips.stopCount);
+        CuAssertIntEquals(test, 6 * 4, mips.ip);
+        CuAssertIntEquals(test, SYS_HART_JOIN, mips.regs[$v0]);
+    }
+
+    freeSimulator(&mips);
+    freeMemory(&memory);
+}
+
+// Hart 1 waits on a word nobody stores to while hart 0 joins it, twice, then hart 0 waits on its own
+static const uint32_t deadlock[] = {
+    /*  0 */ I(OP_ADDI, $zero, $a0, 20 * 4),
+    /*  1 */ I(OP_ADDI, $sp, $a1, -4096),
+    /*  2 */ I(OP_ADDI, $zero, $v0, SYS_HART_SPAWN),
+    /*  3 */ SYSCALL,
+    /*  4 */ R($v0, $zero, $s0, 0, SPE_ADD),
+    /*  5 */ R($s0, $zero, $a0, 0, SPE_ADD),
+    /*  6 */ I(OP_ADDI, $zero, $v0, SYS_HART_JOIN),
+    /*  7 */ SYSCALL,
+    /*  8 */ R($v0, $zero, $s1, 0, SPE_ADD),
+    /*  9 */ R($s0, $zero, $a0, 0, SPE_ADD),
+    /* 10 */ I(OP_ADDI, $zero, $v0, SYS_HART_JOIN),
+    /* 11 */ SYSCALL,
+    /* 12 */ R($v0, $zero, $s2, 0, SPE_ADD),
+    /* 13 */ I(OP_LUI, 0, $a0, DATA_ADDRESS >> 16),
+    /* 14 */ I(OP_ADDI, $zero, $a1, -1),
+    /* 15 */ I(OP_ADDI, $zero, $v0, SYS_FUTEX_WAIT),
+    /* 16 */ SYSCALL,
+    /* 17 */ R($v0, $zero, $s3, 0, SPE_ADD),
+    /* 18 */ I(OP_ADDI, $zero, $v0, SYS_EXIT),
+    /* 19 */ SYSCALL,
+    /* 20 */ I(OP_LUI, 0, $s1, DATA_ADDRESS >> 16),
+    /* 21 */ R($s1, $zero, $a0, 0, SPE_ADD),
+    /* 22 */ I(OP_ADDI, $zero, $a1, 0),
+    /* 23 */ I(OP_ADDI, $zero, $v0, SYS_FUTEX_WAIT),
+    /* 24 */ SYSCALL,
+    /* 25 */ I(OP_SW, $s1, $v0, 0),
+    /* 26 */ I(OP_ADDI, $zero, $v0, SYS_EXIT),
+    /* 27 */ SYSCALL
+};
+
+void testWaitsEndWhenAllHartsWait(CuTest* test) {
+    Memory memory;
+    LMips mips;
+    loadWords(&memory, &mips, deadlock, sizeof(deadlock) / 4);
+
+    // Once both harts wait, both waits fail and hart 1 can be joined on the second try. With hart 1 gone,
+    // nothing could wake hart 0.
+    CuAssertIntEquals(test, EXEC_SUCCESS, runSimulator(&mips));
+    CuAssertIntEquals(test, -1, mips.regs[$s1]);
+    CuAssertIntEquals(test, 0, mips.regs[$s2]);
+    CuAssertIntEquals(test, -1, mem_read(&memory, DATA_ADDRESS));
+    CuAssertIntEquals(test, -1, mips.regs[$s3]);
+
+    freeSimulator(&mips);
+    freeMemory(&memory);
+}
+
+CuSuite* getLMipsHartsSuite() {
+    CuSuite* suite = CuSuiteNew();
+
+    SUITE_ADD_TEST(suite, testSpawnAndJoinHarts);
+    SUITE_ADD_TEST(suite, testSpawnAtLoadedLabel);
+    SUITE_ADD_TEST(suite, testAlignedWordsAreAtomic);
+    SUITE_ADD_TEST(suite, testExitStopsHarts);
+    SUITE_ADD_TEST(suite, testContendedCounters);
+    SUITE_ADD_TEST(suite, testFutexWaitAndWake);
+    SUITE_ADD_TEST(suite, testBudgetEndsJoin);
+    SUITE_ADD_TEST(suite, testWaitsEndWhenAllHartsWait);
+
+    return suite;
+}
@@ -0,0 +1,252 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "CuTest.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "image.h"
+#include "imagecache.h"
+#include "syscalls.h"
+
+void testImageRoundTrip(CuTest* test) {
+    char path[] = "/tmp/lmips_image_XXXXXX";
+    close(mkstemp(path));
+
+    Memory memory;
+    initMemory(&memory);
+    LMips mips;
+    initSimulator(&mips, &memory);
+    mips.ip = 8;
+    mips.regs[$t0] = 42;
+    mem_write(&memory, PROGRAM_ADDRESS, 0x2002000A);
+    mem_write(&memory, STACK_ADDRESS - 3, 0xCAFEBABE);
+
+    ImageKey key = {};
+    key.hash = 1;
+    CuAssertTrue(test, image_write(path, &key, &mips, NULL));
+
+    Memory restored;
+    initMemory(&restored);
+    LMips copy;
+    initSimulator(&copy, &restored);
+
+    ImageKey other = key;
+    other.hash = 2;
+    CuAssertTrue(test, !image_map(path, &other, &restored, &copy, NULL));
+    CuAssertTrue(test, image_map(path, &key, &restored, &copy, NULL));
+    CuAssertIntEquals(test, 8, copy.ip);
+    CuAssertIntEquals(test, 42, copy.regs[$t0]);
+    CuAssertIntEquals(test, STACK_ADDRESS, copy.regs[$sp]);
+    CuAssertIntEquals(test, 0x2002000A, mem_read(&restored, PROGRAM_ADDRESS));
+    CuAssertIntEquals(test, (int32_t)0xCAFEBABE, mem_read(&restored, STACK_ADDRESS - 3));
+    CuAssertIntEquals(test, 0, mem_read(&restored, DATA_ADDRESS));
+
+    // Mapped pages are private to the VM
+    mem_write(&restored, PROGRAM_ADDRESS, 0);
+    CuAssertTrue(test, image_map(path, &key, &memory, &mips, NULL));
+    CuAssertIntEquals(test, 0x2002000A, mem_read(&memory, PROGRAM_ADDRESS));
+
+    freeSimulator(&copy);
+    freeMemory(&restored);
+    freeSimulator(&mips);
+    freeMemory(&memory);
+    unlink(path);
+}
+
+void testSnapshotResume(CuTest* test) {
+    char path[] = "/tmp/lmips_image_XXXXXX";
+    close(mkstemp(path));
+
+    Memory memory;
+    initMemory(&memory);
+    LMips mips;
+    initSimulator(&mips, &memory);
+    mem_write(&memory, PROGRAM_ADDRESS, 0x21080001); // addi $t0, $t0, 1
+    mem_write(&memory, PROGRAM_ADDRESS + 4, 0x21080001); // addi $t0, $t0, 1
+    mem_write(&memory, PROGRAM_ADDRESS + 8, 0x2002000A); // addi $v0, $zero, 10
+    mem_write(&memory, PROGRAM_ADDRESS + 12, 0x0000000C); // syscall
+
+    mips.stopCount = 1;
+    CuAssertIntEquals(test, EXEC_BREAKPOINT, runSimulator(&mips));
+    CuAssertIntEquals(test, 1, mips.regs[$t0]);
+    // A read-only mapping stays read-only
+    memory.readOnlyStart = MAP_ADDRESS - MEMORY_PAGE_SIZE;
+    memory.readOnlyEnd = MAP_ADDRESS;
+    CuAssertTrue(test, image_write(path, NULL, &mips, NULL));
+
+    mips.stopCount = UINT64_MAX;
+    mips.breakpoint = 8;
+    CuAssertIntEquals(test, EXEC_BREAKPOINT, runSimulator(&mips));
+    CuAssertIntEquals(test, 2, mips.regs[$t0]);
+    CuAssertIntEquals(test, 2, (int)mips.icount);
+
+    Memory restored;
+    initMemory(&restored);
+    LMips copy;
+    initSimulator(&copy, &restored);
+    CuAssertTrue(test, image_map(path, NULL, &restored, &copy, NULL));
+    CuAssertIntEquals(test, 1, (int)copy.icount);
+    CuAssertIntEquals(test, MAP_ADDRESS - MEMORY_PAGE_SIZE, restored.readOnlyStart);
+    CuAssertIntEquals(test, MAP_ADDRESS, restored.readOnlyEnd);
+    CuAssertTrue(test, !mem_writable(&restored, MAP_ADDRESS - 8, 4));
+    CuAssertIntEquals(test, EXEC_SUCCESS, runSimulator(&copy));
+    CuAssertIntEquals(test, 2, copy.regs[$t0]);
+
+    freeSimulator(&copy);
+    freeMemory(&restored);
+    freeSimulator(&mips);
+    freeMemory(&memory);
+    unlink(path);
+}
+
+void testSnapshotKeepsAllocations(CuTest* test) {
+    char path[] = "/tmp/lmips_image_XXXXXX";
+    close(mkstemp(path));
+
+    Memory memory;
+    initMemory(&memory);
+    LMips mips;
+    initSimulator(&mips, &memory);
+    mips.regs[$a0] = 24;
+    CuAssertIntEquals(test, EXEC_SUCCESS, sys_malloc(&mips));
+    uint32_t small = mips.regs[$v0];
+    mips.regs[$a0] = 3 * MEMORY_PAGE_SIZE;
+    CuAssertIntEquals(test, EXEC_SUCCESS, sys_malloc(&mips));
+    uint32_t run = mips.regs[$v0];
+    mips.regs[$a0] = run;
+    CuAssertIntEquals(test, EXEC_SUCCESS, sys_free(&mips));
+    CuAssertTrue(test, image_write(path, NULL, &mips, NULL));
+
+    // Allocations made before the snapshot can be freed after a restore, and are not handed out again
+    Memory restored;
+    initMemory(&restored);
+    LMips copy;
+    initSimulator(&copy, &restored);
+    CuAssertTrue(test, image_map(path, NULL, &restored, &copy, NULL));
+    CuAssertPtrNotNull(test, copy.allocator);
+    CuAssertIntEquals(test, 2, copy.allocator->stats.allocations);
+    copy.regs[$a0] = 24;
+    CuAssertIntEquals(test, EXEC_SUCCESS, sys_malloc(&copy));
+    CuAssertTrue(test, copy.regs[$v0] != small);
+    copy.regs[$a0] = small;
+    CuAssertIntEquals(test, EXEC_SUCCESS, sys_free(&copy));
+    copy.regs[$a0] = run;
+    CuAssertIntEquals(test, EXEC_ERR_MEMORY_ADDR, sys_free(&copy));
+    copy.regs[$a0] = 2 * MEMORY_PAGE_SIZE;
+    CuAssertIntEquals(test, EXEC_SUCCESS, sys_malloc(&copy));
+    CuAssertIntEquals(test, run, copy.regs[$v0]);
+
+    freeSimulator(&copy);
+    freeMemory(&restored);
+    freeSimulator(&mips);
+    freeMemory(&memory);
+    unlink(path);
+}
+
+static void writeFile(char* path, const char* contents) {
+    int fd = mkstemp(path);
+    write(fd, contents, strlen(contents));
+    close(fd);
+}
+
+void testCacheKey(CuTest* test) {
+    char first[] = "/tmp/lmips_image_XXXXXX";
+    char second[] = "/tmp/lmips_image_XXXXXX";
+    char same[] = "/tmp/lmips_image_XXXXXX";
+    writeFile(first, "0123456789 first executable");
+    writeFile(second, "0123456789 other executable");
+    writeFile(same, "0123456789 first executable");
+
+    ImageKey a, b, c;
+    CuAssertTrue(test, cache_key(first, &a));
+    CuAssertTrue(test, cache_key(second, &b));
+    CuAssertTrue(test, cache_key(same, &c));
+    CuAssertIntEquals(test, 27, (int)a.size);
+    CuAssertIntEquals(test, 27, (int)b.size);
+    CuAssertTrue(test, a.hash != b.hash);
+    CuAssertTrue(test, memcmp(&a, &c, sizeof(ImageKey)) == 0);
+    CuAssertTrue(test, !cache_key("/nonexistent", &a));
+
+    unlink(first);
+    unlink(second);
+    unlink(same);
+}
+
+static void cachePath(char* path, size_t size, const char* directory, const ImageKey* key) {
+    snprintf(path, size, "%s/%016llx.limg", directory, (unsigned long long)key->hash);
+}
+
+void testCacheLookupAndEviction(CuTest* test) {
+    char directory[] = "/tmp/lmips_cache_XXXXXX";
+    CuAssertPtrNotNull(test, mkdtemp(directory));
+    ImageCache cache;
+    initImageCache(&cache, directory, 0);
+
+    Memory memory;
+    initMemory(&memory);
+    LMips mips;
+    initSimulator(&mips, &memory);
+    mem_write(&memory, PROGRAM_ADDRESS, 0x2002000A);
+    mips.ip = 4;
+
+    ImageKey first = {}, second = {};
+    first.hash = 1;
+    second.hash = 2;
+
+    Memory restored;
+    initMemory(&restored);
+    LMips copy;
+    initSimulator(&copy, &restored);
+    CuAssertTrue(test, !cache_lookup(&cache, &first, &restored, &copy, NULL));
+    CuAssertTrue(test, cache_store(&cache, &first, &mips, NULL));
+    CuAssertTrue(test, cache_lookup(&cache, &first, &restored, &copy, NULL));
+    CuAssertIntEquals(test, 4, copy.ip);
+    CuAssertIntEquals(test, 0x2002000A, mem_read(&restored, PROGRAM_ADDRESS));
+
+    ImageCacheStats stats;
+    CuAssertTrue(test, cache_stats(&cache, &stats));
+    CuAssertIntEquals(test, 1, (int)stats.hits);
+    CuAssertIntEquals(test, 1, (int)stats.misses);
+
+    // Room for a single image : storing the second one evicts the least recently used
+    char firstPath[128], secondPath[128];
+    cachePath(firstPath, sizeof(firstPath), directory, &first);
+    cachePath(secondPath, sizeof(secondPath), directory, &second);
+    struct stat info;
+    CuAssertIntEquals(test, 0, stat(firstPath, &info));
+    struct timespec old[2] = {{1, 0}, {1, 0}};
+    utimensat(AT_FDCWD, firstPath, old, 0);
+
+    cache.maxSize = (uint64_t)info.st_blocks * 512;
+    CuAssertTrue(test, cache_store(&cache, &second, &mips, NULL));
+    CuAssertTrue(test, access(firstPath, F_OK) != 0);
+    CuAssertIntEquals(test, 0, access(secondPath, F_OK));
+    CuAssertTrue(test, !cache_lookup(&cache, &first, &restored, &copy, NULL));
+    CuAssertTrue(test, cache_stats(&cache, &stats));
+    CuAssertIntEquals(test, 2, (int)stats.misses);
+
+    freeSimulator(&copy);
+    freeMemory(&restored);
+    freeSimulator(&mips);
+    freeMemory(&memory);
+
+    char statsPath[128];
+    snprintf(statsPath, sizeof(statsPath), "%s/stats", directory);
+    unlink(secondPath);
+    unlink(statsPath);
+    rmdir(directory);
+    freeImageCache(&cache);
+}
+
+CuSuite* getLMipsImageSuite() {
+    CuSuite* suite = CuSuiteNew();
+
+    SUITE_ADD_TEST(suite, testImageRoundTrip);
+    SUITE_ADD_TEST(suite, testSnapshotResume);
+    SUITE_ADD_TEST(suite, testSnapshotKeepsAllocations);
+    SUITE_ADD_TEST(suite, testCacheKey);
+    SUITE_ADD_TEST(suite, testCacheLookupAndEviction);
+
+    return suite;
+}
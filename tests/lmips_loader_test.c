@@ -0,0 +1,282 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <lmips_opcodes.h>
+#include "CuTest.h"
+#include "loader.h"
+
+typedef struct {
+    uint8_t bytes[512];
+    size_t length;
+} Image;
+
+static void emitByte(Image* image, uint8_t byte) {
+    image->bytes[image->length++] = byte;
+}
+
+static void emitWord(Image* image, uint32_t word) {
+    emitByte(image, word >> 24);
+    emitByte(image, word >> 16);
+    emitByte(image, word >> 8);
+    emitByte(image, word);
+}
+
+static void emitSectionHeader(Image* image, uint8_t type, uint32_t offset, uint32_t size) {
+    emitByte(image, 0);
+    emitByte(image, 0);
+    emitByte(image, type);
+    emitWord(image, offset);
+    emitWord(image, size);
+}
+
+// Writes an executable with two instructions, one data byte and its debug sections
+static void writeExecutable(char* path) {
+    Image image = {};
+    image.length = 15;
+
+    uint32_t text = image.length;
+    emitWord(&image, 0x20020001); // addi $v0, $zero, 1
+    emitWord(&image, 0x20020002); // addi $v0, $zero, 2
+
+    uint32_t data = image.length;
+    emitByte(&image, 42);
+
+    uint32_t symtab = image.length;
+    emitWord(&image, 3);
+    emitWord(&image, 0); emitWord(&image, 0); emitWord(&image, SEGMENT_TEXT << 24);
+    emitWord(&image, 4); emitWord(&image, 5); emitWord(&image, SEGMENT_TEXT << 24);
+    emitWord(&image, 0); emitWord(&image, 10); emitWord(&image, SEGMENT_DATA << 24);
+    memcpy(&image.bytes[image.length], "main\0loop\0value", 16);
+    image.length += 16;
+
+    uint32_t lines = image.length;
+    emitWord(&image, 2);
+    emitWord(&image, 0); emitWord(&image, 7);
+    emitWord(&image, 4); emitWord(&image, 9);
+
+    uint32_t sha = image.length;
+    emitSectionHeader(&image, SHT_EXEC, text, data - text);
+    emitSectionHeader(&image, SHT_ALLOC, data, symtab - data);
+    emitSectionHeader(&image, SHT_SYMTAB, symtab, lines - symtab);
+    emitSectionHeader(&image, SHT_LINES, lines, sha - lines);
+
+    size_t length = image.length;
+    image.length = 0;
+    emitByte(&image, 0x10);
+    emitByte(&image, 'L');
+    emitByte(&image, 'E');
+    emitByte(&image, 'F');
+    emitByte(&image, 1);
+    emitByte(&image, 0);
+    emitWord(&image, text + 4);
+    emitWord(&image, sha);
+    emitByte(&image, 4);
+
+    int fd = mkstemp(path);
+    write(fd, image.bytes, length);
+    close(fd);
+}
+
+void testLoadExecutable(CuTest* test) {
+    char path[] = "/tmp/lmips_loader_XXXXXX";
+    writeExecutable(path);
+
+    Memory memory;
+    initMemory(&memory);
+    Executable executable;
+
+    CuAssertIntEquals(test, LOAD_SUCCESS, loadExecutable(path, &memory, &executable));
+    CuAssertIntEquals(test, 4, executable.entry);
+    CuAssertIntEquals(test, 0x20020002, mem_read(&memory, PROGRAM_ADDRESS + 4));
+    CuAssertIntEquals(test, 42, mem_read_byte(&memory, DATA_ADDRESS));
+
+    // Debug sections are not mapped until queried
+    CuAssertPtrEquals(test, NULL, executable.debug.map);
+
+    freeExecutable(&executable);
+    freeMemory(&memory);
+    unlink(path);
+}
+
+void testLoadInvalidExecutable(CuTest* test) {
+    char path[] = "/tmp/lmips_loader_XXXXXX";
+    int fd = mkstemp(path);
+    write(fd, "\x7F" "ELF", 4);
+    close(fd);
+
+    Memory memory;
+    initMemory(&memory);
+    Executable executable;
+
+    CuAssertIntEquals(test, LOAD_ERR_FORMAT, loadExecutable(path, &memory, &executable));
+    CuAssertIntEquals(test, LOAD_ERR_OPEN, loadExecutable("/nonexistent/file.bin", &memory, &executable));
+
+    freeMemory(&memory);
+    unlink(path);
+}
+
+void testLoadRelocatableObject(CuTest* test) {
+    char path[] = "/tmp/lmips_loader_XXXXXX";
+
+    Image image = {};
+    emitByte(&image, 0x10);
+    emitByte(&image, 'L');
+    emitByte(&image, 'E');
+    emitByte(&image, 'F');
+    emitByte(&image, 1);
+    emitByte(&image, 0);
+    emitWord(&image, 15);
+    emitWord(&image, 19);
+    emitByte(&image, 1);
+    emitWord(&image, 0); // Empty relocation table
+    emitSectionHeader(&image, SHT_REL, 15, 4);
+
+    int fd = mkstemp(path);
+    write(fd, image.bytes, image.length);
+    close(fd);
+
+    Memory memory;
+    initMemory(&memory);
+    Executable executable;
+
+    CuAssertIntEquals(test, LOAD_ERR_OBJECT, loadExecutable(path, &memory, &executable));
+
+    freeMemory(&memory);
+    unlink(path);
+}
+
+void testDebugInfoLookup(CuTest* test) {
+    char path[] = "/tmp/lmips_loader_XXXXXX";
+    writeExecutable(path);
+
+    Memory memory;
+    initMemory(&memory);
+    Executable executable;
+    loadExecutable(path, &memory, &executable);
+
+    Symbol symbol;
+    CuAssertTrue(test, debug_find_symbol(&executable.debug, SEGMENT_TEXT, 0, &symbol));
+    CuAssertStrEquals(test, "main", symbol.name);
+    CuAssertTrue(test, debug_find_symbol(&executable.debug, SEGMENT_TEXT, 12, &symbol));
+    CuAssertStrEquals(test, "loop", symbol.name);
+    CuAssertIntEquals(test, 4, symbol.address);
+    CuAssertTrue(test, debug_find_symbol(&executable.debug, SEGMENT_DATA, 3, &symbol));
+    CuAssertStrEquals(test, "value", symbol.name);
+
+    CuAssertTrue(test, debug_find_symbol_by_name(&executable.debug, "loop", &symbol));
+    CuAssertIntEquals(test, 4, symbol.address);
+    CuAssertTrue(test, !debug_find_symbol_by_name(&executable.debug, "missing", &symbol));
+
+    uint32_t line = 0;
+    CuAssertTrue(test, debug_find_line(&executable.debug, 0, &line));
+    CuAssertIntEquals(test, 7, line);
+    CuAssertTrue(test, debug_find_line(&executable.debug, 8, &line));
+    CuAssertIntEquals(test, 9, line);
+
+    freeExecutable(&executable);
+    freeMemory(&memory);
+    unlink(path);
+}
+
+typedef struct {
+    Memory* memory;
+    uint32_t address;
+    _Atomic bool done;
+    bool result;
+} Fault;
+
+static void* faultThread(void* arg) {
+    Fault* fault = arg;
+    fault->result = mem_fault(fault->memory, fault->address);
+    atomic_store(&fault->done, true);
+    return NULL;
+}
+
+void testLoadLargeDataInBackground(CuTest* test) {
+    char path[] = "/tmp/lmips_loader_XXXXXX";
+    uint32_t size = 512 * 1024;
+    uint8_t* file = calloc(1, 15 + 4 + size + 22);
+
+    Image header = {};
+    emitByte(&header, 0x10);
+    emitByte(&header, 'L');
+    emitByte(&header, 'E');
+    emitByte(&header, 'F');
+    emitByte(&header, 1);
+    emitByte(&header, 0);
+    emitWord(&header, 15);
+    emitWord(&header, 15 + 4 + size);
+    emitByte(&header, 2);
+    emitWord(&header, 0x2002000A); // addi $v0, $zero, 10
+    memcpy(file, header.bytes, header.length);
+
+    for (uint32_t i = 0; i < size; ++i) {
+        file[19 + i] = (uint8_t)i;
+    }
+
+    Image sections = {};
+    emitSectionHeader(&sections, SHT_EXEC, 15, 4);
+    emitSectionHeader(&sections, SHT_ALLOC, 19, size);
+    memcpy(&file[19 + size], sections.bytes, sections.length);
+
+    int fd = mkstemp(path);
+    write(fd, file, 19 + size + sections.length);
+    close(fd);
+    free(file);
+
+    Memory memory;
+    initMemory(&memory);
+    Executable executable;
+
+    CuAssertIntEquals(test, LOAD_SUCCESS, loadExecutable(path, &memory, &executable));
+    CuAssertIntEquals(test, 0x2002000A, mem_read(&memory, PROGRAM_ADDRESS));
+
+    // Data accesses go through mem_fault until the background copy is over
+    MemoryBarrier* barrier = memory.pending;
+    CuAssertPtrNotNull(test, barrier);
+    CuAssertIntEquals(test, DATA_ADDRESS + size, memory.base);
+
+    // An extra chunk held back keeps the copy pending, whatever the workers have done so far
+    pthread_mutex_lock(&barrier->lock);
+    barrier->remaining++;
+    pthread_mutex_unlock(&barrier->lock);
+
+    Fault fault = {&memory, DATA_ADDRESS + size - 1, false, false};
+    pthread_t thread;
+    pthread_create(&thread, NULL, faultThread, &fault);
+    usleep(20000);
+    CuAssertTrue(test, !atomic_load(&fault.done));
+
+    pthread_mutex_lock(&barrier->lock);
+    if (--barrier->remaining == 0) {
+        pthread_cond_broadcast(&barrier->done);
+    }
+    pthread_mutex_unlock(&barrier->lock);
+    pthread_join(thread, NULL);
+
+    CuAssertTrue(test, fault.result);
+    CuAssertPtrEquals(test, NULL, memory.pending);
+    CuAssertIntEquals(test, DATA_ADDRESS, memory.base);
+    CuAssertIntEquals(test, (uint8_t)(size - 1), mem_read_byte(&memory, DATA_ADDRESS + size - 1));
+    CuAssertIntEquals(test, 0x42, mem_read_byte(&memory, DATA_ADDRESS + 0x42));
+    CuAssertTrue(test, !mem_fault(&memory, DATA_ADDRESS - 1));
+
+    freeExecutable(&executable);
+    freeMemory(&memory);
+    unlink(path);
+}
+
+CuSuite* getLMipsLoaderSuite() {
+    CuSuite* suite = CuSuiteNew();
+
+    SUITE_ADD_TEST(suite, testLoadExecutable);
+    SUITE_ADD_TEST(suite, testLoadInvalidExecutable);
+    SUITE_ADD_TEST(suite, testLoadRelocatableObject);
+    SUITE_ADD_TEST(suite, testDebugInfoLookup);
+    SUITE_ADD_TEST(suite, testLoadLargeDataInBackground);
+
+    return suite;
+}
@@ -0,0 +1,111 @@
+#include "CuTest.h"
+#include "lockstep.h"
+#include "lmips_test_words.h"
+
+// Rotates $a0 a hundred times, adding 3 to $s0 for its odd values and 1 in a subroutine for the even ones
+static const uint32_t rotator[] = {
+    /*  0 */ I(OP_ADDI, $zero, $t0, 100),
+    /*  1 */ I(OP_ADDI, $zero, $s0, 0),
+    /*  2 */ I(OP_LUI, 0, $t2, DATA_ADDRESS >> 16),
+    /*  3 */ I(OP_ANDI, $a0, $t1, 1),
+    /*  4 */ I(OP_BEQ, $t1, $zero, 7 - 4),
+    /*  5 */ I(OP_ADDI, $s0, $s0, 3),
+    /*  6 */ I(OP_BEQ, $zero, $zero, 8 - 6),
+    /*  7 */ ((uint32_t)OP_JAL << 26) | 17,
+    /*  8 */ R(0, $a0, $t3, 31, SPE_SLL),
+    /*  9 */ R(0, $a0, $a0, 1, SPE_SRL),
+    /* 10 */ R($a0, $t3, $a0, 0, SPE_OR),
+    /* 11 */ I(OP_SW, $t2, $s0, 0),
+    /* 12 */ I(OP_LW, $t2, $s1, 0),
+    /* 13 */ I(OP_ADDI, $t0, $t0, -1),
+    /* 14 */ I(OP_BNE, $t0, $zero, 3 - 14),
+    /* 15 */ I(OP_ADDI, $zero, $v0, SYS_EXIT),
+    /* 16 */ SYSCALL,
+    /* 17 */ I(OP_ADDI, $s0, $s0, 1),
+    /* 18 */ R($ra, 0, 0, 0, SPE_JR)
+};
+
+static const uint32_t seeds[LOCKSTEP_LANES] = {5, 0xF0F0, 0x12345678, 0, 0xFFFFFFFF, 3, 0x80000001, 0xAAAA};
+
+void testLockStepMatchesInterpreter(CuTest* test) {
+    Memory memories[LOCKSTEP_LANES], expectedMemory;
+    LMips lanes[LOCKSTEP_LANES], expected;
+
+    LockStep lockstep;
+    initLockStep(&lockstep);
+    for (int i = 0; i < LOCKSTEP_LANES; ++i) {
+        loadWords(&memories[i], &lanes[i], rotator, sizeof(rotator) / 4);
+        lanes[i].regs[$a0] = seeds[i];
+        CuAssertTrue(test, lockstep_add(&lockstep, &lanes[i]));
+    }
+    CuAssertTrue(test, !lockstep_add(&lockstep, &expected));
+    lockstep_run(&lockstep);
+
+    for (int i = 0; i < LOCKSTEP_LANES; ++i) {
+        loadWords(&expectedMemory, &expected, rotator, sizeof(rotator) / 4);
+        expected.regs[$a0] = seeds[i];
+        CuAssertIntEquals(test, EXEC_SUCCESS, runSimulator(&expected));
+
+        CuAssertIntEquals(test, EXEC_SUCCESS, lockstep.results[i]);
+        CuAssertTrue(test, lanes[i].stop);
+        CuAssertIntEquals(test, expected.icount, lanes[i].icount);
+        CuAssertIntEquals(test, expected.ip, lanes[i].ip);
+        for (int reg = 0; reg < REG_COUNT; ++reg) {
+            CuAssertIntEquals(test, expected.regs[reg], lanes[i].regs[reg]);
+        }
+        CuAssertIntEquals(test, mem_read(&expectedMemory, DATA_ADDRESS), mem_read(&memories[i], DATA_ADDRESS));
+
+        freeSimulator(&expected);
+        freeMemory(&expectedMemory);
+    }
+
+    // Only the exits went through the interpreter
+    CuAssertIntEquals(test, LOCKSTEP_LANES, lockstep.stats.scalar);
+    CuAssertTrue(test, lockstep.stats.divergences > 0);
+    CuAssertTrue(test, lockstep.stats.issued < lockstep.stats.executed);
+
+    for (int i = 0; i < LOCKSTEP_LANES; ++i) {
+        freeSimulator(&lanes[i]);
+        freeMemory(&memories[i]);
+    }
+}
+
+static const uint32_t doubler[] = {
+    R($a0, $a0, $t0, 0, SPE_ADD),
+    I(OP_ADDI, $zero, $v0, SYS_EXIT),
+    SYSCALL
+};
+
+void testLockStepFaultsOneLane(CuTest* test) {
+    Memory memories[3];
+    LMips lanes[3];
+
+    LockStep lockstep;
+    initLockStep(&lockstep);
+    for (int i = 0; i < 3; ++i) {
+        loadWords(&memories[i], &lanes[i], doubler, sizeof(doubler) / 4);
+        lanes[i].regs[$a0] = i == 1 ? 0x40000000 : i;
+        lockstep_add(&lockstep, &lanes[i]);
+    }
+    lockstep_run(&lockstep);
+
+    CuAssertIntEquals(test, EXEC_SUCCESS, lockstep.results[0]);
+    CuAssertIntEquals(test, EXEC_ERR_INT_OVERFLOW, lockstep.results[1]);
+    CuAssertIntEquals(test, EXEC_SUCCESS, lockstep.results[2]);
+    CuAssertIntEquals(test, 4, lanes[2].regs[$t0]);
+    CuAssertIntEquals(test, 1, lanes[1].icount);
+
+    for (int i = 0; i < 3; ++i) {
+        freeSimulator(&lanes[i]);
+        freeMemory(&memories[i]);
+    }
+}
+
+CuSuite* getLMipsLockStepSuite() {
+    CuSuite* suite = CuSuiteNew();
+
+    SUITE_ADD_TEST(suite, testLockStepMatchesInterpreter);
+    SUITE_ADD_TEST(suite, testLockStepFaultsOneLane);
+
+    return suite;
+}
@@ -1,7 +1,9 @@
 #include <stdio.h>
+#include <unistd.h>
 #include <lmips_opcodes.h>
 #include "CuTest.h"
 #include "lmips.h"
+#include "devices.h"
 
 void testLoadInvalidMemoryAddressInstruction(CuTest* test) {
     LMips mips;
@@ -133,6 +135,94 @@ void testSbInstruction(CuTest* test) {
     freeSimulator(&mips);
 }
 
+void testConsoleDeviceStores(CuTest* test) {
+    LMips mips;
+
+    uint8_t program[] = {
+            0xA9, 0x28, 0x00, 0x00, // sw $t0, ($t1)
+            0xA1, 0x2A, 0x00, 0x04, // sb $t2, 4($t1)
+            0xA9, 0x20, 0x0F, 0xFC, // sw $zero, 0xFFC($t1) : doorbell
+            0xA1, 0x2A, 0x00, 0x00, // sb $t2, ($t1)
+            0xA1, 0x2A, 0xFF, 0xFF, // sb $t2, -1($t1) : below the device
+            0x20, 0x02, 0x00, 0x0A, // addi $v0, $zero, 10
+            OP_SPECIAL, 0, 0, SPE_SYSCALL
+    };
+
+    initTestSimulator(&mips, program);
+
+    //Assign memory
+    Memory memory;
+    initMemory(&memory);
+    mips.memory = &memory;
+
+    int pipes[2];
+    pipe(pipes);
+    initConsole(&mips.console, pipes[1], CONSOLE_FULLY_BUFFERED);
+
+    mips.regs[$t0] = 0x4869210A; // "Hi!\n"
+    mips.regs[$t1] = DEVICE_CONSOLE_BUFFER;
+    mips.regs[$t2] = '\n';
+
+    ExecutionResult result = runSimulator(&mips);
+    CuAssertIntEquals(test, EXEC_ERR_MEMORY_ADDR, result);
+    CuAssertIntEquals(test, 20, mips.ip);
+
+    // Only the bytes stored before the doorbell went out
+    CuAssertIntEquals(test, 1, mips.transmitted);
+    char output[16] = {};
+    read(pipes[0], output, sizeof(output) - 1);
+    CuAssertStrEquals(test, "Hi!\n\n", output);
+
+    close(pipes[0]);
+    close(pipes[1]);
+    freeMemory(&memory);
+    freeSimulator(&mips);
+}
+
+void testAtomicInstructions(CuTest* test) {
+    LMips mips;
+
+    uint8_t program[] = {
+            0xC1, 0x28, 0x00, 0x00, // ll $t0, ($t1)
+            0x21, 0x0A, 0x00, 0x01, // addi $t2, $t0, 1
+            0xE1, 0x2A, 0x00, 0x00, // sc $t2, ($t1)
+            0xE1, 0x2B, 0x00, 0x00, // sc $t3, ($t1) : no reservation left
+            0xC5, 0x2C, 0x00, 0x00, // amoadd $t4, ($t1)
+            0xC9, 0x2D, 0x00, 0x00, // amoswap $t5, ($t1)
+            OP_SPECIAL, 0, 0, SPE_SYNC,
+            0xC1, 0x2E, 0x00, 0x02, // ll $t6, 2($t1) : unaligned
+            0x20, 0x02, 0x00, 0x0A, // addi $v0, $zero, 10
+            OP_SPECIAL, 0, 0, SPE_SYSCALL
+    };
+
+    initTestSimulator(&mips, program);
+
+    //Assign memory
+    Memory memory;
+    initMemory(&memory);
+    mips.memory = &memory;
+
+    mips.regs[$t1] = DATA_ADDRESS;
+    mips.regs[$t3] = 7;
+    mips.regs[$t4] = 10;
+    mips.regs[$t5] = 99;
+    mem_write(&memory, DATA_ADDRESS, 5);
+
+    ExecutionResult result = runSimulator(&mips);
+    CuAssertIntEquals(test, EXEC_ERR_MEMORY_ADDR, result);
+    CuAssertIntEquals(test, 32, mips.ip);
+
+    CuAssertIntEquals(test, 5, mips.regs[$t0]);
+    CuAssertIntEquals(test, 1, mips.regs[$t2]);
+    CuAssertIntEquals(test, 0, mips.regs[$t3]);
+    CuAssertIntEquals(test, 6, mips.regs[$t4]);
+    CuAssertIntEquals(test, 16, mips.regs[$t5]);
+    CuAssertIntEquals(test, 99, mem_read(&memory, DATA_ADDRESS));
+
+    freeMemory(&memory);
+    freeSimulator(&mips);
+}
+
 CuSuite* getLMipsMemoryInstructionsSuite() {
     CuSuite* suite = CuSuiteNew();
 
@@ -141,6 +231,8 @@ CuSuite* getLMipsMemoryInstructionsSuite() {
     SUITE_ADD_TEST(suite, testLbInstruction);
     SUITE_ADD_TEST(suite, testLhuInstruction);
     SUITE_ADD_TEST(suite, testSbInstruction);
+    SUITE_ADD_TEST(suite, testConsoleDeviceStores);
+    SUITE_ADD_TEST(suite, testAtomicInstructions);
 
     return suite;
 }
\ No newline at end of file
@@ -26,9 +26,11 @@ void testRunNullProgram(CuTest* test) {
 
 void testRunInvalidProgram(CuTest* test) {
     LMips mips;
-    // This program lead to undefined behaviour
+    // This program lead to undefined behaviour, it ends with an unknown opcode so that
+    // the simulator doesn't run into whatever follows it on the stack
     uint8_t program[] = {
-        1, 0, 0, 0
+        1, 0, 0, 0,
+        0xFC, 0, 0, 0
     };
 
     initTestSimulator(&mips, program);
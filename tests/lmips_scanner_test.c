@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "CuTest.h"
+#include "scanner.h"
+
+static const char INPUT[] =
+    "42\n"
+    "0\n"
+    "  17\n"
+    "-5\n"
+    "0x1F\n"
+    "017\n"
+    "4294967295\n"
+    "12345678901234\n"
+    "7 8\n"
+    "abc\n"
+    "\n"
+    "99";
+
+static FILE* openInput(char* path) {
+    int fd = mkstemp(path);
+    write(fd, INPUT, sizeof(INPUT) - 1);
+    lseek(fd, 0, SEEK_SET);
+
+    return fdopen(fd, "r");
+}
+
+// Integers are read exactly as fgets and strtoul did
+void testScannerReadInt(CuTest* test) {
+    char path[] = "/tmp/lmips_scanner_XXXXXX";
+    FILE* input = openInput(path);
+
+    Scanner scanner;
+    initScanner(&scanner, open(path, O_RDONLY));
+    for (int i = 0; i < 14; ++i) {
+        char buffer[12] = {};
+        uint32_t expected = fgets(buffer, 11, input) != NULL ? strtoul(buffer, NULL, 0) : 0;
+        CuAssertIntEquals(test, expected, scanner_read_int(&scanner));
+    }
+
+    close(scanner.stream.fd);
+    freeScanner(&scanner);
+    fclose(input);
+    unlink(path);
+}
+
+void testScannerReadLine(CuTest* test) {
+    char path[] = "/tmp/lmips_scanner_XXXXXX";
+    FILE* input = openInput(path);
+
+    Scanner scanner;
+    initScanner(&scanner, open(path, O_RDONLY));
+    size_t sizes[] = {10, 3, 2, 1, 64, 64, 64, 64, 64};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        char expected[64] = {}, line[64] = {};
+        fgets(expected, sizes[i], input);
+
+        CuAssertIntEquals(test, strlen(expected), scanner_read_line(&scanner, line, sizes[i]));
+        CuAssertStrEquals(test, expected, line);
+    }
+
+    close(scanner.stream.fd);
+    freeScanner(&scanner);
+    fclose(input);
+    unlink(path);
+}
+
+CuSuite* getLMipsScannerSuite() {
+    CuSuite* suite = CuSuiteNew();
+
+    SUITE_ADD_TEST(suite, testScannerReadInt);
+    SUITE_ADD_TEST(suite, testScannerReadLine);
+
+    return suite;
+}
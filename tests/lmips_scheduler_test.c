@@ -0,0 +1,135 @@
+#include <string.h>
+#include <lmips_opcodes.h>
+#include "CuTest.h"
+#include "scheduler.h"
+
+// Prints the integer it reads, then exits
+static uint8_t echo[] = {
+    0x20, 0x02, 0x00, 0x05, // addi $v0, $zero, 5
+    OP_SPECIAL, 0, 0, SPE_SYSCALL,
+    0x00, 0x40, 0x20, 0x20, // add $a0, $v0, $zero
+    0x20, 0x02, 0x00, 0x01, // addi $v0, $zero, 1
+    OP_SPECIAL, 0, 0, SPE_SYSCALL,
+    0x20, 0x02, 0x00, 0x0A, // addi $v0, $zero, 10
+    OP_SPECIAL, 0, 0, SPE_SYSCALL
+};
+
+// Counts 10000 down to zero, then exits
+static uint8_t loop[] = {
+    0x20, 0x08, 0x27, 0x10, // addi $t0, $zero, 10000
+    0x21, 0x08, 0xFF, 0xFF, // addi $t0, $t0, -1
+    (OP_BNE << 2) | 0x01, 0x00, 0xFF, 0xFF, // bne $t0, $zero, -1
+    0x20, 0x02, 0x00, 0x0A, // addi $v0, $zero, 10
+    OP_SPECIAL, 0, 0, SPE_SYSCALL
+};
+
+static void initGuest(LMips* mips, uint8_t* program) {
+    initTestSimulator(mips, program);
+
+    Stream output;
+    initBufferStream(&output, NULL, 0);
+    lmips_set_output(mips, &output);
+}
+
+static void assertOutput(CuTest* test, const char* expected, LMips* mips) {
+    size_t size;
+    const uint8_t* contents = stream_contents(&mips->console.stream, &size);
+    CuAssertIntEquals(test, strlen(expected), size);
+    CuAssertTrue(test, memcmp(contents, expected, size) == 0);
+}
+
+void testSchedulerParksReaders(CuTest* test) {
+    Scheduler scheduler;
+    CuAssertTrue(test, initScheduler(&scheduler, 2, 1000));
+
+    LMips vms[3];
+    Guest* guests[3];
+    for (int i = 0; i < 3; ++i) {
+        initGuest(&vms[i], echo);
+        guests[i] = scheduler_add(&scheduler, &vms[i]);
+        CuAssertPtrNotNull(test, guests[i]);
+    }
+
+    // Nobody has input yet, they all wait on their first syscall
+    scheduler_wait(&scheduler);
+    GuestStats stats;
+    for (int i = 0; i < 3; ++i) {
+        CuAssertIntEquals(test, GUEST_PARKED, scheduler_guest_stats(&scheduler, guests[i], &stats));
+        CuAssertIntEquals(test, 1, stats.instructions);
+        CuAssertIntEquals(test, 1, stats.parks);
+        CuAssertIntEquals(test, 4, vms[i].ip);
+    }
+
+    // A line is only complete with its new line
+    CuAssertTrue(test, scheduler_feed(&scheduler, guests[0], "4", 1));
+    scheduler_wait(&scheduler);
+    CuAssertIntEquals(test, GUEST_PARKED, scheduler_guest_stats(&scheduler, guests[0], &stats));
+    CuAssertIntEquals(test, 2, stats.parks);
+    CuAssertTrue(test, scheduler_feed(&scheduler, guests[0], "2\n", 2));
+
+    CuAssertTrue(test, scheduler_feed(&scheduler, guests[1], "-7\n", 3));
+    scheduler_close_input(&scheduler, guests[2]);
+    scheduler_wait(&scheduler);
+
+    const char* expected[3] = {"42", "-7", "0"};
+    for (int i = 0; i < 3; ++i) {
+        CuAssertIntEquals(test, GUEST_DONE, scheduler_guest_stats(&scheduler, guests[i], &stats));
+        CuAssertIntEquals(test, EXEC_SUCCESS, guests[i]->result);
+        CuAssertIntEquals(test, vms[i].icount, stats.instructions);
+        assertOutput(test, expected[i], &vms[i]);
+    }
+
+    SchedulerStats totals;
+    scheduler_stats(&scheduler, &totals);
+    CuAssertIntEquals(test, 3, totals.guests);
+    CuAssertIntEquals(test, 3, totals.done);
+    CuAssertIntEquals(test, 0, totals.parked);
+
+    freeScheduler(&scheduler);
+    for (int i = 0; i < 3; ++i) {
+        freeSimulator(&vms[i]);
+    }
+}
+
+void testSchedulerTimeSlices(CuTest* test) {
+    Scheduler scheduler;
+    CuAssertTrue(test, initScheduler(&scheduler, 1, 1000));
+
+    LMips vms[4];
+    Guest* guests[4];
+    for (int i = 0; i < 4; ++i) {
+        initGuest(&vms[i], loop);
+        guests[i] = scheduler_add(&scheduler, &vms[i]);
+    }
+    scheduler_wait(&scheduler);
+
+    // 1 + 2 * 10000 + 2 instructions, no slice goes past the quantum
+    GuestStats stats;
+    for (int i = 0; i < 4; ++i) {
+        CuAssertIntEquals(test, GUEST_DONE, scheduler_guest_stats(&scheduler, guests[i], &stats));
+        CuAssertIntEquals(test, EXEC_SUCCESS, guests[i]->result);
+        CuAssertIntEquals(test, 20003, stats.instructions);
+        CuAssertIntEquals(test, 21, stats.slices);
+        CuAssertIntEquals(test, 0, stats.parks);
+        CuAssertTrue(test, stats.waitNanos >= stats.maxWaitNanos);
+    }
+
+    SchedulerStats totals;
+    scheduler_stats(&scheduler, &totals);
+    CuAssertIntEquals(test, 4, totals.done);
+    CuAssertTrue(test, totals.fairness > 0.25 && totals.fairness <= 1.0);
+
+    freeScheduler(&scheduler);
+    for (int i = 0; i < 4; ++i) {
+        freeSimulator(&vms[i]);
+    }
+}
+
+CuSuite* getLMipsSchedulerSuite() {
+    CuSuite* suite = CuSuiteNew();
+
+    SUITE_ADD_TEST(suite, testSchedulerParksReaders);
+    SUITE_ADD_TEST(suite, testSchedulerTimeSlices);
+
+    return suite;
+}
@@ -0,0 +1,141 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "CuTest.h"
+#include "server.h"
+
+// Reads a number and prints it back
+static const uint8_t program[] = {
+    0x20, 0x02, 0x00, 0x05, // addi $v0, $zero, 5
+    0x00, 0x00, 0x00, 0x0C, // syscall
+    0x00, 0x40, 0x20, 0x20, // add $a0, $v0, $zero
+    0x20, 0x02, 0x00, 0x01, // addi $v0, $zero, 1
+    0x00, 0x00, 0x00, 0x0C, // syscall
+    0x20, 0x02, 0x00, 0x0A, // addi $v0, $zero, 10
+    0x00, 0x00, 0x00, 0x0C, // syscall
+};
+
+static void writeExecutable(char* path) {
+    uint8_t file[15 + sizeof(program) + 11] = {0x10, 'L', 'E', 'F', 1, 0, 0, 0, 0, 15, 0, 0, 0, 15 + sizeof(program), 1};
+    memcpy(&file[15], program, sizeof(program));
+
+    uint8_t* section = &file[15 + sizeof(program)];
+    section[2] = 0x01; // SHT_EXEC
+    section[6] = 15;
+    section[10] = sizeof(program);
+
+    int fd = mkstemp(path);
+    write(fd, file, sizeof(file));
+    close(fd);
+}
+
+static int connectClient(const char* path) {
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    strcpy(address.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void* serve(void* arg) {
+    server_run(arg);
+    return NULL;
+}
+
+void testServerRunsRequests(CuTest* test) {
+    char binary[] = "/tmp/lmips_serve_XXXXXX";
+    char socket[64];
+    writeExecutable(binary);
+    snprintf(socket, sizeof(socket), "%s.sock", binary);
+
+    Server server;
+    CuAssertTrue(test, initServer(&server, socket, 2));
+    CuAssertTrue(test, server_add(&server, binary));
+    CuAssertTrue(test, !server_add(&server, "/nonexistent"));
+    // The socket is in use
+    Server other;
+    CuAssertTrue(test, !initServer(&other, socket, 1));
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, serve, &server);
+
+    // Every request starts from the image, whatever the previous ones did
+    ServerReply reply;
+    CuAssertTrue(test, server_call(socket, binary, "12\n", 3, &reply));
+    CuAssertIntEquals(test, BATCH_EXITED, reply.status);
+    CuAssertIntEquals(test, 7, reply.icount);
+    CuAssertIntEquals(test, 2, reply.outputSize);
+    CuAssertTrue(test, memcmp(reply.output, "12", 2) == 0);
+    free(reply.output);
+
+    CuAssertTrue(test, server_call(socket, binary, "-345\n", 5, &reply));
+    CuAssertIntEquals(test, BATCH_EXITED, reply.status);
+    CuAssertIntEquals(test, 7, reply.icount);
+    CuAssertIntEquals(test, 4, reply.outputSize);
+    CuAssertTrue(test, memcmp(reply.output, "-345", 4) == 0);
+    free(reply.output);
+
+    CuAssertTrue(test, server_call(socket, "/nonexistent", NULL, 0, &reply));
+    CuAssertIntEquals(test, BATCH_ERR_LOAD, reply.status);
+    CuAssertIntEquals(test, 0, reply.outputSize);
+    CuAssertPtrEquals(test, NULL, reply.output);
+
+    server_stop(&server);
+    pthread_join(thread, NULL);
+    CuAssertIntEquals(test, 3, server.requests);
+    CuAssertTrue(test, !server_call(socket, binary, "1\n", 2, &reply));
+
+    freeServer(&server);
+    CuAssertTrue(test, access(socket, F_OK) != 0);
+    unlink(binary);
+}
+
+void testServerLimitsRequests(CuTest* test) {
+    char binary[] = "/tmp/lmips_serve_XXXXXX";
+    char socket[64];
+    writeExecutable(binary);
+    snprintf(socket, sizeof(socket), "%s.sock", binary);
+
+    Server server;
+    CuAssertTrue(test, initServer(&server, socket, 1));
+    CuAssertTrue(test, server_add(&server, binary));
+    server.budget = 4;
+    server.timeout = 1;
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, serve, &server);
+
+    // A client sending nothing only holds the single worker until the timeout
+    int silent = connectClient(socket);
+    CuAssertTrue(test, silent >= 0);
+
+    // Stopped before it prints
+    ServerReply reply;
+    CuAssertTrue(test, server_call(socket, binary, "12\n", 3, &reply));
+    CuAssertIntEquals(test, BATCH_BUDGET, reply.status);
+    CuAssertIntEquals(test, 4, reply.icount);
+    CuAssertIntEquals(test, 0, reply.outputSize);
+
+    server_stop(&server);
+    pthread_join(thread, NULL);
+    close(silent);
+    freeServer(&server);
+    unlink(binary);
+}
+
+CuSuite* getLMipsServerSuite() {
+    CuSuite* suite = CuSuiteNew();
+
+    SUITE_ADD_TEST(suite, testServerRunsRequests);
+    SUITE_ADD_TEST(suite, testServerLimitsRequests);
+
+    return suite;
+}
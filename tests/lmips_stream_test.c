@@ -0,0 +1,93 @@
+#include <string.h>
+#include <lmips_opcodes.h>
+#include "CuTest.h"
+#include "lmips.h"
+
+static ssize_t countWrites(void* context, const void* bytes, size_t size) {
+    *(size_t*)context += size;
+    return size;
+}
+
+void testBufferStream(CuTest* test) {
+    Stream stream;
+    CuAssertTrue(test, initBufferStream(&stream, "12\n", 3));
+
+    char bytes[8] = {};
+    CuAssertIntEquals(test, 2, stream_read(&stream, bytes, 2));
+    CuAssertIntEquals(test, 1, stream_read(&stream, bytes + 2, sizeof(bytes)));
+    CuAssertIntEquals(test, 0, stream_read(&stream, bytes, sizeof(bytes)));
+    CuAssertStrEquals(test, "12\n", bytes);
+
+    // Writes append past the initial contents and grow the buffer
+    char large[10000];
+    memset(large, 'x', sizeof(large));
+    struct iovec pieces[2] = {{.iov_base = "ab", .iov_len = 2}, {.iov_base = large, .iov_len = sizeof(large)}};
+    CuAssertIntEquals(test, 2 + sizeof(large), stream_writev(&stream, pieces, 2));
+
+    size_t size;
+    const uint8_t* contents = stream_contents(&stream, &size);
+    CuAssertIntEquals(test, 3 + 2 + sizeof(large), size);
+    CuAssertTrue(test, memcmp(contents, "12\nabx", 6) == 0);
+
+    freeStream(&stream);
+    CuAssertPtrEquals(test, NULL, (void*)stream_contents(&stream, &size));
+
+    size_t written = 0;
+    initCallbackStream(&stream, NULL, countWrites, &written);
+    CuAssertIntEquals(test, 2 + sizeof(large), stream_writev(&stream, pieces, 2));
+    CuAssertIntEquals(test, 2 + sizeof(large), written);
+    CuAssertIntEquals(test, -1, stream_read(&stream, bytes, sizeof(bytes)));
+    freeStream(&stream);
+}
+
+void testCaptureGuestStreams(CuTest* test) {
+    uint8_t program[] = {
+        0x20, 0x02, 0x00, 0x05, // addi $v0, $zero, 5
+        OP_SPECIAL, 0, 0, SPE_SYSCALL,
+        0x00, 0x40, 0x20, 0x20, // add $a0, $v0, $zero
+        0x20, 0x02, 0x00, 0x01, // addi $v0, $zero, 1
+        OP_SPECIAL, 0, 0, SPE_SYSCALL,
+        0x20, 0x02, 0x00, 0x0A, // addi $v0, $zero, 10
+        OP_SPECIAL, 0, 0, SPE_SYSCALL
+    };
+
+    // Two VMs with their own input and output, as if running on different threads
+    LMips vms[2];
+    const char* inputs[2] = {"42\n", "-7\n"};
+    for (int i = 0; i < 2; ++i) {
+        initTestSimulator(&vms[i], program);
+
+        Stream input, output;
+        initBufferStream(&input, inputs[i], 3);
+        initBufferStream(&output, NULL, 0);
+        lmips_set_input(&vms[i], &input);
+        lmips_set_output(&vms[i], &output);
+    }
+
+    // Asynchronous output gets captured as well
+    Stream output;
+    initBufferStream(&output, NULL, 0);
+    vms[1].console.mode = CONSOLE_ASYNC;
+    lmips_set_output(&vms[1], &output);
+
+    const char* expected[2] = {"42", "-7"};
+    for (int i = 0; i < 2; ++i) {
+        CuAssertIntEquals(test, EXEC_SUCCESS, runSimulator(&vms[i]));
+
+        size_t size;
+        const uint8_t* contents = stream_contents(&vms[i].console.stream, &size);
+        CuAssertIntEquals(test, 2, size);
+        CuAssertTrue(test, memcmp(contents, expected[i], 2) == 0);
+
+        freeSimulator(&vms[i]);
+    }
+}
+
+CuSuite* getLMipsStreamSuite() {
+    CuSuite* suite = CuSuiteNew();
+
+    SUITE_ADD_TEST(suite, testBufferStream);
+    SUITE_ADD_TEST(suite, testCaptureGuestStreams);
+
+    return suite;
+}
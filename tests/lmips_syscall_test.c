@@ -0,0 +1,318 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <lmips_opcodes.h>
+#include "CuTest.h"
+#include "lmips.h"
+#include "syscalls.h"
+
+static ExecutionResult sys_double(LMips* mips) {
+    mips->regs[$v0] = mips->regs[$a0] * 2;
+    return EXEC_SUCCESS;
+}
+
+static ExecutionResult sys_abort(LMips* mips) {
+    return EXEC_FAILURE;
+}
+
+void testRegisteredSyscall(CuTest* test) {
+    LMips mips;
+    uint8_t program[] = {
+        0x20, 0x04, 0x00, 0x15, // addi $a0, $zero, 21
+        0x20, 0x02, 0x00, 0x20, // addi $v0, $zero, 32
+        OP_SPECIAL, 0, 0, SPE_SYSCALL,
+        0x00, 0x40, 0x40, 0x20, // add $t0, $v0, $zero
+        0x20, 0x02, 0x00, 0x0A, // addi $v0, $zero, 10
+        OP_SPECIAL, 0, 0, SPE_SYSCALL
+    };
+
+    initTestSimulator(&mips, program);
+    CuAssertTrue(test, lmips_register_syscall(&mips, 32, sys_double));
+
+    ExecutionResult result = runSimulator(&mips);
+    CuAssertIntEquals(test, EXEC_SUCCESS, result);
+    CuAssertIntEquals(test, 42, mips.regs[$t0]);
+
+    freeSimulator(&mips);
+}
+
+void testSyscallFailure(CuTest* test) {
+    LMips mips;
+    uint8_t program[] = {
+        0x20, 0x02, 0x00, 0x0A, // addi $v0, $zero, 10
+        OP_SPECIAL, 0, 0, SPE_SYSCALL
+    };
+
+    // Handlers can replace the built-in ones and stop the guest
+    initTestSimulator(&mips, program);
+    CuAssertTrue(test, lmips_register_syscall(&mips, SYS_EXIT, sys_abort));
+    CuAssertIntEquals(test, EXEC_FAILURE, runSimulator(&mips));
+
+    CuAssertTrue(test, !lmips_register_syscall(&mips, SYSCALL_COUNT, sys_double));
+
+    // Codes past the table are unknown
+    initTestSimulator(&mips, program);
+    program[3] = 0xFF;
+    CuAssertIntEquals(test, EXEC_FAILURE, runSimulator(&mips));
+
+    freeSimulator(&mips);
+}
+
+static void writeString(Memory* memory, uint32_t address, const char* string) {
+    memcpy(&memory->store[address], string, strlen(string) + 1);
+}
+
+static int32_t callSyscall(CuTest* test, LMips* mips, uint32_t code, uint32_t a0, uint32_t a1, uint32_t a2) {
+    mips->regs[$v0] = code;
+    mips->regs[$a0] = a0;
+    mips->regs[$a1] = a1;
+    mips->regs[$a2] = a2;
+
+    CuAssertIntEquals(test, EXEC_SUCCESS, mips->syscalls[code](mips));
+    return mips->regs[$v0];
+}
+
+void testFileSyscalls(CuTest* test) {
+    char directory[] = "/tmp/lmips_sandbox_XXXXXX";
+    mkdtemp(directory);
+
+    Memory memory;
+    initMemory(&memory);
+    LMips mips;
+    initSimulator(&mips, &memory);
+    writeString(&memory, DATA_ADDRESS, "data.txt");
+    writeString(&memory, DATA_ADDRESS + 16, "../escape.txt");
+    writeString(&memory, DATA_ADDRESS + 32, "Hello sandbox");
+
+    // Nothing can be opened without a sandbox
+    CuAssertIntEquals(test, -1, callSyscall(test, &mips, SYS_OPEN, DATA_ADDRESS, 1, 0));
+    CuAssertTrue(test, files_set_root(&mips.files, directory));
+    CuAssertIntEquals(test, -1, callSyscall(test, &mips, SYS_OPEN, DATA_ADDRESS + 16, 1, 0));
+
+    int32_t fd = callSyscall(test, &mips, SYS_OPEN, DATA_ADDRESS, 1, 0);
+    CuAssertTrue(test, fd >= 3);
+    CuAssertIntEquals(test, 13, callSyscall(test, &mips, SYS_WRITE, fd, DATA_ADDRESS + 32, 13));
+    CuAssertIntEquals(test, 0, callSyscall(test, &mips, SYS_CLOSE, fd, 0, 0));
+    CuAssertIntEquals(test, -1, callSyscall(test, &mips, SYS_WRITE, fd, DATA_ADDRESS + 32, 13));
+
+    fd = callSyscall(test, &mips, SYS_OPEN, DATA_ADDRESS, 0, 0);
+    CuAssertIntEquals(test, 13, callSyscall(test, &mips, SYS_READ, fd, HEAP_ADDRESS, 64));
+    CuAssertIntEquals(test, 0, callSyscall(test, &mips, SYS_READ, fd, HEAP_ADDRESS, 64));
+    CuAssertTrue(test, memcmp(&memory.store[HEAP_ADDRESS], "Hello sandbox", 13) == 0);
+
+    // Ranges past the end of the memory fault
+    mips.regs[$v0] = SYS_READ;
+    mips.regs[$a0] = fd;
+    mips.regs[$a1] = MEMORY_SIZE - 4;
+    mips.regs[$a2] = 8;
+    CuAssertIntEquals(test, EXEC_ERR_MEMORY_ADDR, sys_read(&mips));
+
+    freeSimulator(&mips);
+    freeMemory(&memory);
+
+    char path[64];
+    snprintf(path, sizeof(path), "%s/data.txt", directory);
+    unlink(path);
+    rmdir(directory);
+}
+
+// Symbolic links inside the sandbox can't lead out of it, whatever their place in the path
+void testSandboxSymlinks(CuTest* test) {
+    char outside[] = "/tmp/lmips_outside_XXXXXX";
+    char directory[] = "/tmp/lmips_sandbox_XXXXXX";
+    mkdtemp(outside);
+    mkdtemp(directory);
+
+    char secret[64], link[64], inner[64], file[64];
+    snprintf(secret, sizeof(secret), "%s/secret", outside);
+    snprintf(link, sizeof(link), "%s/link", directory);
+    snprintf(inner, sizeof(inner), "%s/inner", directory);
+    snprintf(file, sizeof(file), "%s/inner/file", directory);
+    fclose(fopen(secret, "w"));
+    mkdir(inner, 0755);
+    fclose(fopen(file, "w"));
+    symlink(outside, link);
+
+    FileTable files;
+    initFileTable(&files);
+    CuAssertTrue(test, files_set_root(&files, directory));
+    CuAssertIntEquals(test, -1, files_open(&files, "link/secret", 0));
+    CuAssertIntEquals(test, -1, files_open(&files, "inner/../link/secret", 0));
+    CuAssertIntEquals(test, -1, files_open(&files, secret, 0));
+    CuAssertTrue(test, files_open(&files, "inner/file", 0) >= 0);
+    CuAssertTrue(test, files_open(&files, "./inner//file", 0) >= 0);
+    freeFileTable(&files);
+
+    unlink(file);
+    rmdir(inner);
+    unlink(link);
+    rmdir(directory);
+    unlink(secret);
+    rmdir(outside);
+}
+
+void testMapFile(CuTest* test) {
+    char directory[] = "/tmp/lmips_sandbox_XXXXXX";
+    mkdtemp(directory);
+    char path[64];
+    snprintf(path, sizeof(path), "%s/table.bin", directory);
+    FILE* file = fopen(path, "w");
+    fwrite("\x12\x34\x56\x78", 1, 4, file);
+    fclose(file);
+
+    Memory memory;
+    initMemory(&memory);
+    LMips mips;
+    initSimulator(&mips, &memory);
+    files_set_root(&mips.files, directory);
+    writeString(&memory, DATA_ADDRESS, "table.bin");
+    int32_t fd = callSyscall(test, &mips, SYS_OPEN, DATA_ADDRESS, 0, 0);
+
+    mips.regs[$a3] = 0;
+    uint32_t readOnly = callSyscall(test, &mips, SYS_MMAP, fd, 4, 0);
+    CuAssertIntEquals(test, MAP_ADDRESS - MEMORY_PAGE_SIZE, readOnly);
+    CuAssertIntEquals(test, 0x12345678, mem_read(&memory, readOnly));
+    CuAssertIntEquals(test, 0, mem_read(&memory, readOnly + 4));
+
+    uint32_t heap = mips.heap;
+    uint32_t copy = callSyscall(test, &mips, SYS_MMAP, fd, 4, 1);
+    CuAssertIntEquals(test, heap, copy);
+    CuAssertIntEquals(test, heap + MEMORY_PAGE_SIZE, mips.heap);
+    mem_write(&memory, copy, 0);
+    CuAssertIntEquals(test, 0x12345678, mem_read(&memory, readOnly));
+
+    // Guest stores to read-only mappings fault, stores to copies don't
+    uint8_t program[] = {
+        (OP_SW << 2) | ($t0 >> 3), ($t0 & 7) << 5, 0x00, 0x00, // sw $zero, 0($t0)
+        0x20, 0x02, 0x00, 0x0A, // addi $v0, $zero, 10
+        OP_SPECIAL, 0, 0, SPE_SYSCALL
+    };
+    memcpy(&memory.store[PROGRAM_ADDRESS], program, sizeof(program));
+    mips.ip = 0;
+    mips.regs[$t0] = copy;
+    CuAssertIntEquals(test, EXEC_SUCCESS, runSimulator(&mips));
+    mips.ip = 0;
+    mips.stop = false;
+    mips.regs[$t0] = readOnly;
+    CuAssertIntEquals(test, EXEC_ERR_MEMORY_ADDR, runSimulator(&mips));
+
+    // The break can reach the read-only mappings but not cross them
+    heap = mips.heap;
+    mips.regs[$v0] = 0;
+    mips.regs[$a0] = readOnly - heap + 4;
+    CuAssertIntEquals(test, EXEC_ERR_MEMORY_ADDR, sys_sbrk(&mips));
+    CuAssertIntEquals(test, heap, mips.heap);
+    CuAssertIntEquals(test, 0, mips.regs[$v0]);
+    CuAssertIntEquals(test, heap, callSyscall(test, &mips, SYS_SBRK, readOnly - heap, 0, 0));
+    CuAssertIntEquals(test, readOnly, mips.heap);
+
+    freeSimulator(&mips);
+    freeMemory(&memory);
+    unlink(path);
+    rmdir(directory);
+}
+
+void testMapTruncatedFile(CuTest* test) {
+    char directory[] = "/tmp/lmips_sandbox_XXXXXX";
+    mkdtemp(directory);
+    char path[64];
+    snprintf(path, sizeof(path), "%s/t.bin", directory);
+    FILE* file = fopen(path, "w");
+    for (int i = 0; i < 2 * MEMORY_PAGE_SIZE; ++i) fputc(0x5A, file);
+    fclose(file);
+
+    Memory memory;
+    initMemory(&memory);
+    LMips mips;
+    initSimulator(&mips, &memory);
+    files_set_root(&mips.files, directory);
+    writeString(&memory, DATA_ADDRESS, "t.bin");
+    int32_t fd = callSyscall(test, &mips, SYS_OPEN, DATA_ADDRESS, 0, 0);
+    mips.regs[$a3] = 0;
+    uint32_t mapped = callSyscall(test, &mips, SYS_MMAP, fd, 2 * MEMORY_PAGE_SIZE, 0);
+    CuAssertIntEquals(test, MAP_ADDRESS - 2 * MEMORY_PAGE_SIZE, mapped);
+
+    // Opening for writing truncates the file, the mapping keeps what it held
+    CuAssertTrue(test, callSyscall(test, &mips, SYS_OPEN, DATA_ADDRESS, 1, 0) >= 0);
+    struct stat info;
+    CuAssertIntEquals(test, 0, stat(path, &info));
+    CuAssertIntEquals(test, 0, info.st_size);
+    CuAssertIntEquals(test, 0x5A5A5A5A, mem_read(&memory, mapped + MEMORY_PAGE_SIZE + 4));
+
+    freeSimulator(&mips);
+    freeMemory(&memory);
+    unlink(path);
+    rmdir(directory);
+}
+
+void testReallocSyscall(CuTest* test) {
+    Memory memory;
+    initMemory(&memory);
+    LMips mips;
+    initSimulator(&mips, &memory);
+
+    // Null pointers are allocated, the arguments are left as they were
+    uint32_t block = callSyscall(test, &mips, SYS_REALLOC, 0, 24, 0);
+    CuAssertTrue(test, block >= HEAP_ADDRESS);
+    CuAssertIntEquals(test, 0, mips.regs[$a0]);
+    CuAssertIntEquals(test, 24, mips.regs[$a1]);
+
+    mem_write(&memory, block, 0x12345678);
+    uint32_t moved = callSyscall(test, &mips, SYS_REALLOC, block, 5000, 0);
+    CuAssertTrue(test, moved != block);
+    CuAssertIntEquals(test, 0x12345678, mem_read(&memory, moved));
+    CuAssertIntEquals(test, 0, callSyscall(test, &mips, SYS_REALLOC, moved, 0, 0));
+
+    freeSimulator(&mips);
+    freeMemory(&memory);
+}
+
+void testBulkMemorySyscalls(CuTest* test) {
+    Memory memory;
+    initMemory(&memory);
+    LMips mips;
+    initSimulator(&mips, &memory);
+    writeString(&memory, DATA_ADDRESS, "overlapping");
+
+    CuAssertIntEquals(test, 11, callSyscall(test, &mips, SYS_STRLEN, DATA_ADDRESS, 0, 0));
+    CuAssertIntEquals(test, DATA_ADDRESS + 4, callSyscall(test, &mips, SYS_MEMMOVE, DATA_ADDRESS + 4, DATA_ADDRESS, 12));
+    CuAssertStrEquals(test, "overoverlapping", (char*)&memory.store[DATA_ADDRESS]);
+
+    callSyscall(test, &mips, SYS_MEMCPY, HEAP_ADDRESS, DATA_ADDRESS, 16);
+    CuAssertIntEquals(test, 0, callSyscall(test, &mips, SYS_MEMCMP, HEAP_ADDRESS, DATA_ADDRESS, 16));
+    callSyscall(test, &mips, SYS_MEMSET, HEAP_ADDRESS + 4, 'x', 0x104);
+    CuAssertTrue(test, memcmp(&memory.store[HEAP_ADDRESS], "overxxxx", 8) == 0);
+    CuAssertIntEquals(test, 1, callSyscall(test, &mips, SYS_MEMCMP, HEAP_ADDRESS, DATA_ADDRESS, 16));
+    CuAssertIntEquals(test, -1, callSyscall(test, &mips, SYS_MEMCMP, DATA_ADDRESS, HEAP_ADDRESS, 16));
+
+    // Ranges are checked once for the whole call
+    mips.regs[$a0] = MEMORY_SIZE - 8;
+    mips.regs[$a1] = 0;
+    mips.regs[$a2] = 16;
+    CuAssertIntEquals(test, EXEC_ERR_MEMORY_ADDR, sys_memset(&mips));
+    mips.regs[$a0] = PROGRAM_ADDRESS;
+    CuAssertIntEquals(test, EXEC_ERR_MEMORY_ADDR, sys_memset(&mips));
+    memset(&memory.store[MEMORY_SIZE - 8], 'x', 8);
+    mips.regs[$a0] = MEMORY_SIZE - 8;
+    CuAssertIntEquals(test, EXEC_ERR_MEMORY_ADDR, sys_strlen(&mips));
+
+    freeSimulator(&mips);
+    freeMemory(&memory);
+}
+
+CuSuite* getLMipsSyscallSuite() {
+    CuSuite* suite = CuSuiteNew();
+
+    SUITE_ADD_TEST(suite, testRegisteredSyscall);
+    SUITE_ADD_TEST(suite, testSyscallFailure);
+    SUITE_ADD_TEST(suite, testFileSyscalls);
+    SUITE_ADD_TEST(suite, testSandboxSymlinks);
+    SUITE_ADD_TEST(suite, testMapFile);
+    SUITE_ADD_TEST(suite, testMapTruncatedFile);
+    SUITE_ADD_TEST(suite, testReallocSyscall);
+    SUITE_ADD_TEST(suite, testBulkMemorySyscalls);
+
+    return suite;
+}
@@ -0,0 +1,21 @@
+#ifndef LMIPS_TEST_WORDS
+#define LMIPS_TEST_WORDS
+
+#include <lmips_opcodes.h>
+#include "lmips.h"
+
+// Encodes the instructions of test programs written as arrays of words
+#define I(op, rs, rt, immediate) (((uint32_t)(op) << 26) | ((rs) << 21) | ((rt) << 16) | ((immediate) & 0xFFFF))
+#define R(rs, rt, rd, sa, func) (((rs) << 21) | ((rt) << 16) | ((rd) << 11) | ((sa) << 6) | (func))
+#define SYSCALL R(0, 0, 0, 0, SPE_SYSCALL)
+
+// A fresh VM with `words` as its program
+static inline void loadWords(Memory* memory, LMips* mips, const uint32_t* words, size_t count) {
+    initMemory(memory);
+    initSimulator(mips, memory);
+    for (size_t i = 0; i < count; ++i) {
+        mem_write(memory, PROGRAM_ADDRESS + i * 4, words[i]);
+    }
+}
+
+#endif //LMIPS_TEST_WORDS
@@ -0,0 +1,152 @@
+#include <string.h>
+#include "CuTest.h"
+#include "translator.h"
+#include "lmips_test_words.h"
+
+#define JAL(index) (((uint32_t)OP_JAL << 26) | (index))
+#define EXIT I(OP_ADDI, $zero, $v0, SYS_EXIT), SYSCALL
+
+static ExecutionResult runFor(LMips* mips, uint64_t count) {
+    mips->stopCount = count;
+    return executeSimulator(mips);
+}
+
+// Stores and loads a table, calling a function for every entry
+static const uint32_t loop[] = {
+    /*  0 */ I(OP_LUI, 0, $s0, DATA_ADDRESS >> 16),
+    /*  1 */ I(OP_ADDI, $zero, $t0, 200),
+    /*  2 */ I(OP_ADDI, $zero, $s1, 0),
+    /*  3 */ R(0, $t0, $t1, 2, SPE_SLL),
+    /*  4 */ R($s0, $t1, $t2, 0, SPE_ADDU),
+    /*  5 */ I(OP_SW, $t2, $t0, 0),
+    /*  6 */ I(OP_LW, $t2, $t3, 0),
+    /*  7 */ JAL(12),
+    /*  8 */ I(OP_ADDI, $t0, $t0, -1),
+    /*  9 */ I(OP_BNE, $t0, $zero, 3 - 9),
+    /* 10 */ EXIT,
+    /* 12 */ R($s1, $t3, $s1, 0, SPE_ADDU),
+    /* 13 */ R($s2, $t1, $s2, 0, SPE_XOR),
+    /* 14 */ R($t3, $t0, $s3, 0, SPE_SLT),
+    /* 15 */ R($ra, 0, 0, 0, SPE_JR),
+};
+
+void testTranslatorMatchesInterpreter(CuTest* test) {
+    Memory memory, translatedMemory;
+    LMips mips, translated;
+    loadWords(&memory, &mips, loop, sizeof(loop) / 4);
+    loadWords(&translatedMemory, &translated, loop, sizeof(loop) / 4);
+    CuAssertIntEquals(test, EXEC_SUCCESS, executeSimulator(&mips));
+
+    Translator translator;
+    CuAssertTrue(test, initTranslator(&translator, &translated, 1));
+    CuAssertIntEquals(test, EXEC_BREAKPOINT, runFor(&translated, 1000));
+    translator_wait(&translator);
+    CuAssertTrue(test, translator.stats.translated >= 2);
+    CuAssertTrue(test, translator_lookup(&translator, 3 * 4) != NULL);
+
+    // Blocks running past the budget are left to the interpreter
+    CuAssertIntEquals(test, EXEC_BREAKPOINT, runFor(&translated, 1501));
+    CuAssertIntEquals(test, 1501, translated.icount);
+    CuAssertIntEquals(test, EXEC_SUCCESS, runFor(&translated, UINT64_MAX));
+
+    CuAssertIntEquals(test, mips.icount, translated.icount);
+    CuAssertIntEquals(test, mips.ip, translated.ip);
+    CuAssertTrue(test, memcmp(mips.regs, translated.regs, sizeof(mips.regs)) == 0);
+    CuAssertTrue(test, memcmp(&memory.store[DATA_ADDRESS], &translatedMemory.store[DATA_ADDRESS], 1024) == 0);
+
+    freeSimulator(&translated);
+    freeTranslator(&translator);
+    freeSimulator(&mips);
+    freeMemory(&translatedMemory);
+    freeMemory(&memory);
+}
+
+// Stores below the data segment after 150 iterations
+static const uint32_t fault[] = {
+    /* 0 */ I(OP_LUI, 0, $a0, DATA_ADDRESS >> 16),
+    /* 1 */ I(OP_ADDIU, $a0, $a0, 150 * 4),
+    /* 2 */ I(OP_ADDIU, $a0, $a0, -4),
+    /* 3 */ I(OP_SW, $a0, $t1, 0),
+    /* 4 */ I(OP_ADDI, $t1, $t1, 1),
+    /* 5 */ I(OP_BNE, $t1, $zero, 2 - 5),
+    /* 6 */ EXIT,
+};
+
+void testTranslatorLeavesFaultsToInterpreter(CuTest* test) {
+    Memory memory, translatedMemory;
+    LMips mips, translated;
+    loadWords(&memory, &mips, fault, sizeof(fault) / 4);
+    loadWords(&translatedMemory, &translated, fault, sizeof(fault) / 4);
+    CuAssertIntEquals(test, EXEC_ERR_MEMORY_ADDR, executeSimulator(&mips));
+
+    Translator translator;
+    CuAssertTrue(test, initTranslator(&translator, &translated, 1));
+    CuAssertIntEquals(test, EXEC_BREAKPOINT, runFor(&translated, 300));
+    translator_wait(&translator);
+    CuAssertTrue(test, translator_lookup(&translator, 2 * 4) != NULL);
+
+    CuAssertIntEquals(test, EXEC_ERR_MEMORY_ADDR, runFor(&translated, UINT64_MAX));
+    CuAssertIntEquals(test, mips.icount, translated.icount);
+    CuAssertIntEquals(test, mips.ip, translated.ip);
+    CuAssertIntEquals(test, 150, translated.regs[$t1]);
+
+    freeSimulator(&translated);
+    freeTranslator(&translator);
+    freeSimulator(&mips);
+    freeMemory(&translatedMemory);
+    freeMemory(&memory);
+}
+
+static const uint32_t counter[] = {
+    /* 0 */ I(OP_ADDI, $zero, $t0, 100),
+    /* 1 */ I(OP_ADDI, $s0, $s0, 1),
+    /* 2 */ I(OP_ADDI, $t0, $t0, -1),
+    /* 3 */ I(OP_BNE, $t0, $zero, 1 - 3),
+    /* 4 */ EXIT,
+};
+
+void testTranslatorInvalidation(CuTest* test) {
+    Memory memory;
+    LMips mips;
+    loadWords(&memory, &mips, counter, sizeof(counter) / 4);
+
+    Translator translator;
+    CuAssertTrue(test, initTranslator(&translator, &mips, 1));
+    CuAssertIntEquals(test, EXEC_BREAKPOINT, runFor(&mips, 200));
+    translator_wait(&translator);
+    CuAssertTrue(test, translator_lookup(&translator, 4) != NULL);
+    uint32_t done = mips.regs[$s0];
+
+    // Counting by 2 from now on
+    mem_write(&memory, PROGRAM_ADDRESS + 4, I(OP_ADDI, $s0, $s0, 2));
+    translator_invalidate(&translator, 4, 4);
+    CuAssertPtrEquals(test, NULL, (void*)translator_lookup(&translator, 4));
+    CuAssertIntEquals(test, 1, translator.stats.invalidations);
+
+    // Whichever comes first, a translation queued before an invalidation never runs the text it replaced
+    for (int i = 0; i < TRANSLATOR_THRESHOLD; ++i) {
+        translator_heat(&translator, 4);
+    }
+    mem_write(&memory, PROGRAM_ADDRESS + 4, I(OP_ADDI, $s0, $s0, 3));
+    translator_invalidate(&translator, 0, 16);
+    translator_wait(&translator);
+    const Translation* block = translator_lookup(&translator, 4);
+    CuAssertTrue(test, block == NULL || block->ops[0].immediate == 3);
+
+    CuAssertIntEquals(test, EXEC_SUCCESS, runFor(&mips, UINT64_MAX));
+    CuAssertIntEquals(test, done + (100 - done) * 3, mips.regs[$s0]);
+
+    freeSimulator(&mips);
+    freeTranslator(&translator);
+    freeMemory(&memory);
+}
+
+CuSuite* getLMipsTranslatorSuite() {
+    CuSuite* suite = CuSuiteNew();
+
+    SUITE_ADD_TEST(suite, testTranslatorMatchesInterpreter);
+    SUITE_ADD_TEST(suite, testTranslatorLeavesFaultsToInterpreter);
+    SUITE_ADD_TEST(suite, testTranslatorInvalidation);
+
+    return suite;
+}
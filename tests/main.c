@@ -5,6 +5,21 @@ CuSuite* getLMipsRTypeInstructionsSuite();
 CuSuite* getLMipsITypeInstructionsSuite();
 CuSuite* getLMipsJTypeInstructionsSuite();
 CuSuite* getLMipsMemoryInstructionsSuite();
+CuSuite* getLMipsLoaderSuite();
+CuSuite* getLMipsImageSuite();
+CuSuite* getLMipsConsoleSuite();
+CuSuite* getLMipsSyscallSuite();
+CuSuite* getLMipsScannerSuite();
+CuSuite* getLMipsAllocatorSuite();
+CuSuite* getLMipsStreamSuite();
+CuSuite* getLMipsApiSuite();
+CuSuite* getLMipsBatchSuite();
+CuSuite* getLMipsSchedulerSuite();
+CuSuite* getLMipsHartsSuite();
+CuSuite* getLMipsLockStepSuite();
+CuSuite* getLMipsFuzzerSuite();
+CuSuite* getLMipsServerSuite();
+CuSuite* getLMipsTranslatorSuite();
 
 int main(int argc, char const *argv[]) {
     printf("Welcome to Lite MIPS test suite.\n\n");
@@ -16,6 +31,21 @@ int main(int argc, char const *argv[]) {
     CuSuiteAddSuite(suite, getLMipsITypeInstructionsSuite());
     CuSuiteAddSuite(suite, getLMipsJTypeInstructionsSuite());
     CuSuiteAddSuite(suite, getLMipsMemoryInstructionsSuite());
+    CuSuiteAddSuite(suite, getLMipsLoaderSuite());
+    CuSuiteAddSuite(suite, getLMipsImageSuite());
+    CuSuiteAddSuite(suite, getLMipsConsoleSuite());
+    CuSuiteAddSuite(suite, getLMipsSyscallSuite());
+    CuSuiteAddSuite(suite, getLMipsScannerSuite());
+    CuSuiteAddSuite(suite, getLMipsAllocatorSuite());
+    CuSuiteAddSuite(suite, getLMipsStreamSuite());
+    CuSuiteAddSuite(suite, getLMipsApiSuite());
+    CuSuiteAddSuite(suite, getLMipsBatchSuite());
+    CuSuiteAddSuite(suite, getLMipsSchedulerSuite());
+    CuSuiteAddSuite(suite, getLMipsHartsSuite());
+    CuSuiteAddSuite(suite, getLMipsLockStepSuite());
+    CuSuiteAddSuite(suite, getLMipsFuzzerSuite());
+    CuSuiteAddSuite(suite, getLMipsServerSuite());
+    CuSuiteAddSuite(suite, getLMipsTranslatorSuite());
 
     CuSuiteRun(suite);
     CuSuiteSummary(suite, output);